@@ -3,10 +3,13 @@
 
 #include "Pdu.h"
 #include "Knx_Types.h"
+#include "KnxFrameBuffer.h"
 
 void IP_L_Data_Req(AckType ack, AddressType addrType, uint16_t destAddr, FrameFormatType frameFormat, PduInfoType * pduInfoPtr, uint16_t octetCount, PriorityType priority, uint16_t sourceAddr);
-void IP_L_Data_Ind(PduInfoType * pduInfoPtr,  uint32_t ipAddr, uint16_t port,  KNXnetIP_HostProtocolCodeTpe protocol);
+void IP_L_Data_Ind(PduInfoType * pduInfoPtr, KnxFrameBuffer_HandleType frame, uint32_t ipAddr, uint16_t port,  KNXnetIP_HostProtocolCodeTpe protocol, int sock);
 
-extern uint8_t IP_TxBuffer[256];
+#ifdef KNXNETIP_DISPATCH_BENCHMARK
+void IP_DispatchBenchmark(void);
+#endif /* KNXNETIP_DISPATCH_BENCHMARK */
 
 #endif /* #ifndef IP_DATALINKLAYER_H */ 
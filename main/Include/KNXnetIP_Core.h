@@ -3,14 +3,29 @@
 
 #include "Knx_Types.h"
 #include "KNXnetIP_Types.h"
+#include "KnxTimer.h"
 
 void KNXnetIP_SearchResponse(uint8_t * txBuffer, uint16_t * txLength);
-void KNXnetIP_SearchResponseExtended(uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_SearchResponseExtended(const uint8_t * srpPtr, uint16_t srpLength, uint8_t * txBuffer, uint16_t * txLength);
 void KNXnetIP_DescriptionResponse(uint8_t * txBuffer, uint16_t * txLength);
-void KNXnetIP_ConnectResponse(KNXnetIP_ErrorCodeType errorCode, KNXnetIP_HPAIType * connectRequestHpai, KNXnetIP_CRIType * cri, uint8_t * txBuffer, uint16_t * txLength);
-void KNXnetIP_ConnectionStateResponse(KNXnetIP_ErrorCodeType errorCode, uint8_t * txBuffer, uint16_t * txLength);
-//void KNXnetIP_DisconnectRequest(void);
-void KNXnetIP_DisconnectResponse(uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_ResponseCacheInvalidate(void);
+void KNXnetIP_ConnectResponse(uint8_t channelId, KNXnetIP_ErrorCodeType errorCode, KNXnetIP_HPAIType * dataEndpointHpai, KNXnetIP_CRIType * cri, uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_ConnectionStateResponse(uint8_t channelId, KNXnetIP_ErrorCodeType errorCode, uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_DisconnectRequest(uint8_t channelId, KNXnetIP_HPAIType * disconnectRequestHpai, uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_DisconnectResponse(uint8_t channelId, KNXnetIP_ErrorCodeType errorCode, uint8_t * txBuffer, uint16_t * txLength);
+
+KNXnetIP_ChannelType * KNXnetIP_ChannelAlloc(KNXnetIP_ConnectionType connectionType, KNXnetIP_HostProtocolCodeTpe protocol, int sock);
+KNXnetIP_ChannelType * KNXnetIP_ChannelGet(uint8_t channelId);
+void KNXnetIP_ChannelFree(uint8_t channelId);
+void KNXnetIP_ChannelFreeBySocket(int sock);
+uint8_t KNXnetIP_TunnelConnectionCount(void);
+KNXnetIP_ChannelType * KNXnetIP_ChannelGetByIndvAddr(uint16_t indvAddr);
+void KNXnetIP_ChannelHeartbeat(KNXnetIP_ChannelType * channel);
+void KNXnetIP_ChannelDisconnect(KNXnetIP_ChannelType * channel);
+
+void KNXnetIP_TimerInit(void);
+void KNXnetIP_TimerArm(uint8_t transport, KnxTimer_Type * timer, uint32_t delayMs);
+uint32_t KNXnetIP_TimerMainFunction(uint8_t transport);
 
 #define IP_ADDRESS(x,y,z,t) (uint32_t)((((uint32_t)t << 24) & 0xFF000000) | \
                                        (((uint32_t)z << 16) & 0xFF0000) | \
@@ -22,12 +37,30 @@ void KNXnetIP_DisconnectResponse(uint8_t * txBuffer, uint16_t * txLength);
 #define CHANNEL_3 (3U)
 #define CHANNEL_4 (4U)
 
+/* The channel and tunnelling slot tables are laid out for 4, only */
+/* the host tests raise it to load the TCP server with more tunnels */
+#ifndef KNX_CHANNEL_NUM
 #define KNX_CHANNEL_NUM (4U)
+#endif
+#define KNX_CHANNEL_INVALID (0U)
+
+/* Network task serving a transport, one frame ring and tx buffer each */
+#define KNXNETIP_TRANSPORT_UDP (0U)
+#define KNXNETIP_TRANSPORT_TCP (1U)
+#define KNXNETIP_TRANSPORT_NUM (2U)
+#define KNXNETIP_TRANSPORT_INDEX(protocol) ((IPV4_TCP == (protocol)) ? KNXNETIP_TRANSPORT_TCP : KNXNETIP_TRANSPORT_UDP)
 
 #define KNX_INDIVIDUAL_ADDR  (0x1101U)
-#define KNX_SUPPORTED_SERVICE_NUM (4U)
-#define KNX_INDIVIDUAL_ADDR_NUM (2U)
-#define KNX_TUNNELLING_SLOT_NUM (1U)
+#define KNX_SUPPORTED_SERVICE_NUM (5U)
+#define KNX_SUPPORTED_SERVICE_DIB_LENGTH (2U + (2U * KNX_SUPPORTED_SERVICE_NUM))
+
+/* One tunnelling slot per tunnel, addresses KNX_TUNNELLING_SLOT_BASE_ADDR + slot index */
+#define KNX_TUNNELLING_SLOT_NUM       (4U)
+#define KNX_TUNNELLING_SLOT_BASE_ADDR (0x11FAU)
+#define KNX_TUNNELLING_SLOT_INVALID   (0xFFU)
+
+/* Device address followed by the tunnelling slot addresses */
+#define KNX_INDIVIDUAL_ADDR_NUM (1U + KNX_TUNNELLING_SLOT_NUM)
 
 #define KNX_TUNNELLING_SLOT_STATUS_FREE       (0x01U)
 #define KNX_TUNNELLING_SLOT_STATUS_AUTHORIZED (0x02U)
@@ -42,4 +75,7 @@ void KNXnetIP_DisconnectResponse(uint8_t * txBuffer, uint16_t * txLength);
 #define CEMI_FRAME_LENGTH_FIELD_OFFSET (8U)
 #define CEMI_FRAME_TPDU_FIELD_OFFSET   (9U)
 
+/* CTRL1 confirm flag of an L_Data.con, set when the frame was not acknowledged */
+#define CEMI_FRAME_CTRL1_CONFIRM_ERROR (0x01U)
+
 #endif /* #ifndef KNXNETIP_CORE_H */ 
@@ -0,0 +1,74 @@
+/**
+ * \file KNXnetIP_Discovery.h
+ *
+ * \brief KNXnet/IP Discovery Flow Control
+ *
+ * This file contains the per-source rate limiting of control endpoint
+ * services and the randomized delay of search responses
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+#ifndef KNXNETIP_DISCOVERY_H
+#define KNXNETIP_DISCOVERY_H
+
+/*==================[inclusions]============================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "KNXnetIP_UdpServer.h"
+
+/*==================[macros]================================================*/
+
+/* Control endpoint requests per source host, bursts of ..._BURST. Hosts
+ * beyond ..._SOURCE_NUM share the budget left in the idlest entry */
+#define KNXNETIP_DISCOVERY_INTERVAL_MS   (250U)    /* 4 requests per second */
+#define KNXNETIP_DISCOVERY_BURST         (8U)
+#define KNXNETIP_DISCOVERY_SOURCE_NUM    (8U)
+
+/* Search responses are sent after a random delay up to this */
+#define KNXNETIP_DISCOVERY_DELAY_MAX_MS  (100U)
+#define KNXNETIP_DISCOVERY_PENDING_NUM   (4U)
+
+/* Returned by KNXnetIP_DiscoveryMainFunction when nothing is waiting */
+#define KNXNETIP_DISCOVERY_NO_TIMEOUT    (0xFFFFFFFFU)
+
+/*==================[type definitions]======================================*/
+typedef struct {
+    uint32_t RateLimited;    /* Requests over the budget of their source */
+    uint32_t Collapsed;      /* Searches repeated while their response was pending */
+    uint32_t PendingFull;    /* Search responses sent at once, no free pending slot */
+} KNXnetIP_DiscoveryStatisticsType;
+
+/*==================[external function declarations]========================*/
+extern void KNXnetIP_DiscoveryInit(void);
+extern uint32_t KNXnetIP_DiscoveryMainFunction(void);
+extern bool KNXnetIP_DiscoveryAdmit(uint32_t ipAddr, uint16_t port, uint16_t serviceType);
+extern void KNXnetIP_DiscoveryDefer(uint32_t ipAddr, uint16_t port, uint16_t serviceType, const KNXnetIP_TxFrameType * txFrame);
+extern const KNXnetIP_DiscoveryStatisticsType * KNXnetIP_DiscoveryStatistics(void);
+
+/*==================[internal function declarations]========================*/
+
+/*==================[external constants]====================================*/
+
+/*------------------[version constants definition]--------------------------*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+
+/*==================[external function definitions]=========================*/
+
+/*==================[internal function definitions]=========================*/
+
+#endif /* #ifndef KNXNETIP_DISCOVERY_H */
+
+/*==================[end of file]===========================================*/
@@ -0,0 +1,71 @@
+/**
+ * \file KNXnetIP_Routing.h
+ *
+ * \brief KNXnet/IP Routing Services
+ *
+ * This file contains the implementation of KNXnet/IP Routing Services
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+#ifndef KNXNETIP_ROUTING_H
+#define KNXNETIP_ROUTING_H
+
+/*==================[inclusions]============================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "KnxFrameBuffer.h"
+
+/*==================[macros]================================================*/
+
+/* 224.0.23.12, host byte order as taken by KNXnetIP_UDPSend */
+#define KNXNETIP_ROUTING_MULTICAST_ADDR (0xE000170CU)
+
+/* ROUTING_INDICATION sent to the multicast group at most this often */
+#define KNXNETIP_ROUTING_TX_INTERVAL_MS (20U)    /* 50 telegrams per second */
+#define KNXNETIP_ROUTING_TX_BURST       (5U)
+
+/* Routed frames waiting for the bus at which the other routers are asked to slow down */
+#define KNXNETIP_ROUTING_BUSY_THRESHOLD (12U)
+#define KNXNETIP_ROUTING_BUSY_WAIT_MS   (100U)
+
+/* Returned by KNXnetIP_RoutingMainFunction when nothing is waiting */
+#define KNXNETIP_ROUTING_NO_TIMEOUT     (0xFFFFFFFFU)
+
+/*==================[type definitions]======================================*/
+
+/*==================[external function declarations]========================*/
+extern void KNXnetIP_RoutingInit(void);
+extern int KNXnetIP_RoutingDoorbell(void);
+extern uint32_t KNXnetIP_RoutingMainFunction(bool doorbell);
+extern void KNXnetIP_RoutingTP2IP(KnxFrameBuffer_HandleType frame);
+extern void KNXnetIP_RoutingIP2TP(KnxFrameBuffer_HandleType frame, uint32_t ipAddr);
+extern void KNXnetIP_RoutingBusy(const uint8_t * dataPtr, uint16_t length);
+extern void KNXnetIP_RoutingLostMessage(const uint8_t * dataPtr, uint16_t length);
+
+/*==================[internal function declarations]========================*/
+
+/*==================[external constants]====================================*/
+
+/*------------------[version constants definition]--------------------------*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+
+/*==================[external function definitions]=========================*/
+
+/*==================[internal function definitions]=========================*/
+
+#endif /* #ifndef KNXNETIP_ROUTING_H */
+
+/*==================[end of file]===========================================*/
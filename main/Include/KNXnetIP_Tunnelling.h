@@ -3,13 +3,22 @@
 
 #include "Pdu.h"
 #include "Knx_Types.h"
+#include "KnxFrameBuffer.h"
 
-void KNXnetIP_TunnellingAck(uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_TunnellingAck(uint8_t channelId, uint8_t sequenceCounter, uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_TunnellingAckReceived(uint8_t channelId, uint8_t sequenceCounter, KNXnetIP_ErrorCodeType status);
+void KNXnetIP_TunnellingReset(uint8_t channelId);
+void KNXnetIP_TunnellingAckWithhold(uint8_t channelId, uint8_t sequenceCounter);
+bool KNXnetIP_TunnellingAckRelease(uint8_t channelId);
+void KNXnetIP_TunnellingResume(uint8_t channelId);
 void KNXnetIP_TunnellingInit(void);
-void KNXnetIP_TunnellingFeatureGet(KNXnetIP_FeatureIdentifierType featureIdentifier, uint8_t * txBuffer, uint16_t * txLength);
-void KNXnetIP_TunnellingFeatureSet(KNXnetIP_FeatureIdentifierType featureIdentifier, uint16_t value, uint8_t * txBuffer, uint16_t * txLength);
-void KNXnetIP_TunnellingRequest(uint8_t * bufferPtr, uint16_t length);
+void KNXnetIP_TunnellingFeatureGet(uint8_t channelId, KNXnetIP_FeatureIdentifierType featureIdentifier, uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_TunnellingFeatureSet(uint8_t channelId, KNXnetIP_FeatureIdentifierType featureIdentifier, uint16_t value, uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_TunnellingRequest(uint8_t channelId, KnxFrameBuffer_HandleType frame);
+int KNXnetIP_TunnellingDoorbell(uint8_t transport);
+void KNXnetIP_TunnellingMainFunction(uint8_t transport);
+void KNXnetIP_TunnellingTransmit(uint8_t channelId, KnxFrameBuffer_HandleType frame);
 
-extern void KNXnetIP_TunnelIP2TP(uint8_t * rxBufferPtr, uint8_t rxLength);
+extern void KNXnetIP_TunnelIP2TP(uint8_t channelId, KnxFrameBuffer_HandleType frame);
 
 #endif /* #ifndef KNXNETIP_TUNNELLING_H */ 
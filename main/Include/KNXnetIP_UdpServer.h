@@ -18,6 +18,7 @@
 #define KNXNETIP_UDPSERVER_H
 
 /*==================[inclusions]============================================*/
+#include "Knx_Types.h"
 
 /*==================[macros]================================================*/
 
@@ -26,18 +27,47 @@
 #define MULTICAST_TTL IP_MULTICAST_TTL
 #define MULTICAST_IPV4_ADDR "224.0.23.12"
 
-/*==================[type definitions]======================================*/
+/* Returned by KNXnetIP_UDPMainFunction when no datagram is waiting */
+#define KNXNETIP_UDP_NO_TIMEOUT (0xFFFFFFFFU)
+
+/* Frame header plus the connection header of tunnelling frames */
+#define KNXNETIP_TX_HEADER_MAX  (HEADER_SIZE_10 + CONNECTION_HEADER_SIZE)
 
+/* Body pieces of one frame, a cEMI frame split around a rewritten octet at most */
+#define KNXNETIP_TX_SEGMENT_NUM (3U)
+
+/*==================[type definitions]======================================*/
+typedef struct {
+    const uint8_t * DataPtr;
+    uint16_t Length;
+} KNXnetIP_TxSegmentType;
+
+/* Outgoing frame: the headers are built here, the body is referenced where */
+/* it is held and gathered by the socket call, so it is never staged        */
+typedef struct {
+    uint8_t Header[KNXNETIP_TX_HEADER_MAX];
+    uint8_t HeaderLength;
+    uint8_t SegmentCount;
+    uint16_t Length;        /* Total length, headers included */
+    KNXnetIP_TxSegmentType Segment[KNXNETIP_TX_SEGMENT_NUM];
+} KNXnetIP_TxFrameType;
 
 /*==================[external function declarations]========================*/
 void udp_mcast_task(void *pvParameters);
 void tcp_server_task(void *pvParameters);
 
-void KNXnetIP_UDPSend(uint32_t ipAddr, uint16_t port, uint8_t * txBuffer, uint16_t txLength);
-void KNXnetIP_TcpUpdateTxBuffer(uint8_t * txBuffer, uint16_t txLength);
+void KNXnetIP_TxFrameInit(KNXnetIP_TxFrameType * txFrame, uint16_t serviceType);
+void KNXnetIP_TxFrameConnectionHeader(KNXnetIP_TxFrameType * txFrame, uint8_t channelId, uint8_t sequenceCounter);
+void KNXnetIP_TxFrameAppend(KNXnetIP_TxFrameType * txFrame, const uint8_t * dataPtr, uint16_t length);
+uint16_t KNXnetIP_TxFrameGather(const KNXnetIP_TxFrameType * txFrame, uint16_t offset, uint8_t * destPtr);
+
+void KNXnetIP_UDPSend(uint32_t ipAddr, uint16_t port, const KNXnetIP_TxFrameType * txFrame);
+uint32_t KNXnetIP_UDPMainFunction(void);
+void KNXnetIP_UDPDataSend(uint8_t channelId, uint32_t ipAddr, uint16_t port, const KNXnetIP_TxFrameType * txFrame);
+bool KNXnetIP_UDPDataEndpointOpen(uint8_t channelId, KNXnetIP_HPAIType * hpai);
 
 extern int create_unicast_ipv4_socket(uint32_t ipAddr, uint16_t port);
-extern void tcp_transmitPendingTunnelReq(const int sock, uint32_t ipAddr, uint16_t port);
+extern void KNXnetIP_TcpSend(const int sock, const KNXnetIP_TxFrameType * txFrame);
 
 /*==================[internal function declarations]========================*/
 
@@ -0,0 +1,104 @@
+/**
+ * \file KnxFrameBuffer.h
+ *
+ * \brief Knx Frame Buffer Pool
+ *
+ * This file contains the implementation of the reference counted frame
+ * buffers passed by handle between the IP and TP layers
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+#ifndef KNXFRAMEBUFFER_H
+#define KNXFRAMEBUFFER_H
+
+/*==================[inclusions]============================================*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/*==================[macros]================================================*/
+
+/* Buffers in the pool, frames in flight at 9600 bit/s stay well below it, */
+/* an empty pool drops frames the way a full ring does                      */
+#define KNX_FRAME_BUFFER_NUM       (48U)
+
+/* Room in front of a received frame: a TP frame grows by 3 bytes into a */
+/* cEMI frame in place, KNXnet/IP headers are gathered when it is sent   */
+#define KNX_FRAME_BUFFER_HEADROOM  (4U)
+
+/* Longest KNXnet/IP frame accepted, behind the headroom */
+#define KNX_FRAME_BUFFER_SIZE      (KNX_FRAME_BUFFER_HEADROOM + 256U)
+
+/* Largest cEMI frame passed between IP and TP, extended frames up to LG 64 included */
+#define KNX_FRAME_BUFFER_CEMI_MAX  (96U)
+
+#define KNX_FRAME_BUFFER_INVALID   (0xFFU)
+
+/* Frames carry the time they were read from the bus, for latency measurements */
+#if defined(TPUART2_RX_LATENCY) && !defined(KNX_FRAME_BUFFER_TIMESTAMP)
+#define KNX_FRAME_BUFFER_TIMESTAMP
+#endif
+
+/*==================[type definitions]======================================*/
+typedef uint8_t KnxFrameBuffer_HandleType;
+
+typedef struct {
+    uint8_t Data[KNX_FRAME_BUFFER_SIZE];
+    uint16_t Offset;        /* First frame byte, KNX_FRAME_BUFFER_HEADROOM when allocated */
+    uint16_t Length;
+    atomic_uint RefCount;   /* Holders of the handle, 0 while the buffer is free */
+#ifdef KNX_FRAME_BUFFER_TIMESTAMP
+    int64_t RxTimestampUs;  /* 0 unless the frame came from the bus */
+#endif /* KNX_FRAME_BUFFER_TIMESTAMP */
+} KnxFrameBuffer_Type;
+
+typedef struct {
+    uint32_t Frames;        /* Buffers handed out */
+    uint32_t Copies;        /* Frame bodies still copied, by Clone, AllocCopy and Copy */
+    uint32_t Exhausted;     /* Allocations refused on an empty pool */
+    uint8_t InUse;
+    uint8_t HighWater;
+} KnxFrameBuffer_StatisticsType;
+
+/*==================[external function declarations]========================*/
+/* A handle passed to a function hands over the caller's reference, */
+/* a caller keeping the frame as well takes one more with _Ref       */
+extern void KnxFrameBuffer_Init(void);
+extern KnxFrameBuffer_HandleType KnxFrameBuffer_Alloc(void);
+extern KnxFrameBuffer_HandleType KnxFrameBuffer_AllocCopy(const uint8_t * dataPtr, uint16_t length);
+extern KnxFrameBuffer_HandleType KnxFrameBuffer_Clone(KnxFrameBuffer_HandleType handle);
+extern void KnxFrameBuffer_Ref(KnxFrameBuffer_HandleType handle);
+extern void KnxFrameBuffer_Release(KnxFrameBuffer_HandleType handle);
+extern KnxFrameBuffer_Type * KnxFrameBuffer_Get(KnxFrameBuffer_HandleType handle);
+extern uint8_t * KnxFrameBuffer_Frame(KnxFrameBuffer_HandleType handle);
+extern uint8_t * KnxFrameBuffer_Push(KnxFrameBuffer_HandleType handle, uint16_t length);
+extern uint8_t * KnxFrameBuffer_Pull(KnxFrameBuffer_HandleType handle, uint16_t length);
+extern uint16_t KnxFrameBuffer_Copy(KnxFrameBuffer_HandleType handle, uint8_t * destPtr);
+extern const KnxFrameBuffer_StatisticsType * KnxFrameBuffer_Statistics(void);
+
+/*==================[internal function declarations]========================*/
+
+/*==================[external constants]====================================*/
+
+/*------------------[version constants definition]--------------------------*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+
+/*==================[external function definitions]=========================*/
+
+/*==================[internal function definitions]=========================*/
+
+#endif /* #ifndef KNXFRAMEBUFFER_H */
+
+/*==================[end of file]===========================================*/
@@ -0,0 +1,80 @@
+/**
+ * \file KnxFrameRing.h
+ *
+ * \brief Knx Frame Ring
+ *
+ * This file contains the implementation of the single-producer/single-consumer
+ * rings used to pass frame buffer handles between tasks
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+#ifndef KNXFRAMERING_H
+#define KNXFRAMERING_H
+
+/*==================[inclusions]============================================*/
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "KnxFrameBuffer.h"
+
+/*==================[macros]================================================*/
+
+/* Slots per ring, power of two */
+#define KNX_FRAME_RING_LENGTH    (16U)
+
+/* Slots carry the time they were committed, for latency measurements */
+#if defined(KNXNETIP_TUNNEL_LATENCY) && !defined(KNX_FRAME_RING_TIMESTAMP)
+#define KNX_FRAME_RING_TIMESTAMP
+#endif
+
+/*==================[type definitions]======================================*/
+typedef struct {
+    KnxFrameBuffer_HandleType Frame;    /* Reference owned by the ring until the consumer takes it */
+    uint8_t ChannelId;
+    uint8_t Generation;                 /* Connection on the channel the frame came with */
+#ifdef KNX_FRAME_RING_TIMESTAMP
+    int64_t TimestampUs;
+#endif /* KNX_FRAME_RING_TIMESTAMP */
+} KnxFrameRing_SlotType;
+
+typedef struct {
+    KnxFrameRing_SlotType Slot[KNX_FRAME_RING_LENGTH];
+    atomic_uint Head;    /* Free running write count, only the producer stores it */
+    atomic_uint Tail;    /* Free running read count, only the consumer stores it */
+    uint32_t Dropped;    /* Frames refused on a full ring, producer side */
+} KnxFrameRingType;
+
+/*==================[external function declarations]========================*/
+extern void KnxFrameRing_Init(KnxFrameRingType * ring);
+extern KnxFrameRing_SlotType * KnxFrameRing_Reserve(KnxFrameRingType * ring);
+extern void KnxFrameRing_Commit(KnxFrameRingType * ring);
+extern KnxFrameRing_SlotType * KnxFrameRing_Peek(KnxFrameRingType * ring);
+extern void KnxFrameRing_Release(KnxFrameRingType * ring);
+extern unsigned int KnxFrameRing_Count(KnxFrameRingType * ring);
+
+/*==================[internal function declarations]========================*/
+
+/*==================[external constants]====================================*/
+
+/*------------------[version constants definition]--------------------------*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+
+/*==================[external function definitions]=========================*/
+
+/*==================[internal function definitions]=========================*/
+
+#endif /* #ifndef KNXFRAMERING_H */
+
+/*==================[end of file]===========================================*/
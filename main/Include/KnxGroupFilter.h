@@ -0,0 +1,75 @@
+/**
+ * \file KnxGroupFilter.h
+ *
+ * \brief Knx Group Filter
+ *
+ * This file contains the implementation of the group address filter tables
+ * used when forwarding frames between TP and IP. Mode and table of each
+ * direction are read from NVS at start-up, written there by the NVS
+ * partition image of the installation:
+ *
+ *   namespace  key          type  value
+ *   knx_filter tp2ip_mode   u8    KnxGroupFilter_ModeType
+ *   knx_filter tp2ip_table  blob  one bit per group address, LSB first
+ *   knx_filter ip2tp_mode   u8
+ *   knx_filter ip2tp_table  blob
+ *
+ * Without an entry a direction passes all frames
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+#ifndef KNXGROUPFILTER_H
+#define KNXGROUPFILTER_H
+
+/*==================[inclusions]============================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/*==================[macros]================================================*/
+
+/* Forwarding direction, one table each */
+#define KNX_GROUP_FILTER_TP_TO_IP     (0U)
+#define KNX_GROUP_FILTER_IP_TO_TP     (1U)
+#define KNX_GROUP_FILTER_DIRECTION_NUM (2U)
+
+/* One bit per group address, bit set passes the frame */
+#define KNX_GROUP_FILTER_TABLE_SIZE   (8192U)
+
+/*==================[type definitions]======================================*/
+typedef enum {
+    KNX_GROUP_FILTER_PASS_ALL = 0U,
+    KNX_GROUP_FILTER_BLOCK_ALL,
+    KNX_GROUP_FILTER_TABLE,
+    KNX_GROUP_FILTER_MODE_NUM
+} KnxGroupFilter_ModeType;
+
+/*==================[external function declarations]========================*/
+extern void KnxGroupFilter_Init(void);
+extern bool KnxGroupFilter_Pass(uint8_t direction, uint16_t groupAddr);
+
+/*==================[internal function declarations]========================*/
+
+/*==================[external constants]====================================*/
+
+/*------------------[version constants definition]--------------------------*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+
+/*==================[external function definitions]=========================*/
+
+/*==================[internal function definitions]=========================*/
+
+#endif /* #ifndef KNXGROUPFILTER_H */
+
+/*==================[end of file]===========================================*/
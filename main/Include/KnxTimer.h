@@ -0,0 +1,96 @@
+/**
+ * \file KnxTimer.h
+ *
+ * \brief Knx Protocol Timers
+ *
+ * This file contains the implementation of the hierarchical timer wheel
+ * holding the protocol timeouts of a task
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+#ifndef KNXTIMER_H
+#define KNXTIMER_H
+
+/*==================[inclusions]============================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/*==================[macros]================================================*/
+
+/* Resolution of the wheel, a timer never expires before its delay */
+#define KNX_TIMER_TICK_MS      (10U)
+
+/* Three levels of 64 slots cover 640 ms, 41 s and 43 min, longer delays are cut to that */
+#define KNX_TIMER_LEVEL_BITS   (6U)
+#define KNX_TIMER_SLOT_NUM     (1U << KNX_TIMER_LEVEL_BITS)
+#define KNX_TIMER_LEVEL_NUM    (3U)
+#define KNX_TIMER_MAX_TICKS    ((1UL << (KNX_TIMER_LEVEL_BITS * KNX_TIMER_LEVEL_NUM)) - 1UL)
+
+/* Returned by KnxTimer_Advance when no timer is armed */
+#define KNX_TIMER_NO_TIMEOUT   (0xFFFFFFFFU)
+
+/*==================[type definitions]======================================*/
+typedef void (*KnxTimer_CallbackType)(void * context);
+
+struct KnxTimer_WheelTag;
+
+/* Embedded in the state it times, linked into a slot while armed */
+typedef struct KnxTimer_Tag {
+    struct KnxTimer_Tag * Next;
+    struct KnxTimer_Tag * Prev;
+    struct KnxTimer_WheelTag * Wheel;   /* NULL while not armed */
+    uint32_t ExpiryTick;
+    uint8_t Level;
+    uint8_t Slot;
+    KnxTimer_CallbackType Callback;
+    void * Context;
+} KnxTimer_Type;
+
+/* One wheel per task, only the owning task arms, cancels and advances it */
+typedef struct KnxTimer_WheelTag {
+    KnxTimer_Type * Slot[KNX_TIMER_LEVEL_NUM][KNX_TIMER_SLOT_NUM];
+    uint64_t Occupied[KNX_TIMER_LEVEL_NUM];   /* Bit per non-empty slot */
+    uint32_t Tick;                            /* Last tick expired */
+    int64_t TickMs;                           /* Time of the last tick */
+    uint32_t Armed;
+} KnxTimer_WheelType;
+
+/*==================[external function declarations]========================*/
+/* Time is passed in by the caller, a host build drives the wheel from a virtual clock */
+extern void KnxTimer_WheelInit(KnxTimer_WheelType * wheel, int64_t nowMs);
+extern void KnxTimer_Init(KnxTimer_Type * timer, KnxTimer_CallbackType callback, void * context);
+extern void KnxTimer_Arm(KnxTimer_WheelType * wheel, KnxTimer_Type * timer, int64_t nowMs, uint32_t delayMs);
+extern void KnxTimer_Cancel(KnxTimer_Type * timer);
+extern bool KnxTimer_Armed(const KnxTimer_Type * timer);
+extern uint32_t KnxTimer_Advance(KnxTimer_WheelType * wheel, int64_t nowMs);
+extern uint32_t KnxTimer_NextTimeoutMs(const KnxTimer_WheelType * wheel, int64_t nowMs);
+#ifdef KNX_TIMER_BENCHMARK
+extern void KnxTimer_Benchmark(void);
+#endif /* KNX_TIMER_BENCHMARK */
+
+/*==================[internal function declarations]========================*/
+
+/*==================[external constants]====================================*/
+
+/*------------------[version constants definition]--------------------------*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+
+/*==================[external function definitions]=========================*/
+
+/*==================[internal function definitions]=========================*/
+
+/*==================[end of file]===========================================*/
+
+#endif /* ifndef KNXTIMER_H */
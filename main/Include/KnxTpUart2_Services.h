@@ -39,6 +39,9 @@
 #define TPUART2_U_L_DATAEND            (0x40U) /* +length [7..63] */
 #define TPUART2_U_POLLINGSTATE         (0xE0U) /* +Slotnumber [0..14] */
 
+/* Longest L_Data frame the U_L_DataContinue index [1..62] can address */
+#define TPUART2_FRAME_MAX_LENGTH       (64U)
+
 /* Services from UART */
 #define TPUART2_ACKNOWLEDGEFRAME       (0xCCU)
 #define TPUART2_NOTACKNOWLEDGEFRAME    (0x0CU)
@@ -56,6 +59,20 @@
 #define TPUART2_LAYER2_L_EXT_DATA_REQ (0x10U)
 #define TPUART2_LAYER2_L_POLLDATA_REQ (0xF0U)
 
+/* Control field of received frames, repeat and priority bits masked */
+#define TPUART2_FRAME_START_MASK     (0xD3U)
+#define TPUART2_FRAME_START_STANDARD (0x90U)
+#define TPUART2_FRAME_START_EXTENDED (0x10U)
+
+/* Frame length = LG + overhead (CTRL, [CTRLE,] SA, DA, LG, TPCI, FCS) */
+#define TPUART2_STANDARD_FRAME_OVERHEAD (8U)
+#define TPUART2_EXTENDED_FRAME_OVERHEAD (9U)
+#define TPUART2_STANDARD_LENGTH_OFFSET  (5U)
+#define TPUART2_EXTENDED_LENGTH_OFFSET  (6U)
+
+/* CTRL, SA, poll group address, slot count, FCS */
+#define TPUART2_POLLDATA_FRAME_LENGTH (7U)
+
 /* TP-UART-Control-Services */
 #define TPUART2_U_RESET_IND (0x03U)
 
@@ -81,6 +98,7 @@ extern UartReq_ReturnType KnxTpUart2_U_AckInformation(uint8_t nack, uint8_t busy
 extern UartReq_ReturnType KnxTpUart2_U_L_DataStart(uint8_t eibCtrl);
 extern UartReq_ReturnType KnxTpUart2_U_L_DataContinue(uint8_t index, uint8_t eibData);
 extern UartReq_ReturnType KnxTpUart2_U_L_DataEnd(uint8_t length, uint8_t chksum);
+extern UartReq_ReturnType KnxTpUart2_U_L_DataFrame(const uint8_t * frame, uint8_t length);
 extern UartReq_ReturnType KnxTpUart2_U_MxRstCnt(uint8_t busyCnt, uint8_t nackCnt);
 extern UartReq_ReturnType KnxTpUart2_U_ActivateCRC(void);
 extern UartReq_ReturnType KnxTpUart2_U_PollingState(uint8_t slotnumber, uint16_t pollAddr, uint8_t pollState);
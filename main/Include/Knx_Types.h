@@ -20,6 +20,7 @@
 /*==================[inclusions]============================================*/
 #include "esp_system.h"
 #include "Pdu.h"
+#include "KnxTimer.h"
 
 /*==================[macros]================================================*/
 /* INDICATOR field : B7  B6  B5  B4  B3  B2  B1  B0 */
@@ -146,6 +147,11 @@ typedef enum {
     TUNNELLING_FEATURE_SET      = 0x0424U,
     TUNNELLING_FEATURE_INFO     = 0x0425U,
 
+    /* KNXnet/IP Routing Services */
+    ROUTING_INDICATION   = 0x0530U,
+    ROUTING_LOST_MESSAGE = 0x0531U,
+    ROUTING_BUSY         = 0x0532U,
+
     /* KNXnet/IP Secure Services */
     SECURE_WRAPPER       = 0x0950U,
     SESSION_REQUEST      = 0x0951U,
@@ -209,6 +215,14 @@ typedef enum {
     MFR_DATA = 0xFEU,
 } KNXnetIP_DIBType;
 
+typedef enum {
+    SRP_INVALID = 0x00U,
+    SRP_SELECT_BY_PROGRAMMING_MODE,
+    SRP_SELECT_BY_MAC_ADDRESS,
+    SRP_SELECT_BY_SERVICE,
+    SRP_REQUEST_DIBS,
+} KNXnetIP_SRPType;
+
 typedef enum {
     KNX_TP1   = 0x02U,
     KNX_PL110 = 0x04U,
@@ -235,11 +249,6 @@ typedef enum {
     | (2 Octet)                                                     |
     +-7-+-6-+-5-+-4-+-3-+-2-+-1-+-0-+-7-+-6-+-5-+-4-+-3-+-2-+-1-+-0-+
 */
-typedef struct {
-    uint8_t ChannelId;
-    KNXnetIP_ChannelStatusType ChannelStatus;
-} KNXnetIP_ChannelType;
-
 typedef struct {
     uint8_t  HeaderSize;
     uint8_t  ProtocolVersion;
@@ -261,6 +270,25 @@ typedef struct {
     uint8_t * HostProtocolDataPtr;
 } KNXnetIP_CRIType;
 
+typedef struct {
+    uint8_t ChannelId;
+    KNXnetIP_ChannelStatusType ChannelStatus;
+    KNXnetIP_ConnectionType ConnectionType;
+    KNXnetIP_HostProtocolCodeTpe Protocol;
+    KNXnetIP_HPAIType ControlHpai; /* Client control endpoint */
+    KNXnetIP_HPAIType DataHpai;    /* Client data endpoint */
+    int Socket;                    /* TCP connection the channel is bound to, -1 for UDP */
+    uint8_t SlotIndex;             /* Tunnelling slot bound at connect time */
+    uint16_t IndvAddr;             /* Individual address of the bound tunnelling slot */
+    uint8_t RxSequence;            /* Sequence counter expected in the next TUNNELLING_REQUEST */
+    uint8_t TxSequence;            /* Sequence counter of the next TUNNELLING_REQUEST sent */
+    uint8_t Generation;            /* Counted up on every connect, frames queued for an earlier */
+                                   /* connection on the channel are told apart by it           */
+    KnxTimer_Type HeartbeatTimer;  /* CONNECTION_ALIVE_TIME, on the wheel of the serving task */
+    uint32_t RxFrameCount;
+    uint32_t TxFrameCount;
+} KNXnetIP_ChannelType;
+
 typedef struct {
     KNXnetIP_ServiceFamilyIdType ServiceFamilyId;
     uint8_t ServiceFamilyVersion;
@@ -269,6 +297,7 @@ typedef struct {
 typedef struct {
     uint16_t IndvAddr;
     uint16_t SlotStatus;
+    uint8_t ChannelId; /* Channel using the slot, KNX_CHANNEL_INVALID when free */
 } KNXnetIP_TunnelingSlotType;
 
 typedef enum {
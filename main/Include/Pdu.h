@@ -130,7 +130,7 @@ typedef enum {
 
 typedef struct {
   uint8_t * SduDataPtr;
-  uint8_t SduLength;
+  uint16_t SduLength;
 } PduInfoType;
 
 #endif /* #ifndef PDU_H */
@@ -2,11 +2,25 @@
 #ifndef TP_DATALINKLAYER_H
 #define TP_DATALINKLAYER_H
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
 #include "Pdu.h"
 #include "Knx_Types.h"
+#include "KnxFrameBuffer.h"
+
+/* Frames of a UDP tunnel waiting for the bus at which its TUNNELLING_ACKs */
+/* are held back, the client then waits instead of losing frames          */
+#ifndef TP_GW_ACK_WITHHOLD_DEPTH
+#define TP_GW_ACK_WITHHOLD_DEPTH (4U)
+#endif
 
-extern void TP_GW_L_Data_Req(uint8_t * bufferPtr, uint8_t rxLength);
-extern void TP_GW_L_Data_Ind(PduInfoType * pduInfoPtr);
-extern void TP_GW_L_Data_Ind_ACK(PduInfoType * pduInfoPtr);
+extern void TP_GW_Init(void);
+extern SemaphoreHandle_t TP_GW_GetDoorbell(void);
+extern void TP_GW_MainFunction(void);
+extern StatusType TP_GW_L_Data_Req(uint8_t channelId, KnxFrameBuffer_HandleType frame);
+extern void TP_GW_L_Data_Con(uint8_t channelId, KnxFrameBuffer_HandleType frame, bool success);
+extern void TP_GW_L_Data_Ind(KnxFrameBuffer_HandleType frame);
+extern unsigned int TP_GW_ChannelBacklog(uint8_t channelId);
 
 #endif /* #ifndef TP_DATALINKLAYER_H */
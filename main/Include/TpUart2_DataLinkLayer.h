@@ -3,10 +3,42 @@
 
 #include "Pdu.h"
 #include "Knx_Types.h"
+#include "KnxFrameBuffer.h"
 
-extern void TpUart2_L_Data_Req(bool repeatFlag, uint16_t destAddr, AddressType addrType, PriorityType priority, PduInfoType * pduInfoPtr);
-extern void TpUart2_L_Data_Con(void);
-extern void TpUart2_L_Data_Ind(PduInfoType * pduInfoPtr);
-extern bool TpUart2_DetectEOP(uint8_t * dataPtr, uint8_t rxLength, uint8_t * validDataLength);
+/* TpUart2_GetNextTimeoutMs: nothing to supervise */
+#define TPUART2_NO_TIMEOUT (0xFFFFFFFFU)
+
+#ifdef TPUART2_RX_LATENCY
+/* One latency histogram per network task, indexed like the transports */
+#define TPUART2_RX_LATENCY_SINK_NUM (2U)
+#endif /* TPUART2_RX_LATENCY */
+
+typedef struct {
+    uint32_t Frames;
+    uint32_t Confirms;
+    uint32_t StateIndications;
+    uint32_t ResetIndications;
+    uint32_t ChecksumErrors;
+    uint32_t OversizeFrames;
+    uint32_t NoBuffer;       /* Frames dropped on an empty frame buffer pool */
+    uint32_t Timeouts;       /* Partial frames dropped on bus idle */
+    uint32_t DiscardedBytes; /* Unexpected bytes outside a frame */
+} TpUart2_RxStatisticsType;
+
+extern void TpUart2_Init(void);
+extern void TpUart2_MainFunction(void);
+extern uint32_t TpUart2_GetNextTimeoutMs(void);
+/* reqTimestampMs: KnxTpUart2_GetTimeMs() when the frame was first requested, */
+/* the waiting times of the statistics count from there                      */
+extern StatusType TpUart2_L_Data_Req(uint8_t channelId, bool repeatFlag, uint16_t destAddr, AddressType addrType, PriorityType priority, KnxFrameBuffer_HandleType frame, int64_t reqTimestampMs);
+extern bool TpUart2_TxQueueFull(void);
+extern uint8_t TpUart2_TxQueueCount(void);
+extern void TpUart2_L_Data_Con(bool success);
+extern void TpUart2_L_Data_Ind(KnxFrameBuffer_HandleType frame);
+extern void TpUart2_RxIndication(const uint8_t * dataPtr, uint16_t length);
+extern const TpUart2_RxStatisticsType * TpUart2_GetRxStatistics(void);
+#ifdef TPUART2_RX_LATENCY
+extern void TpUart2_RxLatencyRecord(uint8_t sink, KnxFrameBuffer_HandleType frame);
+#endif /* TPUART2_RX_LATENCY */
 
 #endif /* #ifndef TPUART2_DATALINKLAYER_H */ 
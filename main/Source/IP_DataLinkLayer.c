@@ -25,375 +25,729 @@
 #include "KNXnetIP.h"
 
 #include "TP_DataLinkLayer.h"
+#include "KNXnetIP_Routing.h"
+#include "KNXnetIP_Discovery.h"
+#include "KnxFrameBuffer.h"
+
+#ifdef KNXNETIP_DISPATCH_BENCHMARK
+#include "esp_timer.h"
+#endif /* KNXNETIP_DISPATCH_BENCHMARK */
 
-bool KNXnetIP_Connected = false;
 uint16_t KNXnetIP_ConnectionPort = 0;
 
 /*==================[macros]================================================*/
+#define IP_SERVICE_FAMILY(serviceType) ((uint8_t)(((serviceType) >> 8) & 0xFFU))
+#define IP_SERVICE_ID(serviceType)     ((uint8_t)((serviceType) & 0xFFU))
+
+/* Service families with a dispatch table, starting at KNXNETIP_CORE */
+#define IP_SERVICE_FAMILY_NUM          (4U)
+
+/* Response service of a request answered by nothing */
+#define IP_SERVICE_NO_RESPONSE         (0x0000U)
+
+/* Service flags */
+#define IP_SERVICE_RATE_LIMITED        (0x01U)    /* Control endpoint service, budgeted per source over UDP */
+#define IP_SERVICE_DELAYED             (0x02U)    /* Multicast search, response sent after a random delay */
+#define IP_SERVICE_DATA_ENDPOINT       (0x04U)    /* Tunnel service, response sent from the data endpoint over UDP */
+#define IP_SERVICE_CHANNEL             (0x08U)    /* Request on a channel, not budgeted from the control endpoint of its tunnel */
+
+/* Longest cEMI frame taken from a tunnelling request or routing indication */
+#define IP_CEMI_MAX_LENGTH             (128U)
+
+/* Longest response body a handler writes, the header is kept apart */
+#define IP_TX_BODY_SIZE                (256U - HEADER_SIZE_10)
+
+#ifdef KNXNETIP_DISPATCH_BENCHMARK
+#define IP_DISPATCH_BENCHMARK_ROUNDS   (100000UL)
+#endif /* KNXNETIP_DISPATCH_BENCHMARK */
 
 /*==================[type definitions]======================================*/
+typedef struct {
+    PduInfoType * PduInfoPtr;
+    uint32_t IpAddr;
+    uint16_t Port;
+    KNXnetIP_HostProtocolCodeTpe Protocol;
+    int Sock;                       /* TCP connection the frame came in on, -1 over UDP */
+    KNXnetIP_HPAIType Hpai;         /* Control or discovery endpoint, if the service has one */
+    uint8_t * TxBuffer;             /* Response body, the header goes in front of it when sent */
+    KnxFrameBuffer_HandleType Frame;    /* Buffer holding the received frame, KNX_FRAME_BUFFER_INVALID over TCP */
+} IP_ServiceContextType;
+
+/* Returns the length of the response body, 0 when nothing is answered */
+typedef uint16_t (*IP_ServiceHandlerType)(IP_ServiceContextType * context);
+
+typedef struct {
+    uint16_t MinLength;             /* Shortest frame, header included */
+    uint8_t HpaiOffset;             /* Offset of the HPAI, 0 if the service has none */
+    uint8_t Flags;
+    IP_ServiceHandlerType Handler;  /* NULL for services this device does not accept */
+    uint16_t ResponseType;
+} IP_ServiceEntryType;
+
+typedef struct {
+    const IP_ServiceEntryType * Service;
+    uint8_t ServiceBase;            /* Service ID of Service[0] */
+    uint8_t ServiceNum;
+} IP_ServiceFamilyEntryType;
 
 /*==================[external function declarations]========================*/
 
 /*==================[internal function declarations]========================*/
+static const IP_ServiceEntryType * IP_ServiceLookup(uint16_t serviceType);
+static void IP_ReadHpai(const uint8_t * dataPtr, KNXnetIP_HPAIType * hpai);
+static void IP_DecodeHpai(const uint8_t * dataPtr, KNXnetIP_HPAIType * hpai, uint32_t ipAddr, uint16_t port);
+static KnxFrameBuffer_HandleType IP_TakeCemi(IP_ServiceContextType * context, uint16_t cemiOffset);
+static bool IP_ChannelOwned(const IP_ServiceContextType * context, const KNXnetIP_ChannelType * channel);
+static bool IP_ChannelControlEndpoint(const IP_ServiceEntryType * service, const PduInfoType * pduInfoPtr, uint32_t ipAddr, uint16_t port);
+
+static uint16_t IP_SearchRequest(IP_ServiceContextType * context);
+static uint16_t IP_SearchRequestExtended(IP_ServiceContextType * context);
+static uint16_t IP_DescriptionRequest(IP_ServiceContextType * context);
+static uint16_t IP_ConnectRequest(IP_ServiceContextType * context);
+static uint16_t IP_ConnectionStateRequest(IP_ServiceContextType * context);
+static uint16_t IP_DisconnectRequest(IP_ServiceContextType * context);
+static uint16_t IP_DisconnectResponse(IP_ServiceContextType * context);
+static uint16_t IP_TunnellingRequest(IP_ServiceContextType * context);
+static uint16_t IP_TunnellingAck(IP_ServiceContextType * context);
+static uint16_t IP_TunnellingFeatureGet(IP_ServiceContextType * context);
+static uint16_t IP_TunnellingFeatureSet(IP_ServiceContextType * context);
+static uint16_t IP_RoutingIndication(IP_ServiceContextType * context);
+static uint16_t IP_RoutingLostMessage(IP_ServiceContextType * context);
+static uint16_t IP_RoutingBusy(IP_ServiceContextType * context);
 
 /*==================[external constants]====================================*/
 
 /*==================[internal constants]====================================*/
+/* KNXnet/IP Core Services, 0x0201 - 0x020C */
+static const IP_ServiceEntryType IP_CoreServices[] = {
+    {14U, 6U, IP_SERVICE_RATE_LIMITED | IP_SERVICE_DELAYED, IP_SearchRequest,           SEARCH_RESPONSE},           /* SEARCH_REQUEST */
+    { 0U, 0U, 0U,                                           NULL,                       IP_SERVICE_NO_RESPONSE},    /* SEARCH_RESPONSE */
+    {14U, 6U, IP_SERVICE_RATE_LIMITED,                      IP_DescriptionRequest,      DESCRIPTION_RESPONSE},      /* DESCRIPTION_REQUEST */
+    { 0U, 0U, 0U,                                           NULL,                       IP_SERVICE_NO_RESPONSE},    /* DESCRIPTION_RESPONSE */
+    {26U, 6U, IP_SERVICE_RATE_LIMITED,                      IP_ConnectRequest,          CONNECT_RESPONSE},          /* CONNECT_REQUEST */
+    { 0U, 0U, 0U,                                           NULL,                       IP_SERVICE_NO_RESPONSE},    /* CONNECT_RESPONSE */
+    {16U, 8U, IP_SERVICE_RATE_LIMITED | IP_SERVICE_CHANNEL, IP_ConnectionStateRequest,  CONNECTIONSTATE_RESPONSE},  /* CONNECTIONSTATE_REQUEST */
+    { 0U, 0U, 0U,                                           NULL,                       IP_SERVICE_NO_RESPONSE},    /* CONNECTIONSTATE_RESPONSE */
+    {16U, 8U, IP_SERVICE_RATE_LIMITED | IP_SERVICE_CHANNEL, IP_DisconnectRequest,       DISCONNECT_RESPONSE},       /* DISCONNECT_REQUEST */
+    { 8U, 0U, 0U,                                           IP_DisconnectResponse,      IP_SERVICE_NO_RESPONSE},    /* DISCONNECT_RESPONSE */
+    {14U, 6U, IP_SERVICE_RATE_LIMITED | IP_SERVICE_DELAYED, IP_SearchRequestExtended,   SEARCH_RESPONSE_EXTENDED},  /* SEARCH_REQUEST_EXTENDED */
+    { 0U, 0U, 0U,                                           NULL,                       IP_SERVICE_NO_RESPONSE},    /* SEARCH_RESPONSE_EXTENDED */
+};
+
+/* KNXnet/IP Tunnelling Services, 0x0420 - 0x0425 */
+static const IP_ServiceEntryType IP_TunnellingServices[] = {
+    {20U, 0U, IP_SERVICE_DATA_ENDPOINT,                     IP_TunnellingRequest,       TUNNELLING_ACK},               /* TUNNELLING_REQUEST */
+    {10U, 0U, 0U,                                           IP_TunnellingAck,           IP_SERVICE_NO_RESPONSE},       /* TUNNELLING_ACK */
+    {12U, 0U, IP_SERVICE_DATA_ENDPOINT,                     IP_TunnellingFeatureGet,    TUNNELLING_FEATURE_RESPONSE},  /* TUNNELLING_FEATURE_GET */
+    { 0U, 0U, 0U,                                           NULL,                       IP_SERVICE_NO_RESPONSE},       /* TUNNELLING_FEATURE_RESPONSE */
+    {13U, 0U, IP_SERVICE_DATA_ENDPOINT,                     IP_TunnellingFeatureSet,    TUNNELLING_FEATURE_RESPONSE},  /* TUNNELLING_FEATURE_SET */
+    { 0U, 0U, 0U,                                           NULL,                       IP_SERVICE_NO_RESPONSE},       /* TUNNELLING_FEATURE_INFO */
+};
+
+/* KNXnet/IP Routing Services, 0x0530 - 0x0532 */
+static const IP_ServiceEntryType IP_RoutingServices[] = {
+    {16U, 0U, 0U,                                           IP_RoutingIndication,       IP_SERVICE_NO_RESPONSE},    /* ROUTING_INDICATION */
+    {10U, 0U, 0U,                                           IP_RoutingLostMessage,      IP_SERVICE_NO_RESPONSE},    /* ROUTING_LOST_MESSAGE */
+    {12U, 0U, 0U,                                           IP_RoutingBusy,             IP_SERVICE_NO_RESPONSE},    /* ROUTING_BUSY */
+};
+
+/* Indexed by service family - KNXNETIP_CORE */
+static const IP_ServiceFamilyEntryType IP_ServiceFamilies[IP_SERVICE_FAMILY_NUM] = {
+    {IP_CoreServices,       IP_SERVICE_ID(SEARCH_REQUEST),     sizeof(IP_CoreServices) / sizeof(IP_CoreServices[0])},
+    {NULL,                  0U,                                0U},    /* Device management */
+    {IP_TunnellingServices, IP_SERVICE_ID(TUNNELLING_REQUEST), sizeof(IP_TunnellingServices) / sizeof(IP_TunnellingServices[0])},
+    {IP_RoutingServices,    IP_SERVICE_ID(ROUTING_INDICATION), sizeof(IP_RoutingServices) / sizeof(IP_RoutingServices[0])},
+};
 
 /*==================[external data]=========================================*/
 
 /*==================[internal data]=========================================*/
-uint8_t IP_TxBuffer[256];
-uint8_t IP_RxBuffer[128];
-
 // static uint8_t KNXnetIP_SequenceNumber = 0U;
 
 /*==================[external function definitions]=========================*/
 
 void IP_L_Data_Req(AckType ack, AddressType addrType, uint16_t destAddr, FrameFormatType frameFormat, PduInfoType * pduInfoPtr, uint16_t octetCount, PriorityType priority, uint16_t sourceAddr);
-void IP_L_Data_Ind(PduInfoType * pduInfoPtr, uint32_t ipAddr, uint16_t port, KNXnetIP_HostProtocolCodeTpe protocol);
+void IP_L_Data_Ind(PduInfoType * pduInfoPtr, KnxFrameBuffer_HandleType frame, uint32_t ipAddr, uint16_t port, KNXnetIP_HostProtocolCodeTpe protocol, int sock);
+#ifdef KNXNETIP_DISPATCH_BENCHMARK
+void IP_DispatchBenchmark(void);
+#endif /* KNXNETIP_DISPATCH_BENCHMARK */
 
-void IP_L_Data_Ind(PduInfoType * pduInfoPtr, uint32_t ipAddr, uint16_t port, KNXnetIP_HostProtocolCodeTpe protocol)
+void IP_L_Data_Ind(PduInfoType * pduInfoPtr, KnxFrameBuffer_HandleType frame, uint32_t ipAddr, uint16_t port, KNXnetIP_HostProtocolCodeTpe protocol, int sock)
 {
+    /* Takes the frame buffer, a handler passing the frame on keeps it, */
+    /* otherwise it goes back to the pool once the frame is handled     */
     if (NULL == pduInfoPtr)
     {
         ESP_LOGI("IP","L_Data_Ind: ERR_NULL_PTR");
     }
+    else if ((HEADER_SIZE_10 > pduInfoPtr->SduLength) ||
+             (HEADER_SIZE_10 != pduInfoPtr->SduDataPtr[0]) ||
+             (KNXNETIP_VERSION_10 != pduInfoPtr->SduDataPtr[1]))
+    {
+        /* Not a KNXnet/IP 1.0 frame */
+    }
     else
     {
-        KNXnetIP_FrameType cemiFrame;
-        KNXnetIP_ErrorCodeType errorCode = E_NO_ERROR;
-        uint8_t rxIndex = HEADER_SIZE_10;
+        uint16_t serviceType = ((uint16_t)pduInfoPtr->SduDataPtr[2] << 8) | pduInfoPtr->SduDataPtr[3];
+        const IP_ServiceEntryType * service = IP_ServiceLookup(serviceType);
 
-        /* Decode KNXnet/IP header */
-        cemiFrame.HeaderSize = pduInfoPtr->SduDataPtr[0];
-        cemiFrame.ProtocolVersion = pduInfoPtr->SduDataPtr[1];
-        cemiFrame.ServiceType = ((uint16_t)(pduInfoPtr->SduDataPtr[2]) << 8U) & 0xFF00U;
-        cemiFrame.ServiceType |= pduInfoPtr->SduDataPtr[3] & 0xFFU;
-
-        if (HEADER_SIZE_10 != cemiFrame.HeaderSize)
+        if (NULL == service)
         {
-            errorCode = E_ERROR;
+            /* Unsupported service */
+#ifdef KNXNETIP_DEBUG_LOGGING
+            ESP_LOGI("IP", "L_Data_Ind::UNSUPPORTED_SERVICE 0x%X", serviceType);
+#endif
         }
-        else if (KNXNETIP_VERSION_10 != cemiFrame.ProtocolVersion)
+        else if (service->MinLength > pduInfoPtr->SduLength)
         {
-            errorCode = E_VERSION_NOT_SUPPORTED;
+            ESP_LOGW("IP", "L_Data_Ind: service 0x%X too short, %d bytes", serviceType, pduInfoPtr->SduLength);
+        }
+        else if ((0U != service->HpaiOffset) &&
+                 (IPV4_UDP != pduInfoPtr->SduDataPtr[service->HpaiOffset + 1U]) &&
+                 (IPV4_TCP != pduInfoPtr->SduDataPtr[service->HpaiOffset + 1U]))
+        {
+#ifdef KNXNETIP_DEBUG_LOGGING
+            ESP_LOGE("IP", "L_Data_Ind::E_HOST_PROTOCOL_TYPE::0x%X", serviceType);
+#endif
+        }
+        else if ((IPV4_UDP == protocol) &&
+                 (0U != (service->Flags & IP_SERVICE_RATE_LIMITED)) &&
+                 (false == IP_ChannelControlEndpoint(service, pduInfoPtr, ipAddr, port)) &&
+                 (false == KNXnetIP_DiscoveryAdmit(ipAddr, port, serviceType)))
+        {
+            /* Over the budget of its source or a repeated search, counted by the discovery module */
         }
         else
         {
-            KNXnetIP_HPAIType dataIndHpai;
-            uint16_t txLength = 0;
-
-            if ((DISCONNECT_REQUEST == cemiFrame.ServiceType) || (CONNECTIONSTATE_REQUEST == cemiFrame.ServiceType))
+            /* On the stack of the calling network task, nothing shared between them */
+            uint8_t txBody[IP_TX_BODY_SIZE];
+            IP_ServiceContextType context;
+            uint16_t txLength;
+
+            /* Channel ID of the connection header, read while the frame is still ours */
+            uint8_t channelId = pduInfoPtr->SduDataPtr[HEADER_SIZE_10 + 1U];
+
+            context.PduInfoPtr = pduInfoPtr;
+            context.IpAddr = ipAddr;
+            context.Port = port;
+            context.Protocol = protocol;
+            context.Sock = sock;
+            context.TxBuffer = &txBody[0];
+            context.Frame = frame;
+
+            if (0U != service->HpaiOffset)
             {
-                rxIndex += 3;
-            }
-            else
-            {
-                rxIndex++;
+                IP_ReadHpai(&pduInfoPtr->SduDataPtr[service->HpaiOffset], &context.Hpai);
             }
 
-            dataIndHpai.HostProtocolCode = pduInfoPtr->SduDataPtr[rxIndex++];
-            dataIndHpai.ipAddress  = (uint32_t)(pduInfoPtr->SduDataPtr[rxIndex++]) << 24U;
-            dataIndHpai.ipAddress |= (uint32_t)(pduInfoPtr->SduDataPtr[rxIndex++]) << 16U;
-            dataIndHpai.ipAddress |= (uint32_t)(pduInfoPtr->SduDataPtr[rxIndex++]) << 8U;
-            dataIndHpai.ipAddress |= (uint32_t)(pduInfoPtr->SduDataPtr[rxIndex++]);
-            dataIndHpai.portNumber = (uint32_t)(pduInfoPtr->SduDataPtr[rxIndex++]) << 8U;
-            dataIndHpai.portNumber |= (uint32_t)(pduInfoPtr->SduDataPtr[rxIndex++]);
+            txLength = service->Handler(&context);
+
+            /* Taken by the handler, or released here */
+            frame = context.Frame;
 
-            if ((IPV4_UDP != dataIndHpai.HostProtocolCode) && 
-                (IPV4_TCP != dataIndHpai.HostProtocolCode))
+            if (0U < txLength)
             {
-                errorCode = E_HOST_PROTOCOL_TYPE;
-#ifdef KNXNETIP_DEBUG_LOGGING
-                ESP_LOGE("IP", "L_Data_Ind::E_HOST_PROTOCOL_TYPE::0x%X", cemiFrame.ServiceType);
-#endif
+                /* Frame header, the same for every response, the body is sent from where the handler wrote it */
+                KNXnetIP_TxFrameType txFrame;
+
+                KNXnetIP_TxFrameInit(&txFrame, service->ResponseType);
+                KNXnetIP_TxFrameAppend(&txFrame, &txBody[0], txLength);
+
+                if ((IPV4_UDP == protocol) && (0U != (service->Flags & IP_SERVICE_DELAYED)))
+                {
+                    KNXnetIP_DiscoveryDefer(ipAddr, port, serviceType, &txFrame);
+                }
+                else if ((IPV4_UDP == protocol) && (0U != (service->Flags & IP_SERVICE_DATA_ENDPOINT)))
+                {
+                    KNXnetIP_UDPDataSend(channelId, ipAddr, port, &txFrame);
+                }
+                else if (IPV4_UDP == protocol)
+                {
+                    KNXnetIP_UDPSend(ipAddr, port, &txFrame);
+                }
+                else
+                {
+                    /* Connection of the frame being dispatched */
+                    KNXnetIP_TcpSend(sock, &txFrame);
+                }
             }
             else
             {
-                cemiFrame.HeaderSize = HEADER_SIZE_10;
-                cemiFrame.ProtocolVersion = KNXNETIP_VERSION_10;
-                KNXnetIP_FeatureIdentifierType featureIdentifer;
+                /* No data to be sent! */
+            }
+        }
+    }
 
-                switch (cemiFrame.ServiceType)
-                {
-                    case SEARCH_REQUEST:
-#ifdef KNXNETIP_DEBUG_LOGGING
-                        ESP_LOGI("IP", "L_Data_Ind::SEARCH_REQUEST");
-#endif
-                        KNXnetIP_SearchResponse(&IP_TxBuffer[HEADER_SIZE_10], &txLength);
+    KnxFrameBuffer_Release(frame);
+}
 
-                        /* Construct frame header */
-                        cemiFrame.ServiceType = SEARCH_RESPONSE;
-                        cemiFrame.TotalLength = HEADER_SIZE_10 + txLength;
+void IP_L_Data_Req(AckType ack, AddressType addrType, uint16_t destAddr, FrameFormatType frameFormat, PduInfoType * pduInfoPtr, uint16_t octetCount, PriorityType priority, uint16_t sourceAddr)
+{
+    if (NULL == pduInfoPtr)
+    {
+        ESP_LOGI("IP","L_Data_Ind: ERR_NULL_PTR");
+    }
+    else
+    {
 
-                        IP_TxBuffer[0] = cemiFrame.HeaderSize;
-                        IP_TxBuffer[1] = cemiFrame.ProtocolVersion;
-                        IP_TxBuffer[2] = (uint8_t)((cemiFrame.ServiceType & 0xFF00) >> 8);
-                        IP_TxBuffer[3] = cemiFrame.ServiceType & 0xFFU;
-                        IP_TxBuffer[4] = (uint8_t)((cemiFrame.TotalLength & 0xFF00) >> 8);
-                        IP_TxBuffer[5] = cemiFrame.TotalLength & 0xFFU;
+    }
+//    (void)ack;
+//    (void)addrType;
+//    (void)destAddr;
+//    (void)frameFormat;
+//    (void)octetCount;
+//    (void)priority;
+//    (void)sourceAddr;
+}
 
-                        break;
+#ifdef KNXNETIP_DISPATCH_BENCHMARK
+void IP_DispatchBenchmark(void)
+{
+    /* Every service the switch used to handle, plus one unknown service per family */
+    static const uint16_t serviceTypes[] = {
+        SEARCH_REQUEST, DESCRIPTION_REQUEST, CONNECT_REQUEST, CONNECTIONSTATE_REQUEST,
+        DISCONNECT_REQUEST, DISCONNECT_RESPONSE, SEARCH_REQUEST_EXTENDED,
+        TUNNELLING_REQUEST, TUNNELLING_FEATURE_GET, TUNNELLING_FEATURE_SET,
+        ROUTING_INDICATION, ROUTING_LOST_MESSAGE, ROUTING_BUSY,
+        0x020FU, 0x0310U, 0x0426U, 0x0533U, 0x0000U, 0xFFFFU,
+    };
+    volatile uintptr_t sink = 0U;
+
+    for (uint8_t i = 0; i < (sizeof(serviceTypes) / sizeof(serviceTypes[0])); i++)
+    {
+        int64_t startUs = esp_timer_get_time();
 
-                    case SEARCH_REQUEST_EXTENDED:
-#ifdef KNXNETIP_DEBUG_LOGGING
-                        ESP_LOGI("IP", "L_Data_Ind::SEARCH_REQUEST_EXTENDED");
-#endif
-                        KNXnetIP_SearchResponseExtended(&IP_TxBuffer[HEADER_SIZE_10], &txLength);
+        for (uint32_t round = 0; round < IP_DISPATCH_BENCHMARK_ROUNDS; round++)
+        {
+            sink += (uintptr_t)IP_ServiceLookup(serviceTypes[i]);
+        }
 
-                         /* Construct frame header */
-                        cemiFrame.ServiceType = SEARCH_RESPONSE_EXTENDED;
-                        cemiFrame.TotalLength = HEADER_SIZE_10 + txLength;
+        ESP_LOGI("IP", "Dispatch 0x%04X: %lu ns per lookup (%s)", serviceTypes[i],
+                 (unsigned long)(((esp_timer_get_time() - startUs) * 1000LL) / IP_DISPATCH_BENCHMARK_ROUNDS),
+                 (NULL != IP_ServiceLookup(serviceTypes[i])) ? "handled" : "rejected");
+    }
 
-                        IP_TxBuffer[0] = cemiFrame.HeaderSize;
-                        IP_TxBuffer[1] = cemiFrame.ProtocolVersion;
-                        IP_TxBuffer[2] = (uint8_t)((cemiFrame.ServiceType & 0xFF00) >> 8);
-                        IP_TxBuffer[3] = cemiFrame.ServiceType & 0xFFU;
-                        IP_TxBuffer[4] = (uint8_t)((cemiFrame.TotalLength & 0xFF00) >> 8);
-                        IP_TxBuffer[5] = cemiFrame.TotalLength & 0xFFU;
+    (void)sink;
+}
+#endif /* KNXNETIP_DISPATCH_BENCHMARK */
 
-                        break;
+/*==================[internal function definitions]=========================*/
 
-                    case DESCRIPTION_REQUEST:
-#ifdef KNXNETIP_DEBUG_LOGGING
-                        ESP_LOGI("IP", "L_Data_Ind::DESCRIPTION_REQUEST");
-#endif
-                        KNXnetIP_DescriptionResponse(&IP_TxBuffer[HEADER_SIZE_10], &txLength);
+static const IP_ServiceEntryType * IP_ServiceLookup(uint16_t serviceType)
+{
+    const IP_ServiceEntryType * service = NULL;
+    uint8_t family = IP_SERVICE_FAMILY(serviceType) - KNXNETIP_CORE;
+
+    /* Family below KNXNETIP_CORE wraps around and fails the bound as well */
+    if (IP_SERVICE_FAMILY_NUM > family)
+    {
+        const IP_ServiceFamilyEntryType * familyEntry = &IP_ServiceFamilies[family];
+        uint8_t index = IP_SERVICE_ID(serviceType) - familyEntry->ServiceBase;
+
+        if ((familyEntry->ServiceNum > index) && (NULL != familyEntry->Service[index].Handler))
+        {
+            service = &familyEntry->Service[index];
+        }
+    }
 
-                        /* Construct frame header */
-                        cemiFrame.ServiceType = DESCRIPTION_RESPONSE;
-                        cemiFrame.TotalLength = HEADER_SIZE_10 + txLength;
+    return service;
+}
 
-                        IP_TxBuffer[0] = cemiFrame.HeaderSize;
-                        IP_TxBuffer[1] = cemiFrame.ProtocolVersion;
-                        IP_TxBuffer[2] = (uint8_t)((cemiFrame.ServiceType & 0xFF00) >> 8);
-                        IP_TxBuffer[3] = cemiFrame.ServiceType & 0xFFU;
-                        IP_TxBuffer[4] = (uint8_t)((cemiFrame.TotalLength & 0xFF00) >> 8);
-                        IP_TxBuffer[5] = cemiFrame.TotalLength & 0xFFU;
+static void IP_ReadHpai(const uint8_t * dataPtr, KNXnetIP_HPAIType * hpai)
+{
+    hpai->StructureLength = dataPtr[0];
+    hpai->HostProtocolCode = dataPtr[1];
+    hpai->ipAddress  = (uint32_t)(dataPtr[2]) << 24U;
+    hpai->ipAddress |= (uint32_t)(dataPtr[3]) << 16U;
+    hpai->ipAddress |= (uint32_t)(dataPtr[4]) << 8U;
+    hpai->ipAddress |= (uint32_t)(dataPtr[5]);
+    hpai->portNumber  = (uint16_t)(dataPtr[6]) << 8U;
+    hpai->portNumber |= (uint16_t)(dataPtr[7]);
+}
 
-                        break;
+static void IP_DecodeHpai(const uint8_t * dataPtr, KNXnetIP_HPAIType * hpai, uint32_t ipAddr, uint16_t port)
+{
+    IP_ReadHpai(dataPtr, hpai);
 
-                    case CONNECT_REQUEST:
-#ifdef KNXNETIP_DEBUG_LOGGING
-                        ESP_LOGI("IP", "L_Data_Ind::CONNECT_REQUEST");
-#endif
-                        KNXnetIP_CRIType cri;
+    /* Route back (NAT) mode: the client asks to be answered at the source address */
+    if ((0U == hpai->ipAddress) || (0U == hpai->portNumber))
+    {
+        hpai->ipAddress = ipAddr;
+        hpai->portNumber = port;
+    }
+}
 
-                        cri.ConnectionTypeCode = pduInfoPtr->SduDataPtr[23];
-                        KNXnetIP_ConnectResponse(errorCode, &dataIndHpai, &cri, &IP_TxBuffer[HEADER_SIZE_10], &txLength);
+static KnxFrameBuffer_HandleType IP_TakeCemi(IP_ServiceContextType * context, uint16_t cemiOffset)
+{
+    KnxFrameBuffer_HandleType frame = context->Frame;
 
-                        /* Construct frame header */
-                        cemiFrame.ServiceType = CONNECT_RESPONSE;
-                        cemiFrame.TotalLength = HEADER_SIZE_10 + txLength;
+    if (KNX_FRAME_BUFFER_INVALID == frame)
+    {
+        /* Received into the stream buffer of a TCP connection, copied out once */
+        frame = KnxFrameBuffer_AllocCopy(&context->PduInfoPtr->SduDataPtr[cemiOffset], context->PduInfoPtr->SduLength - cemiOffset);
+    }
+    else
+    {
+        /* The receive buffer becomes the frame buffer, headers are stripped in place */
+        context->Frame = KNX_FRAME_BUFFER_INVALID;
+        (void)KnxFrameBuffer_Pull(frame, cemiOffset);
+    }
 
-                        IP_TxBuffer[0] = cemiFrame.HeaderSize;
-                        IP_TxBuffer[1] = cemiFrame.ProtocolVersion;
-                        IP_TxBuffer[2] = (uint8_t)((cemiFrame.ServiceType & 0xFF00) >> 8);
-                        IP_TxBuffer[3] = cemiFrame.ServiceType & 0xFFU;
-                        IP_TxBuffer[4] = (uint8_t)((cemiFrame.TotalLength & 0xFF00) >> 8);
-                        IP_TxBuffer[5] = cemiFrame.TotalLength & 0xFFU;
+    return frame;
+}
 
-                        KNXnetIP_Connected = true;
+static bool IP_ChannelOwned(const IP_ServiceContextType * context, const KNXnetIP_ChannelType * channel)
+{
+    /* Served by the task of its transport only, its timers live there, and over */
+    /* TCP only for the connection it was opened on, never for another client   */
+    return (NULL != channel) &&
+           (context->Protocol == channel->Protocol) &&
+           (context->Sock == channel->Socket);
+}
 
-                        break;
+static bool IP_ChannelControlEndpoint(const IP_ServiceEntryType * service, const PduInfoType * pduInfoPtr, uint32_t ipAddr, uint16_t port)
+{
+    /* The heartbeat and the disconnect of an open tunnel are never refused */
+    /* for a scan of other hosts, the channel ID leads the request body     */
+    bool open = false;
 
-                    case CONNECTIONSTATE_REQUEST:
-#ifdef KNXNETIP_DEBUG_LOGGING
-                        ESP_LOGI("IP", "L_Data_Ind::CONNECTIONSTATE_REQUEST");
-#endif
-                        KNXnetIP_ConnectionStateResponse(errorCode, &IP_TxBuffer[HEADER_SIZE_10], &txLength);
+    if (0U != (service->Flags & IP_SERVICE_CHANNEL))
+    {
+        const KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(pduInfoPtr->SduDataPtr[HEADER_SIZE_10]);
 
-                        /* Construct frame header */
-                        cemiFrame.ServiceType = CONNECTIONSTATE_RESPONSE;
-                        cemiFrame.TotalLength = HEADER_SIZE_10 + txLength;
+        open = (NULL != channel) &&
+               (IPV4_UDP == channel->Protocol) &&
+               (ipAddr == channel->ControlHpai.ipAddress) &&
+               (port == channel->ControlHpai.portNumber);
+    }
 
-                        IP_TxBuffer[0] = cemiFrame.HeaderSize;
-                        IP_TxBuffer[1] = cemiFrame.ProtocolVersion;
-                        IP_TxBuffer[2] = (uint8_t)((cemiFrame.ServiceType & 0xFF00) >> 8);
-                        IP_TxBuffer[3] = cemiFrame.ServiceType & 0xFFU;
-                        IP_TxBuffer[4] = (uint8_t)((cemiFrame.TotalLength & 0xFF00) >> 8);
-                        IP_TxBuffer[5] = cemiFrame.TotalLength & 0xFFU;
+    return open;
+}
 
-                        break;
+static uint16_t IP_SearchRequest(IP_ServiceContextType * context)
+{
+    uint16_t txLength = 0;
 
-                    case DISCONNECT_REQUEST:
 #ifdef KNXNETIP_DEBUG_LOGGING
-                        ESP_LOGI("IP", "L_Data_Ind::DISCONNECT_REQUEST");
+    ESP_LOGI("IP", "L_Data_Ind::SEARCH_REQUEST");
 #endif
-                        KNXnetIP_DisconnectResponse(&IP_TxBuffer[HEADER_SIZE_10], &txLength);
+    KNXnetIP_SearchResponse(context->TxBuffer, &txLength);
 
-                        /* Construct frame header */
-                        cemiFrame.ServiceType = DISCONNECT_RESPONSE;
-                        cemiFrame.TotalLength = HEADER_SIZE_10 + txLength;
-
-                        IP_TxBuffer[0] = cemiFrame.HeaderSize;
-                        IP_TxBuffer[1] = cemiFrame.ProtocolVersion;
-                        IP_TxBuffer[2] = (uint8_t)((cemiFrame.ServiceType & 0xFF00) >> 8);
-                        IP_TxBuffer[3] = cemiFrame.ServiceType & 0xFFU;
-                        IP_TxBuffer[4] = (uint8_t)((cemiFrame.TotalLength & 0xFF00) >> 8);
-                        IP_TxBuffer[5] = cemiFrame.TotalLength & 0xFFU;
-
-                        KNXnetIP_Connected = false;
+    return txLength;
+}
 
-                        break;
+static uint16_t IP_SearchRequestExtended(IP_ServiceContextType * context)
+{
+    uint16_t txLength = 0;
 
-                    case DISCONNECT_RESPONSE:
 #ifdef KNXNETIP_DEBUG_LOGGING
-                        ESP_LOGI("IP", "L_Data_Ind::DISCONNECT_RESPONSE");
+    ESP_LOGI("IP", "L_Data_Ind::SEARCH_REQUEST_EXTENDED");
 #endif
-                        break;
+    /* Search Request Parameters follow the discovery endpoint */
+    KNXnetIP_SearchResponseExtended(&context->PduInfoPtr->SduDataPtr[HEADER_SIZE_10 + 8U],
+                                    context->PduInfoPtr->SduLength - (HEADER_SIZE_10 + 8U),
+                                    context->TxBuffer, &txLength);
+
+    return txLength;
+}
+
+static uint16_t IP_DescriptionRequest(IP_ServiceContextType * context)
+{
+    uint16_t txLength = 0;
 
-                    case TUNNELLING_REQUEST:
 #ifdef KNXNETIP_DEBUG_LOGGING
-                        ESP_LOGI("IP","L_Data_Ind::TUNNELLING_REQUEST");
+    ESP_LOGI("IP", "L_Data_Ind::DESCRIPTION_REQUEST");
 #endif
-                        /* Copy L-PDU into Rx Buffer */
-                        memcpy(&IP_RxBuffer[0], &pduInfoPtr->SduDataPtr[HEADER_SIZE_10 + CONNECTION_HEADER_SIZE], pduInfoPtr->SduLength - (HEADER_SIZE_10+CONNECTION_HEADER_SIZE));
+    KNXnetIP_DescriptionResponse(context->TxBuffer, &txLength);
+
+    return txLength;
+}
+
+static uint16_t IP_ConnectRequest(IP_ServiceContextType * context)
+{
+    uint16_t txLength = 0;
+    uint8_t * dataPtr = context->PduInfoPtr->SduDataPtr;
+    KNXnetIP_ErrorCodeType errorCode = E_NO_ERROR;
+    KNXnetIP_ChannelType * connectChannel = NULL;
+    KNXnetIP_CRIType cri;
+    KNXnetIP_HPAIType dataEndpoint = context->Hpai;    /* Over TCP the request's own, route back */
 
 #ifdef KNXNETIP_DEBUG_LOGGING
-                        for (uint8_t rxIndex = 0; rxIndex < pduInfoPtr->SduLength - (HEADER_SIZE_10+CONNECTION_HEADER_SIZE); rxIndex++)
-                        {
-                            if (IP_RxBuffer[rxIndex] < 0x10U)
-                            {
-                                printf("0%X ", IP_RxBuffer[rxIndex]);
-                            }
-                            else
-                            {
-                                printf("%X ", IP_RxBuffer[rxIndex]);
-                            }
-                        }
-                        printf("\n ");
+    ESP_LOGI("IP", "L_Data_Ind::CONNECT_REQUEST");
 #endif
+    cri.ConnectionTypeCode = dataPtr[23];
+
+    if ((TUNNEL_CONNECTION != cri.ConnectionTypeCode) &&
+        (DEVICE_MGMT_CONNECTION != cri.ConnectionTypeCode))
+    {
+        errorCode = E_CONNECTION_TYPE;
+    }
+    else
+    {
+        connectChannel = KNXnetIP_ChannelAlloc(cri.ConnectionTypeCode, context->Protocol, context->Sock);
+
+        if (NULL == connectChannel)
+        {
+            errorCode = E_NO_MORE_CONNECTIONS;
+        }
+        else
+        {
+            /* Control endpoint at octet 6, data endpoint at octet 14 */
+            IP_DecodeHpai(&dataPtr[HEADER_SIZE_10], &connectChannel->ControlHpai, context->IpAddr, context->Port);
+            IP_DecodeHpai(&dataPtr[HEADER_SIZE_10 + 8U], &connectChannel->DataHpai, context->IpAddr, context->Port);
+
+            /* Over UDP the tunnel gets a socket of its own, announced in the response */
+            if ((IPV4_UDP == context->Protocol) &&
+                (false == KNXnetIP_UDPDataEndpointOpen(connectChannel->ChannelId, &dataEndpoint)))
+            {
+                KNXnetIP_ChannelFree(connectChannel->ChannelId);
+                connectChannel = NULL;
+                errorCode = E_NO_MORE_CONNECTIONS;
+            }
+            else if (IPV4_UDP == context->Protocol)
+            {
+                /* Nothing left waiting for an ack from a previous user of the channel ID */
+                KNXnetIP_TunnellingReset(connectChannel->ChannelId);
+            }
+        }
+    }
+
+    KNXnetIP_ConnectResponse((NULL != connectChannel) ? connectChannel->ChannelId : KNX_CHANNEL_INVALID,
+                             errorCode, &dataEndpoint, &cri, context->TxBuffer, &txLength);
+
+    return txLength;
+}
+
+static uint16_t IP_ConnectionStateRequest(IP_ServiceContextType * context)
+{
+    uint16_t txLength = 0;
+    uint8_t channelId = context->PduInfoPtr->SduDataPtr[HEADER_SIZE_10];
+    KNXnetIP_ErrorCodeType errorCode = E_NO_ERROR;
+    KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(channelId);
 
-                        /* Gateway to TP-UART2 Interface */
-                        KNXnetIP_TunnelIP2TP(&IP_RxBuffer[0], pduInfoPtr->SduLength - (HEADER_SIZE_10 + CONNECTION_HEADER_SIZE));
-
-                        if (IPV4_UDP == protocol)
-                        {
-                            KNXnetIP_TunnellingAck(&IP_TxBuffer[HEADER_SIZE_10], &txLength);
-
-                            /* Construct ack frame header */
-                            cemiFrame.ServiceType = TUNNELLING_ACK;
-                            cemiFrame.TotalLength = HEADER_SIZE_10 + txLength;
-
-                            IP_TxBuffer[0] = cemiFrame.HeaderSize;
-                            IP_TxBuffer[1] = cemiFrame.ProtocolVersion;
-                            IP_TxBuffer[2] = (uint8_t)((cemiFrame.ServiceType & 0xFF00) >> 8);
-                            IP_TxBuffer[3] = cemiFrame.ServiceType & 0xFFU;
-                            IP_TxBuffer[4] = (uint8_t)((cemiFrame.TotalLength & 0xFF00) >> 8);
-                            IP_TxBuffer[5] = cemiFrame.TotalLength & 0xFFU;
-                        }
-                        else if (IPV4_TCP == protocol)
-                        {
-                            /* Send L_Data.con to client */
-                            txLength = pduInfoPtr->SduDataPtr[5];
-                            cemiFrame.TotalLength = txLength;
-                            memcpy(&IP_TxBuffer[0], pduInfoPtr->SduDataPtr, txLength);
-
-                            /* Update Message Code to L_Data.con (0x2E) */
-                            IP_TxBuffer[10] = L_DATA_CON;
-
-                            /* Update Source Address */
-                            IP_TxBuffer[14] = 0x11;
-                            IP_TxBuffer[15] = 0xFA;
-                        }
-                        else
-                        {
-                            /* Protocol is neither UDP nor TCP. */
-                            /* Should not get here.             */
-                        }
-
-                        break;
-
-                    case TUNNELLING_FEATURE_GET:
 #ifdef KNXNETIP_DEBUG_LOGGING
-                        ESP_LOGI("IP","L_Data_Ind::TUNNELLING_FEATURE_GET");
+    ESP_LOGI("IP", "L_Data_Ind::CONNECTIONSTATE_REQUEST");
 #endif
-                        featureIdentifer = pduInfoPtr->SduDataPtr[10];
-
-                        KNXnetIP_TunnellingFeatureGet(featureIdentifer, &IP_TxBuffer[HEADER_SIZE_10], &txLength);
+    if (false == IP_ChannelOwned(context, channel))
+    {
+        errorCode = E_CONNECTION_ID;
+    }
+    else
+    {
+        KNXnetIP_ChannelHeartbeat(channel);
+    }
 
-                        /* Construct frame header */
-                        cemiFrame.ServiceType = TUNNELLING_FEATURE_RESPONSE;
-                        cemiFrame.TotalLength = HEADER_SIZE_10 + txLength;
+    KNXnetIP_ConnectionStateResponse(channelId, errorCode, context->TxBuffer, &txLength);
 
-                        IP_TxBuffer[0] = cemiFrame.HeaderSize;
-                        IP_TxBuffer[1] = cemiFrame.ProtocolVersion;
-                        IP_TxBuffer[2] = (uint8_t)((cemiFrame.ServiceType & 0xFF00) >> 8);
-                        IP_TxBuffer[3] = cemiFrame.ServiceType & 0xFFU;
-                        IP_TxBuffer[4] = (uint8_t)((cemiFrame.TotalLength & 0xFF00) >> 8);
-                        IP_TxBuffer[5] = cemiFrame.TotalLength & 0xFFU;
+    return txLength;
+}
 
-                        break;
+static uint16_t IP_DisconnectRequest(IP_ServiceContextType * context)
+{
+    uint16_t txLength = 0;
+    uint8_t channelId = context->PduInfoPtr->SduDataPtr[HEADER_SIZE_10];
+    KNXnetIP_ErrorCodeType errorCode = E_NO_ERROR;
+    KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(channelId);
 
-                    case TUNNELLING_FEATURE_SET:
 #ifdef KNXNETIP_DEBUG_LOGGING
-                        ESP_LOGI("IP","L_Data_Ind::TUNNELLING_FEATURE_SET");
+    ESP_LOGI("IP", "L_Data_Ind::DISCONNECT_REQUEST");
 #endif
-                        featureIdentifer = pduInfoPtr->SduDataPtr[10];
-                        uint16_t value = pduInfoPtr->SduDataPtr[12];
+    if (false == IP_ChannelOwned(context, channel))
+    {
+        errorCode = E_CONNECTION_ID;
+    }
+    else
+    {
+        if (IPV4_UDP == channel->Protocol)
+        {
+            /* Requests still waiting for a TUNNELLING_ACK go back to the pool */
+            KNXnetIP_TunnellingReset(channelId);
+        }
 
-                        KNXnetIP_TunnellingFeatureSet(featureIdentifer, value, &IP_TxBuffer[HEADER_SIZE_10], &txLength);
+        KNXnetIP_ChannelFree(channelId);
+    }
 
-                        /* Construct frame header */
-                        cemiFrame.ServiceType = TUNNELLING_FEATURE_RESPONSE;
-                        cemiFrame.TotalLength = HEADER_SIZE_10 + txLength;
+    KNXnetIP_DisconnectResponse(channelId, errorCode, context->TxBuffer, &txLength);
 
-                        IP_TxBuffer[0] = cemiFrame.HeaderSize;
-                        IP_TxBuffer[1] = cemiFrame.ProtocolVersion;
-                        IP_TxBuffer[2] = (uint8_t)((cemiFrame.ServiceType & 0xFF00) >> 8);
-                        IP_TxBuffer[3] = cemiFrame.ServiceType & 0xFFU;
-                        IP_TxBuffer[4] = (uint8_t)((cemiFrame.TotalLength & 0xFF00) >> 8);
-                        IP_TxBuffer[5] = cemiFrame.TotalLength & 0xFFU;
+    return txLength;
+}
+
+static uint16_t IP_DisconnectResponse(IP_ServiceContextType * context)
+{
+#ifdef KNXNETIP_DEBUG_LOGGING
+    ESP_LOGI("IP", "L_Data_Ind::DISCONNECT_RESPONSE");
+#endif
+    (void)context;
+
+    return 0U;
+}
 
-                        break;
+static uint16_t IP_TunnellingRequest(IP_ServiceContextType * context)
+{
+    uint16_t txLength = 0;
+    uint8_t channelId = context->PduInfoPtr->SduDataPtr[HEADER_SIZE_10 + 1U];
+    uint8_t sequenceCounter = context->PduInfoPtr->SduDataPtr[HEADER_SIZE_10 + 2U];
+    uint16_t cemiLength = context->PduInfoPtr->SduLength - (HEADER_SIZE_10 + CONNECTION_HEADER_SIZE);
+    KNXnetIP_ChannelType * tunnelChannel = KNXnetIP_ChannelGet(channelId);
 
-                    default:
-                        /* Unsupported service */
 #ifdef KNXNETIP_DEBUG_LOGGING
-                        ESP_LOGI("IP", "L_Data_Ind::UNSUPPORTED_SERVICE");
-                        ESP_LOGI("IP", "Service: 0x%X",cemiFrame.ServiceType);
+    ESP_LOGI("IP","L_Data_Ind::TUNNELLING_REQUEST");
 #endif
-                        break;
-                }
+    if (false == IP_ChannelOwned(context, tunnelChannel))
+    {
+        /* Unknown communication channel, frame is ignored */
+        ESP_LOGW("IP", "L_Data_Ind::TUNNELLING_REQUEST E_CONNECTION_ID 0x%X", channelId);
+    }
+    else if (IP_CEMI_MAX_LENGTH < cemiLength)
+    {
+        /* cEMI frame no TP frame can carry */
+        ESP_LOGW("IP", "L_Data_Ind::TUNNELLING_REQUEST length %d", context->PduInfoPtr->SduLength);
+    }
+    else if ((IPV4_UDP == context->Protocol) && ((uint8_t)(tunnelChannel->RxSequence - 1U) == sequenceCounter))
+    {
+        /* Repeat of a request already on its way to the bus, its ack got lost or was */
+        /* withheld: a withheld one goes now, before the client gives the tunnel up   */
+        KNXnetIP_ChannelHeartbeat(tunnelChannel);
+
+        if (false == KNXnetIP_TunnellingAckRelease(channelId))
+        {
+            KNXnetIP_TunnellingAck(channelId, sequenceCounter, context->TxBuffer, &txLength);
+        }
+    }
+    else if ((IPV4_UDP == context->Protocol) && (tunnelChannel->RxSequence != sequenceCounter))
+    {
+        /* Out of sequence, discarded without an ack */
+        ESP_LOGW("IP", "L_Data_Ind::TUNNELLING_REQUEST sequence %u, expected %u", sequenceCounter, tunnelChannel->RxSequence);
+    }
+    else
+    {
+        KnxFrameBuffer_HandleType frame = IP_TakeCemi(context, HEADER_SIZE_10 + CONNECTION_HEADER_SIZE);
 
-                if (txLength > 0)
+        if (KNX_FRAME_BUFFER_INVALID == frame)
+        {
+            /* No buffer, left unacknowledged so the client repeats it */
+            ESP_LOGW("IP", "L_Data_Ind::TUNNELLING_REQUEST no frame buffer");
+        }
+        else
+        {
+            tunnelChannel->RxFrameCount++;
+            tunnelChannel->RxSequence++;
+            KNXnetIP_ChannelHeartbeat(tunnelChannel);
+
+#ifdef KNXNETIP_DEBUG_LOGGING
+            for (uint16_t rxIndex = 0; rxIndex < cemiLength; rxIndex++)
+            {
+                if (KnxFrameBuffer_Frame(frame)[rxIndex] < 0x10U)
                 {
-                    if (IPV4_UDP == protocol)
-                    {
-                        KNXnetIP_UDPSend(ipAddr, port, &IP_TxBuffer[0], cemiFrame.TotalLength);
-                    }
-                    else
-                    {
-                        KNXnetIP_TcpUpdateTxBuffer(&IP_TxBuffer[0], cemiFrame.TotalLength);
-                    }
+                    printf("0%X ", KnxFrameBuffer_Frame(frame)[rxIndex]);
                 }
                 else
                 {
-                    /* No data to be sent! */
+                    printf("%X ", KnxFrameBuffer_Frame(frame)[rxIndex]);
                 }
             }
+            printf("\n ");
+#endif
+
+            /* Gateway to TP-UART2 Interface */
+            KNXnetIP_TunnelIP2TP(channelId, frame);
+
+            if ((IPV4_UDP == context->Protocol) && (TP_GW_ACK_WITHHOLD_DEPTH <= TP_GW_ChannelBacklog(channelId)))
+            {
+                /* The client is ahead of the bus, it waits for this ack instead of sending more */
+                KNXnetIP_TunnellingAckWithhold(channelId, sequenceCounter);
+            }
+            else if (IPV4_UDP == context->Protocol)
+            {
+                KNXnetIP_TunnellingAck(channelId, sequenceCounter, context->TxBuffer, &txLength);
+            }
+            else
+            {
+                /* No ack over TCP, the L_Data.con follows once the */
+                /* TP-UART confirms the frame (TP_GW_L_Data_Con)    */
+            }
         }
     }
+
+    return txLength;
 }
 
-void IP_L_Data_Req(AckType ack, AddressType addrType, uint16_t destAddr, FrameFormatType frameFormat, PduInfoType * pduInfoPtr, uint16_t octetCount, PriorityType priority, uint16_t sourceAddr)
+static uint16_t IP_TunnellingAck(IP_ServiceContextType * context)
 {
-    if (NULL == pduInfoPtr)
-    {
-        ESP_LOGI("IP","L_Data_Ind: ERR_NULL_PTR");
-    }
-    else
+    const uint8_t * dataPtr = &context->PduInfoPtr->SduDataPtr[HEADER_SIZE_10];
+
+#ifdef KNXNETIP_DEBUG_LOGGING
+    ESP_LOGI("IP","L_Data_Ind::TUNNELLING_ACK");
+#endif
+    /* Connection header: length, channel ID, sequence counter, status */
+    KNXnetIP_TunnellingAckReceived(dataPtr[1], dataPtr[2], (KNXnetIP_ErrorCodeType)dataPtr[3]);
+
+    return 0U;
+}
+
+static uint16_t IP_TunnellingFeatureGet(IP_ServiceContextType * context)
+{
+    uint16_t txLength = 0;
+    uint8_t channelId = context->PduInfoPtr->SduDataPtr[HEADER_SIZE_10 + 1U];
+    KNXnetIP_FeatureIdentifierType featureIdentifer = context->PduInfoPtr->SduDataPtr[10];
+
+#ifdef KNXNETIP_DEBUG_LOGGING
+    ESP_LOGI("IP","L_Data_Ind::TUNNELLING_FEATURE_GET");
+#endif
+    KNXnetIP_TunnellingFeatureGet(channelId, featureIdentifer, context->TxBuffer, &txLength);
+
+    return txLength;
+}
+
+static uint16_t IP_TunnellingFeatureSet(IP_ServiceContextType * context)
+{
+    uint16_t txLength = 0;
+    uint8_t channelId = context->PduInfoPtr->SduDataPtr[HEADER_SIZE_10 + 1U];
+    KNXnetIP_FeatureIdentifierType featureIdentifer = context->PduInfoPtr->SduDataPtr[10];
+    uint16_t value = context->PduInfoPtr->SduDataPtr[12];
+
+#ifdef KNXNETIP_DEBUG_LOGGING
+    ESP_LOGI("IP","L_Data_Ind::TUNNELLING_FEATURE_SET");
+#endif
+    KNXnetIP_TunnellingFeatureSet(channelId, featureIdentifer, value, context->TxBuffer, &txLength);
+
+    return txLength;
+}
+
+static uint16_t IP_RoutingIndication(IP_ServiceContextType * context)
+{
+    uint16_t cemiLength = context->PduInfoPtr->SduLength - HEADER_SIZE_10;
+
+#ifdef KNXNETIP_DEBUG_LOGGING
+    ESP_LOGI("IP","L_Data_Ind::ROUTING_INDICATION");
+#endif
+    if ((IPV4_UDP == context->Protocol) && (IP_CEMI_MAX_LENGTH >= cemiLength))
     {
+        /* The hop count is updated in place, in the buffer the datagram was received into */
+        KnxFrameBuffer_HandleType frame = IP_TakeCemi(context, HEADER_SIZE_10);
 
+        if (KNX_FRAME_BUFFER_INVALID != frame)
+        {
+            KNXnetIP_RoutingIP2TP(frame, context->IpAddr);
+        }
     }
-//    (void)ack;
-//    (void)addrType;
-//    (void)destAddr;
-//    (void)frameFormat;
-//    (void)octetCount;
-//    (void)priority;
-//    (void)sourceAddr;
+
+    return 0U;
+}
+
+static uint16_t IP_RoutingLostMessage(IP_ServiceContextType * context)
+{
+    KNXnetIP_RoutingLostMessage(&context->PduInfoPtr->SduDataPtr[HEADER_SIZE_10], context->PduInfoPtr->SduLength - HEADER_SIZE_10);
+
+    return 0U;
+}
+
+static uint16_t IP_RoutingBusy(IP_ServiceContextType * context)
+{
+#ifdef KNXNETIP_DEBUG_LOGGING
+    ESP_LOGI("IP","L_Data_Ind::ROUTING_BUSY");
+#endif
+    KNXnetIP_RoutingBusy(&context->PduInfoPtr->SduDataPtr[HEADER_SIZE_10], context->PduInfoPtr->SduLength - HEADER_SIZE_10);
+
+    return 0U;
 }
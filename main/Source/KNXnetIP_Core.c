@@ -20,20 +20,94 @@
 #include "string.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+
+#include "lwip/sockets.h"
 
 #include "KNXnetIP.h"
+#include "KnxTimer.h"
 
 /*==================[macros]================================================*/
+/* Discovery and description responses are composed of fragments, each     */
+/* serialized once. Fragments are indexed by DIB type code, index 0 holds   */
+/* the control endpoint HPAI and the last one the description device DIB.   */
+#define KNXNETIP_FRAGMENT_HPAI               (0x00U)
+#define KNXNETIP_FRAGMENT_DESCRIPTION_DEVICE (0x09U)
+#define KNXNETIP_FRAGMENT_NUM                (0x0AU)
+
+/* Largest fragment, the Device Information DIB */
+#define KNXNETIP_FRAGMENT_SIZE               (56U)
+
+/* Tunnel Information DIB, one 4-byte entry per slot with the status last */
+#define KNXNETIP_SLOT_ENTRY_SIZE             (4U)
+#define KNXNETIP_SLOT_STATUS_OFFSET          (3U)
+
+/* Search Request Parameter header, the mandatory flag is the type MSB */
+#define KNXNETIP_SRP_HEADER_SIZE             (2U)
+#define KNXNETIP_SRP_MANDATORY_FLAG          (0x80U)
+#define KNXNETIP_SRP_TYPE_MASK               (0x7FU)
+
+/* No frame from the client within CONNECTION_ALIVE_TIME ends the connection */
+#define KNXNETIP_CHANNEL_ALIVE_MS            (CONNECTION_ALIVE_TIME * 1000U)
+
+/* Channel ID, reserved and control endpoint HPAI */
+#define KNXNETIP_DISCONNECT_REQUEST_LENGTH   (10U)
 
 /*==================[type definitions]======================================*/
+typedef struct {
+    uint8_t Data[KNXNETIP_FRAGMENT_SIZE];
+    uint16_t Length;
+    uint16_t SlotStatusOffset;  /* Status of the first tunnelling slot, 0 if the fragment has none */
+    uint32_t Epoch;             /* Serialized at this cache epoch */
+} KNXnetIP_ResponseCacheType;
 
 /*==================[external function declarations]========================*/
 
 /*==================[internal function declarations]========================*/
+static uint16_t KNXnetIP_ResponseCompose(const uint8_t * fragments, uint8_t fragmentNum, uint8_t * txBuffer);
+static bool KNXnetIP_SearchParameters(const uint8_t * srpPtr, uint16_t srpLength, uint8_t * fragments, uint8_t * fragmentNum);
+static void KNXnetIP_HpaiEncode(KNXnetIP_ResponseCacheType * cache);
+static void KNXnetIP_DeviceInfoEncode(KNXnetIP_ResponseCacheType * cache);
+static void KNXnetIP_SupportedServicesEncode(KNXnetIP_ResponseCacheType * cache);
+static void KNXnetIP_ExtendedDeviceInfoEncode(KNXnetIP_ResponseCacheType * cache);
+static void KNXnetIP_IpConfigEncode(KNXnetIP_ResponseCacheType * cache);
+static void KNXnetIP_IpCurrentConfigEncode(KNXnetIP_ResponseCacheType * cache);
+static void KNXnetIP_KnxAddressesEncode(KNXnetIP_ResponseCacheType * cache);
+static void KNXnetIP_TunnellingInfoEncode(KNXnetIP_ResponseCacheType * cache);
+static void KNXnetIP_DescriptionDeviceInfoEncode(KNXnetIP_ResponseCacheType * cache);
+static int64_t KNXnetIP_CoreGetTimeMs(void);
+static void KNXnetIP_ChannelHeartbeatExpired(void * context);
 
 /*==================[external constants]====================================*/
 
 /*==================[internal constants]====================================*/
+/* NULL for DIBs this device does not provide */
+static void (* const KNXnetIP_FragmentEncoder[KNXNETIP_FRAGMENT_NUM])(KNXnetIP_ResponseCacheType * cache) = {
+    KNXnetIP_HpaiEncode,                    /* Control endpoint */
+    KNXnetIP_DeviceInfoEncode,              /* DEVICE_INFO */
+    KNXnetIP_SupportedServicesEncode,       /* SUPP_SVC_FAMILIES */
+    KNXnetIP_IpConfigEncode,                /* IP_CONFIG */
+    KNXnetIP_IpCurrentConfigEncode,         /* IP_CUR_CONFIG */
+    KNXnetIP_KnxAddressesEncode,            /* KNX_ADDRESSES */
+    NULL,                                   /* SECURED_SERVICES */
+    KNXnetIP_TunnellingInfoEncode,          /* TUNNELLING_INFO */
+    KNXnetIP_ExtendedDeviceInfoEncode,      /* EXTENDED_DEVICE_INFO */
+    KNXnetIP_DescriptionDeviceInfoEncode,   /* Description device DIB */
+};
+
+static const uint8_t KNXnetIP_SearchFragments[] = {
+    KNXNETIP_FRAGMENT_HPAI, DEVICE_INFO, SUPP_SVC_FAMILIES,
+};
+
+/* Extended search without a Request DIBs SRP */
+static const uint8_t KNXnetIP_SearchExtendedFragments[] = {
+    KNXNETIP_FRAGMENT_HPAI, DEVICE_INFO, SUPP_SVC_FAMILIES, EXTENDED_DEVICE_INFO,
+    IP_CONFIG, IP_CUR_CONFIG, KNX_ADDRESSES, TUNNELLING_INFO,
+};
+
+static const uint8_t KNXnetIP_DescriptionFragments[] = {
+    KNXNETIP_FRAGMENT_DESCRIPTION_DEVICE, SUPP_SVC_FAMILIES,
+};
 
 /*==================[external data]=========================================*/
 extern uint32_t KnxIPInterface_IpAddr;
@@ -50,18 +124,16 @@ static const KNXnetIP_ServiceFamilyType KnxSupportedServiceFamilies[KNX_SUPPORTE
     {KNXNETIP_CORE,       0x02U},
     {KNXNETIP_DEVICEMGMT, 0x02U},
     {KNXNETIP_TUNNELLING, 0x02U},
+    {KNXNETIP_ROUTING,    0x01U},
     {KNXNETIP_SECURE,     0x01U},
 };
 
-static const uint16_t KNXnetIP_KnxIndividualAddresses[KNX_INDIVIDUAL_ADDR_NUM] =
-{
-    KNX_INDIVIDUAL_ADDR,
-    0x11FAU,
-};
-
 static KNXnetIP_TunnelingSlotType KNXnetIP_TunnelingSlot[KNX_TUNNELLING_SLOT_NUM] = 
 {
-    {0x11FAU, KNX_TUNNELLING_SLOT_STATUS_FREE},
+    {KNX_TUNNELLING_SLOT_BASE_ADDR + 0U, KNX_TUNNELLING_SLOT_STATUS_FREE | KNX_TUNNELLING_SLOT_STATUS_USABLE, KNX_CHANNEL_INVALID},
+    {KNX_TUNNELLING_SLOT_BASE_ADDR + 1U, KNX_TUNNELLING_SLOT_STATUS_FREE | KNX_TUNNELLING_SLOT_STATUS_USABLE, KNX_CHANNEL_INVALID},
+    {KNX_TUNNELLING_SLOT_BASE_ADDR + 2U, KNX_TUNNELLING_SLOT_STATUS_FREE | KNX_TUNNELLING_SLOT_STATUS_USABLE, KNX_CHANNEL_INVALID},
+    {KNX_TUNNELLING_SLOT_BASE_ADDR + 3U, KNX_TUNNELLING_SLOT_STATUS_FREE | KNX_TUNNELLING_SLOT_STATUS_USABLE, KNX_CHANNEL_INVALID},
 };
 
 static const uint8_t KnxDeviceFriendlyName[30] = {'A','T','I','O','S',' ','K','N','X',' ','B','R','I','D','G','E'};
@@ -72,95 +144,538 @@ static const uint8_t KnxDeviceMACAddress[6] = {0xCCU, 0x1BU, 0xE0, 0x80U, 0x96U,
 static const uint32_t KnxDeviceMulticastAddr = IP_ADDRESS(224, 0, 23, 12);
 static const uint32_t KnxDeviceZeroAddr = IP_ADDRESS(0, 0, 0, 0);
 
+/* Channel table is shared by the UDP and TCP server tasks */
+static portMUX_TYPE KNXnetIP_ChannelLock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t KNXnetIP_TunnelConnections = 0U;
+
+/* Response cache is shared by the UDP and TCP server tasks, the epoch is   */
+/* bumped by the got-IP handlers. Fragments start at epoch 0 and are        */
+/* serialized on their first use.                                           */
+static portMUX_TYPE KNXnetIP_ResponseCacheLock = portMUX_INITIALIZER_UNLOCKED;
+static KNXnetIP_ResponseCacheType KNXnetIP_ResponseCache[KNXNETIP_FRAGMENT_NUM];
+static uint32_t KNXnetIP_ResponseCacheEpoch = 1U;
+
+/* Protocol timers, indexed by transport, each belongs to the network task serving it */
+static KnxTimer_WheelType KNXnetIP_TimerWheels[KNXNETIP_TRANSPORT_NUM];
+
 /*==================[external function definitions]=========================*/
 
 /*==================[internal function definitions]=========================*/
 
 void KNXnetIP_SearchResponse(uint8_t * txBuffer, uint16_t * txLength);
-void KNXnetIP_SearchResponseExtended(uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_SearchResponseExtended(const uint8_t * srpPtr, uint16_t srpLength, uint8_t * txBuffer, uint16_t * txLength);
 void KNXnetIP_DescriptionResponse(uint8_t * txBuffer, uint16_t * txLength);
-void KNXnetIP_ConnectResponse(KNXnetIP_ErrorCodeType errorCode, KNXnetIP_HPAIType * connectRequestHpai, KNXnetIP_CRIType * cri, uint8_t * txBuffer, uint16_t * txLength);
-void KNXnetIP_ConnectionStateResponse(KNXnetIP_ErrorCodeType errorCode, uint8_t * txBuffer, uint16_t * txLength);
-void KNXnetIP_DisconnectRequest(KNXnetIP_HPAIType * disconnectRequestHpai, uint8_t * txBuffer, uint16_t * txLength );
-void KNXnetIP_DisconnectResponse(uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_ResponseCacheInvalidate(void);
+void KNXnetIP_ConnectResponse(uint8_t channelId, KNXnetIP_ErrorCodeType errorCode, KNXnetIP_HPAIType * dataEndpointHpai, KNXnetIP_CRIType * cri, uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_ConnectionStateResponse(uint8_t channelId, KNXnetIP_ErrorCodeType errorCode, uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_DisconnectRequest(uint8_t channelId, KNXnetIP_HPAIType * disconnectRequestHpai, uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_DisconnectResponse(uint8_t channelId, KNXnetIP_ErrorCodeType errorCode, uint8_t * txBuffer, uint16_t * txLength);
+
+KNXnetIP_ChannelType * KNXnetIP_ChannelAlloc(KNXnetIP_ConnectionType connectionType, KNXnetIP_HostProtocolCodeTpe protocol, int sock);
+KNXnetIP_ChannelType * KNXnetIP_ChannelGet(uint8_t channelId);
+void KNXnetIP_ChannelFree(uint8_t channelId);
+void KNXnetIP_ChannelFreeBySocket(int sock);
+uint8_t KNXnetIP_TunnelConnectionCount(void);
+KNXnetIP_ChannelType * KNXnetIP_ChannelGetByIndvAddr(uint16_t indvAddr);
+void KNXnetIP_ChannelHeartbeat(KNXnetIP_ChannelType * channel);
+void KNXnetIP_ChannelDisconnect(KNXnetIP_ChannelType * channel);
+void KNXnetIP_TimerInit(void);
+void KNXnetIP_TimerArm(uint8_t transport, KnxTimer_Type * timer, uint32_t delayMs);
+uint32_t KNXnetIP_TimerMainFunction(uint8_t transport);
 
 void KNXnetIP_SearchResponse(uint8_t * txBuffer, uint16_t * txLength)
+{
+    *txLength = KNXnetIP_ResponseCompose(&KNXnetIP_SearchFragments[0], sizeof(KNXnetIP_SearchFragments), txBuffer);
+}
+
+void KNXnetIP_SearchResponseExtended(const uint8_t * srpPtr, uint16_t srpLength, uint8_t * txBuffer, uint16_t * txLength)
+{
+    uint8_t fragments[KNXNETIP_FRAGMENT_NUM];
+    uint8_t fragmentNum = 0U;
+
+    if (false == KNXnetIP_SearchParameters(srpPtr, srpLength, &fragments[0], &fragmentNum))
+    {
+        /* Not selected, the request is left unanswered */
+        *txLength = 0U;
+    }
+    else if (0U == fragmentNum)
+    {
+        *txLength = KNXnetIP_ResponseCompose(&KNXnetIP_SearchExtendedFragments[0], sizeof(KNXnetIP_SearchExtendedFragments), txBuffer);
+    }
+    else
+    {
+        *txLength = KNXnetIP_ResponseCompose(&fragments[0], fragmentNum, txBuffer);
+    }
+}
+
+void KNXnetIP_DescriptionResponse(uint8_t * txBuffer, uint16_t * txLength)
+{
+    *txLength = KNXnetIP_ResponseCompose(&KNXnetIP_DescriptionFragments[0], sizeof(KNXnetIP_DescriptionFragments), txBuffer);
+}
+
+void KNXnetIP_ResponseCacheInvalidate(void)
+{
+    /* Called on a new IP address, every response is serialized again */
+    taskENTER_CRITICAL(&KNXnetIP_ResponseCacheLock);
+    KNXnetIP_ResponseCacheEpoch++;
+    taskEXIT_CRITICAL(&KNXnetIP_ResponseCacheLock);
+}
+
+void KNXnetIP_ConnectResponse(uint8_t channelId, KNXnetIP_ErrorCodeType errorCode, KNXnetIP_HPAIType * dataEndpointHpai, KNXnetIP_CRIType * cri, uint8_t * txBuffer, uint16_t * txLength)
 {
     uint16_t txBytes = 0;
 
+    /* Communication Channel ID */
+    txBuffer[txBytes++] = channelId;
+
+    /* Status Code */
+    txBuffer[txBytes++] = errorCode;
+
+    /* A rejected connection carries neither data endpoint nor CRD */
+    if (E_NO_ERROR == errorCode)
+    {
+        /* HPAI Data endpoint - Structure Length */
+        txBuffer[txBytes++] = 0x08U;
+
+        /* HPAI Data endpoint - Host Protocol Code */
+        txBuffer[txBytes++] = dataEndpointHpai->HostProtocolCode;
+
+        /* HPAI Data endpoint - IP Address */
+        txBuffer[txBytes++] = (uint8_t)((dataEndpointHpai->ipAddress >> 24) & 0xFFU);
+        txBuffer[txBytes++] = (uint8_t)((dataEndpointHpai->ipAddress >> 16) & 0xFFU);
+        txBuffer[txBytes++] = (uint8_t)((dataEndpointHpai->ipAddress >> 8) & 0xFFU);
+        txBuffer[txBytes++] = (uint8_t)(dataEndpointHpai->ipAddress & 0xFFU);
+
+        /* HPAI Data endpoint - Port Number */
+        txBuffer[txBytes++] = (uint8_t)((dataEndpointHpai->portNumber >> 8) & 0xFFU);
+        txBuffer[txBytes++] = (uint8_t)(dataEndpointHpai->portNumber & 0xFFU);
+
+        if (TUNNEL_CONNECTION == cri->ConnectionTypeCode)
+        {
+            KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(channelId);
+
+            /* CRD - Structure Length */
+            txBuffer[txBytes++] = 0x04;
+
+            /* CRD - Connection Type Code */
+            txBuffer[txBytes++] = TUNNEL_CONNECTION;
+
+            /* CRD - Individual Address of the tunnelling slot bound to the channel */
+            txBuffer[txBytes++] = (uint8_t)((channel->IndvAddr >> 8) & 0xFFU);
+            txBuffer[txBytes++] = (uint8_t)(channel->IndvAddr & 0xFFU);
+        }
+        else if (DEVICE_MGMT_CONNECTION == cri->ConnectionTypeCode)
+        {
+            /* CRD - Structure Length */
+            txBuffer[txBytes++] = 0x02;
+
+            /* CRD - Connection Type Code */
+            txBuffer[txBytes++] = DEVICE_MGMT_CONNECTION;
+        }
+    }
+
+    /* Update Tx Length */
+    *txLength = txBytes;
+}
+
+void KNXnetIP_ConnectionStateResponse(uint8_t channelId, KNXnetIP_ErrorCodeType errorCode, uint8_t * txBuffer, uint16_t * txLength)
+{
+    uint8_t txBytes = 0;
+
+    /* Communication Channel ID */
+    txBuffer[txBytes++] = channelId;
+
+    /* Status Code */
+    txBuffer[txBytes++] = errorCode;
+
+    /* Update Tx Length */
+    *txLength = txBytes;
+}
+
+void KNXnetIP_DisconnectRequest(uint8_t channelId, KNXnetIP_HPAIType * disconnectRequestHpai, uint8_t * txBuffer, uint16_t * txLength)
+{
+    uint8_t txBytes = 0;
+
+    /* Communication Channel ID */
+    txBuffer[txBytes++] = channelId;
+
+    /* reserved */
+    txBuffer[txBytes++] = 0x00U;
+
     /* HPAI Control endpoint - Structure Length */
     txBuffer[txBytes++] = 0x08U;
 
     /* HPAI Control endpoint - Host Protocol Code */
-    txBuffer[txBytes++] = IPV4_UDP;
+    txBuffer[txBytes++] = disconnectRequestHpai->HostProtocolCode;
 
     /* HPAI Control endpoint - IP Address */
-    txBuffer[txBytes++] = (uint8_t)(KnxIPInterface_IpAddr & 0xFFU);
-    txBuffer[txBytes++] = (uint8_t)((KnxIPInterface_IpAddr >> 8) & 0xFFU);
-    txBuffer[txBytes++] = (uint8_t)((KnxIPInterface_IpAddr >> 16) & 0xFFU);
-    txBuffer[txBytes++] = (uint8_t)((KnxIPInterface_IpAddr >> 24) & 0xFFU);
+    txBuffer[txBytes++] = (uint8_t)((disconnectRequestHpai->ipAddress >> 24) & 0xFFU);
+    txBuffer[txBytes++] = (uint8_t)((disconnectRequestHpai->ipAddress >> 16) & 0xFFU);
+    txBuffer[txBytes++] = (uint8_t)((disconnectRequestHpai->ipAddress >> 8) & 0xFFU);
+    txBuffer[txBytes++] = (uint8_t)(disconnectRequestHpai->ipAddress & 0xFFU);
 
     /* HPAI Control endpoint - Port Number */
-    txBuffer[txBytes++] = (uint8_t)((UDP_PORT >> 8) & 0xFFU);
-    txBuffer[txBytes++] = (uint8_t)(UDP_PORT & 0xFFU);
+    txBuffer[txBytes++] = (uint8_t)((disconnectRequestHpai->portNumber >> 8) & 0xFFU);
+    txBuffer[txBytes++] = (uint8_t)(disconnectRequestHpai->portNumber & 0xFFU);
 
-    /* DIB Device Hardware - Structure Length */
-    txBuffer[txBytes++] = 0x36U;
+    /* Update Tx Length */
+    *txLength = txBytes;
+}
 
-    /* DIB Device Hardware - Description Type Code */
-    txBuffer[txBytes++] = DEVICE_INFO;
+void KNXnetIP_DisconnectResponse(uint8_t channelId, KNXnetIP_ErrorCodeType errorCode, uint8_t * txBuffer, uint16_t * txLength)
+{
+    uint8_t txBytes = 0;
 
-    /* DIB Device Hardware - KNX Medium */
-    txBuffer[txBytes++] = KNX_TP1;
+    /* Communication Channel ID */
+    txBuffer[txBytes++] = channelId;
 
-    /* DIB Device Hardware - Device Status */
-    txBuffer[txBytes++] = 0x00U; /* Programming mode */
+    /* Status Code */
+    txBuffer[txBytes++] = errorCode;
 
-    /* DIB Device Hardware - Individual Address */
-    txBuffer[txBytes++] = (uint8_t)((KNX_INDIVIDUAL_ADDR >> 8) & 0xFFU);
-    txBuffer[txBytes++] = (uint8_t)(KNX_INDIVIDUAL_ADDR & 0xFFU);
+    /* Update Tx Length */
+    *txLength = txBytes;
+}
 
-    /* DIB Device Hardware - Project-InstallationID */
-    txBuffer[txBytes++] = 0x00U;
-    txBuffer[txBytes++] = 0x00U;
+KNXnetIP_ChannelType * KNXnetIP_ChannelAlloc(KNXnetIP_ConnectionType connectionType, KNXnetIP_HostProtocolCodeTpe protocol, int sock)
+{
+    KNXnetIP_ChannelType * channel = NULL;
 
-    /* DIB Device Hardware - Serial Number */
-    memcpy(&txBuffer[txBytes], &KnxDeviceSerialNumber[0], 6U);
-    txBytes += 6;
+    taskENTER_CRITICAL(&KNXnetIP_ChannelLock);
 
-    /* DIB Device Hardware - Routing Multicast Address */
-    memcpy(&txBuffer[txBytes], &KnxDeviceZeroAddr, 4U);
-    txBytes += 4;
+    uint8_t slotIndex = KNX_TUNNELLING_SLOT_INVALID;
 
-    /* DIB Device Hardware - MAC Address */
-    memcpy(&txBuffer[txBytes], &KnxDeviceMACAddress[0], 6U);
-    txBytes += 6;
+    if (TUNNEL_CONNECTION == connectionType)
+    {
+        /* A tunnel needs a free tunnelling slot for its individual address */
+        for (uint8_t index = 0; index < KNX_TUNNELLING_SLOT_NUM; index++)
+        {
+            if (KNX_CHANNEL_INVALID == KNXnetIP_TunnelingSlot[index].ChannelId)
+            {
+                slotIndex = index;
+                break;
+            }
+        }
+    }
 
-    /* DIB Device Hardware - Friendly Name */
-    memcpy(&txBuffer[txBytes], &KnxDeviceFriendlyName[0], 30);
-    txBytes += 30;
+    if ((TUNNEL_CONNECTION != connectionType) || (KNX_TUNNELLING_SLOT_INVALID != slotIndex))
+    {
+        for (uint8_t index = 0; index < KNX_CHANNEL_NUM; index++)
+        {
+            if (CH_FREE == KNXnetIP_Channel[index].ChannelStatus)
+            {
+                channel = &KNXnetIP_Channel[index];
+
+                channel->ChannelStatus = CH_CONNECTED;
+                channel->ConnectionType = connectionType;
+                channel->Protocol = protocol;
+                channel->Socket = (IPV4_TCP == protocol) ? sock : -1;
+                channel->SlotIndex = slotIndex;
+                channel->IndvAddr = KNX_INDIVIDUAL_ADDR;
+                channel->RxSequence = 0U;
+                channel->TxSequence = 0U;
+                channel->Generation++;
+                channel->RxFrameCount = 0U;
+                channel->TxFrameCount = 0U;
+
+                if (TUNNEL_CONNECTION == connectionType)
+                {
+                    KNXnetIP_TunnelingSlot[slotIndex].ChannelId = channel->ChannelId;
+                    KNXnetIP_TunnelingSlot[slotIndex].SlotStatus &= ~KNX_TUNNELLING_SLOT_STATUS_FREE;
+                    channel->IndvAddr = KNXnetIP_TunnelingSlot[slotIndex].IndvAddr;
+
+                    KNXnetIP_TunnelConnections++;
+                }
+                break;
+            }
+        }
+    }
 
-    /* DIB Supported Service Family - Structure Length */
-    txBuffer[txBytes++] = 0x0AU;
+    taskEXIT_CRITICAL(&KNXnetIP_ChannelLock);
 
-    /* DIB Supported Service Family - Description Type Code */
-    txBuffer[txBytes++] = SUPP_SVC_FAMILIES;
+    if (NULL != channel)
+    {
+        /* Allocated by the task serving the transport, the heartbeat runs on its wheel */
+        KnxTimer_Init(&channel->HeartbeatTimer, KNXnetIP_ChannelHeartbeatExpired, channel);
+        KNXnetIP_ChannelHeartbeat(channel);
+    }
 
-    /* DIB Supported Service Family - Supported Service Families */
-    for (uint8_t index = 0; index < KNX_SUPPORTED_SERVICE_NUM; index++)
+    return channel;
+}
+
+KNXnetIP_ChannelType * KNXnetIP_ChannelGet(uint8_t channelId)
+{
+    KNXnetIP_ChannelType * channel = NULL;
+
+    /* Channel IDs are assigned in table order, so the ID is the index */
+    if ((CHANNEL_1 <= channelId) && (KNX_CHANNEL_NUM >= channelId))
     {
-        txBuffer[txBytes++] = KnxSupportedServiceFamilies[index].ServiceFamilyId;
-        txBuffer[txBytes++] = KnxSupportedServiceFamilies[index].ServiceFamilyVersion;
+        channel = &KNXnetIP_Channel[channelId - CHANNEL_1];
+
+        if (CH_CONNECTED != channel->ChannelStatus)
+        {
+            channel = NULL;
+        }
     }
 
-    /* Update Tx Length */
-    *txLength = txBytes;
+    return channel;
+}
+
+void KNXnetIP_ChannelFree(uint8_t channelId)
+{
+    KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(channelId);
+
+    if (NULL != channel)
+    {
+        KnxTimer_Cancel(&channel->HeartbeatTimer);
+
+        taskENTER_CRITICAL(&KNXnetIP_ChannelLock);
+
+        if (TUNNEL_CONNECTION == channel->ConnectionType)
+        {
+            KNXnetIP_TunnelingSlot[channel->SlotIndex].ChannelId = KNX_CHANNEL_INVALID;
+            KNXnetIP_TunnelingSlot[channel->SlotIndex].SlotStatus |= KNX_TUNNELLING_SLOT_STATUS_FREE;
+            channel->SlotIndex = KNX_TUNNELLING_SLOT_INVALID;
+
+            KNXnetIP_TunnelConnections--;
+        }
+
+        channel->ChannelStatus = CH_FREE;
+        channel->Socket = -1;
+
+        taskEXIT_CRITICAL(&KNXnetIP_ChannelLock);
+    }
+}
+
+void KNXnetIP_ChannelFreeBySocket(int sock)
+{
+    /* A KNXnet/IP over TCP connection is bound to its TCP connection */
+    for (uint8_t index = 0; index < KNX_CHANNEL_NUM; index++)
+    {
+        if ((CH_CONNECTED == KNXnetIP_Channel[index].ChannelStatus) &&
+            (IPV4_TCP == KNXnetIP_Channel[index].Protocol) &&
+            (sock == KNXnetIP_Channel[index].Socket))
+        {
+            KNXnetIP_ChannelFree(KNXnetIP_Channel[index].ChannelId);
+        }
+    }
+}
+
+uint8_t KNXnetIP_TunnelConnectionCount(void)
+{
+    return KNXnetIP_TunnelConnections;
+}
+
+KNXnetIP_ChannelType * KNXnetIP_ChannelGetByIndvAddr(uint16_t indvAddr)
+{
+    KNXnetIP_ChannelType * channel = NULL;
+
+    for (uint8_t index = 0; index < KNX_TUNNELLING_SLOT_NUM; index++)
+    {
+        if (indvAddr == KNXnetIP_TunnelingSlot[index].IndvAddr)
+        {
+            channel = KNXnetIP_ChannelGet(KNXnetIP_TunnelingSlot[index].ChannelId);
+            break;
+        }
+    }
+
+    return channel;
+}
+
+void KNXnetIP_ChannelHeartbeat(KNXnetIP_ChannelType * channel)
+{
+    /* Restarted by every frame of the client received on the channel */
+    KNXnetIP_TimerArm(KNXNETIP_TRANSPORT_INDEX(channel->Protocol), &channel->HeartbeatTimer, KNXNETIP_CHANNEL_ALIVE_MS);
 }
 
-void KNXnetIP_SearchResponseExtended(uint8_t * txBuffer, uint16_t * txLength)
+void KNXnetIP_ChannelDisconnect(KNXnetIP_ChannelType * channel)
 {
+    KNXnetIP_HPAIType controlEndpoint = {
+        .StructureLength = 0x08U,
+        .HostProtocolCode = channel->Protocol,
+        .ipAddress = 0U,
+        .portNumber = 0U,
+    };
+    uint8_t body[KNXNETIP_DISCONNECT_REQUEST_LENGTH];
+    uint16_t bodyLength = 0U;
+    uint8_t channelId = channel->ChannelId;
+    KNXnetIP_TxFrameType txFrame;
+
+    if (IPV4_UDP == channel->Protocol)
+    {
+        controlEndpoint.ipAddress = ntohl(KnxIPInterface_IpAddr);
+        controlEndpoint.portNumber = UDP_PORT;
+    }
+
+    /* Server initiated, the DISCONNECT_RESPONSE is not waited for */
+    KNXnetIP_DisconnectRequest(channelId, &controlEndpoint, &body[0], &bodyLength);
+
+    KNXnetIP_TxFrameInit(&txFrame, DISCONNECT_REQUEST);
+    KNXnetIP_TxFrameAppend(&txFrame, &body[0], bodyLength);
+
+    if (IPV4_TCP == channel->Protocol)
+    {
+        KNXnetIP_TcpSend(channel->Socket, &txFrame);
+    }
+    else
+    {
+        KNXnetIP_UDPSend(channel->ControlHpai.ipAddress, channel->ControlHpai.portNumber, &txFrame);
+    }
+
+    if (IPV4_UDP == channel->Protocol)
+    {
+        /* Requests still waiting for a TUNNELLING_ACK go back to the pool */
+        KNXnetIP_TunnellingReset(channelId);
+    }
+
+    KNXnetIP_ChannelFree(channelId);
+}
+
+void KNXnetIP_TimerInit(void)
+{
+    for (uint8_t transport = 0; transport < KNXNETIP_TRANSPORT_NUM; transport++)
+    {
+        KnxTimer_WheelInit(&KNXnetIP_TimerWheels[transport], KNXnetIP_CoreGetTimeMs());
+    }
+}
+
+void KNXnetIP_TimerArm(uint8_t transport, KnxTimer_Type * timer, uint32_t delayMs)
+{
+    /* Only the task serving the transport arms its timers, counted from now */
+    KnxTimer_Arm(&KNXnetIP_TimerWheels[transport], timer, KNXnetIP_CoreGetTimeMs(), delayMs);
+}
+
+uint32_t KNXnetIP_TimerMainFunction(uint8_t transport)
+{
+    /* Runs the expired timers of the calling task, returns the time to the next one */
+    return KnxTimer_Advance(&KNXnetIP_TimerWheels[transport], KNXnetIP_CoreGetTimeMs());
+}
+
+static uint16_t KNXnetIP_ResponseCompose(const uint8_t * fragments, uint8_t fragmentNum, uint8_t * txBuffer)
+{
+    uint16_t txBytes = 0;
+    uint16_t slotStatusOffset = 0U;
+
+    taskENTER_CRITICAL(&KNXnetIP_ResponseCacheLock);
+
+    for (uint8_t index = 0; index < fragmentNum; index++)
+    {
+        KNXnetIP_ResponseCacheType * cache = &KNXnetIP_ResponseCache[fragments[index]];
+
+        if (KNXnetIP_ResponseCacheEpoch != cache->Epoch)
+        {
+            KNXnetIP_FragmentEncoder[fragments[index]](cache);
+            cache->Epoch = KNXnetIP_ResponseCacheEpoch;
+        }
+
+        if (0U != cache->SlotStatusOffset)
+        {
+            slotStatusOffset = txBytes + cache->SlotStatusOffset;
+        }
+
+        memcpy(&txBuffer[txBytes], &cache->Data[0], cache->Length);
+        txBytes += cache->Length;
+    }
+
+    taskEXIT_CRITICAL(&KNXnetIP_ResponseCacheLock);
+
+    /* Slot status changes with every connect and disconnect, patched per response */
+    if (0U != slotStatusOffset)
+    {
+        for (uint8_t index = 0; index < KNX_TUNNELLING_SLOT_NUM; index++)
+        {
+            txBuffer[slotStatusOffset + (index * KNXNETIP_SLOT_ENTRY_SIZE)] = KNXnetIP_TunnelingSlot[index].SlotStatus;
+        }
+    }
+
+    return txBytes;
+}
+
+static bool KNXnetIP_SearchParameters(const uint8_t * srpPtr, uint16_t srpLength, uint8_t * fragments, uint8_t * fragmentNum)
+{
+    bool selected = true;
+    uint16_t requested = 0U;
+    uint16_t srpIndex = 0U;
+
+    /* Walk the SRP blocks until one of them deselects this device */
+    while ((true == selected) && ((srpIndex + KNXNETIP_SRP_HEADER_SIZE) <= srpLength))
+    {
+        uint8_t structureLength = srpPtr[srpIndex];
+        uint8_t srpType = srpPtr[srpIndex + 1U] & KNXNETIP_SRP_TYPE_MASK;
+        const uint8_t * srpData = &srpPtr[srpIndex + KNXNETIP_SRP_HEADER_SIZE];
+        uint8_t dataLength = structureLength - KNXNETIP_SRP_HEADER_SIZE;
+
+        if ((KNXNETIP_SRP_HEADER_SIZE > structureLength) || ((srpIndex + structureLength) > srpLength))
+        {
+            /* Malformed request */
+            selected = false;
+        }
+        else if (SRP_SELECT_BY_PROGRAMMING_MODE == srpType)
+        {
+            /* Device status is never in programming mode */
+            selected = false;
+        }
+        else if (SRP_SELECT_BY_MAC_ADDRESS == srpType)
+        {
+            selected = ((sizeof(KnxDeviceMACAddress) <= dataLength) &&
+                        (0 == memcmp(srpData, &KnxDeviceMACAddress[0], sizeof(KnxDeviceMACAddress))));
+        }
+        else if (SRP_SELECT_BY_SERVICE == srpType)
+        {
+            selected = false;
+
+            for (uint8_t index = 0; (2U <= dataLength) && (index < KNX_SUPPORTED_SERVICE_NUM); index++)
+            {
+                if ((srpData[0] == KnxSupportedServiceFamilies[index].ServiceFamilyId) &&
+                    (srpData[1] <= KnxSupportedServiceFamilies[index].ServiceFamilyVersion))
+                {
+                    selected = true;
+                }
+            }
+        }
+        else if (SRP_REQUEST_DIBS == srpType)
+        {
+            /* Device information and supported services are always part of the response */
+            if (0U == *fragmentNum)
+            {
+                fragments[(*fragmentNum)++] = KNXNETIP_FRAGMENT_HPAI;
+                fragments[(*fragmentNum)++] = DEVICE_INFO;
+                fragments[(*fragmentNum)++] = SUPP_SVC_FAMILIES;
+                requested = (1U << DEVICE_INFO) | (1U << SUPP_SVC_FAMILIES);
+            }
+
+            /* Unknown DIBs and the zero padding are skipped */
+            for (uint8_t index = 0; index < dataLength; index++)
+            {
+                uint8_t dib = srpData[index];
+
+                if ((KNXNETIP_FRAGMENT_HPAI < dib) && (KNXNETIP_FRAGMENT_DESCRIPTION_DEVICE > dib) &&
+                    (NULL != KNXnetIP_FragmentEncoder[dib]) && (0U == (requested & (1U << dib))))
+                {
+                    fragments[(*fragmentNum)++] = dib;
+                    requested |= (uint16_t)(1U << dib);
+                }
+            }
+        }
+        else if (KNXNETIP_SRP_MANDATORY_FLAG == (srpPtr[srpIndex + 1U] & KNXNETIP_SRP_MANDATORY_FLAG))
+        {
+            /* Unsupported SRP the client insists on */
+            selected = false;
+        }
+        else
+        {
+            /* Unsupported optional SRP, ignored */
+        }
+
+        srpIndex += structureLength;
+    }
+
+    return selected;
+}
+
+static void KNXnetIP_HpaiEncode(KNXnetIP_ResponseCacheType * cache)
+{
+    uint8_t * txBuffer = &cache->Data[0];
     uint16_t txBytes = 0;
-    uint8_t index = 0;
 
     /* HPAI Control endpoint - Structure Length */
     txBuffer[txBytes++] = 0x08U;
@@ -178,6 +693,15 @@ void KNXnetIP_SearchResponseExtended(uint8_t * txBuffer, uint16_t * txLength)
     txBuffer[txBytes++] = (uint8_t)((UDP_PORT >> 8) & 0xFFU);
     txBuffer[txBytes++] = (uint8_t)(UDP_PORT & 0xFFU);
 
+    cache->Length = txBytes;
+    cache->SlotStatusOffset = 0U;
+}
+
+static void KNXnetIP_DeviceInfoEncode(KNXnetIP_ResponseCacheType * cache)
+{
+    uint8_t * txBuffer = &cache->Data[0];
+    uint16_t txBytes = 0;
+
     /* DIB Device Hardware - Structure Length */
     txBuffer[txBytes++] = 0x36U;
 
@@ -203,7 +727,7 @@ void KNXnetIP_SearchResponseExtended(uint8_t * txBuffer, uint16_t * txLength)
     txBytes += 6;
 
     /* DIB Device Hardware - Routing Multicast Address */
-    memcpy(&txBuffer[txBytes], &KnxDeviceZeroAddr, 4U);
+    memcpy(&txBuffer[txBytes], &KnxDeviceMulticastAddr, 4U);
     txBytes += 4;
 
     /* DIB Device Hardware - MAC Address */
@@ -214,19 +738,37 @@ void KNXnetIP_SearchResponseExtended(uint8_t * txBuffer, uint16_t * txLength)
     memcpy(&txBuffer[txBytes], &KnxDeviceFriendlyName[0], 30);
     txBytes += 30;
 
+    cache->Length = txBytes;
+    cache->SlotStatusOffset = 0U;
+}
+
+static void KNXnetIP_SupportedServicesEncode(KNXnetIP_ResponseCacheType * cache)
+{
+    uint8_t * txBuffer = &cache->Data[0];
+    uint16_t txBytes = 0;
+
     /* DIB Supported Service Family - Structure Length */
-    txBuffer[txBytes++] = 0x0AU;
+    txBuffer[txBytes++] = KNX_SUPPORTED_SERVICE_DIB_LENGTH;
 
     /* DIB Supported Service Family - Description Type Code */
     txBuffer[txBytes++] = SUPP_SVC_FAMILIES;
 
     /* DIB Supported Service Family - Supported Service Families */
-    for (index = 0; index < KNX_SUPPORTED_SERVICE_NUM; index++)
+    for (uint8_t index = 0; index < KNX_SUPPORTED_SERVICE_NUM; index++)
     {
         txBuffer[txBytes++] = KnxSupportedServiceFamilies[index].ServiceFamilyId;
         txBuffer[txBytes++] = KnxSupportedServiceFamilies[index].ServiceFamilyVersion;
     }
 
+    cache->Length = txBytes;
+    cache->SlotStatusOffset = 0U;
+}
+
+static void KNXnetIP_ExtendedDeviceInfoEncode(KNXnetIP_ResponseCacheType * cache)
+{
+    uint8_t * txBuffer = &cache->Data[0];
+    uint16_t txBytes = 0;
+
     /* DIB Extended Device Information - Structure Length*/
     txBuffer[txBytes++] = 0x08U;
 
@@ -249,6 +791,15 @@ void KNXnetIP_SearchResponseExtended(uint8_t * txBuffer, uint16_t * txLength)
     txBuffer[txBytes++] = (uint8_t)((KNXNETIP_SYS7 >> 8) & 0xFFU);
     txBuffer[txBytes++] = (uint8_t)(KNXNETIP_SYS7 & 0xFFU);
 
+    cache->Length = txBytes;
+    cache->SlotStatusOffset = 0U;
+}
+
+static void KNXnetIP_IpConfigEncode(KNXnetIP_ResponseCacheType * cache)
+{
+    uint8_t * txBuffer = &cache->Data[0];
+    uint16_t txBytes = 0;
+
     /* DIB Ip Config - Structure Length */
     txBuffer[txBytes++] = 0x10U;
 
@@ -279,6 +830,15 @@ void KNXnetIP_SearchResponseExtended(uint8_t * txBuffer, uint16_t * txLength)
     /* DIB Ip Config - IP Assignment */
     txBuffer[txBytes++] = 0x04; /* DHCP */
 
+    cache->Length = txBytes;
+    cache->SlotStatusOffset = 0U;
+}
+
+static void KNXnetIP_IpCurrentConfigEncode(KNXnetIP_ResponseCacheType * cache)
+{
+    uint8_t * txBuffer = &cache->Data[0];
+    uint16_t txBytes = 0;
+
     /* DIB Current Config - Structure Length */
     txBuffer[txBytes++] = 0x14U;
 
@@ -315,21 +875,43 @@ void KNXnetIP_SearchResponseExtended(uint8_t * txBuffer, uint16_t * txLength)
     /* DIB Current Config - Reserved */
     txBuffer[txBytes++] = 0x00U;
 
+    cache->Length = txBytes;
+    cache->SlotStatusOffset = 0U;
+}
+
+static void KNXnetIP_KnxAddressesEncode(KNXnetIP_ResponseCacheType * cache)
+{
+    uint8_t * txBuffer = &cache->Data[0];
+    uint16_t txBytes = 0;
+
     /* DIB Knx Address - Structure Length */
-    txBuffer[txBytes++] = 0x06U;
+    txBuffer[txBytes++] = 2U + (2U * KNX_INDIVIDUAL_ADDR_NUM);
 
     /* DIB Knx Address - Description Type Code */
     txBuffer[txBytes++] = KNX_ADDRESSES;
 
     /* DIB Knx Address - KNX Individual Address */
-    for (index = 0; index < KNX_INDIVIDUAL_ADDR_NUM; index++)
+    txBuffer[txBytes++] = (uint8_t)((KNX_INDIVIDUAL_ADDR >> 8) & 0xFFU);
+    txBuffer[txBytes++] = (uint8_t)(KNX_INDIVIDUAL_ADDR & 0xFFU);
+
+    /* DIB Knx Address - Additional Individual Addresses (tunnelling slots) */
+    for (uint8_t index = 0; index < KNX_TUNNELLING_SLOT_NUM; index++)
     {
-        txBuffer[txBytes++] = (uint8_t)((KNXnetIP_KnxIndividualAddresses[index] >> 8) & 0xFFU);
-        txBuffer[txBytes++] = (uint8_t)(KNXnetIP_KnxIndividualAddresses[index] & 0xFFU);
+        txBuffer[txBytes++] = (uint8_t)((KNXnetIP_TunnelingSlot[index].IndvAddr >> 8) & 0xFFU);
+        txBuffer[txBytes++] = (uint8_t)(KNXnetIP_TunnelingSlot[index].IndvAddr & 0xFFU);
     }
 
+    cache->Length = txBytes;
+    cache->SlotStatusOffset = 0U;
+}
+
+static void KNXnetIP_TunnellingInfoEncode(KNXnetIP_ResponseCacheType * cache)
+{
+    uint8_t * txBuffer = &cache->Data[0];
+    uint16_t txBytes = 0;
+
     /* DIB Tunnel Information - Structure Length */
-    txBuffer[txBytes++] = 0x08U;
+    txBuffer[txBytes++] = 4U + (4U * KNX_TUNNELLING_SLOT_NUM);
 
     /* DIB Tunnel Information - Description Type Code */
     txBuffer[txBytes++] = TUNNELLING_INFO;
@@ -339,24 +921,25 @@ void KNXnetIP_SearchResponseExtended(uint8_t * txBuffer, uint16_t * txLength)
     txBuffer[txBytes++] = 0xF0U;
 
     /* DIB Tunnel Information - Tunneling Slot */
-    for (index = 0; index < KNX_TUNNELLING_SLOT_NUM; index++)
+    cache->SlotStatusOffset = txBytes + KNXNETIP_SLOT_STATUS_OFFSET;
+    for (uint8_t index = 0; index < KNX_TUNNELLING_SLOT_NUM; index++)
     {
         txBuffer[txBytes++] = (uint8_t)((KNXnetIP_TunnelingSlot[index].IndvAddr >> 8) & 0xFFU);
         txBuffer[txBytes++] = (uint8_t)(KNXnetIP_TunnelingSlot[index].IndvAddr & 0xFFU);
 
         /* Reserved */
-        txBuffer[txBytes++] = 0x00; 
+        txBuffer[txBytes++] = 0x00;
 
         /* Slot Status */
         txBuffer[txBytes++] = KNXnetIP_TunnelingSlot[index].SlotStatus;
     }
 
-    /* Update Tx Length */
-    *txLength = txBytes;
+    cache->Length = txBytes;
 }
 
-void KNXnetIP_DescriptionResponse(uint8_t * txBuffer, uint16_t * txLength)
+static void KNXnetIP_DescriptionDeviceInfoEncode(KNXnetIP_ResponseCacheType * cache)
 {
+    uint8_t * txBuffer = &cache->Data[0];
     uint16_t txBytes = 0;
 
     /* DIB Device Hardware - Structure Length */
@@ -395,130 +978,22 @@ void KNXnetIP_DescriptionResponse(uint8_t * txBuffer, uint16_t * txLength)
     memcpy(&txBuffer[txBytes], &KnxDeviceFriendlyName[0], 30);
     txBytes += 30;
 
-    /* DIB Supported Service Family - Structure Length */
-    txBuffer[txBytes++] = 0x0AU;
-
-    /* DIB Supported Service Family - Description Type Code */
-    txBuffer[txBytes++] = SUPP_SVC_FAMILIES;
-
-    /* DIB Supported Service Family - Supported Service Families */
-    for (uint8_t index = 0; index < KNX_SUPPORTED_SERVICE_NUM; index++)
-    {
-        txBuffer[txBytes++] = KnxSupportedServiceFamilies[index].ServiceFamilyId;
-        txBuffer[txBytes++] = KnxSupportedServiceFamilies[index].ServiceFamilyVersion;
-    }
-
-    /* Update Tx Length */
-    *txLength = txBytes;
-}
-
-void KNXnetIP_ConnectResponse(KNXnetIP_ErrorCodeType errorCode, KNXnetIP_HPAIType * connectRequestHpai, KNXnetIP_CRIType * cri, uint8_t * txBuffer, uint16_t * txLength)
-{
-    uint16_t txBytes = 0;
-
-    /* Communication Channel ID */
-    txBuffer[txBytes++] = KNXnetIP_Channel[0].ChannelId;
-
-    /* Status Code */
-    txBuffer[txBytes++] = errorCode;
-
-    /* HPAI Control endpoint - Structure Length */
-    txBuffer[txBytes++] = 0x08U;
-
-    /* HPAI Control endpoint - Host Protocol Code */
-    txBuffer[txBytes++] = connectRequestHpai->HostProtocolCode;
-
-    /* HPAI Control endpoint - IP Address */
-    txBuffer[txBytes++] = (uint8_t)((connectRequestHpai->ipAddress >> 24) & 0xFFU);
-    txBuffer[txBytes++] = (uint8_t)((connectRequestHpai->ipAddress >> 16) & 0xFFU);
-    txBuffer[txBytes++] = (uint8_t)((connectRequestHpai->ipAddress >> 8) & 0xFFU);
-    txBuffer[txBytes++] = (uint8_t)(connectRequestHpai->ipAddress & 0xFFU);
-
-    /* HPAI Control endpoint - Port Number */
-    txBuffer[txBytes++] = (uint8_t)((connectRequestHpai->portNumber >> 8) & 0xFFU);
-    txBuffer[txBytes++] = (uint8_t)(connectRequestHpai->portNumber & 0xFFU);
-
-    if (TUNNEL_CONNECTION == cri->ConnectionTypeCode)
-    {
-        /* CRD - Structure Length */
-        txBuffer[txBytes++] = 0x04;
-
-        /* CRD - Connection Type Code */
-        txBuffer[txBytes++] = TUNNEL_CONNECTION;
-
-        /* CRD - Individual Address */
-        txBuffer[txBytes++] = (uint8_t)((KNXnetIP_TunnelingSlot[0].IndvAddr >> 8) & 0xFFU);
-        txBuffer[txBytes++] = (uint8_t)(KNXnetIP_TunnelingSlot[0].IndvAddr & 0xFFU);
-    }
-    else if (DEVICE_MGMT_CONNECTION == cri->ConnectionTypeCode)
-    {
-        /* CRD - Structure Length */
-        txBuffer[txBytes++] = 0x02;
-
-        /* CRD - Connection Type Code */
-        txBuffer[txBytes++] = DEVICE_MGMT_CONNECTION;
-    }
-
-    /* Update Tx Length */
-    *txLength = txBytes;
-}
-
-void KNXnetIP_ConnectionStateResponse(KNXnetIP_ErrorCodeType errorCode, uint8_t * txBuffer, uint16_t * txLength)
-{
-    uint8_t txBytes = 0;
-
-    /* Communication Channel ID */
-    txBuffer[txBytes++] = KNXnetIP_Channel[0].ChannelId;
-
-    /* Status Code */
-    txBuffer[txBytes++] = errorCode;
-
-    /* Update Tx Length */
-    *txLength = txBytes;
+    cache->Length = txBytes;
+    cache->SlotStatusOffset = 0U;
 }
 
-void KNXnetIP_DisconnectRequest(KNXnetIP_HPAIType * disconnectRequestHpai, uint8_t * txBuffer, uint16_t * txLength)
+static int64_t KNXnetIP_CoreGetTimeMs(void)
 {
-    uint8_t txBytes = 0;
-
-    /* Communication Channel ID */
-    txBuffer[txBytes++] = KNXnetIP_Channel[0].ChannelId;
-
-    /* reserved */
-    txBuffer[txBytes++] = 0x00U;
-
-    /* HPAI Control endpoint - Structure Length */
-    txBuffer[txBytes++] = 0x08U;
-
-    /* HPAI Control endpoint - Host Protocol Code */
-    txBuffer[txBytes++] = disconnectRequestHpai->HostProtocolCode;
-
-    /* HPAI Control endpoint - IP Address */
-    txBuffer[txBytes++] = (uint8_t)((disconnectRequestHpai->ipAddress >> 24) & 0xFFU);
-    txBuffer[txBytes++] = (uint8_t)((disconnectRequestHpai->ipAddress >> 16) & 0xFFU);
-    txBuffer[txBytes++] = (uint8_t)((disconnectRequestHpai->ipAddress >> 8) & 0xFFU);
-    txBuffer[txBytes++] = (uint8_t)(disconnectRequestHpai->ipAddress & 0xFFU);
-
-    /* HPAI Control endpoint - Port Number */
-    txBuffer[txBytes++] = (uint8_t)((disconnectRequestHpai->portNumber >> 8) & 0xFFU);
-    txBuffer[txBytes++] = (uint8_t)(disconnectRequestHpai->portNumber & 0xFFU);
-
-    /* Update Tx Length */
-    *txLength = txBytes;
+    return (esp_timer_get_time() / 1000);
 }
 
-void KNXnetIP_DisconnectResponse(uint8_t * txBuffer, uint16_t * txLength)
+static void KNXnetIP_ChannelHeartbeatExpired(void * context)
 {
-    uint8_t txBytes = 0;
+    KNXnetIP_ChannelType * channel = (KNXnetIP_ChannelType *)context;
 
-    /* Communication Channel ID */
-    txBuffer[txBytes++] = KNXnetIP_Channel[0].ChannelId;
-
-    /* Status Code */
-    txBuffer[txBytes++] = E_NO_ERROR;
+    ESP_LOGW("IP", "Channel %d: no frame within %u s, disconnecting", channel->ChannelId, CONNECTION_ALIVE_TIME);
 
-    /* Update Tx Length */
-    *txLength = txBytes;
+    KNXnetIP_ChannelDisconnect(channel);
 }
 
 /*==================[end of file]===========================================*/
@@ -0,0 +1,235 @@
+/**
+ * \file KNXnetIP_Discovery.c
+ *
+ * \brief KNXnet/IP Discovery Flow Control
+ *
+ * This file contains the per-source rate limiting of control endpoint
+ * services and the randomized delay of search responses
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include "freertos/FreeRTOS.h"
+#include "string.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <sys/param.h>
+
+#include "KNXnetIP.h"
+#include "KNXnetIP_Discovery.h"
+
+/*==================[macros]================================================*/
+/* Largest search response, header included */
+#define KNXNETIP_DISCOVERY_FRAME_SIZE    (256U)
+
+/* Drop counters are logged at most this often */
+#define KNXNETIP_DISCOVERY_REPORT_MS     (10000U)
+
+/*==================[type definitions]======================================*/
+typedef struct {
+    uint32_t IpAddr;         /* Keyed on the host alone, ports are free to pick */
+    int64_t NextMs;          /* Virtual request time of the rate limiter, 0 if unused */
+} KNXnetIP_DiscoverySourceType;
+
+typedef struct {
+    uint32_t IpAddr;
+    uint16_t Port;
+    uint16_t ServiceType;    /* Search request answered, 0 if the slot is free */
+    int64_t DueMs;
+    KNXnetIP_TxFrameType Frame;    /* Header kept as built, the body points into Data */
+    uint8_t Data[KNXNETIP_DISCOVERY_FRAME_SIZE];
+} KNXnetIP_DiscoveryPendingType;
+
+/*==================[external function declarations]========================*/
+void KNXnetIP_DiscoveryInit(void);
+uint32_t KNXnetIP_DiscoveryMainFunction(void);
+bool KNXnetIP_DiscoveryAdmit(uint32_t ipAddr, uint16_t port, uint16_t serviceType);
+void KNXnetIP_DiscoveryDefer(uint32_t ipAddr, uint16_t port, uint16_t serviceType, const KNXnetIP_TxFrameType * txFrame);
+const KNXnetIP_DiscoveryStatisticsType * KNXnetIP_DiscoveryStatistics(void);
+
+/*==================[internal function declarations]========================*/
+static int64_t KNXnetIP_DiscoveryGetTimeMs(void);
+static KNXnetIP_DiscoveryPendingType * KNXnetIP_DiscoveryPendingGet(uint32_t ipAddr, uint16_t port, uint16_t serviceType);
+static KNXnetIP_DiscoverySourceType * KNXnetIP_DiscoverySourceGet(uint32_t ipAddr);
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+/* Everything below belongs to the UDP task */
+static KNXnetIP_DiscoverySourceType KNXnetIP_DiscoverySource[KNXNETIP_DISCOVERY_SOURCE_NUM];
+static KNXnetIP_DiscoveryPendingType KNXnetIP_DiscoveryPending[KNXNETIP_DISCOVERY_PENDING_NUM];
+static KNXnetIP_DiscoveryStatisticsType KNXnetIP_DiscoveryStatistic;
+static KNXnetIP_DiscoveryStatisticsType KNXnetIP_DiscoveryReported;
+static int64_t KNXnetIP_DiscoveryReportMs;
+
+/*==================[external function definitions]=========================*/
+void KNXnetIP_DiscoveryInit(void)
+{
+    memset(&KNXnetIP_DiscoverySource[0], 0, sizeof(KNXnetIP_DiscoverySource));
+    memset(&KNXnetIP_DiscoveryPending[0], 0, sizeof(KNXnetIP_DiscoveryPending));
+    memset(&KNXnetIP_DiscoveryStatistic, 0, sizeof(KNXnetIP_DiscoveryStatistic));
+    memset(&KNXnetIP_DiscoveryReported, 0, sizeof(KNXnetIP_DiscoveryReported));
+    KNXnetIP_DiscoveryReportMs = 0;
+}
+
+uint32_t KNXnetIP_DiscoveryMainFunction(void)
+{
+    uint32_t timeoutMs = KNXNETIP_DISCOVERY_NO_TIMEOUT;
+    int64_t nowMs = KNXnetIP_DiscoveryGetTimeMs();
+
+    for (uint8_t index = 0; index < KNXNETIP_DISCOVERY_PENDING_NUM; index++)
+    {
+        KNXnetIP_DiscoveryPendingType * pending = &KNXnetIP_DiscoveryPending[index];
+
+        if (0U == pending->ServiceType)
+        {
+            /* Free slot */
+        }
+        else if (nowMs >= pending->DueMs)
+        {
+            KNXnetIP_UDPSend(pending->IpAddr, pending->Port, &pending->Frame);
+            pending->ServiceType = 0U;
+        }
+        else
+        {
+            timeoutMs = MIN(timeoutMs, (uint32_t)(pending->DueMs - nowMs));
+        }
+    }
+
+    if ((nowMs >= KNXnetIP_DiscoveryReportMs) &&
+        (0 != memcmp(&KNXnetIP_DiscoveryStatistic, &KNXnetIP_DiscoveryReported, sizeof(KNXnetIP_DiscoveryStatistic))))
+    {
+        ESP_LOGW("IP", "Discovery: %lu rate limited, %lu collapsed, %lu sent undelayed",
+                 (unsigned long)KNXnetIP_DiscoveryStatistic.RateLimited,
+                 (unsigned long)KNXnetIP_DiscoveryStatistic.Collapsed,
+                 (unsigned long)KNXnetIP_DiscoveryStatistic.PendingFull);
+
+        KNXnetIP_DiscoveryReported = KNXnetIP_DiscoveryStatistic;
+        KNXnetIP_DiscoveryReportMs = nowMs + KNXNETIP_DISCOVERY_REPORT_MS;
+    }
+
+    return timeoutMs;
+}
+
+bool KNXnetIP_DiscoveryAdmit(uint32_t ipAddr, uint16_t port, uint16_t serviceType)
+{
+    bool admit = false;
+    int64_t nowMs = KNXnetIP_DiscoveryGetTimeMs();
+    KNXnetIP_DiscoverySourceType * source = KNXnetIP_DiscoverySourceGet(ipAddr);
+
+    if (NULL != KNXnetIP_DiscoveryPendingGet(ipAddr, port, serviceType))
+    {
+        /* Same search again before the response went out, one response covers both */
+        KNXnetIP_DiscoveryStatistic.Collapsed++;
+    }
+    else if (nowMs < (source->NextMs - ((KNXNETIP_DISCOVERY_BURST - 1U) * KNXNETIP_DISCOVERY_INTERVAL_MS)))
+    {
+        /* Bucket of this source is empty */
+        KNXnetIP_DiscoveryStatistic.RateLimited++;
+    }
+    else
+    {
+        source->NextMs = MAX(source->NextMs, nowMs) + KNXNETIP_DISCOVERY_INTERVAL_MS;
+        admit = true;
+    }
+
+    return admit;
+}
+
+void KNXnetIP_DiscoveryDefer(uint32_t ipAddr, uint16_t port, uint16_t serviceType, const KNXnetIP_TxFrameType * txFrame)
+{
+    KNXnetIP_DiscoveryPendingType * pending = KNXnetIP_DiscoveryPendingGet(0U, 0U, 0U);
+
+    if ((NULL == pending) || (KNXNETIP_DISCOVERY_FRAME_SIZE < txFrame->Length))
+    {
+        /* No room to hold it back, answer at once */
+        KNXnetIP_DiscoveryStatistic.PendingFull++;
+        KNXnetIP_UDPSend(ipAddr, port, txFrame);
+    }
+    else
+    {
+        uint16_t bodyLength = KNXnetIP_TxFrameGather(txFrame, txFrame->HeaderLength, &pending->Data[0]);
+
+        pending->IpAddr = ipAddr;
+        pending->Port = port;
+        pending->ServiceType = serviceType;
+        pending->DueMs = KNXnetIP_DiscoveryGetTimeMs() + (esp_random() % (KNXNETIP_DISCOVERY_DELAY_MAX_MS + 1U));
+
+        /* The body outlives the buffer of the handler only as this copy */
+        pending->Frame = *txFrame;
+        pending->Frame.SegmentCount = 0U;
+        pending->Frame.Length = pending->Frame.HeaderLength;
+        KNXnetIP_TxFrameAppend(&pending->Frame, &pending->Data[0], bodyLength);
+    }
+}
+
+const KNXnetIP_DiscoveryStatisticsType * KNXnetIP_DiscoveryStatistics(void)
+{
+    return &KNXnetIP_DiscoveryStatistic;
+}
+
+/*==================[internal function definitions]=========================*/
+static int64_t KNXnetIP_DiscoveryGetTimeMs(void)
+{
+    return (esp_timer_get_time() / 1000);
+}
+
+static KNXnetIP_DiscoveryPendingType * KNXnetIP_DiscoveryPendingGet(uint32_t ipAddr, uint16_t port, uint16_t serviceType)
+{
+    KNXnetIP_DiscoveryPendingType * pending = NULL;
+
+    /* Service type 0 finds a free slot */
+    for (uint8_t index = 0; (NULL == pending) && (index < KNXNETIP_DISCOVERY_PENDING_NUM); index++)
+    {
+        if ((serviceType == KNXnetIP_DiscoveryPending[index].ServiceType) &&
+            ((0U == serviceType) ||
+             ((ipAddr == KNXnetIP_DiscoveryPending[index].IpAddr) && (port == KNXnetIP_DiscoveryPending[index].Port))))
+        {
+            pending = &KNXnetIP_DiscoveryPending[index];
+        }
+    }
+
+    return pending;
+}
+
+static KNXnetIP_DiscoverySourceType * KNXnetIP_DiscoverySourceGet(uint32_t ipAddr)
+{
+    KNXnetIP_DiscoverySourceType * source = NULL;
+    KNXnetIP_DiscoverySourceType * idlest = &KNXnetIP_DiscoverySource[0];
+
+    for (uint8_t index = 0; (NULL == source) && (index < KNXNETIP_DISCOVERY_SOURCE_NUM); index++)
+    {
+        if (ipAddr == KNXnetIP_DiscoverySource[index].IpAddr)
+        {
+            source = &KNXnetIP_DiscoverySource[index];
+        }
+        else if (KNXnetIP_DiscoverySource[index].NextMs < idlest->NextMs)
+        {
+            idlest = &KNXnetIP_DiscoverySource[index];
+        }
+    }
+
+    if (NULL == source)
+    {
+        /* Unknown source takes over the entry whose bucket refilled the longest ago,
+           bucket included: cycling through more hosts than entries buys no fresh burst */
+        source = idlest;
+        source->IpAddr = ipAddr;
+    }
+
+    return source;
+}
+
+/*==================[end of file]===========================================*/
@@ -0,0 +1,392 @@
+/**
+ * \file KNXnetIP_Routing.c
+ *
+ * \brief KNXnet/IP Routing Services
+ *
+ * This file contains the implementation of KNXnet/IP Routing Services
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "string.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_vfs_eventfd.h"
+#include <unistd.h>
+#include <errno.h>
+#include <sys/param.h>
+
+#include "lwip/sockets.h"
+
+#include "TP_DataLinkLayer.h"
+#include "TpUart2_DataLinkLayer.h"
+#include "KnxFrameRing.h"
+#include "KnxFrameBuffer.h"
+
+#include "KNXnetIP.h"
+#include "KNXnetIP_Routing.h"
+
+/*==================[macros]================================================*/
+#define KNXNETIP_ROUTING_BUSY_LENGTH       (0x06U)
+#define KNXNETIP_ROUTING_LOST_LENGTH       (0x04U)
+
+/* ROUTING_BUSY from several routers within this window count once */
+#define KNXNETIP_ROUTING_BUSY_WINDOW_MS    (10U)
+
+/* Random part of the pause added per counted ROUTING_BUSY */
+#define KNXNETIP_ROUTING_BUSY_RANDOM_MS    (50U)
+
+/* Counted ROUTING_BUSY are forgotten after the wait time plus this per count */
+#define KNXNETIP_ROUTING_BUSY_DECAY_MS     (100U)
+
+#define KNXNETIP_ROUTING_HOP_COUNT(ctrl2)  (((ctrl2) & CTRLE_FIELD_HOP_COUNT_MASK) >> CTRLE_FIELD_HOP_COUNT_OFFSET)
+#define KNXNETIP_ROUTING_HOP_COUNT_MAX     (7U)
+
+/*==================[type definitions]======================================*/
+typedef struct {
+    int64_t NextTxMs;        /* Virtual send time of the rate limiter */
+    int64_t BusyUntilMs;     /* No ROUTING_INDICATION before this, set by ROUTING_BUSY */
+    int64_t BusyRxMs;        /* Last counted ROUTING_BUSY */
+    int64_t BusyTxMs;        /* Last ROUTING_BUSY sent */
+    uint16_t BusyCount;
+    uint16_t LostCount;      /* Indications from IP not taken by the TP queue */
+} KNXnetIP_RoutingStateType;
+
+/*==================[external function declarations]========================*/
+void KNXnetIP_RoutingInit(void);
+int KNXnetIP_RoutingDoorbell(void);
+uint32_t KNXnetIP_RoutingMainFunction(bool doorbell);
+void KNXnetIP_RoutingTP2IP(KnxFrameBuffer_HandleType frame);
+void KNXnetIP_RoutingIP2TP(KnxFrameBuffer_HandleType frame, uint32_t ipAddr);
+void KNXnetIP_RoutingBusy(const uint8_t * dataPtr, uint16_t length);
+void KNXnetIP_RoutingLostMessage(const uint8_t * dataPtr, uint16_t length);
+
+/*==================[internal function declarations]========================*/
+static int64_t KNXnetIP_RoutingGetTimeMs(void);
+static bool KNXnetIP_RoutingHopCount(uint8_t * ctrl2Ptr);
+static void KNXnetIP_RoutingTransmit(KNXnetIP_ServiceType serviceType, const uint8_t * bufferPtr, uint16_t length);
+static void KNXnetIP_RoutingTransmitFrame(KnxFrameBuffer_HandleType frame);
+static void KNXnetIP_RoutingSendBusy(void);
+static void KNXnetIP_RoutingSendLostMessage(void);
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+extern uint32_t KnxIPInterface_IpAddr;
+
+/*==================[internal data]=========================================*/
+/* TP -> IP multicast, filled by the tpuart task, drained by the UDP task */
+static KnxFrameRingType KNXnetIP_RoutingTxRing;
+
+/* eventfd added to the select() set of the UDP task */
+static int KNXnetIP_RoutingDoorbellFd = -1;
+
+/* Everything below belongs to the UDP task */
+static KNXnetIP_RoutingStateType KNXnetIP_RoutingState;
+
+/*==================[external function definitions]=========================*/
+void KNXnetIP_RoutingInit(void)
+{
+    KnxFrameRing_Init(&KNXnetIP_RoutingTxRing);
+    memset(&KNXnetIP_RoutingState, 0, sizeof(KNXnetIP_RoutingState));
+
+    KNXnetIP_RoutingDoorbellFd = eventfd(0, 0);
+
+    if (KNXnetIP_RoutingDoorbellFd < 0)
+    {
+        /* The UDP task would select on and write to an invalid descriptor */
+        ESP_LOGE("IP", "RoutingInit: eventfd failed, errno %d", errno);
+        ESP_ERROR_CHECK(ESP_FAIL);
+    }
+}
+
+int KNXnetIP_RoutingDoorbell(void)
+{
+    return KNXnetIP_RoutingDoorbellFd;
+}
+
+uint32_t KNXnetIP_RoutingMainFunction(bool doorbell)
+{
+    uint32_t timeoutMs = KNXNETIP_ROUTING_NO_TIMEOUT;
+    int64_t nowMs = KNXnetIP_RoutingGetTimeMs();
+    KnxFrameRing_SlotType * slot;
+
+    if (true == doorbell)
+    {
+        uint64_t count;
+
+        /* select() reported the doorbell readable, so this read does not block */
+        read(KNXnetIP_RoutingDoorbellFd, &count, sizeof(count));
+    }
+
+    slot = KnxFrameRing_Peek(&KNXnetIP_RoutingTxRing);
+
+    while ((NULL != slot) && (KNXNETIP_ROUTING_NO_TIMEOUT == timeoutMs))
+    {
+        /* Rate limiter lets KNXNETIP_ROUTING_TX_BURST frames through back to back */
+        int64_t earliestMs = KNXnetIP_RoutingState.NextTxMs - ((KNXNETIP_ROUTING_TX_BURST - 1U) * KNXNETIP_ROUTING_TX_INTERVAL_MS);
+
+        if (nowMs < KNXnetIP_RoutingState.BusyUntilMs)
+        {
+            /* Another router asked for a pause, frames wait in the ring */
+            timeoutMs = (uint32_t)(KNXnetIP_RoutingState.BusyUntilMs - nowMs);
+        }
+        else if (nowMs < earliestMs)
+        {
+            timeoutMs = (uint32_t)(earliestMs - nowMs);
+        }
+        else
+        {
+            KNXnetIP_RoutingTransmitFrame(slot->Frame);
+
+            KNXnetIP_RoutingState.NextTxMs = MAX(KNXnetIP_RoutingState.NextTxMs, nowMs) + KNXNETIP_ROUTING_TX_INTERVAL_MS;
+
+            KnxFrameRing_Release(&KNXnetIP_RoutingTxRing);
+            slot = KnxFrameRing_Peek(&KNXnetIP_RoutingTxRing);
+        }
+    }
+
+    return timeoutMs;
+}
+
+void KNXnetIP_RoutingTP2IP(KnxFrameBuffer_HandleType frame)
+{
+    uint16_t length = KnxFrameBuffer_Get(frame)->Length;
+
+    if (KNX_FRAME_BUFFER_CEMI_MAX < length)
+    {
+        ESP_LOGW("IP", "RoutingTP2IP: frame too long %d", length);
+        KnxFrameBuffer_Release(frame);
+    }
+    else if (0U == KNXNETIP_ROUTING_HOP_COUNT(KnxFrameBuffer_Frame(frame)[CEMI_FRAME_CTRL2_FIELD_OFFSET]))
+    {
+        /* Routing counter exhausted, decremented when the frame is sent */
+        KnxFrameBuffer_Release(frame);
+    }
+    else
+    {
+        /* Runs in the tpuart task */
+        KnxFrameRing_SlotType * slot = KnxFrameRing_Reserve(&KNXnetIP_RoutingTxRing);
+
+        if (NULL == slot)
+        {
+#ifdef KNXNETIP_DEBUG_LOGGING
+            ESP_LOGW("IP", "RoutingTP2IP: tx ring full, %lu dropped", (unsigned long)KNXnetIP_RoutingTxRing.Dropped);
+#endif /* KNXNETIP_DEBUG_LOGGING */
+            KnxFrameBuffer_Release(frame);
+        }
+        else
+        {
+            uint64_t doorbell = 1U;
+
+            slot->Frame = frame;
+            slot->ChannelId = KNX_CHANNEL_INVALID;
+
+            KnxFrameRing_Commit(&KNXnetIP_RoutingTxRing);
+
+            write(KNXnetIP_RoutingDoorbellFd, &doorbell, sizeof(doorbell));
+        }
+    }
+}
+
+void KNXnetIP_RoutingIP2TP(KnxFrameBuffer_HandleType frame, uint32_t ipAddr)
+{
+    uint8_t * cemiPtr = KnxFrameBuffer_Frame(frame);
+    uint16_t length = KnxFrameBuffer_Get(frame)->Length;
+
+    if (ipAddr == ntohl(KnxIPInterface_IpAddr))
+    {
+        /* Own indication looped back by the multicast group */
+        KnxFrameBuffer_Release(frame);
+    }
+    else if ((CEMI_FRAME_TPDU_FIELD_OFFSET >= length) ||
+             (KNX_FRAME_BUFFER_CEMI_MAX < length) ||
+             (L_DATA_IND != cemiPtr[0]) ||
+             (0x00U != cemiPtr[1]))
+    {
+        /* Only plain L_Data.ind is routed, no additional info */
+        KnxFrameBuffer_Release(frame);
+    }
+    else if (false == KNXnetIP_RoutingHopCount(&cemiPtr[CEMI_FRAME_CTRL2_FIELD_OFFSET]))
+    {
+        /* Routing counter exhausted */
+        KnxFrameBuffer_Release(frame);
+    }
+    else if (E_OK != TP_GW_L_Data_Req(KNX_CHANNEL_INVALID, frame))
+    {
+        /* TP queue full: tell the sender the indication was lost */
+        KnxFrameBuffer_Release(frame);
+
+        KNXnetIP_RoutingState.LostCount++;
+        KNXnetIP_RoutingSendLostMessage();
+    }
+    else if (KNXNETIP_ROUTING_BUSY_THRESHOLD <= TP_GW_ChannelBacklog(KNX_CHANNEL_INVALID))
+    {
+        /* 9600 bit/s falling behind, slow the IP side down before frames get lost */
+        KNXnetIP_RoutingSendBusy();
+    }
+    else
+    {
+        /* Queued for the bus */
+    }
+}
+
+void KNXnetIP_RoutingBusy(const uint8_t * dataPtr, uint16_t length)
+{
+    if ((KNXNETIP_ROUTING_BUSY_LENGTH > length) || (KNXNETIP_ROUTING_BUSY_LENGTH != dataPtr[0]))
+    {
+        ESP_LOGW("IP", "RoutingBusy: malformed");
+    }
+    else
+    {
+        int64_t nowMs = KNXnetIP_RoutingGetTimeMs();
+        uint16_t waitMs = ((uint16_t)dataPtr[2] << 8) | dataPtr[3];
+        uint32_t pauseMs;
+
+        if ((nowMs - KNXnetIP_RoutingState.BusyRxMs) > (waitMs + (KNXnetIP_RoutingState.BusyCount * KNXNETIP_ROUTING_BUSY_DECAY_MS)))
+        {
+            /* Congestion cleared since the last one */
+            KNXnetIP_RoutingState.BusyCount = 0U;
+        }
+
+        if ((nowMs - KNXnetIP_RoutingState.BusyRxMs) > KNXNETIP_ROUTING_BUSY_WINDOW_MS)
+        {
+            KNXnetIP_RoutingState.BusyCount++;
+            KNXnetIP_RoutingState.BusyRxMs = nowMs;
+        }
+
+        /* Random part keeps the routers of the group from resuming together */
+        pauseMs = waitMs + (esp_random() % ((KNXnetIP_RoutingState.BusyCount * KNXNETIP_ROUTING_BUSY_RANDOM_MS) + 1U));
+
+        KNXnetIP_RoutingState.BusyUntilMs = MAX(KNXnetIP_RoutingState.BusyUntilMs, nowMs + pauseMs);
+
+#ifdef KNXNETIP_DEBUG_LOGGING
+        ESP_LOGI("IP", "RoutingBusy: wait %u ms, pause %lu ms", waitMs, (unsigned long)pauseMs);
+#endif
+    }
+}
+
+void KNXnetIP_RoutingLostMessage(const uint8_t * dataPtr, uint16_t length)
+{
+    if ((KNXNETIP_ROUTING_LOST_LENGTH > length) || (KNXNETIP_ROUTING_LOST_LENGTH != dataPtr[0]))
+    {
+        ESP_LOGW("IP", "RoutingLostMessage: malformed");
+    }
+    else
+    {
+        /* Nothing to resend, ROUTING_INDICATION is unacknowledged */
+        ESP_LOGW("IP", "RoutingLostMessage: %u lost by a router", ((uint16_t)dataPtr[2] << 8) | dataPtr[3]);
+    }
+}
+
+/*==================[internal function definitions]=========================*/
+static int64_t KNXnetIP_RoutingGetTimeMs(void)
+{
+    return (esp_timer_get_time() / 1000);
+}
+
+static bool KNXnetIP_RoutingHopCount(uint8_t * ctrl2Ptr)
+{
+    bool forward = true;
+    uint8_t hopCount = KNXNETIP_ROUTING_HOP_COUNT(*ctrl2Ptr);
+
+    if (0U == hopCount)
+    {
+        forward = false;
+    }
+    else if (KNXNETIP_ROUTING_HOP_COUNT_MAX == hopCount)
+    {
+        /* Hop count 7 is never decremented */
+    }
+    else
+    {
+        *ctrl2Ptr &= (uint8_t)~CTRLE_FIELD_HOP_COUNT_MASK;
+        *ctrl2Ptr |= (uint8_t)((hopCount - 1U) << CTRLE_FIELD_HOP_COUNT_OFFSET);
+    }
+
+    return forward;
+}
+
+static void KNXnetIP_RoutingTransmit(KNXnetIP_ServiceType serviceType, const uint8_t * bufferPtr, uint16_t length)
+{
+    KNXnetIP_TxFrameType txFrame;
+
+    KNXnetIP_TxFrameInit(&txFrame, serviceType);
+    KNXnetIP_TxFrameAppend(&txFrame, bufferPtr, length);
+
+    KNXnetIP_UDPSend(KNXNETIP_ROUTING_MULTICAST_ADDR, UDP_PORT, &txFrame);
+}
+
+static void KNXnetIP_RoutingTransmitFrame(KnxFrameBuffer_HandleType frame)
+{
+    const uint8_t * cemiPtr = KnxFrameBuffer_Frame(frame);
+    uint16_t length = KnxFrameBuffer_Get(frame)->Length;
+    uint8_t ctrl2 = cemiPtr[CEMI_FRAME_CTRL2_FIELD_OFFSET];
+    KNXnetIP_TxFrameType txFrame;
+
+    /* Checked for zero before the frame was queued */
+    (void)KNXnetIP_RoutingHopCount(&ctrl2);
+
+    /* The frame may still be read by the tunnels, the decremented hop count */
+    /* goes out from here and the octets around it from the frame buffer     */
+    KNXnetIP_TxFrameInit(&txFrame, ROUTING_INDICATION);
+    KNXnetIP_TxFrameAppend(&txFrame, &cemiPtr[0], CEMI_FRAME_CTRL2_FIELD_OFFSET);
+    KNXnetIP_TxFrameAppend(&txFrame, &ctrl2, 1U);
+    KNXnetIP_TxFrameAppend(&txFrame, &cemiPtr[CEMI_FRAME_CTRL2_FIELD_OFFSET + 1U], length - CEMI_FRAME_CTRL2_FIELD_OFFSET - 1U);
+
+    KNXnetIP_UDPSend(KNXNETIP_ROUTING_MULTICAST_ADDR, UDP_PORT, &txFrame);
+
+#ifdef TPUART2_RX_LATENCY
+    TpUart2_RxLatencyRecord(KNXNETIP_TRANSPORT_UDP, frame);
+#endif /* TPUART2_RX_LATENCY */
+
+    KnxFrameBuffer_Release(frame);
+}
+
+static void KNXnetIP_RoutingSendBusy(void)
+{
+    int64_t nowMs = KNXnetIP_RoutingGetTimeMs();
+
+    /* One ROUTING_BUSY per window is enough while the queue stays above the threshold */
+    if ((nowMs - KNXnetIP_RoutingState.BusyTxMs) > KNXNETIP_ROUTING_BUSY_WINDOW_MS)
+    {
+        uint8_t busy[KNXNETIP_ROUTING_BUSY_LENGTH];
+
+        busy[0] = KNXNETIP_ROUTING_BUSY_LENGTH;
+        busy[1] = 0x00U;    /* Device state */
+        busy[2] = (uint8_t)((KNXNETIP_ROUTING_BUSY_WAIT_MS >> 8) & 0xFFU);
+        busy[3] = (uint8_t)(KNXNETIP_ROUTING_BUSY_WAIT_MS & 0xFFU);
+        busy[4] = 0x00U;    /* Routing busy control field */
+        busy[5] = 0x00U;
+
+        KNXnetIP_RoutingTransmit(ROUTING_BUSY, &busy[0], sizeof(busy));
+
+        KNXnetIP_RoutingState.BusyTxMs = nowMs;
+    }
+}
+
+static void KNXnetIP_RoutingSendLostMessage(void)
+{
+    uint8_t lost[KNXNETIP_ROUTING_LOST_LENGTH];
+
+    lost[0] = KNXNETIP_ROUTING_LOST_LENGTH;
+    lost[1] = 0x00U;    /* Device state */
+    lost[2] = (uint8_t)((KNXnetIP_RoutingState.LostCount >> 8) & 0xFFU);
+    lost[3] = (uint8_t)(KNXnetIP_RoutingState.LostCount & 0xFFU);
+
+    KNXnetIP_RoutingTransmit(ROUTING_LOST_MESSAGE, &lost[0], sizeof(lost));
+}
+
+/*==================[end of file]===========================================*/
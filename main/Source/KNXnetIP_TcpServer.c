@@ -32,115 +32,357 @@
 #define KEEPALIVE_INTERVAL          (30U)
 #define KEEPALIVE_COUNT             (3U)
 
+/* Longest KNXnet/IP frame accepted from a client, the stream buffer holds two */
+#define TCP_FRAME_MAX_LENGTH        (256U)
+#define TCP_STREAM_BUFFER_SIZE      (2U * TCP_FRAME_MAX_LENGTH)
+
+/* Bytes of a KNXnet/IP header, total length at octets 4-5 */
+#define TCP_FRAME_HEADER_LENGTH     (HEADER_SIZE_10)
+
+/* Concurrent client connections. A KNXnet/IP TCP connection carries one */
+/* tunnel, so one per channel: a client beyond KNX_CHANNEL_NUM could only  */
+/* be refused at CONNECT_REQUEST. With the multicast, listening and UDP    */
+/* data endpoint sockets this is lwIP's default of 10 sockets              */
+#define TCP_CONNECTION_NUM          (KNX_CHANNEL_NUM)
+
+/* Frames waiting for a congested client, written together by one writev() */
+#define TCP_TX_QUEUE_LENGTH         (8U)
+
+/* 1: every frame leaves at once (latency), 0: Nagle merges small frames (throughput) */
+#ifndef KNXNETIP_TCP_NODELAY
+#define KNXNETIP_TCP_NODELAY        (1)
+#endif
+
+typedef struct {
+    uint8_t Data[TCP_STREAM_BUFFER_SIZE];
+    uint16_t Length;    /* Bytes held, always starts on a frame boundary */
+} Tcp_StreamType;
+
+typedef struct {
+    uint8_t Data[TCP_FRAME_MAX_LENGTH];
+    uint16_t Length;
+} Tcp_TxFrameType;
+
+typedef struct {
+    Tcp_TxFrameType Frame[TCP_TX_QUEUE_LENGTH];
+    uint8_t Head;
+    uint8_t Count;
+    uint16_t Offset;    /* Bytes of the head frame already written */
+    uint32_t Dropped;   /* Frames refused on a full queue */
+} Tcp_TxQueueType;
+
+typedef struct {
+    int Sock;           /* -1 while the slot is free */
+    uint32_t IpAddr;
+    uint16_t Port;
+    Tcp_StreamType RxStream;
+    Tcp_TxQueueType TxQueue;
+} Tcp_ConnectionType;
+
 static const char *TAG = "KNXnetIP_TcpServer";
 
 bool KNXnetIP_TcpTxTunnelReqPending = false;
 
-uint32_t KNXnetIP_TcpIpAddr = 0;
-int KNXnetIP_TcpSock = -1;
+/* Owned by tcp_server_task, the only task touching client sockets */
+static Tcp_ConnectionType Tcp_Connection[TCP_CONNECTION_NUM];
+
+static Tcp_ConnectionType * tcp_find(const int sock)
+{
+    Tcp_ConnectionType * connection = NULL;
+
+    for (uint8_t index = 0; (index < TCP_CONNECTION_NUM) && (NULL == connection); index++)
+    {
+        if (sock == Tcp_Connection[index].Sock)
+        {
+            connection = &Tcp_Connection[index];
+        }
+    }
 
-uint8_t * Tcp_TxBufferPtr;
-uint16_t Tcp_TxLength = 0;
+    return connection;
+}
 
-void KNXnetIP_TcpUpdateTxBuffer(uint8_t * txBuffer, uint16_t txLength)
+static int tcp_flush(Tcp_ConnectionType * connection)
 {
-    Tcp_TxBufferPtr = txBuffer;
-    Tcp_TxLength = txLength;
+    Tcp_TxQueueType * queue = &connection->TxQueue;
+    struct iovec iov[TCP_TX_QUEUE_LENGTH];
+    int status = 0;
+
+    /* Everything queued goes out in one call, starting where the last one stopped */
+    for (uint8_t i = 0; i < queue->Count; i++)
+    {
+        Tcp_TxFrameType * frame = &queue->Frame[(queue->Head + i) % TCP_TX_QUEUE_LENGTH];
+        uint16_t offset = (0U == i) ? queue->Offset : 0U;
+
+        iov[i].iov_base = &frame->Data[offset];
+        iov[i].iov_len = frame->Length - offset;
+    }
+
+    if (0U < queue->Count)
+    {
+        int written = writev(connection->Sock, &iov[0], queue->Count);
+
+        if (written < 0)
+        {
+            if ((EAGAIN != errno) && (EWOULDBLOCK != errno))
+            {
+                ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+                status = -1;
+            }
+        }
+        else
+        {
+            /* Drop what the stack took, a partly written frame stays at the head */
+            while (0 < written)
+            {
+                uint16_t remaining = queue->Frame[queue->Head].Length - queue->Offset;
+
+                if (written >= remaining)
+                {
+                    written -= remaining;
+                    queue->Head = (queue->Head + 1U) % TCP_TX_QUEUE_LENGTH;
+                    queue->Count--;
+                    queue->Offset = 0U;
+                }
+                else
+                {
+                    queue->Offset += (uint16_t)written;
+                    written = 0;
+                }
+            }
+        }
+    }
+
+    return status;
 }
 
-static void tcp_transmit(const int sock, uint32_t ipAddr, uint16_t port)
+static uint16_t tcp_write(Tcp_ConnectionType * connection, const KNXnetIP_TxFrameType * txFrame)
 {
-    int len;
-    char rx_buffer[256];
+    struct iovec iov[1U + KNXNETIP_TX_SEGMENT_NUM];
+    int iovCount = 1;
+    int written;
 
-    do {
-        len = recv(sock, rx_buffer, sizeof(rx_buffer) - 1, 0);
-        if (len < 0)
+    iov[0].iov_base = (void *)&txFrame->Header[0];
+    iov[0].iov_len = txFrame->HeaderLength;
+
+    for (uint8_t index = 0; index < txFrame->SegmentCount; index++)
+    {
+        iov[iovCount].iov_base = (void *)txFrame->Segment[index].DataPtr;
+        iov[iovCount].iov_len = txFrame->Segment[index].Length;
+        iovCount++;
+    }
+
+    /* Headers and body gathered by the stack, straight from where they are held */
+    written = writev(connection->Sock, &iov[0], iovCount);
+
+    if (written < 0)
+    {
+        if ((EAGAIN != errno) && (EWOULDBLOCK != errno))
         {
-            ESP_LOGE(TAG, "Error occurred during receiving: errno %d", errno);
+            /* Closed by the next select() round */
+            ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
         }
-        else if (len == 0)
+
+        written = 0;
+    }
+
+    return (uint16_t)written;
+}
+
+void KNXnetIP_TcpSend(const int sock, const KNXnetIP_TxFrameType * txFrame)
+{
+    Tcp_ConnectionType * connection = tcp_find(sock);
+
+    if (NULL == connection)
+    {
+        ESP_LOGW(TAG, "Send: no connection for socket %d", sock);
+    }
+    else if ((TCP_FRAME_MAX_LENGTH < txFrame->Length) || (TCP_TX_QUEUE_LENGTH <= connection->TxQueue.Count))
+    {
+        /* Client not reading, only its own frames are lost */
+        connection->TxQueue.Dropped++;
+        ESP_LOGW(TAG, "Send: socket %d congested, %lu dropped", sock, (unsigned long)connection->TxQueue.Dropped);
+    }
+    else if (0U == connection->TxQueue.Count)
+    {
+        /* Nothing waiting, only what the stack does not take is copied */
+        uint16_t written = tcp_write(connection, txFrame);
+
+        if (txFrame->Length > written)
+        {
+            Tcp_TxFrameType * frame = &connection->TxQueue.Frame[connection->TxQueue.Head];
+
+            frame->Length = KNXnetIP_TxFrameGather(txFrame, written, &frame->Data[0]);
+            connection->TxQueue.Count++;
+        }
+    }
+    else
+    {
+        /* Behind the frames already waiting, to keep the order */
+        Tcp_TxQueueType * queue = &connection->TxQueue;
+        Tcp_TxFrameType * frame = &queue->Frame[(queue->Head + queue->Count) % TCP_TX_QUEUE_LENGTH];
+
+        frame->Length = KNXnetIP_TxFrameGather(txFrame, 0U, &frame->Data[0]);
+        queue->Count++;
+
+        /* Socket errors show up in the next select() round, which closes it */
+        (void)tcp_flush(connection);
+    }
+}
+
+static int tcp_dispatch(Tcp_ConnectionType * connection)
+{
+    Tcp_StreamType * stream = &connection->RxStream;
+    int status = 0;
+    uint16_t offset = 0;
+    bool partial = false;
+
+    /* Every complete frame held in the buffer, in order */
+    while ((0 == status) && (false == partial) && ((uint16_t)(stream->Length - offset) >= TCP_FRAME_HEADER_LENGTH))
+    {
+        uint8_t * frame = &stream->Data[offset];
+        uint16_t totalLength = ((uint16_t)frame[4] << 8) | frame[5];
+
+        if ((HEADER_SIZE_10 != frame[0]) ||
+            (TCP_FRAME_HEADER_LENGTH > totalLength) ||
+            (TCP_FRAME_MAX_LENGTH < totalLength))
         {
-            ESP_LOGW(TAG, "Connection closed");
+            /* A byte stream cannot be resynchronised, drop the connection */
+            ESP_LOGE(TAG, "Invalid frame header, length %d", totalLength);
+            status = -1;
+        }
+        else if ((stream->Length - offset) < totalLength)
+        {
+            /* Rest of the frame comes with a later recv() */
+            partial = true;
         }
         else
         {
-            rx_buffer[len] = 0; /* Null-terminate whatever is received and treat it like a string */ 
-//            ESP_LOGI(TAG, "Received %d bytes", len);
-
             PduInfoType lpdu;
-            lpdu.SduDataPtr = (uint8_t *)&rx_buffer;
-            lpdu.SduLength = (uint8_t)len;
+            lpdu.SduDataPtr = frame;
+            lpdu.SduLength = totalLength;
 
-            /* Call L_Data_Ind to inform IP DataLinkLayer */
-            IP_L_Data_Ind(&lpdu, ipAddr, port, IPV4_TCP);
+            /* Call L_Data_Ind to inform IP DataLinkLayer, tunnels opened by this */
+            /* frame are bound to the connection, responses go out on it         */
+            IP_L_Data_Ind(&lpdu, KNX_FRAME_BUFFER_INVALID, connection->IpAddr, connection->Port, IPV4_TCP, connection->Sock);
 
-            /* IP DataLinkLayer updates Tcp_TxBufferPtr via call to KNXnetIP_TcpUpdateTxBuffer */
+            offset += totalLength;
+        }
+    }
 
-            if (0 == Tcp_TxLength)
-            {
-                ESP_LOGE(TAG, "Error occurred during getting data from link layer.");
-            }
-            else
-            {
-                // send() can return less bytes than supplied length.
-                // Walk-around for robust implementation.
-                int to_write = Tcp_TxLength;
-                while (to_write > 0) {
-                    int written = send(sock, Tcp_TxBufferPtr + (Tcp_TxLength - to_write), to_write, 0);
-                    if (written < 0) {
-                        ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
-                        // Failed to retransmit, giving up
-                        return;
-                    }
-                    to_write -= written;
-                }
-            }
+    /* Keep the partial tail at the front for the next recv() */
+    if ((0 == status) && (0U < offset))
+    {
+        memmove(&stream->Data[0], &stream->Data[offset], stream->Length - offset);
+        stream->Length -= offset;
+    }
+
+    return status;
+}
+
+static void tcp_accept(const int listen_sock)
+{
+    int keepAlive = 1;
+    int keepIdle = KEEPALIVE_IDLE;
+    int keepInterval = KEEPALIVE_INTERVAL;
+    int keepCount = KEEPALIVE_COUNT;
+    Tcp_ConnectionType * connection = NULL;
+
+    struct sockaddr_storage source_addr; // Large enough for both IPv4 or IPv6
+    socklen_t addr_len = sizeof(source_addr);
+    int sock = accept(listen_sock, (struct sockaddr *)&source_addr, &addr_len);
+
+    for (uint8_t index = 0; (index < TCP_CONNECTION_NUM) && (NULL == connection); index++)
+    {
+        if (Tcp_Connection[index].Sock < 0)
+        {
+            connection = &Tcp_Connection[index];
         }
-    } while (len > 0);
+    }
+
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to accept connection: errno %d", errno);
+    }
+    else if (NULL == connection) {
+        ESP_LOGW(TAG, "All %u connections in use, refused", TCP_CONNECTION_NUM);
+        close(sock);
+    }
+    else {
+        // Set tcp keepalive option
+        setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(int));
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &keepIdle, sizeof(int));
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &keepInterval, sizeof(int));
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &keepCount, sizeof(int));
+
+        int noDelay = KNXNETIP_TCP_NODELAY;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(int));
+
+        // One slow client must not block the others
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+        connection->Sock = sock;
+        connection->IpAddr = htonl(((struct sockaddr_in *)&source_addr)->sin_addr.s_addr);
+        connection->Port = htons(((struct sockaddr_in *)&source_addr)->sin_port);
+        connection->RxStream.Length = 0;
+        memset(&connection->TxQueue, 0, sizeof(connection->TxQueue));
+
+        ESP_LOGI(TAG, "Connection %d accepted", (int)(connection - &Tcp_Connection[0]));
+    }
 }
 
-void tcp_transmitPendingTunnelReq(const int sock, uint32_t ipAddr, uint16_t port)
+static void tcp_close(Tcp_ConnectionType * connection)
 {
-    /* IP DataLinkLayer updates Tcp_TxBufferPtr via call to KNXnetIP_TunnellingRequest */
-    if (NULL == Tcp_TxBufferPtr)
+    /* Tunnels opened on this connection end with it */
+    KNXnetIP_ChannelFreeBySocket(connection->Sock);
+
+    shutdown(connection->Sock, 0);
+    close(connection->Sock);
+
+    connection->Sock = -1;
+}
+
+static int tcp_receive(Tcp_ConnectionType * connection)
+{
+    Tcp_StreamType * stream = &connection->RxStream;
+
+    /* Append to whatever is left of the previous segment */
+    int len = recv(connection->Sock, &stream->Data[stream->Length], sizeof(stream->Data) - stream->Length, 0);
+
+    if (len < 0)
     {
-        ESP_LOGE(TAG, "Error occurred during getting data from link layer. NULL_PTR");
+        if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+        {
+            /* Spurious wakeup, nothing to read after all */
+            len = 1;
+        }
+        else
+        {
+            ESP_LOGE(TAG, "Error occurred during receiving: errno %d", errno);
+        }
     }
-    else if (0 == Tcp_TxLength)
+    else if (len == 0)
     {
-        ESP_LOGE(TAG, "Error occurred during getting data from link layer. ZERO_LENGTH");
+        ESP_LOGW(TAG, "Connection closed");
     }
     else
     {
-        // send() can return less bytes than supplied length.
-        // Walk-around for robust implementation.
-        int to_write = Tcp_TxLength;
-        while (to_write > 0) {
-            int written = send(sock, Tcp_TxBufferPtr + (Tcp_TxLength - to_write), to_write, 0);
-            if (written < 0) {
-                ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
-                // Failed to retransmit, giving up
-                return;
-            }
-            to_write -= written;
+//        ESP_LOGI(TAG, "Received %d bytes", len);
+        stream->Length += (uint16_t)len;
+
+        if (0 != tcp_dispatch(connection))
+        {
+            len = -1;
         }
     }
+
+    return len;
 }
 
 void tcp_server_task(void *pvParameters)
 {
-    char addr_str[128];
     int addr_family = (int)pvParameters;
     int ip_protocol = 0;
+    int doorbell = KNXnetIP_TunnellingDoorbell(KNXNETIP_TRANSPORT_TCP);
 
-    int keepAlive = 1;
-    int keepIdle = KEEPALIVE_IDLE;
-    int keepInterval = KEEPALIVE_INTERVAL;
-    int keepCount = KEEPALIVE_COUNT;
-
-    uint32_t ipAddr;
-    uint16_t port;
     struct sockaddr_storage dest_addr;
 
     if (addr_family == AF_INET) {
@@ -151,6 +393,11 @@ void tcp_server_task(void *pvParameters)
         ip_protocol = IPPROTO_IP;
     }
 
+    for (uint8_t index = 0; index < TCP_CONNECTION_NUM; index++)
+    {
+        Tcp_Connection[index].Sock = -1;
+    }
+
     int listen_sock = socket(addr_family, SOCK_STREAM, ip_protocol);
     if (listen_sock < 0) {
         ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
@@ -159,6 +406,7 @@ void tcp_server_task(void *pvParameters)
     }
     int opt = 1;
     setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    fcntl(listen_sock, F_SETFL, fcntl(listen_sock, F_GETFL, 0) | O_NONBLOCK);
 
     ESP_LOGI(TAG, "Socket created");
 
@@ -170,43 +418,84 @@ void tcp_server_task(void *pvParameters)
     }
     ESP_LOGI(TAG, "Socket bound, port %d", PORT);
 
-    err = listen(listen_sock, 1);
+    err = listen(listen_sock, TCP_CONNECTION_NUM);
     if (err != 0) {
         ESP_LOGE(TAG, "Error occurred during listen: errno %d", errno);
         goto CLEAN_UP;
     }
 
+    ESP_LOGI(TAG, "Socket listening");
+
     while (1) {
-        ESP_LOGI(TAG, "Socket listening");
+        /* Connection heartbeats of the TCP channels */
+        uint32_t timeoutMs = KNXnetIP_TimerMainFunction(KNXNETIP_TRANSPORT_TCP);
+        struct timeval tv = {
+            .tv_sec = timeoutMs / 1000U,
+            .tv_usec = (timeoutMs % 1000U) * 1000U,
+        };
+        int maxfd = MAX(listen_sock, doorbell);
+        fd_set rfds;
+        fd_set wfds;
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+        FD_SET(listen_sock, &rfds);
+        FD_SET(doorbell, &rfds);
+
+        for (uint8_t index = 0; index < TCP_CONNECTION_NUM; index++)
+        {
+            if (0 <= Tcp_Connection[index].Sock)
+            {
+                FD_SET(Tcp_Connection[index].Sock, &rfds);
+                maxfd = MAX(maxfd, Tcp_Connection[index].Sock);
+
+                if (0U < Tcp_Connection[index].TxQueue.Count)
+                {
+                    /* Congested, wait until the client takes more */
+                    FD_SET(Tcp_Connection[index].Sock, &wfds);
+                }
+            }
+        }
 
-        struct sockaddr_storage source_addr; // Large enough for both IPv4 or IPv6
-        socklen_t addr_len = sizeof(source_addr);
-        int sock = accept(listen_sock, (struct sockaddr *)&source_addr, &addr_len);
-        if (sock < 0) {
-            ESP_LOGE(TAG, "Unable to accept connection: errno %d", errno);
+        /* Wait for any client, a new connection, frames queued by the tpuart task or the next timer */
+        int s = select(maxfd + 1, &rfds, &wfds, NULL, (KNX_TIMER_NO_TIMEOUT == timeoutMs) ? NULL : &tv);
+        if (s < 0) {
+            ESP_LOGE(TAG, "Select failed: errno %d", errno);
             break;
         }
 
-        // Set tcp keepalive option
-        setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(int));
-        setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &keepIdle, sizeof(int));
-        setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &keepInterval, sizeof(int));
-        setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &keepCount, sizeof(int));
-        // Convert ip address to string
-        if (source_addr.ss_family == PF_INET) {
-            inet_ntoa_r(((struct sockaddr_in *)&source_addr)->sin_addr, addr_str, sizeof(addr_str) - 1);
+        if (FD_ISSET(doorbell, &rfds)) {
+            /* Tunnelling requests from the bus, each goes to the socket of its tunnel */
+            KNXnetIP_TunnellingMainFunction(KNXNETIP_TRANSPORT_TCP);
         }
 
-        ipAddr = htonl(((struct sockaddr_in *)&source_addr)->sin_addr.s_addr);
-        port = htons(((struct sockaddr_in *)&source_addr)->sin_port);
+        for (uint8_t index = 0; index < TCP_CONNECTION_NUM; index++)
+        {
+            if ((0 <= Tcp_Connection[index].Sock) &&
+                FD_ISSET(Tcp_Connection[index].Sock, &wfds) &&
+                (0 > tcp_flush(&Tcp_Connection[index])))
+            {
+                tcp_close(&Tcp_Connection[index]);
+            }
 
-        KNXnetIP_TcpIpAddr = ipAddr;
-        KNXnetIP_TcpSock = sock;
+            if ((0 <= Tcp_Connection[index].Sock) &&
+                FD_ISSET(Tcp_Connection[index].Sock, &rfds) &&
+                (0 >= tcp_receive(&Tcp_Connection[index])))
+            {
+                tcp_close(&Tcp_Connection[index]);
+            }
+        }
 
-        tcp_transmit(sock, ipAddr, port);
+        if (FD_ISSET(listen_sock, &rfds)) {
+            tcp_accept(listen_sock);
+        }
+    }
 
-        shutdown(sock, 0);
-        close(sock);
+    for (uint8_t index = 0; index < TCP_CONNECTION_NUM; index++)
+    {
+        if (0 <= Tcp_Connection[index].Sock)
+        {
+            tcp_close(&Tcp_Connection[index]);
+        }
     }
 
 CLEAN_UP:
@@ -20,24 +20,79 @@
 #include "string.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_vfs_eventfd.h"
+#include <unistd.h>
+#include <errno.h>
+#include <sys/param.h>
 
 #include "IP_DataLinkLayer.h"
 #include "TP_DataLinkLayer.h"
 #include "TpUart2_DataLinkLayer.h"
+#include "KnxFrameRing.h"
+#include "KnxFrameBuffer.h"
+#include "KnxTimer.h"
 
 #include "KNXnetIP.h"
 
 /*==================[macros]================================================*/
+/* Requests a UDP tunnel holds while the one sent waits for its TUNNELLING_ACK */
+#define KNXNETIP_TUNNEL_TX_QUEUE_LENGTH (8U)
+
+/* TUNNELLING_REQUEST_TIMEOUT, one repeat before the connection is dropped */
+#define KNXNETIP_TUNNEL_ACK_TIMEOUT_MS  (TUNNELLING_REQUEST_TIMEOUT * 1000U)
+#define KNXNETIP_TUNNEL_REPEAT_NUM      (1U)
+
+#ifdef KNXNETIP_TUNNEL_LATENCY
+/* Frames per tunnel between two latency reports */
+#define KNXNETIP_TUNNEL_LATENCY_REPORT (500U)
+#endif /* KNXNETIP_TUNNEL_LATENCY */
 
 /*==================[type definitions]======================================*/
+typedef struct {
+    KnxFrameBuffer_HandleType Frame[KNXNETIP_TUNNEL_TX_QUEUE_LENGTH];   /* Head frame is the one sent */
+    uint8_t Head;
+    uint8_t Count;
+    uint8_t Repeats;        /* Repeats of the head frame so far */
+    KnxTimer_Type AckTimer; /* Head frame repeated, or the connection dropped, when it expires */
+    uint32_t Dropped;       /* Frames refused on a full queue */
+} KNXnetIP_TunnelTxQueueType;
+
+typedef struct {
+    bool Pending;           /* TUNNELLING_ACK held back until the backlog drains */
+    uint8_t SequenceCounter;
+    uint32_t Withheld;      /* Acks held back so far */
+} KNXnetIP_TunnelAckType;
+
+#ifdef KNXNETIP_TUNNEL_LATENCY
+typedef struct {
+    uint32_t Frames;
+    int64_t SumUs;
+    int64_t MaxUs;
+} KNXnetIP_TunnelLatencyType;
+#endif /* KNXNETIP_TUNNEL_LATENCY */
 
 /*==================[external function declarations]========================*/
 void KNXnetIP_TunnellingInit(void);
-void KNXnetIP_TunnellingFeatureGet(KNXnetIP_FeatureIdentifierType featureIdentifier, uint8_t * txBuffer, uint16_t * txLength);
-void KNXnetIP_TunnellingFeatureSet(KNXnetIP_FeatureIdentifierType featureIdentifier, uint16_t value, uint8_t * txBuffer, uint16_t * txLength);
-void KNXnetIP_TunnellingRequest(uint8_t * bufferPtr, uint16_t length);
+void KNXnetIP_TunnellingFeatureGet(uint8_t channelId, KNXnetIP_FeatureIdentifierType featureIdentifier, uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_TunnellingFeatureSet(uint8_t channelId, KNXnetIP_FeatureIdentifierType featureIdentifier, uint16_t value, uint8_t * txBuffer, uint16_t * txLength);
+void KNXnetIP_TunnellingRequest(uint8_t channelId, KnxFrameBuffer_HandleType frame);
+int KNXnetIP_TunnellingDoorbell(uint8_t transport);
+void KNXnetIP_TunnellingMainFunction(uint8_t transport);
+void KNXnetIP_TunnellingTransmit(uint8_t channelId, KnxFrameBuffer_HandleType frame);
+void KNXnetIP_TunnellingAckReceived(uint8_t channelId, uint8_t sequenceCounter, KNXnetIP_ErrorCodeType status);
+void KNXnetIP_TunnellingReset(uint8_t channelId);
+void KNXnetIP_TunnellingAckWithhold(uint8_t channelId, uint8_t sequenceCounter);
+bool KNXnetIP_TunnellingAckRelease(uint8_t channelId);
+void KNXnetIP_TunnellingResume(uint8_t channelId);
 
 /*==================[internal function declarations]========================*/
+static void KNXnetIP_TunnellingSend(KNXnetIP_ChannelType * channel, KnxFrameBuffer_HandleType frame);
+static void KNXnetIP_TunnellingSendHead(KNXnetIP_ChannelType * channel, KNXnetIP_TunnelTxQueueType * queue);
+static void KNXnetIP_TunnellingAckTimeout(void * context);
+#ifdef KNXNETIP_TUNNEL_LATENCY
+static void KNXnetIP_TunnelLatencyRecord(uint8_t channelId, int64_t latencyUs);
+#endif /* KNXNETIP_TUNNEL_LATENCY */
 
 /*==================[external constants]====================================*/
 
@@ -48,6 +103,24 @@ void KNXnetIP_TunnellingRequest(uint8_t * bufferPtr, uint16_t length);
 /*==================[internal data]=========================================*/
 KNXnetIP_TunnellingFeatureType KNXnetIP_TunnellingFeature;
 
+/* TP -> IP, filled by the tpuart task, drained by the network task of each transport */
+static KnxFrameRingType KNXnetIP_TunnelTxRing[KNXNETIP_TRANSPORT_NUM];
+
+/* eventfd per network task, added to its select() set */
+static int KNXnetIP_TunnelDoorbell[KNXNETIP_TRANSPORT_NUM] = { -1, -1 };
+
+/* Requests of the UDP tunnels waiting for or held behind a TUNNELLING_ACK, */
+/* indexed by channel, everything here belongs to the UDP task              */
+static KNXnetIP_TunnelTxQueueType KNXnetIP_TunnelTxQueue[KNX_CHANNEL_NUM];
+
+/* Acks of UDP tunnels with too many frames waiting for the bus, UDP task */
+static KNXnetIP_TunnelAckType KNXnetIP_TunnelAck[KNX_CHANNEL_NUM];
+
+#ifdef KNXNETIP_TUNNEL_LATENCY
+/* Bus to client delivery time per tunnel, written by the task serving it */
+static KNXnetIP_TunnelLatencyType KNXnetIP_TunnelLatency[KNX_CHANNEL_NUM];
+#endif /* KNXNETIP_TUNNEL_LATENCY */
+
 /*==================[external function definitions]=========================*/
 void KNXnetIP_TunnellingInit(void)
 {
@@ -56,28 +129,56 @@ void KNXnetIP_TunnellingInit(void)
     KNXnetIP_TunnellingFeature.BusStatus = true;
     KNXnetIP_TunnellingFeature.ManufacturerCode = KNX_MANUFACTURER_CODE_MDT;
     KNXnetIP_TunnellingFeature.ActiveEMIType = CEMI;
+
+    for (uint8_t transport = 0; transport < KNXNETIP_TRANSPORT_NUM; transport++)
+    {
+        KnxFrameRing_Init(&KNXnetIP_TunnelTxRing[transport]);
+
+        KNXnetIP_TunnelDoorbell[transport] = eventfd(0, 0);
+
+        if (KNXnetIP_TunnelDoorbell[transport] < 0)
+        {
+            /* The network task would select on and write to an invalid descriptor */
+            ESP_LOGE("IP", "TunnellingInit: eventfd failed, errno %d", errno);
+            ESP_ERROR_CHECK(ESP_FAIL);
+        }
+    }
+
+    for (uint8_t index = 0; index < KNX_CHANNEL_NUM; index++)
+    {
+        KnxTimer_Init(&KNXnetIP_TunnelTxQueue[index].AckTimer, KNXnetIP_TunnellingAckTimeout, &KNXnetIP_TunnelTxQueue[index]);
+    }
 }
 
-void KNXnetIP_TunnellingAck(uint8_t * txBuffer, uint16_t * txLength)
+void KNXnetIP_TunnellingAck(uint8_t channelId, uint8_t sequenceCounter, uint8_t * txBuffer, uint16_t * txLength)
 {
     uint8_t txBytes = 0;
     KNXnetIP_ErrorCodeType errorCode = E_NO_ERROR;
 
     txBuffer[txBytes++] = 0x04U;
-    txBuffer[txBytes++] = KNXnetIP_Channel[0].ChannelId;
-    txBuffer[txBytes++] = 0x00U;
+    txBuffer[txBytes++] = channelId;
+    txBuffer[txBytes++] = sequenceCounter;
     txBuffer[txBytes++] = errorCode;
 
     /* Update Tx Length */
     *txLength = txBytes;
 }
 
-void KNXnetIP_TunnelIP2TP(uint8_t * rxBufferPtr, uint8_t rxLength)
+void KNXnetIP_TunnelIP2TP(uint8_t channelId, KnxFrameBuffer_HandleType frame)
 {
-    TP_GW_L_Data_Req(rxBufferPtr, rxLength);
+    if (E_OK != TP_GW_L_Data_Req(channelId, frame))
+    {
+        /* Not queued for the bus, answer with a negative L_Data.con from this task */
+        uint8_t * cemiPtr = KnxFrameBuffer_Frame(frame);
+
+        cemiPtr[0] = L_DATA_CON;
+        cemiPtr[CEMI_FRAME_CTRL1_FIELD_OFFSET] |= CEMI_FRAME_CTRL1_CONFIRM_ERROR;
+
+        KNXnetIP_TunnellingTransmit(channelId, frame);
+    }
 }
 
-void KNXnetIP_TunnellingFeatureGet(KNXnetIP_FeatureIdentifierType featureIdentifier, uint8_t * txBuffer, uint16_t * txLength)
+void KNXnetIP_TunnellingFeatureGet(uint8_t channelId, KNXnetIP_FeatureIdentifierType featureIdentifier, uint8_t * txBuffer, uint16_t * txLength)
 {
     uint16_t featureValue = 0;
     uint16_t txBytes = 0;
@@ -86,7 +187,7 @@ void KNXnetIP_TunnellingFeatureGet(KNXnetIP_FeatureIdentifierType featureIdentif
     txBuffer[txBytes++] = 0x04U;
 
     /* Connection Header - Channel */
-    txBuffer[txBytes++] = KNXnetIP_Channel[0].ChannelId;
+    txBuffer[txBytes++] = channelId;
 
     /* Connection Header - Sequence Counter */
     txBuffer[txBytes++] = 0x00U;
@@ -137,7 +238,7 @@ void KNXnetIP_TunnellingFeatureGet(KNXnetIP_FeatureIdentifierType featureIdentif
     *txLength = txBytes;
 }
 
-void KNXnetIP_TunnellingFeatureSet(KNXnetIP_FeatureIdentifierType featureIdentifier, uint16_t value, uint8_t * txBuffer, uint16_t * txLength)
+void KNXnetIP_TunnellingFeatureSet(uint8_t channelId, KNXnetIP_FeatureIdentifierType featureIdentifier, uint16_t value, uint8_t * txBuffer, uint16_t * txLength)
 {
     uint16_t txBytes = 0;
 
@@ -145,7 +246,7 @@ void KNXnetIP_TunnellingFeatureSet(KNXnetIP_FeatureIdentifierType featureIdentif
     txBuffer[txBytes++] = 0x04U;
 
     /* Connection Header - Channel */
-    txBuffer[txBytes++] = KNXnetIP_Channel[0].ChannelId;
+    txBuffer[txBytes++] = channelId;
 
     /* Connection Header - Sequence Counter */
     txBuffer[txBytes++] = 0x00U;
@@ -196,29 +297,334 @@ void KNXnetIP_TunnellingFeatureSet(KNXnetIP_FeatureIdentifierType featureIdentif
     *txLength = txBytes;
 }
 
-void KNXnetIP_TunnellingRequest(uint8_t * bufferPtr, uint16_t length)
+void KNXnetIP_TunnellingRequest(uint8_t channelId, KnxFrameBuffer_HandleType frame)
+{
+    KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(channelId);
+
+    if (NULL == channel)
+    {
+        ESP_LOGW("IP", "TunnellingRequest: E_CONNECTION_ID 0x%X", channelId);
+        KnxFrameBuffer_Release(frame);
+    }
+    else if (KNX_FRAME_BUFFER_CEMI_MAX < KnxFrameBuffer_Get(frame)->Length)
+    {
+        ESP_LOGW("IP", "TunnellingRequest: frame too long %d", KnxFrameBuffer_Get(frame)->Length);
+        KnxFrameBuffer_Release(frame);
+    }
+    else
+    {
+        /* Runs in the tpuart task, the network task owning the socket sends it */
+        uint8_t transport = KNXNETIP_TRANSPORT_INDEX(channel->Protocol);
+        KnxFrameRing_SlotType * slot = KnxFrameRing_Reserve(&KNXnetIP_TunnelTxRing[transport]);
+
+        if (NULL != slot)
+        {
+            uint64_t doorbell = 1U;
+
+            slot->Frame = frame;
+            slot->ChannelId = channelId;
+#ifdef KNXNETIP_TUNNEL_LATENCY
+            slot->TimestampUs = esp_timer_get_time();
+#endif /* KNXNETIP_TUNNEL_LATENCY */
+
+            KnxFrameRing_Commit(&KNXnetIP_TunnelTxRing[transport]);
+
+            write(KNXnetIP_TunnelDoorbell[transport], &doorbell, sizeof(doorbell));
+        }
+        else
+        {
+#ifdef KNXNETIP_DEBUG_LOGGING
+            ESP_LOGW("IP", "TunnellingRequest: tx ring full, %lu dropped", (unsigned long)KNXnetIP_TunnelTxRing[transport].Dropped);
+#endif /* KNXNETIP_DEBUG_LOGGING */
+            KnxFrameBuffer_Release(frame);
+        }
+    }
+}
+
+int KNXnetIP_TunnellingDoorbell(uint8_t transport)
 {
-    KNXnetIP_ServiceType serviceType = TUNNELLING_REQUEST;
-    uint16_t txLength = HEADER_SIZE_10 + CONNECTION_HEADER_SIZE + length;
+    return KNXnetIP_TunnelDoorbell[transport];
+}
 
-    IP_TxBuffer[0] = HEADER_SIZE_10;
-    IP_TxBuffer[1] = KNXNETIP_VERSION_10;
-    IP_TxBuffer[2] = (uint8_t)((serviceType & 0xFF00) >> 8);
-    IP_TxBuffer[3] = serviceType & 0xFFU;
-    IP_TxBuffer[4] = (uint8_t)((txLength & 0xFF00) >> 8);
-    IP_TxBuffer[5] = (txLength & 0xFFU);
-    IP_TxBuffer[6] = 0x04U;
-    IP_TxBuffer[7] = KNXnetIP_Channel[0].ChannelId;
-    IP_TxBuffer[8] = 0x00U;
-    IP_TxBuffer[9] = 0x00U;
+void KNXnetIP_TunnellingMainFunction(uint8_t transport)
+{
+    uint64_t doorbell;
+    KnxFrameRing_SlotType * slot;
 
-    memcpy(&IP_TxBuffer[10], bufferPtr, length);
+    /* Called once select() reports the doorbell readable, so this read does not block */
+    read(KNXnetIP_TunnelDoorbell[transport], &doorbell, sizeof(doorbell));
 
-    KNXnetIP_TcpUpdateTxBuffer(&IP_TxBuffer[0], HEADER_SIZE_10 + CONNECTION_HEADER_SIZE + length);
+    slot = KnxFrameRing_Peek(&KNXnetIP_TunnelTxRing[transport]);
 
-    tcp_transmitPendingTunnelReq(KNXnetIP_TcpSock, KNXnetIP_TcpIpAddr, UDP_PORT);
+    while (NULL != slot)
+    {
+        KNXnetIP_TunnellingTransmit(slot->ChannelId, slot->Frame);
+
+#ifdef KNXNETIP_TUNNEL_LATENCY
+        KNXnetIP_TunnelLatencyRecord(slot->ChannelId, esp_timer_get_time() - slot->TimestampUs);
+#endif /* KNXNETIP_TUNNEL_LATENCY */
+
+        KnxFrameRing_Release(&KNXnetIP_TunnelTxRing[transport]);
+        slot = KnxFrameRing_Peek(&KNXnetIP_TunnelTxRing[transport]);
+    }
+
+    if (KNXNETIP_TRANSPORT_UDP == transport)
+    {
+        /* Rung as well when the backlog of a tunnel drops below TP_GW_ACK_WITHHOLD_DEPTH */
+        for (uint8_t channelId = CHANNEL_1; channelId <= KNX_CHANNEL_NUM; channelId++)
+        {
+            if (TP_GW_ACK_WITHHOLD_DEPTH > TP_GW_ChannelBacklog(channelId))
+            {
+                (void)KNXnetIP_TunnellingAckRelease(channelId);
+            }
+        }
+    }
+}
+
+void KNXnetIP_TunnellingTransmit(uint8_t channelId, KnxFrameBuffer_HandleType frame)
+{
+    KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(channelId);
+
+    /* Only the network task serving this transport gets here */
+    if (NULL == channel)
+    {
+        /* Tunnel closed while the frame was queued */
+        KnxFrameBuffer_Release(frame);
+    }
+    else if (IPV4_TCP == channel->Protocol)
+    {
+        /* TCP delivers it or drops the connection, no ack to wait for */
+        KNXnetIP_TunnellingSend(channel, frame);
+        channel->TxSequence++;
+
+#ifdef TPUART2_RX_LATENCY
+        TpUart2_RxLatencyRecord(KNXNETIP_TRANSPORT_TCP, frame);
+#endif /* TPUART2_RX_LATENCY */
+
+        KnxFrameBuffer_Release(frame);
+    }
+    else
+    {
+        KNXnetIP_TunnelTxQueueType * queue = &KNXnetIP_TunnelTxQueue[channelId - CHANNEL_1];
+
+        if (KNXNETIP_TUNNEL_TX_QUEUE_LENGTH <= queue->Count)
+        {
+            queue->Dropped++;
+            ESP_LOGW("IP", "TunnellingTransmit: channel %d not acking, %lu dropped", channelId, (unsigned long)queue->Dropped);
+
+            KnxFrameBuffer_Release(frame);
+        }
+        else
+        {
+            /* Held until acked, one request per tunnel is in flight */
+            queue->Frame[(queue->Head + queue->Count) % KNXNETIP_TUNNEL_TX_QUEUE_LENGTH] = frame;
+            queue->Count++;
+
+            if (1U == queue->Count)
+            {
+                KNXnetIP_TunnellingSendHead(channel, queue);
+            }
+        }
+    }
+}
+
+void KNXnetIP_TunnellingAckReceived(uint8_t channelId, uint8_t sequenceCounter, KNXnetIP_ErrorCodeType status)
+{
+    KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(channelId);
+    KNXnetIP_TunnelTxQueueType * queue = (NULL == channel) ? NULL : &KNXnetIP_TunnelTxQueue[channelId - CHANNEL_1];
+
+    if ((NULL == channel) || (IPV4_UDP != channel->Protocol))
+    {
+        ESP_LOGW("IP", "TunnellingAck: E_CONNECTION_ID 0x%X", channelId);
+    }
+    else if ((0U == queue->Count) || (sequenceCounter != channel->TxSequence))
+    {
+        /* Second ack of a repeated request, the first one was taken */
+        KNXnetIP_ChannelHeartbeat(channel);
+    }
+    else if (E_NO_ERROR != status)
+    {
+        /* Refused by the client, repeated when the ack timeout expires */
+        KNXnetIP_ChannelHeartbeat(channel);
+    }
+    else
+    {
+        KNXnetIP_ChannelHeartbeat(channel);
+
+        KnxFrameBuffer_Release(queue->Frame[queue->Head]);
+        queue->Head = (queue->Head + 1U) % KNXNETIP_TUNNEL_TX_QUEUE_LENGTH;
+        queue->Count--;
+        channel->TxSequence++;
+
+        if (0U < queue->Count)
+        {
+            KNXnetIP_TunnellingSendHead(channel, queue);
+        }
+    }
+}
+
+void KNXnetIP_TunnellingReset(uint8_t channelId)
+{
+    if ((CHANNEL_1 <= channelId) && (KNX_CHANNEL_NUM >= channelId))
+    {
+        KNXnetIP_TunnelTxQueueType * queue = &KNXnetIP_TunnelTxQueue[channelId - CHANNEL_1];
+
+        /* Requests of a previous connection on this channel ID are never sent */
+        while (0U < queue->Count)
+        {
+            KnxFrameBuffer_Release(queue->Frame[queue->Head]);
+            queue->Head = (queue->Head + 1U) % KNXNETIP_TUNNEL_TX_QUEUE_LENGTH;
+            queue->Count--;
+        }
+
+        queue->Repeats = 0U;
+        KnxTimer_Cancel(&queue->AckTimer);
+
+        KNXnetIP_TunnelAck[channelId - CHANNEL_1].Pending = false;
+    }
+}
+
+void KNXnetIP_TunnellingAckWithhold(uint8_t channelId, uint8_t sequenceCounter)
+{
+    KNXnetIP_TunnelAckType * ack = &KNXnetIP_TunnelAck[channelId - CHANNEL_1];
+
+    /* UDP task, the client sends its next request only after this ack */
+    ack->Pending = true;
+    ack->SequenceCounter = sequenceCounter;
+    ack->Withheld++;
+
+#ifdef KNXNETIP_DEBUG_LOGGING
+    ESP_LOGI("IP", "Tunnel %d: %u frames waiting for the bus, ack withheld", channelId, TP_GW_ChannelBacklog(channelId));
+#endif /* KNXNETIP_DEBUG_LOGGING */
+}
+
+bool KNXnetIP_TunnellingAckRelease(uint8_t channelId)
+{
+    KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(channelId);
+    KNXnetIP_TunnelAckType * ack = &KNXnetIP_TunnelAck[channelId - CHANNEL_1];
+    bool released = false;
+
+    if ((NULL == channel) || (IPV4_UDP != channel->Protocol))
+    {
+        ack->Pending = false;
+    }
+    else if (true == ack->Pending)
+    {
+        KNXnetIP_TxFrameType txFrame;
+
+        KNXnetIP_TxFrameInit(&txFrame, TUNNELLING_ACK);
+        KNXnetIP_TxFrameConnectionHeader(&txFrame, channelId, ack->SequenceCounter);
+        KNXnetIP_UDPDataSend(channelId, channel->DataHpai.ipAddress, channel->DataHpai.portNumber, &txFrame);
+
+        ack->Pending = false;
+        released = true;
+    }
+    else
+    {
+        /* Nothing held back */
+    }
+
+    return released;
+}
+
+void KNXnetIP_TunnellingResume(uint8_t channelId)
+{
+    KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(channelId);
+
+    /* tpuart task, the UDP task sends the ack once it sees the doorbell */
+    if ((NULL != channel) && (IPV4_UDP == channel->Protocol))
+    {
+        uint64_t doorbell = 1U;
+
+        write(KNXnetIP_TunnelDoorbell[KNXNETIP_TRANSPORT_UDP], &doorbell, sizeof(doorbell));
+    }
 }
 
 /*==================[internal function definitions]=========================*/
+static void KNXnetIP_TunnellingSend(KNXnetIP_ChannelType * channel, KnxFrameBuffer_HandleType frame)
+{
+    /* The cEMI frame is sent from its buffer, shared with other tunnels or not */
+    KNXnetIP_TxFrameType txFrame;
+
+    KNXnetIP_TxFrameInit(&txFrame, TUNNELLING_REQUEST);
+    KNXnetIP_TxFrameConnectionHeader(&txFrame, channel->ChannelId, channel->TxSequence);
+    KNXnetIP_TxFrameAppend(&txFrame, KnxFrameBuffer_Frame(frame), KnxFrameBuffer_Get(frame)->Length);
+
+    if (IPV4_TCP == channel->Protocol)
+    {
+        KNXnetIP_TcpSend(channel->Socket, &txFrame);
+    }
+    else
+    {
+        KNXnetIP_UDPDataSend(channel->ChannelId, channel->DataHpai.ipAddress, channel->DataHpai.portNumber, &txFrame);
+    }
+
+    channel->TxFrameCount++;
+}
+
+static void KNXnetIP_TunnellingSendHead(KNXnetIP_ChannelType * channel, KNXnetIP_TunnelTxQueueType * queue)
+{
+    KNXnetIP_TunnellingSend(channel, queue->Frame[queue->Head]);
+
+#ifdef TPUART2_RX_LATENCY
+    /* First send only, repeats are not counted */
+    TpUart2_RxLatencyRecord(KNXNETIP_TRANSPORT_UDP, queue->Frame[queue->Head]);
+#endif /* TPUART2_RX_LATENCY */
+
+    queue->Repeats = 0U;
+    KNXnetIP_TimerArm(KNXNETIP_TRANSPORT_UDP, &queue->AckTimer, KNXNETIP_TUNNEL_ACK_TIMEOUT_MS);
+}
+
+static void KNXnetIP_TunnellingAckTimeout(void * context)
+{
+    KNXnetIP_TunnelTxQueueType * queue = (KNXnetIP_TunnelTxQueueType *)context;
+    uint8_t channelId = CHANNEL_1 + (uint8_t)(queue - &KNXnetIP_TunnelTxQueue[0]);
+    KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(channelId);
+
+    if ((NULL == channel) || (IPV4_UDP != channel->Protocol))
+    {
+        /* Disconnected or taken over by TCP meanwhile */
+        KNXnetIP_TunnellingReset(channelId);
+    }
+    else if (KNXNETIP_TUNNEL_REPEAT_NUM > queue->Repeats)
+    {
+        /* Same sequence counter, a client that got the first one acks it again without passing it on */
+        KNXnetIP_TunnellingSend(channel, queue->Frame[queue->Head]);
+
+        queue->Repeats++;
+        KNXnetIP_TimerArm(KNXNETIP_TRANSPORT_UDP, &queue->AckTimer, KNXNETIP_TUNNEL_ACK_TIMEOUT_MS);
+    }
+    else
+    {
+        ESP_LOGW("IP", "Tunnel %d: no TUNNELLING_ACK after %u repeat, disconnecting", channelId, KNXNETIP_TUNNEL_REPEAT_NUM);
+
+        KNXnetIP_ChannelDisconnect(channel);
+    }
+}
+
+#ifdef KNXNETIP_TUNNEL_LATENCY
+static void KNXnetIP_TunnelLatencyRecord(uint8_t channelId, int64_t latencyUs)
+{
+    if ((CHANNEL_1 <= channelId) && (KNX_CHANNEL_NUM >= channelId))
+    {
+        KNXnetIP_TunnelLatencyType * latency = &KNXnetIP_TunnelLatency[channelId - CHANNEL_1];
+
+        latency->Frames++;
+        latency->SumUs += latencyUs;
+        latency->MaxUs = MAX(latency->MaxUs, latencyUs);
+
+        if (KNXNETIP_TUNNEL_LATENCY_REPORT <= latency->Frames)
+        {
+            ESP_LOGI("IP", "Tunnel %d latency: avg %lld us, max %lld us over %lu frames",
+                     channelId,
+                     latency->SumUs / latency->Frames,
+                     latency->MaxUs,
+                     (unsigned long)latency->Frames);
+
+            memset(latency, 0, sizeof(KNXnetIP_TunnelLatencyType));
+        }
+    }
+}
+#endif /* KNXNETIP_TUNNEL_LATENCY */
 
 /*==================[end of file]===========================================*/
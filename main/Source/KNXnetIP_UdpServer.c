@@ -6,6 +6,7 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "lwip/err.h"
 #include "lwip/sockets.h"
@@ -16,12 +17,92 @@
 #include "KnxWiFi.h"
 #include "KNXnetIP.h"
 #include "IP_DataLinkLayer.h"
+#include "KNXnetIP_Routing.h"
+#include "KNXnetIP_Discovery.h"
+#include "KnxFrameBuffer.h"
+
+/* Datagrams waiting for lwIP buffers after a transient send error */
+#define UDP_TX_QUEUE_LENGTH         (8U)
+#define UDP_TX_FRAME_MAX_LENGTH     (256U)
+
+/* Retry delay after a transient error, doubled on each further one */
+#define UDP_TX_BACKOFF_MIN_MS       (2U)
+#define UDP_TX_BACKOFF_MAX_MS       (64U)
+
+/* Send and receive counters are logged at most this often */
+#define UDP_REPORT_MS               (10000U)
+
+/* Data endpoint of a UDP tunnel, one port per channel above the control endpoint */
+#define UDP_DATA_ENDPOINT_PORT(channelId) ((uint16_t)(UDP_PORT + (channelId)))
+
+/* Largest datagram read from a socket, straight into a frame buffer behind its headroom */
+#define UDP_RX_BUFFER_SIZE          (KNX_FRAME_BUFFER_SIZE - KNX_FRAME_BUFFER_HEADROOM)
+
+/* Datagrams read from a readable socket before any of them is processed */
+#define UDP_RX_BATCH_SIZE           (8U)
+
+typedef struct {
+    uint8_t Data[UDP_TX_FRAME_MAX_LENGTH];
+    uint16_t Length;
+    int Sock;           /* Control or data endpoint the frame leaves from */
+    uint32_t IpAddr;
+    uint16_t Port;
+    bool Control;       /* Ack or connection state, evicts bulk frames on a full queue */
+} Udp_TxFrameType;
+
+typedef struct {
+    Udp_TxFrameType Frame[UDP_TX_QUEUE_LENGTH];
+    uint8_t Head;
+    uint8_t Count;
+    uint32_t BackoffMs;
+    int64_t RetryMs;    /* Head frame is not retried before this */
+    int64_t ReportMs;
+    uint32_t Retries;   /* Transient errors */
+    uint32_t Dropped;   /* Frames refused or evicted on a full queue */
+    uint32_t Errors;    /* Frames lost to a permanent error */
+    uint32_t Reported;
+} Udp_TxQueueType;
+
+typedef struct {
+    KnxFrameBuffer_HandleType Frame;
+    uint32_t IpAddr;
+    uint16_t Port;
+} Udp_RxDatagramType;
+
+#ifdef KNXNETIP_UDP_RX_STATISTICS
+typedef struct {
+    uint32_t Batches;   /* Readable sockets drained */
+    uint32_t Datagrams;
+    uint32_t Syscalls;  /* recvfrom() calls, the one reporting an empty queue included */
+    uint8_t MaxBatch;
+    int64_t ReportMs;
+} Udp_RxStatisticsType;
+#endif /* KNXNETIP_UDP_RX_STATISTICS */
+
+extern uint32_t KnxIPInterface_IpAddr;
 
 static const char *TAG = "KNXnetIP_UdpServer";
 static const char *V4TAG = "mcast-ipv4";
 
 int KNXnetIP_MulticastSocket = -1;
 
+/* Only the UDP task sends, no locking */
+static Udp_TxQueueType Udp_TxQueue;
+
+/* Data endpoint socket per channel, opened on CONNECT_REQUEST and closed by */
+/* the UDP task once the channel is gone, -1 while closed                    */
+static int Udp_DataSocket[KNX_CHANNEL_NUM] = { -1, -1, -1, -1 };
+
+/* Datagrams of the current drain, each in a frame buffer of its own */
+static Udp_RxDatagramType Udp_RxPool[UDP_RX_BATCH_SIZE];
+
+/* Datagrams arriving while the frame buffer pool is empty are read in here and dropped */
+static uint8_t Udp_RxDiscard[UDP_RX_BUFFER_SIZE];
+
+#ifdef KNXNETIP_UDP_RX_STATISTICS
+static Udp_RxStatisticsType Udp_RxStatistic;
+#endif /* KNXNETIP_UDP_RX_STATISTICS */
+
 /* Add a socket to the IPV4 multicast group */
 static int socket_add_ipv4_multicast_group(int sock, bool assign_source_if)
 {
@@ -103,6 +184,14 @@ static int create_multicast_ipv4_socket(void)
         goto err;
     }
 
+    /* Own ROUTING_INDICATION must not come back to this socket */
+    uint8_t loop = 0U;
+    err = setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(uint8_t));
+    if (err < 0) {
+        ESP_LOGE(V4TAG, "Failed to set IP_MULTICAST_LOOP. Error %d", errno);
+        goto err;
+    }
+
     /* Add socket to the multicast group for listening */
     err = socket_add_ipv4_multicast_group(sock, true);
     if (err < 0) {
@@ -144,50 +233,491 @@ int create_unicast_ipv4_socket(uint32_t ipAddr, uint16_t port)
         else
         {
             ESP_LOGI(V4TAG, "Unicast udp socket bound, addr %lX", saddr.sin_addr.s_addr);
-            ESP_LOGI(V4TAG, "Unicast udp socket bound, port %d", saddr.sin_port);
-
-            /* Add socket to the multicast group for listening */
-            err = socket_add_ipv4_multicast_group(sock, true);
-            if (err < 0) {
-                close(sock);
-                return -1;
-            }
+            ESP_LOGI(V4TAG, "Unicast udp socket bound, port %d", port);
         }
     }
 
+    if ((0 <= sock) && (err < 0))
+    {
+        close(sock);
+        sock = -1;
+    }
+
     return sock;
 }
 
-void KNXnetIP_UDPSend(uint32_t ipAddr, uint16_t port, uint8_t * txBuffer, uint16_t txLength)
+static int64_t udp_time_ms(void)
+{
+    return (esp_timer_get_time() / 1000);
+}
+
+static bool udp_is_control(const uint8_t * txBuffer)
+{
+    uint16_t serviceType = ((uint16_t)txBuffer[2] << 8) | txBuffer[3];
+
+    /* Losing one of these costs a connection, losing an indication costs a repeat */
+    return ((TUNNELLING_ACK == serviceType) ||
+            (CONNECT_RESPONSE == serviceType) ||
+            (CONNECTIONSTATE_RESPONSE == serviceType) ||
+            (DISCONNECT_REQUEST == serviceType) ||
+            (DISCONNECT_RESPONSE == serviceType) ||
+            (TUNNELLING_FEATURE_RESPONSE == serviceType) ||
+            (ROUTING_BUSY == serviceType) ||
+            (ROUTING_LOST_MESSAGE == serviceType));
+}
+
+static void udp_frame_length(KNXnetIP_TxFrameType * txFrame)
+{
+    /* Total length field of the frame header */
+    txFrame->Header[4] = (uint8_t)((txFrame->Length & 0xFF00) >> 8);
+    txFrame->Header[5] = txFrame->Length & 0xFFU;
+}
+
+/* 0: sent, 1: transient error worth a retry, -1: frame lost */
+static int udp_sendmsg(int sock, uint32_t ipAddr, uint16_t port, struct iovec * iov, int iovCount)
 {
-    if (KNXnetIP_MulticastSocket < 0)
+    struct sockaddr_in sdestv4 = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(ipAddr)
+    };
+    struct msghdr msg = {
+        .msg_name = &sdestv4,
+        .msg_namelen = sizeof(struct sockaddr_in),
+        .msg_iov = iov,
+        .msg_iovlen = iovCount
+    };
+    int status = 0;
+
+    /* The pieces are gathered into the datagram by the stack */
+    if (sendmsg(sock, &msg, MSG_DONTWAIT) < 0)
     {
-        ESP_LOGE(TAG, "Failed to get IPv4 socket");
+        if ((ENOMEM == errno) || (ENOBUFS == errno) || (EAGAIN == errno) || (EWOULDBLOCK == errno))
+        {
+            /* lwIP ran out of pbufs, the link is congested */
+            status = 1;
+        }
+        else
+        {
+            ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+            status = -1;
+        }
+    }
+
+    return status;
+}
+
+static int udp_iov(const KNXnetIP_TxFrameType * txFrame, struct iovec * iov)
+{
+    int iovCount = 1;
+
+    iov[0].iov_base = (void *)&txFrame->Header[0];
+    iov[0].iov_len = txFrame->HeaderLength;
+
+    for (uint8_t index = 0; index < txFrame->SegmentCount; index++)
+    {
+        iov[iovCount].iov_base = (void *)txFrame->Segment[index].DataPtr;
+        iov[iovCount].iov_len = txFrame->Segment[index].Length;
+        iovCount++;
+    }
+
+    return iovCount;
+}
+
+static void udp_backoff(void)
+{
+    Udp_TxQueue.Retries++;
+    Udp_TxQueue.BackoffMs = (0U == Udp_TxQueue.BackoffMs) ? UDP_TX_BACKOFF_MIN_MS : MIN(2U * Udp_TxQueue.BackoffMs, UDP_TX_BACKOFF_MAX_MS);
+    Udp_TxQueue.RetryMs = udp_time_ms() + Udp_TxQueue.BackoffMs;
+}
+
+static void udp_enqueue(int sock, uint32_t ipAddr, uint16_t port, const KNXnetIP_TxFrameType * txFrame)
+{
+    bool control = udp_is_control(&txFrame->Header[0]);
+
+    if (UDP_TX_FRAME_MAX_LENGTH < txFrame->Length)
+    {
+        Udp_TxQueue.Errors++;
     }
     else
     {
-        struct sockaddr_in sdestv4 = {
-            .sin_family = AF_INET,
-            .sin_port = htons(port),
-            .sin_addr.s_addr = htonl(ipAddr)
-        };
+        if ((UDP_TX_QUEUE_LENGTH == Udp_TxQueue.Count) && (true == control))
+        {
+            /* Make room by evicting the newest bulk frame, the ones before it keep their order */
+            for (uint8_t position = Udp_TxQueue.Count; (0U < position) && (UDP_TX_QUEUE_LENGTH == Udp_TxQueue.Count); position--)
+            {
+                if (false == Udp_TxQueue.Frame[(Udp_TxQueue.Head + position - 1U) % UDP_TX_QUEUE_LENGTH].Control)
+                {
+                    for (uint8_t next = position; next < Udp_TxQueue.Count; next++)
+                    {
+                        Udp_TxQueue.Frame[(Udp_TxQueue.Head + next - 1U) % UDP_TX_QUEUE_LENGTH] =
+                            Udp_TxQueue.Frame[(Udp_TxQueue.Head + next) % UDP_TX_QUEUE_LENGTH];
+                    }
 
-        int err = 0;
+                    Udp_TxQueue.Count--;
+                    Udp_TxQueue.Dropped++;
+                }
+            }
+        }
 
-        do
+        if (UDP_TX_QUEUE_LENGTH == Udp_TxQueue.Count)
+        {
+            Udp_TxQueue.Dropped++;
+        }
+        else
         {
-            err = sendto(KNXnetIP_MulticastSocket, txBuffer, txLength, 0, (struct sockaddr *)&sdestv4, sizeof(struct sockaddr_in));
+            Udp_TxFrameType * frame = &Udp_TxQueue.Frame[(Udp_TxQueue.Head + Udp_TxQueue.Count) % UDP_TX_QUEUE_LENGTH];
+
+            /* Only a frame held back is copied, its pieces are not kept until the retry */
+            frame->Length = KNXnetIP_TxFrameGather(txFrame, 0U, &frame->Data[0]);
+            frame->Sock = sock;
+            frame->IpAddr = ipAddr;
+            frame->Port = port;
+            frame->Control = control;
+
+            Udp_TxQueue.Count++;
+        }
+    }
+}
+
+static void udp_flush(void)
+{
+    int status = 0;
 
-            if (err < 0)
+    /* Oldest first, the first transient error ends the round */
+    while ((0U < Udp_TxQueue.Count) && (1 != status))
+    {
+        Udp_TxFrameType * frame = &Udp_TxQueue.Frame[Udp_TxQueue.Head];
+        struct iovec iov = { .iov_base = &frame->Data[0], .iov_len = frame->Length };
+
+        status = udp_sendmsg(frame->Sock, frame->IpAddr, frame->Port, &iov, 1);
+
+        if (1 == status)
+        {
+            udp_backoff();
+        }
+        else
+        {
+            if (0 > status)
             {
-                ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+                Udp_TxQueue.Errors++;
             }
             else
             {
-//                ESP_LOGI(TAG, "Message sent");
+                Udp_TxQueue.BackoffMs = 0U;
+            }
+
+            Udp_TxQueue.Head = (Udp_TxQueue.Head + 1U) % UDP_TX_QUEUE_LENGTH;
+            Udp_TxQueue.Count--;
+        }
+    }
+}
+
+static void udp_send(int sock, uint32_t ipAddr, uint16_t port, const KNXnetIP_TxFrameType * txFrame)
+{
+    if (sock < 0)
+    {
+        ESP_LOGE(TAG, "Failed to get IPv4 socket");
+    }
+    else if (0U == Udp_TxQueue.Count)
+    {
+        /* Nothing waiting, the frame goes straight out */
+        struct iovec iov[1U + KNXNETIP_TX_SEGMENT_NUM];
+        int status = udp_sendmsg(sock, ipAddr, port, &iov[0], udp_iov(txFrame, &iov[0]));
+
+        if (1 == status)
+        {
+            udp_enqueue(sock, ipAddr, port, txFrame);
+            udp_backoff();
+        }
+        else if (0 > status)
+        {
+            Udp_TxQueue.Errors++;
+        }
+        else
+        {
+            Udp_TxQueue.BackoffMs = 0U;
+        }
+    }
+    else
+    {
+        /* Behind the frames already waiting, to keep the order */
+        udp_enqueue(sock, ipAddr, port, txFrame);
+
+        if (udp_time_ms() >= Udp_TxQueue.RetryMs)
+        {
+            udp_flush();
+        }
+    }
+}
+
+static int udp_drain(int sock)
+{
+    uint8_t count = 0U;
+    int status = 0;
+
+    /* Everything queued on the socket, up to one pool, is read before any of it is processed */
+    while ((UDP_RX_BATCH_SIZE > count) && (0 == status))
+    {
+        Udp_RxDatagramType * datagram = &Udp_RxPool[count];
+        struct sockaddr_storage raddr;
+        socklen_t socklen = sizeof(raddr);
+        uint8_t * dataPtr;
+        int len;
+
+        /* An empty pool is counted there, the datagram is still read so select() settles */
+        datagram->Frame = KnxFrameBuffer_Alloc();
+        dataPtr = (KNX_FRAME_BUFFER_INVALID == datagram->Frame) ? &Udp_RxDiscard[0] : KnxFrameBuffer_Frame(datagram->Frame);
+
+        len = recvfrom(sock, dataPtr, UDP_RX_BUFFER_SIZE, MSG_DONTWAIT, (struct sockaddr *)&raddr, &socklen);
+
+#ifdef KNXNETIP_UDP_RX_STATISTICS
+        Udp_RxStatistic.Syscalls++;
+#endif /* KNXNETIP_UDP_RX_STATISTICS */
+
+        if ((0 <= len) && (KNX_FRAME_BUFFER_INVALID != datagram->Frame))
+        {
+            KnxFrameBuffer_Get(datagram->Frame)->Length = (uint16_t)len;
+            datagram->IpAddr = htonl(((struct sockaddr_in *)&raddr)->sin_addr.s_addr);
+            datagram->Port = htons(((struct sockaddr_in *)&raddr)->sin_port);
+            count++;
+        }
+        else if (0 <= len)
+        {
+            /* Dropped */
+        }
+        else if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+        {
+            /* Queue is empty */
+            KnxFrameBuffer_Release(datagram->Frame);
+            status = 1;
+        }
+        else
+        {
+            ESP_LOGE(TAG, "recvfrom failed: errno %d", errno);
+            KnxFrameBuffer_Release(datagram->Frame);
+            status = -1;
+        }
+    }
+
+    for (uint8_t index = 0; index < count; index++)
+    {
+        PduInfoType lpdu;
+        lpdu.SduDataPtr = KnxFrameBuffer_Frame(Udp_RxPool[index].Frame);
+        lpdu.SduLength = KnxFrameBuffer_Get(Udp_RxPool[index].Frame)->Length;
+
+        /* Call L_Data_Ind to inform IP DataLinkLayer, the frame buffer goes with it */
+        IP_L_Data_Ind(&lpdu, Udp_RxPool[index].Frame, Udp_RxPool[index].IpAddr, Udp_RxPool[index].Port, IPV4_UDP, -1);
+    }
+
+#ifdef KNXNETIP_UDP_RX_STATISTICS
+    Udp_RxStatistic.Batches++;
+    Udp_RxStatistic.Datagrams += count;
+    Udp_RxStatistic.MaxBatch = MAX(Udp_RxStatistic.MaxBatch, count);
+#endif /* KNXNETIP_UDP_RX_STATISTICS */
+
+    return (0 > status) ? status : count;
+}
+
+static void udp_dequeue_socket(int sock)
+{
+    uint8_t kept = 0U;
+
+    /* Frames still waiting to leave from a socket about to close are dropped, */
+    /* the others move up in order, the descriptor may be reused right away    */
+    for (uint8_t position = 0; position < Udp_TxQueue.Count; position++)
+    {
+        const Udp_TxFrameType * frame = &Udp_TxQueue.Frame[(Udp_TxQueue.Head + position) % UDP_TX_QUEUE_LENGTH];
+
+        if (sock == frame->Sock)
+        {
+            Udp_TxQueue.Dropped++;
+        }
+        else
+        {
+            if (kept != position)
+            {
+                Udp_TxQueue.Frame[(Udp_TxQueue.Head + kept) % UDP_TX_QUEUE_LENGTH] = *frame;
             }
-        } while (-1 == err);
+
+            kept++;
+        }
+    }
+
+    Udp_TxQueue.Count = kept;
+}
+
+static void udp_data_endpoint_check(void)
+{
+    /* Channels are freed by DISCONNECT_REQUEST or taken over by TCP, */
+    /* their data endpoints close here so select() never loses an fd */
+    for (uint8_t index = 0; index < KNX_CHANNEL_NUM; index++)
+    {
+        KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(CHANNEL_1 + index);
+
+        if ((0 <= Udp_DataSocket[index]) && ((NULL == channel) || (IPV4_UDP != channel->Protocol)))
+        {
+            ESP_LOGI(TAG, "Data endpoint of channel %d closed", CHANNEL_1 + index);
+            udp_dequeue_socket(Udp_DataSocket[index]);
+            close(Udp_DataSocket[index]);
+            Udp_DataSocket[index] = -1;
+        }
+    }
+}
+
+void KNXnetIP_TxFrameInit(KNXnetIP_TxFrameType * txFrame, uint16_t serviceType)
+{
+    txFrame->Header[0] = HEADER_SIZE_10;
+    txFrame->Header[1] = KNXNETIP_VERSION_10;
+    txFrame->Header[2] = (uint8_t)((serviceType & 0xFF00) >> 8);
+    txFrame->Header[3] = serviceType & 0xFFU;
+    txFrame->HeaderLength = HEADER_SIZE_10;
+    txFrame->SegmentCount = 0U;
+    txFrame->Length = HEADER_SIZE_10;
+
+    udp_frame_length(txFrame);
+}
+
+void KNXnetIP_TxFrameConnectionHeader(KNXnetIP_TxFrameType * txFrame, uint8_t channelId, uint8_t sequenceCounter)
+{
+    txFrame->Header[HEADER_SIZE_10] = CONNECTION_HEADER_SIZE;
+    txFrame->Header[HEADER_SIZE_10 + 1U] = channelId;
+    txFrame->Header[HEADER_SIZE_10 + 2U] = sequenceCounter;
+    txFrame->Header[HEADER_SIZE_10 + 3U] = 0x00U;
+    txFrame->HeaderLength = HEADER_SIZE_10 + CONNECTION_HEADER_SIZE;
+    txFrame->Length += CONNECTION_HEADER_SIZE;
+
+    udp_frame_length(txFrame);
+}
+
+void KNXnetIP_TxFrameAppend(KNXnetIP_TxFrameType * txFrame, const uint8_t * dataPtr, uint16_t length)
+{
+    if (KNXNETIP_TX_SEGMENT_NUM <= txFrame->SegmentCount)
+    {
+        ESP_LOGE(TAG, "TxFrameAppend: too many segments");
+    }
+    else
+    {
+        /* Referenced only, the data has to stay put until the frame is sent */
+        txFrame->Segment[txFrame->SegmentCount].DataPtr = dataPtr;
+        txFrame->Segment[txFrame->SegmentCount].Length = length;
+        txFrame->SegmentCount++;
+        txFrame->Length += length;
+
+        udp_frame_length(txFrame);
+    }
+}
+
+uint16_t KNXnetIP_TxFrameGather(const KNXnetIP_TxFrameType * txFrame, uint16_t offset, uint8_t * destPtr)
+{
+    uint16_t skip = MIN(offset, txFrame->HeaderLength);
+    uint16_t gathered = txFrame->HeaderLength - skip;
+
+    /* Bytes from offset on, for a frame the socket did not take in full */
+    memcpy(&destPtr[0], &txFrame->Header[skip], gathered);
+    offset -= skip;
+
+    for (uint8_t index = 0; index < txFrame->SegmentCount; index++)
+    {
+        const KNXnetIP_TxSegmentType * segment = &txFrame->Segment[index];
+
+        skip = MIN(offset, segment->Length);
+        memcpy(&destPtr[gathered], &segment->DataPtr[skip], segment->Length - skip);
+        gathered += segment->Length - skip;
+        offset -= skip;
+    }
+
+    return gathered;
+}
+
+void KNXnetIP_UDPSend(uint32_t ipAddr, uint16_t port, const KNXnetIP_TxFrameType * txFrame)
+{
+    /* Control endpoint, port 3671 */
+    udp_send(KNXnetIP_MulticastSocket, ipAddr, port, txFrame);
+}
+
+void KNXnetIP_UDPDataSend(uint8_t channelId, uint32_t ipAddr, uint16_t port, const KNXnetIP_TxFrameType * txFrame)
+{
+    int sock = KNXnetIP_MulticastSocket;
+
+    /* Frames of a tunnel leave from its data endpoint, the client matches on it */
+    if ((CHANNEL_1 <= channelId) && (KNX_CHANNEL_NUM >= channelId) && (0 <= Udp_DataSocket[channelId - CHANNEL_1]))
+    {
+        sock = Udp_DataSocket[channelId - CHANNEL_1];
+    }
+
+    udp_send(sock, ipAddr, port, txFrame);
+}
+
+bool KNXnetIP_UDPDataEndpointOpen(uint8_t channelId, KNXnetIP_HPAIType * hpai)
+{
+    bool opened = false;
+
+    if ((CHANNEL_1 <= channelId) && (KNX_CHANNEL_NUM >= channelId))
+    {
+        int * sock = &Udp_DataSocket[channelId - CHANNEL_1];
+
+        /* A channel ID taken again before the old socket was closed keeps it */
+        if (*sock < 0)
+        {
+            *sock = create_unicast_ipv4_socket(htonl(INADDR_ANY), UDP_DATA_ENDPOINT_PORT(channelId));
+        }
+
+        if (0 <= *sock)
+        {
+            hpai->StructureLength = 0x08U;
+            hpai->HostProtocolCode = IPV4_UDP;
+            hpai->ipAddress = ntohl(KnxIPInterface_IpAddr);
+            hpai->portNumber = UDP_DATA_ENDPOINT_PORT(channelId);
+
+            opened = true;
+        }
     }
+
+    return opened;
+}
+
+uint32_t KNXnetIP_UDPMainFunction(void)
+{
+    uint32_t timeoutMs = KNXNETIP_UDP_NO_TIMEOUT;
+    int64_t nowMs = udp_time_ms();
+    uint32_t events = Udp_TxQueue.Retries + Udp_TxQueue.Dropped + Udp_TxQueue.Errors;
+
+    if ((0U < Udp_TxQueue.Count) && (nowMs >= Udp_TxQueue.RetryMs))
+    {
+        udp_flush();
+    }
+
+    if (0U < Udp_TxQueue.Count)
+    {
+        timeoutMs = (uint32_t)MAX(Udp_TxQueue.RetryMs - nowMs, 1);
+    }
+
+    if ((nowMs >= Udp_TxQueue.ReportMs) && (events != Udp_TxQueue.Reported))
+    {
+        ESP_LOGW(TAG, "Send: %lu retries, %lu dropped, %lu lost, %u queued",
+                 (unsigned long)Udp_TxQueue.Retries, (unsigned long)Udp_TxQueue.Dropped,
+                 (unsigned long)Udp_TxQueue.Errors, Udp_TxQueue.Count);
+
+        Udp_TxQueue.Reported = events;
+        Udp_TxQueue.ReportMs = nowMs + UDP_REPORT_MS;
+    }
+
+#ifdef KNXNETIP_UDP_RX_STATISTICS
+    if ((nowMs >= Udp_RxStatistic.ReportMs) && (0U < Udp_RxStatistic.Batches))
+    {
+        ESP_LOGI(TAG, "Receive: %lu datagrams in %lu batches (%lu.%02lu per wakeup, max %u), %lu recvfrom calls",
+                 (unsigned long)Udp_RxStatistic.Datagrams, (unsigned long)Udp_RxStatistic.Batches,
+                 (unsigned long)(Udp_RxStatistic.Datagrams / Udp_RxStatistic.Batches),
+                 (unsigned long)(((Udp_RxStatistic.Datagrams % Udp_RxStatistic.Batches) * 100U) / Udp_RxStatistic.Batches),
+                 Udp_RxStatistic.MaxBatch, (unsigned long)Udp_RxStatistic.Syscalls);
+
+        memset(&Udp_RxStatistic, 0, sizeof(Udp_RxStatistic));
+        Udp_RxStatistic.ReportMs = nowMs + UDP_REPORT_MS;
+    }
+#endif /* KNXNETIP_UDP_RX_STATISTICS */
+
+    return timeoutMs;
 }
 
 void udp_mcast_task(void *pvParameters)
@@ -212,17 +742,47 @@ void udp_mcast_task(void *pvParameters)
 
         /* Loop waiting for UDP received */
         int err = 1;
+        uint32_t routingTimeoutMs = KNXNETIP_ROUTING_NO_TIMEOUT;
+        uint32_t discoveryTimeoutMs = KNXNETIP_DISCOVERY_NO_TIMEOUT;
+        uint32_t udpTimeoutMs = KNXNETIP_UDP_NO_TIMEOUT;
+        uint32_t timerTimeoutMs = KNX_TIMER_NO_TIMEOUT;
         while (err > 0)
         {
             struct timeval tv = {
                 .tv_sec = 2,
                 .tv_usec = 0,
             };
+            uint32_t timeoutMs = MIN(MIN(routingTimeoutMs, discoveryTimeoutMs), MIN(udpTimeoutMs, timerTimeoutMs));
+            int doorbell = KNXnetIP_TunnellingDoorbell(KNXNETIP_TRANSPORT_UDP);
+            int routingDoorbell = KNXnetIP_RoutingDoorbell();
+            int maxfd = MAX(MAX(KNXnetIP_MulticastSocket, doorbell), routingDoorbell);
             fd_set rfds;
             FD_ZERO(&rfds);
             FD_SET(KNXnetIP_MulticastSocket, &rfds);
+            FD_SET(doorbell, &rfds);
+            FD_SET(routingDoorbell, &rfds);
 
-            int s = select(KNXnetIP_MulticastSocket + 1, &rfds, NULL, NULL, &tv);
+            /* Data endpoints have their own receive queues, tunnelling frames */
+            /* never wait behind search floods on the control endpoint         */
+            for (uint8_t index = 0; index < KNX_CHANNEL_NUM; index++)
+            {
+                if (0 <= Udp_DataSocket[index])
+                {
+                    FD_SET(Udp_DataSocket[index], &rfds);
+                    maxfd = MAX(maxfd, Udp_DataSocket[index]);
+                }
+            }
+
+            if (timeoutMs < 2000U)
+            {
+                /* Routing indications held back by the rate limiter or ROUTING_BUSY, */
+                /* search responses waiting for their random delay, datagrams       */
+                /* waiting for lwIP buffers or the next protocol timer               */
+                tv.tv_sec = 0;
+                tv.tv_usec = timeoutMs * 1000U;
+            }
+
+            int s = select(maxfd + 1, &rfds, NULL, NULL, &tv);
             if (s < 0)
             {
                 ESP_LOGE(TAG, "Select failed: errno %d", errno);
@@ -231,49 +791,48 @@ void udp_mcast_task(void *pvParameters)
             }
             else if (s > 0)
             {
-                if (FD_ISSET(KNXnetIP_MulticastSocket, &rfds))
+                if (FD_ISSET(doorbell, &rfds))
                 {
-                    /* Incoming datagram received */
-                    char recvbuf[512];
-                    char raddr_name[32] = { 0 };
-                    uint32_t ipAddr;
-                    uint16_t port;
-
-                    struct sockaddr_storage raddr;
-                    socklen_t socklen = sizeof(raddr);
-                    int len = recvfrom(KNXnetIP_MulticastSocket, recvbuf, sizeof(recvbuf)-1, 0,
-                                       (struct sockaddr *)&raddr, &socklen);
-                    if (len < 0)
-                    {
-                        ESP_LOGE(TAG, "multicast recvfrom failed: errno %d", errno);
-                        err = -1;
-                        break;
-                    }
+                    /* Tunnelling requests queued by the tpuart task */
+                    KNXnetIP_TunnellingMainFunction(KNXNETIP_TRANSPORT_UDP);
+                }
+
+                /* Tunnel traffic first, then the control endpoint */
+                for (uint8_t index = 0; index < KNX_CHANNEL_NUM; index++)
+                {
+                    int dataSocket = Udp_DataSocket[index];
 
-                    /* Get the sender's address as a string */
-                    if (raddr.ss_family == PF_INET)
+                    if ((0 <= dataSocket) && FD_ISSET(dataSocket, &rfds))
                     {
-                        inet_ntoa_r(((struct sockaddr_in *)&raddr)->sin_addr,
-                                    raddr_name, sizeof(raddr_name)-1);
+                        (void)udp_drain(dataSocket);
                     }
+                }
 
-                    ipAddr = htonl(((struct sockaddr_in *)&raddr)->sin_addr.s_addr);
-                    port = htons(((struct sockaddr_in *)&raddr)->sin_port);
-
-//                    ESP_LOGI(TAG, "received %d bytes from %s:%d", len, raddr_name, port);
-
-                    PduInfoType lpdu;
-                    lpdu.SduDataPtr = (uint8_t *)&recvbuf;
-                    lpdu.SduLength = (uint8_t)len;
-
-                    /* Call L_Data_Ind to inform IP DataLinkLayer */
-                    IP_L_Data_Ind(&lpdu, ipAddr, port, IPV4_UDP);
+                if (FD_ISSET(KNXnetIP_MulticastSocket, &rfds) && (0 > udp_drain(KNXnetIP_MulticastSocket)))
+                {
+                    err = -1;
+                    break;
                 }
             }
             else
             { 
                 /* Socket idle. */
             }
+
+            /* Data endpoints of channels freed meanwhile */
+            udp_data_endpoint_check();
+
+            /* Multicast ROUTING_INDICATION queued by the tpuart task */
+            routingTimeoutMs = KNXnetIP_RoutingMainFunction((s > 0) && FD_ISSET(routingDoorbell, &rfds));
+
+            /* Delayed search responses */
+            discoveryTimeoutMs = KNXnetIP_DiscoveryMainFunction();
+
+            /* Datagrams queued by a transient send error */
+            udpTimeoutMs = KNXnetIP_UDPMainFunction();
+
+            /* Tunnelling ack and connection heartbeat timeouts of the UDP channels */
+            timerTimeoutMs = KNXnetIP_TimerMainFunction(KNXNETIP_TRANSPORT_UDP);
         }
 
         ESP_LOGE(TAG, "Shutting down socket and restarting...");
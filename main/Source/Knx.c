@@ -3,12 +3,14 @@
 #include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "esp_system.h"
 #include "esp_eth.h"
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_netif.h"
 #include "nvs_flash.h"
+#include "esp_vfs_eventfd.h"
 
 #include "driver/uart.h"
 #include "driver/gpio.h"
@@ -21,11 +23,17 @@
 #include "KnxEthernet.h"
 #include "KnxWiFi.h"
 #include "KNXnetIP.h"
+#include "KNXnetIP_Routing.h"
+#include "KNXnetIP_Discovery.h"
 #include "KnxTpUart2_Services.h"
 #include "Pdu.h"
 
 #include "TpUart2_DataLinkLayer.h"
 #include "TP_DataLinkLayer.h"
+#include "KnxFrameBuffer.h"
+#include "KnxGroupFilter.h"
+#include "IP_DataLinkLayer.h"
+#include "KnxTimer.h"
 
 #define TX_TPUART2    (GPIO_NUM_17)
 #define RX_TPUART2    (GPIO_NUM_18)
@@ -39,6 +47,20 @@
 
 static const char *TAG = "Knx Eth sta";
 
+/* UART driver events, the rx task sleeps on these and the TP_GW doorbell */
+#define KNX_UART_EVENT_QUEUE_LENGTH (20U)
+
+static QueueHandle_t Knx_UartEventQueue;
+static QueueSetHandle_t Knx_TpUartQueueSet;
+
+#ifdef TPUART2_RX_SLEEP
+/* Sleeps of the polled receive path after each frame from the bus: behind */
+/* the tunnel to IP hand-off and before the confirm check. Kept to measure */
+/* that path against the event driven one with TPUART2_RX_LATENCY          */
+#define KNX_RX_SLEEP_TUNNEL_MS      (50U)
+#define KNX_RX_SLEEP_CONFIRM_MS     (5U)
+#endif /* TPUART2_RX_SLEEP */
+
 typedef struct {
     uart_port_t uartPort;
     const uart_config_t * uartConfig;
@@ -48,6 +70,7 @@ typedef struct {
     uint16_t rxTimeout;
     uint16_t txTimeout;
     uint16_t rxBufferSize;
+    uint16_t txBufferSize;
 } Knx_UartCfgType;
 
 const uart_config_t TPUART2_CFG = 
@@ -70,6 +93,7 @@ const Knx_UartCfgType KNXTPUART_CFG =
     100, /* Rx Timeout */
     200, /* Tx Timeout */
     3072, /* Rx Buffer Size */
+    512, /* Tx Buffer Size, lets frame writes return without waiting for the FIFO */
 };
 
 static void tpuart_rx_task(void *arg)
@@ -77,96 +101,66 @@ static void tpuart_rx_task(void *arg)
     static const char *RX_TASK_TAG = "TPUART_RX_TASK";
     esp_log_level_set(RX_TASK_TAG, ESP_LOG_INFO);
     uint8_t* data = (uint8_t*) malloc(3073);
-    uint8_t layer2Service;
-    uint8_t dataStartOffset;
-    PduInfoType lpdu;
 
-    while (1) {
-        const int rxBytes = uart_read_bytes(UART_NUM_1, data, 3072, 20/portTICK_PERIOD_MS);
-        if (rxBytes > 0) {
-            data[rxBytes] = 0;
-            
-#ifdef KNXNETIP_DEBUG_LOGGING
-            ESP_LOGI(RX_TASK_TAG, "Read %d bytes", rxBytes);
-            ESP_LOG_BUFFER_HEXDUMP(RX_TASK_TAG, data, rxBytes, ESP_LOG_INFO);
-#endif /* KNXNETIP_DEBUG_LOGGING */
+    uart_event_t event;
 
-            lpdu.SduDataPtr = &data[0];
-            dataStartOffset = 0U;
+    while (1) {
+        uint32_t timeoutMs = TpUart2_GetNextTimeoutMs();
+        TickType_t waitTicks = (TPUART2_NO_TIMEOUT == timeoutMs) ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
 
-            layer2Service = data[0] & TPUART2_LAYER2_SERVICE_MASK;
+        /* Woken by received bytes, frames from the network tasks or the next L_Data.con deadline */
+        QueueSetMemberHandle_t member = xQueueSelectFromSet(Knx_TpUartQueueSet, waitTicks);
 
-#ifdef TPUART2_STATEINDICATION_ENABLED
-            if ( TPUART2_STATEINDICATION == (data[0] & TPUART2_STATE_INDICATION_MASK))
-            {
-                if ( 1 < rxBytes)
+        if ((QueueSetMemberHandle_t)TP_GW_GetDoorbell() == member) {
+            xSemaphoreTake(TP_GW_GetDoorbell(), 0);
+        }
+        else if (((QueueSetMemberHandle_t)Knx_UartEventQueue == member) &&
+                 (pdTRUE == xQueueReceive(Knx_UartEventQueue, &event, 0))) {
+            switch (event.type) {
+                case UART_DATA:
                 {
-                    /* A received L-Data Frame followed by the State indication as noted in */
-                    /* Siemens KNX EIB TP-UART 2-IC Technical Manual, section 3.2.3.1.12.3, */
-                    /* title TP-UART-State.indication/response Service.                     */
-                    /* That means we have the data at offset 1, so set the offset to 1.     */
-                    dataStartOffset = 1U;
+                    const int rxBytes = uart_read_bytes(KNXTPUART_CFG.uartPort, data, MIN(event.size, 3072), 0);
+                    if (rxBytes > 0) {
+                        data[rxBytes] = 0;
 
-                    ESP_LOGW("TP-UART2+", "Received prior Status Code, applying offset to data.");
+#ifdef KNXNETIP_DEBUG_LOGGING
+                        ESP_LOGI(RX_TASK_TAG, "Read %d bytes", rxBytes);
+                        ESP_LOG_BUFFER_HEXDUMP(RX_TASK_TAG, data, rxBytes, ESP_LOG_INFO);
+#endif /* KNXNETIP_DEBUG_LOGGING */
 
-                    /* Update Layer-2 Service */
-                    layer2Service = data[dataStartOffset] & TPUART2_LAYER2_SERVICE_MASK;
-                }
+#ifdef TPUART2_RX_SLEEP
+                        uint32_t frames = TpUart2_GetRxStatistics()->Frames;
+#endif /* TPUART2_RX_SLEEP */
 
-                if (TPUART2_STATE_SLAVE_COLLISION == (TPUART2_STATE_SLAVE_COLLISION & data[0]))
-                {
-                    ESP_LOGW("TP-UART2+", "SC:Slave Collision");
-                }
-                if (TPUART2_STATE_RECEIVE_ERROR == (TPUART2_STATE_RECEIVE_ERROR & data[0]))
-                {
-                    ESP_LOGW("TP-UART2+", "RE:Receive Error");
-                }
-                if (TPUART2_STATE_TRANSMIT_ERROR == (TPUART2_STATE_TRANSMIT_ERROR & data[0]))
-                {
-                    ESP_LOGW("TP-UART2+", "TE:Transmit Error");
-                }
-                if (TPUART2_STATE_PROTOCOL_ERROR == (TPUART2_STATE_PROTOCOL_ERROR & data[0]))
-                {
-                    ESP_LOGW("TP-UART2+", "PE:Protocol Error");
-                }
-                if (TPUART2_STATE_TEMP_WARNING == (TPUART2_STATE_TEMP_WARNING & data[0]))
-                {
-                    ESP_LOGW("TP-UART2+", "TW: Temperature Warning");
-                }
-            }
-#endif /* TPUART2_STATEINDICATION_ENABLED */
+                        /* Frames, confirms and indications may be split across or */
+                        /* packed into reads, the parser keeps state between them   */
+                        TpUart2_RxIndication(&data[0], (uint16_t)rxBytes);
 
-            if (((TPUART2_LAYER2_L_DATA_REQ == layer2Service) ||
-                 (TPUART2_LAYER2_L_EXT_DATA_REQ == layer2Service)))
-            {
-                if(true == TpUart2_DetectEOP(&data[dataStartOffset], (rxBytes - dataStartOffset), &lpdu.SduLength))
-                {
-                    lpdu.SduDataPtr = &data[dataStartOffset];
-
-                    /* Call L_Data_Ind to inform TP DataLinkLayer */
-                    TpUart2_L_Data_Ind(&lpdu);
-
-                    vTaskDelay(5/portTICK_PERIOD_MS);
-
-                    /* Check for data confirmation byte */
-                    /* The L_DATA.confirm service is transmitted to the host if an */
-                    /* acknowledge was received or if the last repetition is       */
-                    /* transmitted and no acknowledge was received.                */
-                    /* 0x8B = The transmission of the L_DATA-frame was successful  */
-                    /* 0x0B = The transmission of the L_DATA-frame was not successful */
-                    if ((lpdu.SduLength < rxBytes) && (0x8BU == data[lpdu.SduLength + 1]))
-                    {
-                        /* Send ACK */
-                        TP_GW_L_Data_Ind_ACK(&lpdu);
+#ifdef TPUART2_RX_SLEEP
+                        frames = TpUart2_GetRxStatistics()->Frames - frames;
+                        vTaskDelay(pdMS_TO_TICKS(frames * (KNX_RX_SLEEP_TUNNEL_MS + KNX_RX_SLEEP_CONFIRM_MS)));
+#endif /* TPUART2_RX_SLEEP */
                     }
+                    break;
                 }
-                else
-                {
-                    /* Invalid data packet from TpUart2+ */
-                    ESP_LOGW(RX_TASK_TAG, "Invalid data packet received from TpUart2+");
-                }
+
+                case UART_FIFO_OVF:
+                case UART_BUFFER_FULL:
+                    /* Bytes were lost, the parser resynchronises on the next frame start */
+                    ESP_LOGW(RX_TASK_TAG, "UART rx overflow");
+                    uart_flush_input(KNXTPUART_CFG.uartPort);
+                    break;
+
+                default:
+                    break;
             }
         }
+
+        /* Queue frames from the network tasks for the bus */
+        TP_GW_MainFunction();
+
+        /* Supervise frames still waiting for their L_Data.con */
+        TpUart2_MainFunction();
     }
     free(data);
 }
@@ -174,6 +168,9 @@ static void tpuart_rx_task(void *arg)
 static void got_network_connection()
 {
     ESP_LOGI(TAG, "successfully established network connection!");
+
+    /* Discovery responses carry the interface address */
+    KNXnetIP_ResponseCacheInvalidate();
 }
 
 void app_main(void)
@@ -181,7 +178,7 @@ void app_main(void)
     ESP_LOGI("KnxIpInterface", "ESP32 Knx Stack v0.1");
 
     // Initialize UART
-    uart_driver_install(KNXTPUART_CFG.uartPort, KNXTPUART_CFG.rxBufferSize * 2, 0, 0, NULL, 0);
+    uart_driver_install(KNXTPUART_CFG.uartPort, KNXTPUART_CFG.rxBufferSize * 2, KNXTPUART_CFG.txBufferSize, KNX_UART_EVENT_QUEUE_LENGTH, &Knx_UartEventQueue, 0);
     uart_param_config(KNXTPUART_CFG.uartPort, KNXTPUART_CFG.uartConfig);
     uart_set_pin(KNXTPUART_CFG.uartPort, KNXTPUART_CFG.txdPin, KNXTPUART_CFG.rxdPin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
 
@@ -198,7 +195,32 @@ void app_main(void)
     wifi_init_sta();
 #endif /* KNXNETIP_USE_WIFI_INTERFACE */
 
+    /* Doorbells between the tpuart task and the network tasks */
+    esp_vfs_eventfd_config_t eventfdConfig = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_vfs_eventfd_register(&eventfdConfig));
+
+    /* Frames travel between the tasks in these buffers */
+    KnxFrameBuffer_Init();
+
+    KNXnetIP_TimerInit();
     KNXnetIP_TunnellingInit();
+    KNXnetIP_RoutingInit();
+    KNXnetIP_DiscoveryInit();
+    TpUart2_Init();
+    KnxGroupFilter_Init();
+    TP_GW_Init();
+
+    Knx_TpUartQueueSet = xQueueCreateSet(KNX_UART_EVENT_QUEUE_LENGTH + 1U);
+    xQueueAddToSet(Knx_UartEventQueue, Knx_TpUartQueueSet);
+    xQueueAddToSet(TP_GW_GetDoorbell(), Knx_TpUartQueueSet);
+
+#ifdef KNXNETIP_DISPATCH_BENCHMARK
+    IP_DispatchBenchmark();
+#endif /* KNXNETIP_DISPATCH_BENCHMARK */
+
+#ifdef KNX_TIMER_BENCHMARK
+    KnxTimer_Benchmark();
+#endif /* KNX_TIMER_BENCHMARK */
 
 #ifdef KNXNETIP_USE_ETH_INTERFACE
     /* Initialize Ethernet */
@@ -0,0 +1,256 @@
+/**
+ * \file KnxFrameBuffer.c
+ *
+ * \brief Knx Frame Buffer Pool
+ *
+ * This file contains the implementation of the reference counted frame
+ * buffers passed by handle between the IP and TP layers
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "string.h"
+#include "esp_system.h"
+#include "esp_log.h"
+
+#include "KnxFrameBuffer.h"
+
+/*==================[macros]================================================*/
+#ifdef KNX_FRAME_BUFFER_STATISTICS
+/* Buffers handed out between two reports */
+#define KNX_FRAME_BUFFER_REPORT_FRAMES (1000U)
+#endif /* KNX_FRAME_BUFFER_STATISTICS */
+
+/*==================[type definitions]======================================*/
+
+/*==================[external function declarations]========================*/
+void KnxFrameBuffer_Init(void);
+KnxFrameBuffer_HandleType KnxFrameBuffer_Alloc(void);
+KnxFrameBuffer_HandleType KnxFrameBuffer_AllocCopy(const uint8_t * dataPtr, uint16_t length);
+KnxFrameBuffer_HandleType KnxFrameBuffer_Clone(KnxFrameBuffer_HandleType handle);
+void KnxFrameBuffer_Ref(KnxFrameBuffer_HandleType handle);
+void KnxFrameBuffer_Release(KnxFrameBuffer_HandleType handle);
+KnxFrameBuffer_Type * KnxFrameBuffer_Get(KnxFrameBuffer_HandleType handle);
+uint8_t * KnxFrameBuffer_Frame(KnxFrameBuffer_HandleType handle);
+uint8_t * KnxFrameBuffer_Push(KnxFrameBuffer_HandleType handle, uint16_t length);
+uint8_t * KnxFrameBuffer_Pull(KnxFrameBuffer_HandleType handle, uint16_t length);
+uint16_t KnxFrameBuffer_Copy(KnxFrameBuffer_HandleType handle, uint8_t * destPtr);
+const KnxFrameBuffer_StatisticsType * KnxFrameBuffer_Statistics(void);
+
+/*==================[internal function declarations]========================*/
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+/* Shared by the tpuart and network tasks, the free stack is guarded by the lock, */
+/* the reference counts are atomic so holders never take it                       */
+static portMUX_TYPE KnxFrameBuffer_Lock = portMUX_INITIALIZER_UNLOCKED;
+static KnxFrameBuffer_Type KnxFrameBuffer_Pool[KNX_FRAME_BUFFER_NUM];
+static KnxFrameBuffer_HandleType KnxFrameBuffer_FreeStack[KNX_FRAME_BUFFER_NUM];
+static uint8_t KnxFrameBuffer_FreeCount;
+static KnxFrameBuffer_StatisticsType KnxFrameBuffer_Statistic;
+
+/*==================[external function definitions]=========================*/
+void KnxFrameBuffer_Init(void)
+{
+    for (uint8_t index = 0; index < KNX_FRAME_BUFFER_NUM; index++)
+    {
+        atomic_init(&KnxFrameBuffer_Pool[index].RefCount, 0U);
+        KnxFrameBuffer_FreeStack[index] = index;
+    }
+
+    KnxFrameBuffer_FreeCount = KNX_FRAME_BUFFER_NUM;
+    memset(&KnxFrameBuffer_Statistic, 0, sizeof(KnxFrameBuffer_Statistic));
+}
+
+KnxFrameBuffer_HandleType KnxFrameBuffer_Alloc(void)
+{
+    KnxFrameBuffer_HandleType handle = KNX_FRAME_BUFFER_INVALID;
+
+    taskENTER_CRITICAL(&KnxFrameBuffer_Lock);
+
+    if (0U == KnxFrameBuffer_FreeCount)
+    {
+        KnxFrameBuffer_Statistic.Exhausted++;
+    }
+    else
+    {
+        handle = KnxFrameBuffer_FreeStack[--KnxFrameBuffer_FreeCount];
+
+        KnxFrameBuffer_Statistic.Frames++;
+        KnxFrameBuffer_Statistic.InUse = KNX_FRAME_BUFFER_NUM - KnxFrameBuffer_FreeCount;
+        KnxFrameBuffer_Statistic.HighWater = MAX(KnxFrameBuffer_Statistic.HighWater, KnxFrameBuffer_Statistic.InUse);
+    }
+
+    taskEXIT_CRITICAL(&KnxFrameBuffer_Lock);
+
+    if (KNX_FRAME_BUFFER_INVALID != handle)
+    {
+        KnxFrameBuffer_Type * buffer = &KnxFrameBuffer_Pool[handle];
+
+        buffer->Offset = KNX_FRAME_BUFFER_HEADROOM;
+        buffer->Length = 0U;
+        atomic_store_explicit(&buffer->RefCount, 1U, memory_order_relaxed);
+#ifdef KNX_FRAME_BUFFER_TIMESTAMP
+        buffer->RxTimestampUs = 0;
+#endif /* KNX_FRAME_BUFFER_TIMESTAMP */
+
+#ifdef KNX_FRAME_BUFFER_STATISTICS
+        if (0U == (KnxFrameBuffer_Statistic.Frames % KNX_FRAME_BUFFER_REPORT_FRAMES))
+        {
+            ESP_LOGI("KnxFrameBuffer", "%lu frames, %lu.%02lu copies per frame, %u of %u buffers in use, high water %u, %lu exhausted",
+                     (unsigned long)KnxFrameBuffer_Statistic.Frames,
+                     (unsigned long)(KnxFrameBuffer_Statistic.Copies / KnxFrameBuffer_Statistic.Frames),
+                     (unsigned long)(((KnxFrameBuffer_Statistic.Copies % KnxFrameBuffer_Statistic.Frames) * 100U) / KnxFrameBuffer_Statistic.Frames),
+                     KnxFrameBuffer_Statistic.InUse, KNX_FRAME_BUFFER_NUM,
+                     KnxFrameBuffer_Statistic.HighWater,
+                     (unsigned long)KnxFrameBuffer_Statistic.Exhausted);
+        }
+#endif /* KNX_FRAME_BUFFER_STATISTICS */
+    }
+
+    return handle;
+}
+
+KnxFrameBuffer_HandleType KnxFrameBuffer_AllocCopy(const uint8_t * dataPtr, uint16_t length)
+{
+    KnxFrameBuffer_HandleType handle = KNX_FRAME_BUFFER_INVALID;
+
+    if ((KNX_FRAME_BUFFER_SIZE - KNX_FRAME_BUFFER_HEADROOM) >= length)
+    {
+        handle = KnxFrameBuffer_Alloc();
+    }
+
+    if (KNX_FRAME_BUFFER_INVALID != handle)
+    {
+        KnxFrameBuffer_Type * buffer = &KnxFrameBuffer_Pool[handle];
+
+        memcpy(&buffer->Data[buffer->Offset], dataPtr, length);
+        buffer->Length = length;
+
+        KnxFrameBuffer_Statistic.Copies++;
+    }
+
+    return handle;
+}
+
+KnxFrameBuffer_HandleType KnxFrameBuffer_Clone(KnxFrameBuffer_HandleType handle)
+{
+    KnxFrameBuffer_HandleType clone = KnxFrameBuffer_Alloc();
+
+    if (KNX_FRAME_BUFFER_INVALID != clone)
+    {
+        /* Same offset, the copy has the headroom of the original */
+        KnxFrameBuffer_Pool[clone].Offset = KnxFrameBuffer_Pool[handle].Offset;
+        KnxFrameBuffer_Pool[clone].Length = KnxFrameBuffer_Copy(handle, KnxFrameBuffer_Frame(clone));
+#ifdef KNX_FRAME_BUFFER_TIMESTAMP
+        KnxFrameBuffer_Pool[clone].RxTimestampUs = KnxFrameBuffer_Pool[handle].RxTimestampUs;
+#endif /* KNX_FRAME_BUFFER_TIMESTAMP */
+    }
+
+    return clone;
+}
+
+void KnxFrameBuffer_Ref(KnxFrameBuffer_HandleType handle)
+{
+    atomic_fetch_add_explicit(&KnxFrameBuffer_Pool[handle].RefCount, 1U, memory_order_relaxed);
+}
+
+void KnxFrameBuffer_Release(KnxFrameBuffer_HandleType handle)
+{
+    if (KNX_FRAME_BUFFER_INVALID == handle)
+    {
+        /* Nothing held */
+    }
+    else if (1U == atomic_fetch_sub_explicit(&KnxFrameBuffer_Pool[handle].RefCount, 1U, memory_order_acq_rel))
+    {
+        /* Last holder, the buffer goes back to the pool */
+        taskENTER_CRITICAL(&KnxFrameBuffer_Lock);
+
+        KnxFrameBuffer_FreeStack[KnxFrameBuffer_FreeCount++] = handle;
+        KnxFrameBuffer_Statistic.InUse = KNX_FRAME_BUFFER_NUM - KnxFrameBuffer_FreeCount;
+
+        taskEXIT_CRITICAL(&KnxFrameBuffer_Lock);
+    }
+    else
+    {
+        /* Still held elsewhere */
+    }
+}
+
+KnxFrameBuffer_Type * KnxFrameBuffer_Get(KnxFrameBuffer_HandleType handle)
+{
+    return &KnxFrameBuffer_Pool[handle];
+}
+
+uint8_t * KnxFrameBuffer_Frame(KnxFrameBuffer_HandleType handle)
+{
+    return &KnxFrameBuffer_Pool[handle].Data[KnxFrameBuffer_Pool[handle].Offset];
+}
+
+uint8_t * KnxFrameBuffer_Push(KnxFrameBuffer_HandleType handle, uint16_t length)
+{
+    KnxFrameBuffer_Type * buffer = &KnxFrameBuffer_Pool[handle];
+    uint8_t * framePtr = NULL;
+
+    /* Grows the frame at its front, into the headroom */
+    if (length <= buffer->Offset)
+    {
+        buffer->Offset -= length;
+        buffer->Length += length;
+        framePtr = &buffer->Data[buffer->Offset];
+    }
+
+    return framePtr;
+}
+
+uint8_t * KnxFrameBuffer_Pull(KnxFrameBuffer_HandleType handle, uint16_t length)
+{
+    KnxFrameBuffer_Type * buffer = &KnxFrameBuffer_Pool[handle];
+    uint8_t * framePtr = NULL;
+
+    /* Drops bytes from the front of the frame, e.g. a header already parsed */
+    if (length <= buffer->Length)
+    {
+        buffer->Offset += length;
+        buffer->Length -= length;
+        framePtr = &buffer->Data[buffer->Offset];
+    }
+
+    return framePtr;
+}
+
+uint16_t KnxFrameBuffer_Copy(KnxFrameBuffer_HandleType handle, uint8_t * destPtr)
+{
+    KnxFrameBuffer_Type * buffer = &KnxFrameBuffer_Pool[handle];
+
+    memcpy(destPtr, &buffer->Data[buffer->Offset], buffer->Length);
+
+    /* Counted without the lock, a lost increment only blurs the report */
+    KnxFrameBuffer_Statistic.Copies++;
+
+    return buffer->Length;
+}
+
+const KnxFrameBuffer_StatisticsType * KnxFrameBuffer_Statistics(void)
+{
+    return &KnxFrameBuffer_Statistic;
+}
+
+/*==================[internal function definitions]=========================*/
+
+/*==================[end of file]===========================================*/
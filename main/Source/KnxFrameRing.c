@@ -0,0 +1,117 @@
+/**
+ * \file KnxFrameRing.c
+ *
+ * \brief Knx Frame Ring
+ *
+ * This file contains the implementation of the single-producer/single-consumer
+ * rings used to pass frame buffer handles between tasks
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include "freertos/FreeRTOS.h"
+#include "string.h"
+#include "esp_system.h"
+#include "esp_log.h"
+
+#include "KnxFrameRing.h"
+
+/*==================[macros]================================================*/
+#define KNX_FRAME_RING_INDEX(count) ((count) & (KNX_FRAME_RING_LENGTH - 1U))
+
+/*==================[type definitions]======================================*/
+
+/*==================[external function declarations]========================*/
+void KnxFrameRing_Init(KnxFrameRingType * ring);
+KnxFrameRing_SlotType * KnxFrameRing_Reserve(KnxFrameRingType * ring);
+void KnxFrameRing_Commit(KnxFrameRingType * ring);
+KnxFrameRing_SlotType * KnxFrameRing_Peek(KnxFrameRingType * ring);
+void KnxFrameRing_Release(KnxFrameRingType * ring);
+unsigned int KnxFrameRing_Count(KnxFrameRingType * ring);
+
+/*==================[internal function declarations]========================*/
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+
+/*==================[external function definitions]=========================*/
+void KnxFrameRing_Init(KnxFrameRingType * ring)
+{
+    memset(ring->Slot, 0, sizeof(ring->Slot));
+    atomic_init(&ring->Head, 0U);
+    atomic_init(&ring->Tail, 0U);
+    ring->Dropped = 0U;
+}
+
+KnxFrameRing_SlotType * KnxFrameRing_Reserve(KnxFrameRingType * ring)
+{
+    KnxFrameRing_SlotType * slot = NULL;
+    unsigned int head = atomic_load_explicit(&ring->Head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->Tail, memory_order_acquire);
+
+    if (KNX_FRAME_RING_LENGTH > (head - tail))
+    {
+        slot = &ring->Slot[KNX_FRAME_RING_INDEX(head)];
+    }
+    else
+    {
+        ring->Dropped++;
+    }
+
+    return slot;
+}
+
+void KnxFrameRing_Commit(KnxFrameRingType * ring)
+{
+    unsigned int head = atomic_load_explicit(&ring->Head, memory_order_relaxed);
+
+    /* Publishes the slot contents to the consumer */
+    atomic_store_explicit(&ring->Head, head + 1U, memory_order_release);
+}
+
+KnxFrameRing_SlotType * KnxFrameRing_Peek(KnxFrameRingType * ring)
+{
+    KnxFrameRing_SlotType * slot = NULL;
+    unsigned int tail = atomic_load_explicit(&ring->Tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ring->Head, memory_order_acquire);
+
+    if (head != tail)
+    {
+        slot = &ring->Slot[KNX_FRAME_RING_INDEX(tail)];
+    }
+
+    return slot;
+}
+
+void KnxFrameRing_Release(KnxFrameRingType * ring)
+{
+    unsigned int tail = atomic_load_explicit(&ring->Tail, memory_order_relaxed);
+
+    /* Hands the slot back to the producer */
+    atomic_store_explicit(&ring->Tail, tail + 1U, memory_order_release);
+}
+
+unsigned int KnxFrameRing_Count(KnxFrameRingType * ring)
+{
+    unsigned int tail = atomic_load_explicit(&ring->Tail, memory_order_acquire);
+    unsigned int head = atomic_load_explicit(&ring->Head, memory_order_acquire);
+
+    /* Exact on either side, a snapshot from any other task */
+    return (head - tail);
+}
+
+/*==================[internal function definitions]=========================*/
+
+/*==================[end of file]===========================================*/
@@ -0,0 +1,150 @@
+/**
+ * \file KnxGroupFilter.c
+ *
+ * \brief Knx Group Filter
+ *
+ * This file contains the implementation of the group address filter tables
+ * used when forwarding frames between TP and IP, loaded from NVS
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include "freertos/FreeRTOS.h"
+#include "string.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+#include "KnxGroupFilter.h"
+
+/*==================[macros]================================================*/
+#define KNX_GROUP_FILTER_BYTE(groupAddr) ((groupAddr) >> 3)
+#define KNX_GROUP_FILTER_BIT(groupAddr)  ((uint8_t)(1U << ((groupAddr) & 0x07U)))
+
+/* Group address 0/0/0 is the broadcast, never filtered */
+#define KNX_GROUP_FILTER_BROADCAST       (0x0000U)
+
+#define KNX_GROUP_FILTER_NVS_NAMESPACE   "knx_filter"
+
+/*==================[type definitions]======================================*/
+
+/*==================[external function declarations]========================*/
+void KnxGroupFilter_Init(void);
+bool KnxGroupFilter_Pass(uint8_t direction, uint16_t groupAddr);
+
+/*==================[internal function declarations]========================*/
+static void KnxGroupFilter_Load(nvs_handle_t nvsHandle, uint8_t direction);
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+/* NVS keys per direction, see KnxGroupFilter.h */
+static const char * const KnxGroupFilter_ModeKey[KNX_GROUP_FILTER_DIRECTION_NUM] = { "tp2ip_mode", "ip2tp_mode" };
+static const char * const KnxGroupFilter_TableKey[KNX_GROUP_FILTER_DIRECTION_NUM] = { "tp2ip_table", "ip2tp_table" };
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+/* Loaded before the tasks start, read only by the tpuart and network tasks after */
+static uint8_t KnxGroupFilter_Table[KNX_GROUP_FILTER_DIRECTION_NUM][KNX_GROUP_FILTER_TABLE_SIZE];
+static KnxGroupFilter_ModeType KnxGroupFilter_Mode[KNX_GROUP_FILTER_DIRECTION_NUM];
+
+/*==================[external function definitions]=========================*/
+void KnxGroupFilter_Init(void)
+{
+    nvs_handle_t nvsHandle;
+    esp_err_t err = nvs_open(KNX_GROUP_FILTER_NVS_NAMESPACE, NVS_READONLY, &nvsHandle);
+
+    for (uint8_t direction = 0; direction < KNX_GROUP_FILTER_DIRECTION_NUM; direction++)
+    {
+        /* Passing everything unless NVS says otherwise */
+        memset(&KnxGroupFilter_Table[direction][0], 0xFF, KNX_GROUP_FILTER_TABLE_SIZE);
+        KnxGroupFilter_Mode[direction] = KNX_GROUP_FILTER_PASS_ALL;
+
+        if (ESP_OK == err)
+        {
+            KnxGroupFilter_Load(nvsHandle, direction);
+        }
+    }
+
+    if (ESP_OK == err)
+    {
+        nvs_close(nvsHandle);
+    }
+    else if (ESP_ERR_NVS_NOT_FOUND != err)
+    {
+        ESP_LOGE("KnxGroupFilter", "Init: nvs_open failed 0x%x, passing all frames", err);
+    }
+    else
+    {
+        /* No filter configured */
+    }
+}
+
+bool KnxGroupFilter_Pass(uint8_t direction, uint16_t groupAddr)
+{
+    bool pass = true;
+
+    if (KNX_GROUP_FILTER_BROADCAST == groupAddr)
+    {
+        /* Broadcasts are not group telegrams to a line coupler */
+    }
+    else if (KNX_GROUP_FILTER_BLOCK_ALL == KnxGroupFilter_Mode[direction])
+    {
+        pass = false;
+    }
+    else if (KNX_GROUP_FILTER_TABLE == KnxGroupFilter_Mode[direction])
+    {
+        pass = (0U != (KnxGroupFilter_Table[direction][KNX_GROUP_FILTER_BYTE(groupAddr)] & KNX_GROUP_FILTER_BIT(groupAddr)));
+    }
+    else
+    {
+        /* KNX_GROUP_FILTER_PASS_ALL */
+    }
+
+    return pass;
+}
+
+/*==================[internal function definitions]=========================*/
+static void KnxGroupFilter_Load(nvs_handle_t nvsHandle, uint8_t direction)
+{
+    uint8_t mode = KNX_GROUP_FILTER_PASS_ALL;
+    size_t length = KNX_GROUP_FILTER_TABLE_SIZE;
+    esp_err_t err = nvs_get_u8(nvsHandle, KnxGroupFilter_ModeKey[direction], &mode);
+
+    if (ESP_ERR_NVS_NOT_FOUND == err)
+    {
+        /* Direction not filtered */
+    }
+    else if ((ESP_OK != err) || (KNX_GROUP_FILTER_MODE_NUM <= mode))
+    {
+        ESP_LOGE("KnxGroupFilter", "Load: %s invalid, passing all frames", KnxGroupFilter_ModeKey[direction]);
+    }
+    else if (KNX_GROUP_FILTER_TABLE != mode)
+    {
+        KnxGroupFilter_Mode[direction] = (KnxGroupFilter_ModeType)mode;
+    }
+    else if (ESP_OK != nvs_get_blob(nvsHandle, KnxGroupFilter_TableKey[direction], &KnxGroupFilter_Table[direction][0], &length))
+    {
+        /* A longer blob is refused as well, the table is left passing everything */
+        memset(&KnxGroupFilter_Table[direction][0], 0xFF, KNX_GROUP_FILTER_TABLE_SIZE);
+        ESP_LOGE("KnxGroupFilter", "Load: %s missing or too long, passing all frames", KnxGroupFilter_TableKey[direction]);
+    }
+    else
+    {
+        /* Group addresses beyond a short table are blocked */
+        memset(&KnxGroupFilter_Table[direction][length], 0x00, KNX_GROUP_FILTER_TABLE_SIZE - length);
+        KnxGroupFilter_Mode[direction] = KNX_GROUP_FILTER_TABLE;
+
+        ESP_LOGI("KnxGroupFilter", "Load: %s, %u bytes", KnxGroupFilter_TableKey[direction], (unsigned int)length);
+    }
+}
+
+/*==================[end of file]===========================================*/
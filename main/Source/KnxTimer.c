@@ -0,0 +1,407 @@
+/**
+ * \file KnxTimer.c
+ *
+ * \brief Knx Protocol Timers
+ *
+ * This file contains the implementation of the hierarchical timer wheel
+ * holding the protocol timeouts of a task
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include <string.h>
+#include <stdlib.h>
+#include <sys/param.h>
+
+#ifdef KNX_TIMER_BENCHMARK
+#include "esp_log.h"
+#include "esp_timer.h"
+#endif /* KNX_TIMER_BENCHMARK */
+
+#include "KnxTimer.h"
+
+/*==================[macros]================================================*/
+#define KNX_TIMER_SLOT_MASK         (KNX_TIMER_SLOT_NUM - 1U)
+
+/* Slot of a tick on a level */
+#define KNX_TIMER_INDEX(tick, level) (((tick) >> (KNX_TIMER_LEVEL_BITS * (level))) & KNX_TIMER_SLOT_MASK)
+
+#ifdef KNX_TIMER_BENCHMARK
+/* Timers armed, cancelled and expired by the benchmark, spread over all levels */
+#define KNX_TIMER_BENCHMARK_TIMERS  (10000U)
+#define KNX_TIMER_BENCHMARK_SPAN_MS (KNX_TIMER_MAX_TICKS * KNX_TIMER_TICK_MS)
+#endif /* KNX_TIMER_BENCHMARK */
+
+/*==================[type definitions]======================================*/
+
+/*==================[external function declarations]========================*/
+void KnxTimer_WheelInit(KnxTimer_WheelType * wheel, int64_t nowMs);
+void KnxTimer_Init(KnxTimer_Type * timer, KnxTimer_CallbackType callback, void * context);
+void KnxTimer_Arm(KnxTimer_WheelType * wheel, KnxTimer_Type * timer, int64_t nowMs, uint32_t delayMs);
+void KnxTimer_Cancel(KnxTimer_Type * timer);
+bool KnxTimer_Armed(const KnxTimer_Type * timer);
+uint32_t KnxTimer_Advance(KnxTimer_WheelType * wheel, int64_t nowMs);
+uint32_t KnxTimer_NextTimeoutMs(const KnxTimer_WheelType * wheel, int64_t nowMs);
+
+/*==================[internal function declarations]========================*/
+static void KnxTimer_Insert(KnxTimer_WheelType * wheel, KnxTimer_Type * timer);
+static void KnxTimer_Unlink(KnxTimer_Type * timer);
+static void KnxTimer_Cascade(KnxTimer_WheelType * wheel, uint8_t level);
+static void KnxTimer_Step(KnxTimer_WheelType * wheel);
+static uint32_t KnxTimer_NextSlot(uint64_t occupied, uint32_t start);
+#ifdef KNX_TIMER_BENCHMARK
+static void KnxTimer_BenchmarkExpired(void * context);
+#endif /* KNX_TIMER_BENCHMARK */
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+#ifdef KNX_TIMER_BENCHMARK
+static uint32_t KnxTimer_BenchmarkExpiries;
+#endif /* KNX_TIMER_BENCHMARK */
+
+/*==================[external function definitions]=========================*/
+void KnxTimer_WheelInit(KnxTimer_WheelType * wheel, int64_t nowMs)
+{
+    memset(wheel, 0, sizeof(KnxTimer_WheelType));
+
+    wheel->TickMs = nowMs;
+}
+
+void KnxTimer_Init(KnxTimer_Type * timer, KnxTimer_CallbackType callback, void * context)
+{
+    memset(timer, 0, sizeof(KnxTimer_Type));
+
+    timer->Callback = callback;
+    timer->Context = context;
+}
+
+void KnxTimer_Arm(KnxTimer_WheelType * wheel, KnxTimer_Type * timer, int64_t nowMs, uint32_t delayMs)
+{
+    int64_t expiryMs = nowMs + delayMs;
+    uint32_t ticks = 1U;
+
+    KnxTimer_Cancel(timer);
+
+    if (0U == wheel->Armed)
+    {
+        /* A task with nothing armed waits without timeout and does not advance */
+        /* its wheel, catching up here is bookkeeping only, nothing can expire */
+        (void)KnxTimer_Advance(wheel, nowMs);
+    }
+
+    /* The last tick may lie well before now, the expiry is counted from its */
+    /* time and rounded up, so the timer never runs before its delay        */
+    if (expiryMs > wheel->TickMs)
+    {
+        int64_t expiryTicks = ((expiryMs - wheel->TickMs) + KNX_TIMER_TICK_MS - 1) / KNX_TIMER_TICK_MS;
+
+        ticks = (uint32_t)MIN(expiryTicks, (int64_t)KNX_TIMER_MAX_TICKS);
+    }
+
+    timer->ExpiryTick = wheel->Tick + ticks;
+    KnxTimer_Insert(wheel, timer);
+
+    wheel->Armed++;
+}
+
+void KnxTimer_Cancel(KnxTimer_Type * timer)
+{
+    if (NULL != timer->Wheel)
+    {
+        timer->Wheel->Armed--;
+        KnxTimer_Unlink(timer);
+    }
+}
+
+bool KnxTimer_Armed(const KnxTimer_Type * timer)
+{
+    return (NULL != timer->Wheel);
+}
+
+uint32_t KnxTimer_Advance(KnxTimer_WheelType * wheel, int64_t nowMs)
+{
+    /* TickMs moves along with Tick, a callback arming a timer counts from the tick it runs in */
+    while ((nowMs - wheel->TickMs) >= KNX_TIMER_TICK_MS)
+    {
+        uint32_t elapsedTicks = (uint32_t)((nowMs - wheel->TickMs) / KNX_TIMER_TICK_MS);
+
+        /* Ticks up to the next level 0 wrap, where level 1 cascades */
+        uint32_t wrapTicks = KNX_TIMER_SLOT_NUM - KNX_TIMER_INDEX(wheel->Tick, 0U);
+
+        if ((0U == wheel->Armed) ||
+            ((0U == wheel->Occupied[0]) && (wrapTicks > elapsedTicks)))
+        {
+            /* Nothing expires or cascades on the way */
+            wheel->Tick += elapsedTicks;
+            wheel->TickMs += (int64_t)elapsedTicks * KNX_TIMER_TICK_MS;
+        }
+        else if (0U == wheel->Occupied[0])
+        {
+            /* Empty level 0 slots are skipped up to the cascade */
+            wheel->Tick += wrapTicks - 1U;
+            wheel->TickMs += (int64_t)(wrapTicks - 1U) * KNX_TIMER_TICK_MS;
+            KnxTimer_Step(wheel);
+        }
+        else
+        {
+            KnxTimer_Step(wheel);
+        }
+    }
+
+    return KnxTimer_NextTimeoutMs(wheel, nowMs);
+}
+
+uint32_t KnxTimer_NextTimeoutMs(const KnxTimer_WheelType * wheel, int64_t nowMs)
+{
+    uint32_t timeoutMs = KNX_TIMER_NO_TIMEOUT;
+
+    if (0U < wheel->Armed)
+    {
+        uint32_t dueTicks = KNX_TIMER_MAX_TICKS;
+        int64_t dueMs;
+
+        for (uint8_t level = 0; level < KNX_TIMER_LEVEL_NUM; level++)
+        {
+            if (0U != wheel->Occupied[level])
+            {
+                /* Level 0 gives the expiry, higher levels the cascade of their */
+                /* next slot, the wheel is advanced there and looks again       */
+                uint32_t shift = KNX_TIMER_LEVEL_BITS * level;
+                uint32_t next = (wheel->Tick >> shift) + 1U;
+                uint32_t dueTick = (next + KnxTimer_NextSlot(wheel->Occupied[level], next & KNX_TIMER_SLOT_MASK)) << shift;
+
+                dueTicks = MIN(dueTicks, dueTick - wheel->Tick);
+            }
+        }
+
+        dueMs = wheel->TickMs + ((int64_t)dueTicks * KNX_TIMER_TICK_MS);
+
+        if (dueMs > nowMs)
+        {
+            timeoutMs = (uint32_t)(dueMs - nowMs);
+        }
+        else
+        {
+            timeoutMs = 0U;
+        }
+    }
+
+    return timeoutMs;
+}
+
+#ifdef KNX_TIMER_BENCHMARK
+void KnxTimer_Benchmark(void)
+{
+    static KnxTimer_WheelType wheel;
+    KnxTimer_Type * timers = malloc(KNX_TIMER_BENCHMARK_TIMERS * sizeof(KnxTimer_Type));
+    int64_t virtualMs = 0;
+
+    if (NULL == timers)
+    {
+        ESP_LOGE("KnxTimer", "Benchmark: no memory for %u timers", KNX_TIMER_BENCHMARK_TIMERS);
+    }
+    else
+    {
+        int64_t startUs;
+        int64_t armUs;
+        int64_t cancelUs;
+        int64_t expireUs;
+        uint32_t timeoutMs;
+
+        /* Virtual clock, the wheel runs through the whole span in microseconds */
+        KnxTimer_WheelInit(&wheel, virtualMs);
+        KnxTimer_BenchmarkExpiries = 0U;
+
+        for (uint32_t index = 0; index < KNX_TIMER_BENCHMARK_TIMERS; index++)
+        {
+            KnxTimer_Init(&timers[index], KnxTimer_BenchmarkExpired, &timers[index]);
+        }
+
+        startUs = esp_timer_get_time();
+        for (uint32_t index = 0; index < KNX_TIMER_BENCHMARK_TIMERS; index++)
+        {
+            KnxTimer_Arm(&wheel, &timers[index], virtualMs, (index * 7919U) % KNX_TIMER_BENCHMARK_SPAN_MS);
+        }
+        armUs = esp_timer_get_time() - startUs;
+
+        startUs = esp_timer_get_time();
+        for (uint32_t index = 0; index < KNX_TIMER_BENCHMARK_TIMERS; index++)
+        {
+            KnxTimer_Cancel(&timers[index]);
+        }
+        cancelUs = esp_timer_get_time() - startUs;
+
+        for (uint32_t index = 0; index < KNX_TIMER_BENCHMARK_TIMERS; index++)
+        {
+            KnxTimer_Arm(&wheel, &timers[index], virtualMs, (index * 7919U) % KNX_TIMER_BENCHMARK_SPAN_MS);
+        }
+
+        startUs = esp_timer_get_time();
+        timeoutMs = KnxTimer_NextTimeoutMs(&wheel, virtualMs);
+        while (KNX_TIMER_NO_TIMEOUT != timeoutMs)
+        {
+            virtualMs += timeoutMs;
+            timeoutMs = KnxTimer_Advance(&wheel, virtualMs);
+        }
+        expireUs = esp_timer_get_time() - startUs;
+
+        ESP_LOGI("KnxTimer", "Benchmark: %u timers, arm %lu ns, cancel %lu ns, expire %lu ns per timer, %lu expired",
+                 KNX_TIMER_BENCHMARK_TIMERS,
+                 (unsigned long)((armUs * 1000LL) / KNX_TIMER_BENCHMARK_TIMERS),
+                 (unsigned long)((cancelUs * 1000LL) / KNX_TIMER_BENCHMARK_TIMERS),
+                 (unsigned long)((expireUs * 1000LL) / KNX_TIMER_BENCHMARK_TIMERS),
+                 (unsigned long)KnxTimer_BenchmarkExpiries);
+
+        free(timers);
+    }
+}
+#endif /* KNX_TIMER_BENCHMARK */
+
+/*==================[internal function definitions]=========================*/
+static void KnxTimer_Insert(KnxTimer_WheelType * wheel, KnxTimer_Type * timer)
+{
+    uint32_t delta = timer->ExpiryTick - wheel->Tick;
+    uint8_t level = 0U;
+
+    /* Level by distance, slot by expiry tick, so a slot is visited again before its timers are due */
+    if ((1UL << (KNX_TIMER_LEVEL_BITS * 2U)) <= delta)
+    {
+        level = 2U;
+    }
+    else if ((1UL << KNX_TIMER_LEVEL_BITS) <= delta)
+    {
+        level = 1U;
+    }
+    else
+    {
+        level = 0U;
+    }
+
+    timer->Wheel = wheel;
+    timer->Level = level;
+    timer->Slot = KNX_TIMER_INDEX(timer->ExpiryTick, level);
+    timer->Prev = NULL;
+    timer->Next = wheel->Slot[level][timer->Slot];
+
+    if (NULL != timer->Next)
+    {
+        timer->Next->Prev = timer;
+    }
+
+    wheel->Slot[level][timer->Slot] = timer;
+    wheel->Occupied[level] |= (1ULL << timer->Slot);
+}
+
+static void KnxTimer_Unlink(KnxTimer_Type * timer)
+{
+    KnxTimer_WheelType * wheel = timer->Wheel;
+
+    if (NULL != timer->Prev)
+    {
+        timer->Prev->Next = timer->Next;
+    }
+    else
+    {
+        wheel->Slot[timer->Level][timer->Slot] = timer->Next;
+    }
+
+    if (NULL != timer->Next)
+    {
+        timer->Next->Prev = timer->Prev;
+    }
+
+    if (NULL == wheel->Slot[timer->Level][timer->Slot])
+    {
+        wheel->Occupied[timer->Level] &= ~(1ULL << timer->Slot);
+    }
+
+    timer->Wheel = NULL;
+    timer->Next = NULL;
+    timer->Prev = NULL;
+}
+
+static void KnxTimer_Cascade(KnxTimer_WheelType * wheel, uint8_t level)
+{
+    uint8_t slot = KNX_TIMER_INDEX(wheel->Tick, level);
+    KnxTimer_Type * timer = wheel->Slot[level][slot];
+
+    wheel->Slot[level][slot] = NULL;
+    wheel->Occupied[level] &= ~(1ULL << slot);
+
+    /* Due within this slot's span, each lands on a lower level */
+    while (NULL != timer)
+    {
+        KnxTimer_Type * next = timer->Next;
+
+        KnxTimer_Insert(wheel, timer);
+        timer = next;
+    }
+}
+
+static void KnxTimer_Step(KnxTimer_WheelType * wheel)
+{
+    uint32_t tick;
+    uint8_t slot;
+
+    wheel->Tick++;
+    wheel->TickMs += KNX_TIMER_TICK_MS;
+    tick = wheel->Tick;
+    slot = KNX_TIMER_INDEX(tick, 0U);
+
+    if (0U == slot)
+    {
+        if (0U == KNX_TIMER_INDEX(wheel->Tick, 1U))
+        {
+            KnxTimer_Cascade(wheel, 2U);
+        }
+
+        KnxTimer_Cascade(wheel, 1U);
+    }
+
+    /* Taken one by one, a callback may arm or cancel any timer, itself included.  */
+    /* Arming on an otherwise empty wheel catches it up to now, a timer landing in */
+    /* this slot then is due a round later                                        */
+    while ((NULL != wheel->Slot[0][slot]) && (tick == wheel->Tick))
+    {
+        KnxTimer_Type * timer = wheel->Slot[0][slot];
+
+        KnxTimer_Cancel(timer);
+        timer->Callback(timer->Context);
+    }
+}
+
+static uint32_t KnxTimer_NextSlot(uint64_t occupied, uint32_t start)
+{
+    /* Occupied slots rotated so start is bit 0, the distance is a bit scan */
+    uint64_t rotated = occupied;
+
+    if (0U != start)
+    {
+        rotated = (occupied >> start) | (occupied << (KNX_TIMER_SLOT_NUM - start));
+    }
+
+    return (uint32_t)__builtin_ctzll(rotated);
+}
+
+#ifdef KNX_TIMER_BENCHMARK
+static void KnxTimer_BenchmarkExpired(void * context)
+{
+    (void)context;
+
+    KnxTimer_BenchmarkExpiries++;
+}
+#endif /* KNX_TIMER_BENCHMARK */
+
+/*==================[end of file]===========================================*/
@@ -43,6 +43,7 @@ UartReq_ReturnType KnxTpUart2_U_AckInformation(uint8_t nack, uint8_t busy, uint8
 UartReq_ReturnType KnxTpUart2_U_L_DataStart(uint8_t eibCtrl);
 UartReq_ReturnType KnxTpUart2_U_L_DataContinue(uint8_t index, uint8_t eibData);
 UartReq_ReturnType KnxTpUart2_U_L_DataEnd(uint8_t length, uint8_t chksum);
+UartReq_ReturnType KnxTpUart2_U_L_DataFrame(const uint8_t * frame, uint8_t length);
 UartReq_ReturnType KnxTpUart2_U_MxRstCnt(uint8_t busyCnt, uint8_t nackCnt);
 UartReq_ReturnType KnxTpUart2_U_ActivateCRC(void);
 UartReq_ReturnType KnxTpUart2_U_PollingState(uint8_t slotnumber, uint16_t pollAddr, uint8_t pollState);
@@ -52,6 +53,7 @@ int64_t KnxTpUart2_GetTimeUs();
 
 /*==================[internal function declarations]========================*/
 static UartReq_ReturnType KnxTpUart2_Transmit(const char * serviceName, const void * data, size_t size);
+static UartReq_ReturnType KnxTpUart2_TransmitAsync(const char * serviceName, const void * data, size_t size);
 
 /*==================[external constants]====================================*/
 
@@ -169,6 +171,34 @@ UartReq_ReturnType KnxTpUart2_U_L_DataEnd(uint8_t length, uint8_t chksum)
     return KnxTpUart2_Transmit("TPUART2_U_L_DATAEND", cmd, 2U);
 }
 
+UartReq_ReturnType KnxTpUart2_U_L_DataFrame(const uint8_t * frame, uint8_t length)
+{
+    /* Whole frame as one U_L_DataStart / U_L_DataContinue... / U_L_DataEnd sequence */
+    char cmd[2U * TPUART2_FRAME_MAX_LENGTH];
+    size_t cmdLength = 0U;
+    UartReq_ReturnType txBytes = -1;
+
+    if ((2U <= length) && (TPUART2_FRAME_MAX_LENGTH >= length))
+    {
+        cmd[cmdLength++] = (char)TPUART2_U_L_DATASTART;
+        cmd[cmdLength++] = (char)frame[0];
+
+        for (uint8_t index = 1U; index < (length - 1U); index++)
+        {
+            cmd[cmdLength++] = (char)(TPUART2_U_L_DATACONTINUE | (index & 0x3FU));
+            cmd[cmdLength++] = (char)frame[index];
+        }
+
+        cmd[cmdLength++] = (char)(TPUART2_U_L_DATAEND | ((length - 1U) & 0x3FU));
+        cmd[cmdLength++] = (char)frame[length - 1U];
+
+        /* Completion is reported by the TP-UART with L_Data.con */
+        txBytes = KnxTpUart2_TransmitAsync("TPUART2_U_L_DATAFRAME", cmd, cmdLength);
+    }
+
+    return txBytes;
+}
+
 UartReq_ReturnType KnxTpUart2_U_MxRstCnt(uint8_t busyCnt, uint8_t nackCnt)
 {
     const char cmd[] = {
@@ -224,4 +254,17 @@ static UartReq_ReturnType KnxTpUart2_Transmit(const char * serviceName, const vo
     return txBytes;
 }
 
+static UartReq_ReturnType KnxTpUart2_TransmitAsync(const char * serviceName, const void * data, size_t size)
+{
+    /* Copied into the UART driver tx ring buffer, returns without waiting for the FIFO to drain */
+    int txBytes = uart_write_bytes(UART_NUM_1, data, size);
+
+    if (txBytes != (int)size)
+    {
+        ESP_LOGW(serviceName, "Wrote %d of %d bytes", txBytes, (int)size);
+    }
+
+    return txBytes;
+}
+
 /*==================[end of file]===========================================*/
@@ -12,6 +12,7 @@
 #include "lwip/sys.h"
 
 #include "KnxWiFi.h"
+#include "KNXnetIP_Core.h"
 
 uint32_t KnxIPInterface_IpAddr = 0x00000000;
 
@@ -48,6 +49,7 @@ static void event_handler(void* arg, esp_event_base_t event_base,
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
         memcpy(&KnxIPInterface_IpAddr, &event->ip_info.ip, 4);
+        KNXnetIP_ResponseCacheInvalidate();
         s_retry_num = 0;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
     }
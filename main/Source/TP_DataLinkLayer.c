@@ -1,176 +1,722 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "string.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include <stdatomic.h>
+#include <sys/param.h>
 
 #include "Pdu.h"
 #include "KNXnetIP.h"
+#include "KNXnetIP_Routing.h"
 #include "TP_DataLinkLayer.h"
 #include "TpUart2_DataLinkLayer.h"
+#include "KnxTpUart2_Services.h"
+#include "KnxFrameRing.h"
+#include "KnxFrameBuffer.h"
+#include "KnxGroupFilter.h"
+
+/* IP -> TP frames are queued per connection, tunnels 1..KNX_CHANNEL_NUM */
+/* first and routed frames last, so a busy client cannot hold up others  */
+#define TP_GW_FLOW_NUM          (KNX_CHANNEL_NUM + 1U)
+#define TP_GW_FLOW_ROUTING      (KNX_CHANNEL_NUM)
+#define TP_GW_FLOW_NONE         (TP_GW_FLOW_NUM)
+#define TP_GW_FLOW_INDEX(channelId) ((KNX_CHANNEL_INVALID == (channelId)) ? TP_GW_FLOW_ROUTING : ((channelId) - CHANNEL_1))
+#define TP_GW_FLOW_QUEUE_LENGTH (16U)
+
+/* Bus time around a frame in byte-times (13 bit-times each): 50 bits */
+/* idle before it, 15 bits gap and the acknowledge character after   */
+#define TP_GW_BUS_OVERHEAD      (6U)
+
+/* Byte-times a flow gets per round, the longest standard frame fits */
+#define TP_GW_DRR_QUANTUM       (15U + TPUART2_STANDARD_FRAME_OVERHEAD + TP_GW_BUS_OVERHEAD)
+
+/* Frames handed to the TP-UART ahead of the bus, one more than its */
+/* pipeline takes, the order of the rest is decided here            */
+#define TP_GW_TX_FEED_DEPTH     (3U)
+
+/* The priority queues of the TP-UART hold little more than the frame on the */
+/* bus, so High priority frames overtake Normal ones here. A flow passed over */
+/* this long takes turns with them again, as aging does in the TP-UART queue  */
+#define TP_GW_TX_AGING_MS       (500U)
+
+/* Round robins over the flows: all of them, and those taking turns while */
+/* High priority frames wait, each keeps its own position                  */
+#define TP_GW_ROUND_ALL         (0U)
+#define TP_GW_ROUND_HIGH        (1U)
+#define TP_GW_ROUND_NUM         (2U)
+
+typedef struct {
+    KnxFrameBuffer_HandleType Frame[TP_GW_FLOW_QUEUE_LENGTH];   /* cEMI frames, oldest at Head */
+    uint8_t Generation[TP_GW_FLOW_QUEUE_LENGTH];                /* Connection each frame came with */
+    uint8_t Head;
+    uint8_t Count;
+    uint16_t Deficit;   /* Byte-times the flow may still send in its turn */
+    bool Held;          /* Backlogged behind High priority frames since HeldSinceMs */
+    int64_t HeldSinceMs;
+} TP_GW_FlowType;
+
+/* IP -> TP, one ring per network task so each has a single producer */
+static KnxFrameRingType TP_GW_TxRing[KNXNETIP_TRANSPORT_NUM];
+
+/* Given by the producers, wakes the tpuart task */
+static SemaphoreHandle_t TP_GW_Doorbell;
+
+/* Only the tpuart task touches the flows */
+static TP_GW_FlowType TP_GW_Flow[TP_GW_FLOW_NUM];
+static uint8_t TP_GW_FlowCurrent[TP_GW_ROUND_NUM];     /* Flow whose turn it is */
+static bool TP_GW_FlowTurnStarted[TP_GW_ROUND_NUM];    /* Quantum of the current turn granted */
+static uint8_t TP_GW_FlowQueued;        /* Frames in all flows */
+
+/* Frames of a connection between TP_GW_L_Data_Req and the TP-UART, */
+/* counted up by the network tasks and down by the tpuart task      */
+static atomic_uint TP_GW_Backlog[TP_GW_FLOW_NUM];
+
+/* Connection each frame in the TP-UART came with, by frame handle */
+static uint8_t TP_GW_TxGeneration[KNX_FRAME_BUFFER_NUM];
+
+/* TP_GW_L_Data_Req of each frame, by frame handle, set by the network */
+/* task before the frame is committed to the ring                      */
+static int64_t TP_GW_ReqTimestampMs[KNX_FRAME_BUFFER_NUM];
+
+void TP_GW_Init(void);
+SemaphoreHandle_t TP_GW_GetDoorbell(void);
+void TP_GW_MainFunction(void);
+StatusType TP_GW_L_Data_Req(uint8_t channelId, KnxFrameBuffer_HandleType frame);
+void TP_GW_L_Data_Con(uint8_t channelId, KnxFrameBuffer_HandleType frame, bool success);
+void TP_GW_L_Data_Ind(KnxFrameBuffer_HandleType frame);
+unsigned int TP_GW_ChannelBacklog(uint8_t channelId);
 
-static uint8_t L_TxBuffer[512];
-static uint8_t L_RxBuffer[512];
+static uint8_t TP_L_Data_CalculateFCS(uint8_t * l_data, uint16_t length);
+static void TP_GW_CemiToTp(uint16_t sourceAddr, KnxFrameBuffer_HandleType frame);
+static void TP_GW_TpToCemi(uint8_t messageCode, KnxFrameBuffer_HandleType frame);
+static void TP_GW_TunnelToIP(KnxFrameBuffer_HandleType frame);
+static bool TP_GW_Stale(uint8_t channelId, uint8_t generation);
+static void TP_GW_FlowEnqueue(uint8_t channelId, uint8_t generation, KnxFrameBuffer_HandleType frame);
+static void TP_GW_FlowPurge(void);
+static uint8_t TP_GW_FlowSelect(int64_t nowMs);
+static bool TP_GW_FlowHigh(const TP_GW_FlowType * flow);
+static KnxFrameBuffer_HandleType TP_GW_FlowDequeue(uint8_t flowIndex);
+static uint16_t TP_GW_FlowCost(KnxFrameBuffer_HandleType frame);
+static void TP_GW_Transmit(uint8_t channelId, uint8_t generation, KnxFrameBuffer_HandleType frame);
+static void TP_GW_BacklogRelease(uint8_t channelId);
+
+void TP_GW_Init(void)
+{
+    for (uint8_t transport = 0; transport < KNXNETIP_TRANSPORT_NUM; transport++)
+    {
+        KnxFrameRing_Init(&TP_GW_TxRing[transport]);
+    }
 
-void TP_GW_L_Data_Req(uint8_t * bufferPtr, uint8_t rxLength);
-void TP_GW_L_Data_Ind(PduInfoType * pduInfoPtr);
-void TP_GW_L_Data_Ind_ACK(PduInfoType * pduInfoPtr);
+    for (uint8_t flowIndex = 0; flowIndex < TP_GW_FLOW_NUM; flowIndex++)
+    {
+        TP_GW_Flow[flowIndex].Head = 0U;
+        TP_GW_Flow[flowIndex].Count = 0U;
+        TP_GW_Flow[flowIndex].Deficit = 0U;
+        TP_GW_Flow[flowIndex].Held = false;
+        atomic_init(&TP_GW_Backlog[flowIndex], 0U);
+    }
 
-static uint8_t TP_L_Data_CalculateFCS(uint8_t * l_data, uint16_t length);
+    for (uint8_t round = 0; round < TP_GW_ROUND_NUM; round++)
+    {
+        TP_GW_FlowCurrent[round] = 0U;
+        TP_GW_FlowTurnStarted[round] = false;
+    }
+    TP_GW_FlowQueued = 0U;
+
+    TP_GW_Doorbell = xSemaphoreCreateBinary();
+}
+
+SemaphoreHandle_t TP_GW_GetDoorbell(void)
+{
+    return TP_GW_Doorbell;
+}
+
+void TP_GW_MainFunction(void)
+{
+    int64_t nowMs = KnxTpUart2_GetTimeMs();
+    uint8_t flowIndex;
+
+    /* Sort the frames of both network tasks into the flows of their connections */
+    for (uint8_t transport = 0; transport < KNXNETIP_TRANSPORT_NUM; transport++)
+    {
+        KnxFrameRing_SlotType * slot = KnxFrameRing_Peek(&TP_GW_TxRing[transport]);
+
+        while (NULL != slot)
+        {
+            TP_GW_FlowEnqueue(slot->ChannelId, slot->Generation, slot->Frame);
+
+            KnxFrameRing_Release(&TP_GW_TxRing[transport]);
+            slot = KnxFrameRing_Peek(&TP_GW_TxRing[transport]);
+        }
+    }
+
+    /* Frames of closed connections go before they take a turn */
+    TP_GW_FlowPurge();
+
+    /* Feed the TP-UART by deficit round robin over the flows, */
+    /* the next frame follows after the next L_Data.con         */
+    flowIndex = (TP_GW_TX_FEED_DEPTH > TpUart2_TxQueueCount()) ? TP_GW_FlowSelect(nowMs) : TP_GW_FLOW_NONE;
+
+    while (TP_GW_FLOW_NONE != flowIndex)
+    {
+        uint8_t channelId = (TP_GW_FLOW_ROUTING == flowIndex) ? KNX_CHANNEL_INVALID : (CHANNEL_1 + flowIndex);
+        uint8_t generation = TP_GW_Flow[flowIndex].Generation[TP_GW_Flow[flowIndex].Head];
+
+        TP_GW_Transmit(channelId, generation, TP_GW_FlowDequeue(flowIndex));
+        TP_GW_BacklogRelease(channelId);
+
+        flowIndex = (TP_GW_TX_FEED_DEPTH > TpUart2_TxQueueCount()) ? TP_GW_FlowSelect(nowMs) : TP_GW_FLOW_NONE;
+    }
+}
+
+StatusType TP_GW_L_Data_Req(uint8_t channelId, KnxFrameBuffer_HandleType frame)
+{
+    StatusType status = E_NOT_OK;
+    KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(channelId);
+
+    /* Takes the frame on E_OK, the caller keeps it otherwise */
+    if (KNX_FRAME_BUFFER_INVALID == frame)
+    {
+        ESP_LOGI("TP","L_Data_Req: ERR_NULL_PTR");
+    }
+    else
+    {
+        uint8_t * bufferPtr = KnxFrameBuffer_Frame(frame);
+        uint16_t rxLength = KnxFrameBuffer_Get(frame)->Length;
+
+        if (((NULL == channel) && (KNX_CHANNEL_INVALID != channelId)) ||
+            (KNX_FRAME_BUFFER_CEMI_MAX < rxLength) ||
+            (CEMI_FRAME_TPDU_FIELD_OFFSET >= rxLength) ||
+            (LENGTH_FIELD_LG_MASK < bufferPtr[CEMI_FRAME_LENGTH_FIELD_OFFSET]) ||
+            ((CEMI_FRAME_TPDU_FIELD_OFFSET + bufferPtr[CEMI_FRAME_LENGTH_FIELD_OFFSET] + 1U) > rxLength))
+        {
+            /* Closed tunnel, or no whole standard frame: LG has to fit the 4 bit */
+            /* length field of the TP frame, the TPCI and LG octets must be there */
+        }
+        else if ((0U != (bufferPtr[CEMI_FRAME_CTRL2_FIELD_OFFSET] & CTRLE_FIELD_ADDRESS_TYPE_MASK)) &&
+                 (false == KnxGroupFilter_Pass(KNX_GROUP_FILTER_IP_TO_TP,
+                                               ((uint16_t)bufferPtr[CEMI_FRAME_DA_HI_BYTE_OFFET] << 8) | bufferPtr[CEMI_FRAME_DA_LO_BYTE_OFFET])))
+        {
+            /* Group address blocked towards the bus: the tunnel client learns */
+            /* the frame never got there, a routed frame is dropped quietly    */
+            if (NULL != channel)
+            {
+                bufferPtr[0] = L_DATA_CON;
+                bufferPtr[CEMI_FRAME_CTRL1_FIELD_OFFSET] |= CEMI_FRAME_CTRL1_CONFIRM_ERROR;
+
+                KNXnetIP_TunnellingTransmit(channelId, frame);
+            }
+            else
+            {
+                KnxFrameBuffer_Release(frame);
+            }
+
+            status = E_OK;
+        }
+        else
+        {
+            /* Runs in the network task serving the channel's transport, routing is UDP only */
+            uint8_t transport = (NULL != channel) ? KNXNETIP_TRANSPORT_INDEX(channel->Protocol) : KNXNETIP_TRANSPORT_UDP;
+            KnxFrameRingType * ring = &TP_GW_TxRing[transport];
+            KnxFrameRing_SlotType * slot = KnxFrameRing_Reserve(ring);
+
+            if (NULL != slot)
+            {
+                /* Only the handle moves, the frame stays where the network task received it */
+                TP_GW_ReqTimestampMs[frame] = KnxTpUart2_GetTimeMs();
+                slot->Frame = frame;
+                slot->ChannelId = channelId;
+                slot->Generation = (NULL != channel) ? channel->Generation : 0U;
+
+                /* Counted before the tpuart task can see the frame */
+                atomic_fetch_add(&TP_GW_Backlog[TP_GW_FLOW_INDEX(channelId)], 1U);
+
+                KnxFrameRing_Commit(ring);
+                xSemaphoreGive(TP_GW_Doorbell);
+
+                status = E_OK;
+            }
+        }
+    }
+
+    // ESP_LOGW("TP","IP2TP");
+
+    return status;
+}
+
+void TP_GW_L_Data_Con(uint8_t channelId, KnxFrameBuffer_HandleType frame, bool success)
+{
+    if (KNX_FRAME_BUFFER_INVALID == frame)
+    {
+        ESP_LOGI("TP","L_Data_Con: ERR_NULL_PTR");
+    }
+    else
+    {
+        KnxFrameBuffer_HandleType confirm = KNX_FRAME_BUFFER_INVALID;
+        KnxFrameBuffer_HandleType indication = KNX_FRAME_BUFFER_INVALID;
+
+        /* Back to cEMI in the buffer the frame was sent from */
+        TP_GW_TpToCemi(L_DATA_IND, frame);
+
+        if ((KNX_CHANNEL_INVALID == channelId) || (true == TP_GW_Stale(channelId, TP_GW_TxGeneration[frame])))
+        {
+            /* Routed frame, or its tunnel closed while the frame was queued */
+            indication = frame;
+        }
+        else if (true == success)
+        {
+            /* Indication and confirmation differ in their first bytes, one of them is a copy */
+            indication = frame;
+            confirm = KnxFrameBuffer_Clone(frame);
+
+            if (KNX_FRAME_BUFFER_INVALID == confirm)
+            {
+                /* No buffer for the copy: the tunnel gets its confirmation, routing misses the frame */
+                confirm = frame;
+                indication = KNX_FRAME_BUFFER_INVALID;
+            }
+        }
+        else
+        {
+            confirm = frame;
+        }
+
+        if (KNX_FRAME_BUFFER_INVALID != confirm)
+        {
+            uint8_t * cemiPtr = KnxFrameBuffer_Frame(confirm);
+
+            cemiPtr[0] = L_DATA_CON;
+
+            if (false == success)
+            {
+                cemiPtr[CEMI_FRAME_CTRL1_FIELD_OFFSET] |= CEMI_FRAME_CTRL1_CONFIRM_ERROR;
+            }
+            else
+            {
+                cemiPtr[CEMI_FRAME_CTRL1_FIELD_OFFSET] &= (uint8_t)~CEMI_FRAME_CTRL1_CONFIRM_ERROR;
+            }
+
+            KNXnetIP_TunnellingRequest(channelId, confirm);
+        }
+
+        if (false == success)
+        {
+            KnxFrameBuffer_Release(indication);
+        }
+        else if (KNX_CHANNEL_INVALID == channelId)
+        {
+            /* The frame is on the bus now, the other IP side sees it as well */
+            TP_GW_TunnelToIP(indication);
+            KnxFrameBuffer_Release(indication);
+        }
+        else if (KNX_FRAME_BUFFER_INVALID != indication)
+        {
+            KNXnetIP_RoutingTP2IP(indication);
+        }
+        else
+        {
+            /* Sent as the confirmation */
+        }
+    }
+}
+
+void TP_GW_L_Data_Ind(KnxFrameBuffer_HandleType frame)
+{
+    uint8_t * framePtr = (KNX_FRAME_BUFFER_INVALID == frame) ? NULL : KnxFrameBuffer_Frame(frame);
+
+    if (NULL == framePtr)
+    {
+        ESP_LOGI("TP","L_Data_Ind: ERR_NULL_PTR");
+    }
+    else if ((0U != (framePtr[5] & LENGHT_FIELD_ADDRESS_TYPE_MASK)) &&
+             (false == KnxGroupFilter_Pass(KNX_GROUP_FILTER_TP_TO_IP,
+                                           ((uint16_t)framePtr[3] << 8) | framePtr[4])))
+    {
+        /* Group address blocked towards IP */
+        KnxFrameBuffer_Release(frame);
+    }
+    else
+    {
+        TP_GW_TpToCemi(L_DATA_IND, frame);
+
+        /* Tunnelling Request - Send over IP */
+        TP_GW_TunnelToIP(frame);
+
+        /* Routing Indication - Send to the multicast group */
+        KNXnetIP_RoutingTP2IP(frame);
 
-void TP_GW_L_Data_Req(uint8_t * bufferPtr, uint8_t rxLength)
+        // ESP_LOGW("IP","TP2IP");
+    }
+}
+
+unsigned int TP_GW_ChannelBacklog(uint8_t channelId)
 {
-    PduInfoType lpdu;
-    uint8_t index = 0;
+    /* Any task, KNX_CHANNEL_INVALID for the routed frames */
+    return atomic_load(&TP_GW_Backlog[TP_GW_FLOW_INDEX(channelId)]);
+}
+
+static void TP_GW_CemiToTp(uint16_t sourceAddr, KnxFrameBuffer_HandleType frame)
+{
+    /* The TP frame overlays the cEMI frame 3 bytes in: addresses and */
+    /* TPDU are already in place, only the header fields are rewritten */
+    uint8_t * cemiPtr = KnxFrameBuffer_Frame(frame);
+    uint8_t ctrl1 = cemiPtr[CEMI_FRAME_CTRL1_FIELD_OFFSET];
+    uint8_t ctrl2 = cemiPtr[CEMI_FRAME_CTRL2_FIELD_OFFSET];
+    uint8_t lg = cemiPtr[CEMI_FRAME_LENGTH_FIELD_OFFSET];
+    uint8_t * framePtr = KnxFrameBuffer_Pull(frame, CEMI_FRAME_CTRL2_FIELD_OFFSET);
+    uint16_t index = 0;
 
     /* Set CTRL field */
-    L_TxBuffer[index++] = bufferPtr[CEMI_FRAME_CTRL1_FIELD_OFFSET];
+    framePtr[index++] = ctrl1;
 
     /* Set Source Address */
-    L_TxBuffer[index++] = 0x11;
-    L_TxBuffer[index++] = 0xFA;
+    framePtr[index++] = (uint8_t)((sourceAddr >> 8) & 0xFFU);
+    framePtr[index++] = (uint8_t)(sourceAddr & 0xFFU);
 
-    /* Set Destination Address */
-    L_TxBuffer[index++] = bufferPtr[CEMI_FRAME_DA_HI_BYTE_OFFET];
-    L_TxBuffer[index++] = bufferPtr[CEMI_FRAME_DA_LO_BYTE_OFFET];
+    /* Destination Address in place */
+    index += 2U;
 
     /* Set Length Field - AT, HC, LG */
-    L_TxBuffer[index++] = bufferPtr[CEMI_FRAME_CTRL2_FIELD_OFFSET] | bufferPtr[CEMI_FRAME_LENGTH_FIELD_OFFSET];
+    framePtr[index++] = ctrl2 | lg;
 
-    /* Copy Data into Tx Buffer */
-    memcpy(&L_TxBuffer[index], &bufferPtr[CEMI_FRAME_TPDU_FIELD_OFFSET], bufferPtr[CEMI_FRAME_LENGTH_FIELD_OFFSET] + 1);
-    index += bufferPtr[CEMI_FRAME_LENGTH_FIELD_OFFSET] + 1;
+    /* Data in place */
+    index += lg + 1;
 
     /* Set FCS field */
-    L_TxBuffer[index] = TP_L_Data_CalculateFCS(&L_TxBuffer[0], index);
+    framePtr[index] = TP_L_Data_CalculateFCS(&framePtr[0], index);
     index++;
 
-    lpdu.SduDataPtr = &L_TxBuffer[0];
-    lpdu.SduLength = index;
+    KnxFrameBuffer_Get(frame)->Length = index;
+}
+
+static void TP_GW_TpToCemi(uint8_t messageCode, KnxFrameBuffer_HandleType frame)
+{
+    /* Inverse of TP_GW_CemiToTp, the cEMI header grows into the headroom */
+    uint8_t * tpPtr = KnxFrameBuffer_Frame(frame);
+    uint8_t ctrl1 = tpPtr[0];
+    uint8_t saHi = tpPtr[1];
+    uint8_t saLo = tpPtr[2];
+    uint8_t lengthField = tpPtr[5];
+    uint8_t * cemiPtr = KnxFrameBuffer_Push(frame, CEMI_FRAME_CTRL2_FIELD_OFFSET);
+    uint16_t index = 0;
 
-    // ESP_LOGW("TP","IP2TP");
+    /* Message Code */
+    cemiPtr[index++] =  messageCode;
+    cemiPtr[index++] =  0x00U;
 
-    TpUart2_L_Data_Req(0, 0, 0, 0, &lpdu);
+    /* CTRL1 Field */
+    cemiPtr[index++] =  ctrl1;
+
+    /* CTRL2 Field - AT, HC, EFF */
+    cemiPtr[index++] =  lengthField & LENGTH_FIELD_AT_HC_MASK;
+
+    /* Source Address - High */
+    cemiPtr[index++] =  saHi;
+
+    /* Source Address - Low */
+    cemiPtr[index++] =  saLo;
+
+    /* Destination Address in place */
+    index += 2U;
+
+    if ((cemiPtr[CEMI_FRAME_SA_HI_BYTE_OFFET] == cemiPtr[CEMI_FRAME_DA_HI_BYTE_OFFET]) && 
+        (cemiPtr[CEMI_FRAME_SA_LO_BYTE_OFFET] == cemiPtr[CEMI_FRAME_DA_LO_BYTE_OFFET]))
+    {
+        /* Source and Destination Address are same! */
+        cemiPtr[CEMI_FRAME_DA_HI_BYTE_OFFET] = 0x00U;
+        cemiPtr[CEMI_FRAME_DA_LO_BYTE_OFFET] = 0x00U;
+    }
+
+    /* Data Length */
+    cemiPtr[index++] =  lengthField & LENGTH_FIELD_LG_MASK;
+
+    /* Data in place, the FCS is dropped */
+    index += cemiPtr[CEMI_FRAME_LENGTH_FIELD_OFFSET] + 1;
+
+    KnxFrameBuffer_Get(frame)->Length = index;
 }
 
-void TP_GW_L_Data_Ind(PduInfoType * pduInfoPtr)
+static void TP_GW_TunnelToIP(KnxFrameBuffer_HandleType frame)
 {
-    if (NULL == pduInfoPtr)
+    /* Borrows the frame, every tunnel it goes to takes a reference of its own */
+    uint8_t * cemiPtr = KnxFrameBuffer_Frame(frame);
+
+    if (0U == (cemiPtr[CEMI_FRAME_CTRL2_FIELD_OFFSET] & CTRLE_FIELD_ADDRESS_TYPE_MASK))
     {
-        ESP_LOGI("TP","L_Data_Ind: ERR_NULL_PTR");
+        /* Point-to-point frame: only the tunnel owning the destination address gets it */
+        uint16_t destAddr = ((uint16_t)cemiPtr[CEMI_FRAME_DA_HI_BYTE_OFFET] << 8) | cemiPtr[CEMI_FRAME_DA_LO_BYTE_OFFET];
+        KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGetByIndvAddr(destAddr);
+
+        if (NULL != channel)
+        {
+            KnxFrameBuffer_Ref(frame);
+            KNXnetIP_TunnellingRequest(channel->ChannelId, frame);
+        }
     }
     else
     {
-        uint8_t index = 0;
+        /* Group and broadcast frames: every open tunnel shares the frame */
+        for (uint8_t channelId = CHANNEL_1; channelId <= KNX_CHANNEL_NUM; channelId++)
+        {
+            KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(channelId);
 
-        /* Message Code */
-        L_RxBuffer[index++] =  L_DATA_IND;
-        L_RxBuffer[index++] =  0x00U;
+            if ((NULL != channel) && (TUNNEL_CONNECTION == channel->ConnectionType))
+            {
+                KnxFrameBuffer_Ref(frame);
+                KNXnetIP_TunnellingRequest(channelId, frame);
+            }
+        }
+    }
+}
 
-        /* CTRL1 Field */
-        L_RxBuffer[index++] =  pduInfoPtr->SduDataPtr[0];
+static uint8_t TP_L_Data_CalculateFCS(uint8_t * l_data, uint16_t length)
+{
+    uint8_t fcs = 0xFFU; /* Start with 0xFF */
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        fcs ^= l_data[i];
+    }
 
-        /* CTRL2 Field - AT, HC, EFF */
-        L_RxBuffer[index++] =  pduInfoPtr->SduDataPtr[5] & LENGTH_FIELD_AT_HC_MASK;
+    /* Return XOR Checksum*/
+    return (fcs);
+}
 
-        /* Source Address - High */
-        L_RxBuffer[index++] =  pduInfoPtr->SduDataPtr[1];
+static bool TP_GW_Stale(uint8_t channelId, uint8_t generation)
+{
+    /* A tunnel frame whose connection is gone, even if the channel is in use again */
+    KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(channelId);
 
-        /* Source Address - Low */
-        L_RxBuffer[index++] =  pduInfoPtr->SduDataPtr[2];
+    return (KNX_CHANNEL_INVALID != channelId) && ((NULL == channel) || (generation != channel->Generation));
+}
 
-        /* Destination Address - High */
-        L_RxBuffer[index++] =  pduInfoPtr->SduDataPtr[3];
+static void TP_GW_FlowEnqueue(uint8_t channelId, uint8_t generation, KnxFrameBuffer_HandleType frame)
+{
+    uint8_t * cemiPtr = KnxFrameBuffer_Frame(frame);
+    PriorityType priority = (PriorityType)((cemiPtr[CEMI_FRAME_CTRL1_FIELD_OFFSET] & CTRL_FIELD_PRIORITY_MASK) >> CTRL_FIELD_PRIORITY_OFFSET);
+    TP_GW_FlowType * flow = &TP_GW_Flow[TP_GW_FLOW_INDEX(channelId)];
 
-        /* Destination Address - Low */
-        L_RxBuffer[index++] =  pduInfoPtr->SduDataPtr[4];
+    if (true == TP_GW_Stale(channelId, generation))
+    {
+        /* Its tunnel closed while the frame was in the ring */
+        KnxFrameBuffer_Release(frame);
+        TP_GW_BacklogRelease(channelId);
+    }
+    else if (((SystemPriority == priority) || (UrgentPriority == priority)) && (false == TpUart2_TxQueueFull()))
+    {
+        /* System and alarm telegrams are not shared out, the TP-UART sends them first */
+        TP_GW_Transmit(channelId, generation, frame);
+        TP_GW_BacklogRelease(channelId);
+    }
+    else if (TP_GW_FLOW_QUEUE_LENGTH <= flow->Count)
+    {
+        /* A client not waiting for its acks, or a TCP one: refused with a negative L_Data.con */
+        if (KNX_CHANNEL_INVALID != channelId)
+        {
+            cemiPtr[0] = L_DATA_CON;
+            cemiPtr[CEMI_FRAME_CTRL1_FIELD_OFFSET] |= CEMI_FRAME_CTRL1_CONFIRM_ERROR;
 
-        if ((L_RxBuffer[CEMI_FRAME_SA_HI_BYTE_OFFET] == L_RxBuffer[CEMI_FRAME_DA_HI_BYTE_OFFET]) && 
-            (L_RxBuffer[CEMI_FRAME_SA_LO_BYTE_OFFET] == L_RxBuffer[CEMI_FRAME_DA_LO_BYTE_OFFET]))
+            KNXnetIP_TunnellingRequest(channelId, frame);
+        }
+        else
         {
-            /* Source and Destination Address are same! */
-            L_RxBuffer[CEMI_FRAME_DA_HI_BYTE_OFFET] = 0x00U;
-            L_RxBuffer[CEMI_FRAME_DA_LO_BYTE_OFFET] = 0x00U;
+            KnxFrameBuffer_Release(frame);
         }
 
-        /* Data Length */
-        L_RxBuffer[index++] =  pduInfoPtr->SduDataPtr[5] & LENGTH_FIELD_LG_MASK;
+        TP_GW_BacklogRelease(channelId);
+    }
+    else
+    {
+        flow->Frame[(flow->Head + flow->Count) % TP_GW_FLOW_QUEUE_LENGTH] = frame;
+        flow->Generation[(flow->Head + flow->Count) % TP_GW_FLOW_QUEUE_LENGTH] = generation;
+        flow->Count++;
+        TP_GW_FlowQueued++;
+    }
+}
 
-        /* Copy Data into Rx Buffer */
-        memcpy(&L_RxBuffer[index], &pduInfoPtr->SduDataPtr[EMI_FRAME_DATA_OFFSET], L_RxBuffer[CEMI_FRAME_LENGTH_FIELD_OFFSET] + 1);
+static void TP_GW_FlowPurge(void)
+{
+    /* A flow keeps its order, the frames of an earlier connection */
+    /* on the channel are all ahead of those of the current one    */
+    for (uint8_t flowIndex = 0; flowIndex < TP_GW_FLOW_ROUTING; flowIndex++)
+    {
+        TP_GW_FlowType * flow = &TP_GW_Flow[flowIndex];
 
-        index += L_RxBuffer[CEMI_FRAME_LENGTH_FIELD_OFFSET] + 1;
+        while ((0U < flow->Count) && (true == TP_GW_Stale(CHANNEL_1 + flowIndex, flow->Generation[flow->Head])))
+        {
+            KnxFrameBuffer_Release(flow->Frame[flow->Head]);
 
-        /* Tunnelling Request - Send over IP */
-        KNXnetIP_TunnellingRequest(&L_RxBuffer[0], index);
+            flow->Head = (flow->Head + 1U) % TP_GW_FLOW_QUEUE_LENGTH;
+            flow->Count--;
+            TP_GW_FlowQueued--;
 
-        // ESP_LOGW("IP","TP2IP");
+            TP_GW_BacklogRelease(CHANNEL_1 + flowIndex);
+        }
     }
 }
 
-void TP_GW_L_Data_Ind_ACK(PduInfoType * pduInfoPtr)
+static uint8_t TP_GW_FlowSelect(int64_t nowMs)
 {
-    if (NULL == pduInfoPtr)
+    uint8_t selected = TP_GW_FLOW_NONE;
+    bool high = false;
+    uint8_t round;
+
+    /* While a flow has a High priority frame at its head, only such flows */
+    /* take turns, and those passed over for TP_GW_TX_AGING_MS, the others */
+    /* keep their credit                                                   */
+    for (uint8_t flowIndex = 0; flowIndex < TP_GW_FLOW_NUM; flowIndex++)
     {
-        ESP_LOGI("TP","L_Data_Ind_ACK: ERR_NULL_PTR");
+        high = high || (true == TP_GW_FlowHigh(&TP_GW_Flow[flowIndex]));
     }
-    else
+
+    for (uint8_t flowIndex = 0; flowIndex < TP_GW_FLOW_NUM; flowIndex++)
+    {
+        TP_GW_FlowType * flow = &TP_GW_Flow[flowIndex];
+
+        if ((0U == flow->Count) || (false == high))
+        {
+            flow->Held = false;
+        }
+        else if ((true == high) && (false == flow->Held) && (false == TP_GW_FlowHigh(flow)))
+        {
+            flow->Held = true;
+            flow->HeldSinceMs = nowMs;
+        }
+        else
+        {
+            /* Served, or passed over already */
+        }
+    }
+
+    round = (true == high) ? TP_GW_ROUND_HIGH : TP_GW_ROUND_ALL;
+
+    /* Deficit round robin: each turn adds a quantum of byte-times to the */
+    /* flow, it sends while its head frame fits, then the next flow goes  */
+    while ((TP_GW_FLOW_NONE == selected) && (0U < TP_GW_FlowQueued))
+    {
+        TP_GW_FlowType * flow = &TP_GW_Flow[TP_GW_FlowCurrent[round]];
+        bool ready = (0U < flow->Count) &&
+                     ((false == high) || (true == TP_GW_FlowHigh(flow)) ||
+                      ((true == flow->Held) && ((nowMs - flow->HeldSinceMs) >= TP_GW_TX_AGING_MS)));
+
+        if ((true == ready) && (false == TP_GW_FlowTurnStarted[round]))
+        {
+            flow->Deficit += TP_GW_DRR_QUANTUM;
+            TP_GW_FlowTurnStarted[round] = true;
+        }
+        else if ((true == ready) && (flow->Deficit >= TP_GW_FlowCost(flow->Frame[flow->Head])))
+        {
+            selected = TP_GW_FlowCurrent[round];
+        }
+        else
+        {
+            /* Turn over, an empty flow keeps no credit for later */
+            if (0U == flow->Count)
+            {
+                flow->Deficit = 0U;
+            }
+
+            TP_GW_FlowCurrent[round] = (TP_GW_FlowCurrent[round] + 1U) % TP_GW_FLOW_NUM;
+            TP_GW_FlowTurnStarted[round] = false;
+        }
+    }
+
+    return selected;
+}
+
+static bool TP_GW_FlowHigh(const TP_GW_FlowType * flow)
+{
+    /* Anything above Normal (LowPriority) at the head of the flow */
+    bool high = false;
+
+    if (0U < flow->Count)
     {
-        uint8_t index = 0;
+        uint8_t ctrl1 = KnxFrameBuffer_Frame(flow->Frame[flow->Head])[CEMI_FRAME_CTRL1_FIELD_OFFSET];
 
-        /* Message Code */
-        L_RxBuffer[index++] =  L_DATA_IND;
-        L_RxBuffer[index++] =  0x00U;
+        high = (LowPriority != (PriorityType)((ctrl1 & CTRL_FIELD_PRIORITY_MASK) >> CTRL_FIELD_PRIORITY_OFFSET));
+    }
 
-        /* CTRL1 Field */
-        L_RxBuffer[index++] =  pduInfoPtr->SduDataPtr[0];
+    return high;
+}
 
-        /* CTRL2 Field - AT, HC, EFF */
-        L_RxBuffer[index++] =  pduInfoPtr->SduDataPtr[5] & LENGTH_FIELD_AT_HC_MASK;
+static KnxFrameBuffer_HandleType TP_GW_FlowDequeue(uint8_t flowIndex)
+{
+    TP_GW_FlowType * flow = &TP_GW_Flow[flowIndex];
+    KnxFrameBuffer_HandleType frame = flow->Frame[flow->Head];
 
-        /* Source Address - High */
-        L_RxBuffer[index++] =  pduInfoPtr->SduDataPtr[1];
+    flow->Deficit -= TP_GW_FlowCost(frame);
+    flow->Head = (flow->Head + 1U) % TP_GW_FLOW_QUEUE_LENGTH;
+    flow->Count--;
+    TP_GW_FlowQueued--;
 
-        /* Source Address - Low */
-        L_RxBuffer[index++] =  pduInfoPtr->SduDataPtr[2];
+    return frame;
+}
 
-        /* Destination Address - High */
-        L_RxBuffer[index++] =  pduInfoPtr->SduDataPtr[3];
+static uint16_t TP_GW_FlowCost(KnxFrameBuffer_HandleType frame)
+{
+    /* Byte-times the frame keeps the bus busy, before any repetition */
+    return KnxFrameBuffer_Frame(frame)[CEMI_FRAME_LENGTH_FIELD_OFFSET] + TPUART2_STANDARD_FRAME_OVERHEAD + TP_GW_BUS_OVERHEAD;
+}
 
-        /* Destination Address - Low */
-        L_RxBuffer[index++] =  pduInfoPtr->SduDataPtr[4];
+static void TP_GW_Transmit(uint8_t channelId, uint8_t generation, KnxFrameBuffer_HandleType frame)
+{
+    KNXnetIP_ChannelType * channel = KNXnetIP_ChannelGet(channelId);
 
-        if ((L_RxBuffer[CEMI_FRAME_SA_HI_BYTE_OFFET] == L_RxBuffer[CEMI_FRAME_DA_HI_BYTE_OFFET]) && 
-            (L_RxBuffer[CEMI_FRAME_SA_LO_BYTE_OFFET] == L_RxBuffer[CEMI_FRAME_DA_LO_BYTE_OFFET]))
+    if (false == TP_GW_Stale(channelId, generation))
+    {
+        uint8_t * cemiPtr = KnxFrameBuffer_Frame(frame);
+        uint16_t sourceAddr;
+        PriorityType priority;
+
+        if (NULL != channel)
+        {
+            /* Frames of a tunnel are sent with the individual address of its slot */
+            sourceAddr = channel->IndvAddr;
+        }
+        else
         {
-            /* Source and Destination Address are same! */
-            L_RxBuffer[CEMI_FRAME_DA_HI_BYTE_OFFET] = 0x00U;
-            L_RxBuffer[CEMI_FRAME_DA_LO_BYTE_OFFET] = 0x00U;
+            /* Routed frames keep the source address they came with */
+            sourceAddr = ((uint16_t)cemiPtr[CEMI_FRAME_SA_HI_BYTE_OFFET] << 8) | cemiPtr[CEMI_FRAME_SA_LO_BYTE_OFFET];
         }
 
-        /* Data Length */
-        L_RxBuffer[index++] =  0x00U;
+        TP_GW_CemiToTp(sourceAddr, frame);
 
-        /* TPCI, SeqNum = 0 : ACK      */
-        /* 1... .... = Packet Type: Control (1)    */
-        /* .1.. .... = Sequence Type: Numbered (1) */
-        /* ..00 00.. = Sequence Number: 0          */
-        /* .... ..10 = Service: ACK (0x2)          */
-        L_RxBuffer[index++] = 0xC2U;
+        /* Queued by the priority of the telegram, higher ones go to the bus first */
+        priority = (PriorityType)((KnxFrameBuffer_Frame(frame)[0] & CTRL_FIELD_PRIORITY_MASK) >> CTRL_FIELD_PRIORITY_OFFSET);
+        TP_GW_TxGeneration[frame] = generation;
 
-        /* Tunnelling Request - Send over IP */
-        KNXnetIP_TunnellingRequest(&L_RxBuffer[0], index);
+        if (E_OK == TpUart2_L_Data_Req(channelId, 0, 0, 0, priority, frame, TP_GW_ReqTimestampMs[frame]))
+        {
+            /* The tx queue holds the frame until its L_Data.con */
+            frame = KNX_FRAME_BUFFER_INVALID;
+        }
+        else if (KNX_CHANNEL_INVALID != channelId)
+        {
+            /* Refused by the TP-UART: back to cEMI, answered with a negative L_Data.con */
+            TP_GW_TpToCemi(L_DATA_CON, frame);
+            KnxFrameBuffer_Frame(frame)[CEMI_FRAME_CTRL1_FIELD_OFFSET] |= CEMI_FRAME_CTRL1_CONFIRM_ERROR;
 
+            KNXnetIP_TunnellingRequest(channelId, frame);
+            frame = KNX_FRAME_BUFFER_INVALID;
+        }
+        else
+        {
+            /* A routed frame is dropped */
+        }
     }
+
+    /* Passed on, or its tunnel closed while it was queued, or a refused routed frame */
+    KnxFrameBuffer_Release(frame);
 }
 
-static uint8_t TP_L_Data_CalculateFCS(uint8_t * l_data, uint16_t length)
+static void TP_GW_BacklogRelease(uint8_t channelId)
 {
-    uint8_t fcs = 0xFFU; /* Start with 0xFF */
+    unsigned int backlog = atomic_fetch_sub(&TP_GW_Backlog[TP_GW_FLOW_INDEX(channelId)], 1U);
 
-    for (uint16_t i = 0; i < length; i++)
+    if ((TP_GW_ACK_WITHHOLD_DEPTH == backlog) && (KNX_CHANNEL_INVALID != channelId))
     {
-        fcs ^= l_data[i];
+        /* Dropped below the depth, an ack held back for this tunnel can go */
+        KNXnetIP_TunnellingResume(channelId);
     }
-
-    /* Return XOR Checksum*/
-    return (fcs);
 }
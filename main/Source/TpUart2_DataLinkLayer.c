@@ -1,6 +1,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "string.h"
+#include <sys/param.h>
 #include "esp_system.h"
 #include "esp_log.h"
 
@@ -10,71 +11,329 @@
 #include "TP_DataLinkLayer.h"
 #include "TpUart2_DataLinkLayer.h"
 #include "KnxTpUart2_Services.h"
+#include "KnxFrameBuffer.h"
+#include "KnxTimer.h"
 
-static uint8_t TpUart2_TxBuffer[512];
-//static uint8_t TpUart2_RxBuffer[512];
+/* Outbound frames waiting for or awaiting their L_Data.con */
+#define TPUART2_TX_QUEUE_LENGTH    (16U)
 
-void TpUart2_L_Data_Req(bool repeatFlag, uint16_t destAddr, AddressType addrType, PriorityType priority, PduInfoType * pduInfoPtr);
-void TpUart2_L_Data_Con(void);
-void TpUart2_L_Data_Ind(PduInfoType * pduInfoPtr);
-bool TpUart2_DetectEOP(uint8_t * dataPtr, uint8_t rxLength, uint8_t * validDataLength);
+/* Frames handed to the TP-UART ahead of their L_Data.con, so the */
+/* next frame is already buffered while the bus sends the current */
+#define TPUART2_TX_PIPELINE_DEPTH  (2U)
 
-void TpUart2_L_Data_Req(bool repeatFlag, uint16_t destAddr, AddressType addrType, PriorityType priority, PduInfoType * pduInfoPtr)
+/* Last repetition plus busy retries stay well below this */
+#define TPUART2_CONFIRM_TIMEOUT_MS (1000U)
+
+/* Waiting frames are queued per telegram priority, served in the order */
+/* System, Alarm (urgent), High (normal), Normal (low)                   */
+#define TPUART2_TX_LEVEL_NUM       (4U)
+#define TPUART2_TX_LEVEL_NONE      (TPUART2_TX_LEVEL_NUM)
+
+/* A frame waiting this long goes ahead of higher priorities, so a */
+/* steady stream of those never starves Normal priority frames     */
+#define TPUART2_TX_AGING_MS        (500U)
+
+typedef struct {
+    KnxFrameBuffer_HandleType Frame;  /* TP frame, held until its L_Data.con */
+    uint8_t ChannelId;  /* Originating tunnel, KNX_CHANNEL_INVALID for local frames */
+    uint8_t Sequence;   /* Running tag, matched in order against L_Data.con */
+    uint8_t Level;      /* Scheduling level of the frame's priority */
+    int64_t ReqTimestampMs;     /* Requested, at the gateway for IP frames */
+    int64_t QueueTimestampMs;   /* Queued here, aging counts from then */
+    int64_t TxTimestampMs;
+#ifdef TPUART2_TX_BENCHMARK
+    int64_t ReqTimestampUs;
+#endif
+} TpUart2_TxEntryType;
+
+typedef struct {
+    TpUart2_TxEntryType Entry[TPUART2_TX_QUEUE_LENGTH];
+    uint8_t Head;
+    uint8_t Count;
+} TpUart2_TxFifoType;
+
+typedef struct {
+    TpUart2_TxFifoType Waiting[TPUART2_TX_LEVEL_NUM];           /* Not yet written, one FIFO per level */
+    TpUart2_TxEntryType InFlight[TPUART2_TX_PIPELINE_DEPTH];    /* Written to the TP-UART, awaiting L_Data.con */
+    uint8_t InFlightHead;   /* Oldest frame, first to be confirmed */
+    uint8_t InFlightCount;
+    uint8_t Count;          /* Queued frames including those in flight */
+    uint8_t Sequence;
+} TpUart2_TxQueueType;
+
+typedef struct {
+    uint32_t Frames;        /* Written to the TP-UART */
+    uint32_t Aged;          /* Written ahead of a higher priority after TPUART2_TX_AGING_MS */
+    uint8_t HighWater;      /* Deepest queue since the last report */
+    int64_t WaitSumMs;      /* Request, at the gateway for IP frames, to the TP-UART write */
+    int64_t WaitMaxMs;
+} TpUart2_TxLevelStatisticsType;
+
+/* Only the tpuart task touches the queue, IP frames reach it through TP_GW_MainFunction */
+static TpUart2_TxQueueType TpUart2_TxQueue;
+
+/* Scheduling level by the priority bits of the control field */
+static const uint8_t TpUart2_TxLevel[TPUART2_TX_LEVEL_NUM] = {
+    0U,     /* SystemPriority */
+    2U,     /* NormalPriority, High */
+    1U,     /* UrgentPriority, Alarm */
+    3U,     /* LowPriority, Normal */
+};
+
+static TpUart2_TxLevelStatisticsType TpUart2_TxStatistics[TPUART2_TX_LEVEL_NUM];
+
+/* Timers of the tpuart task, the confirm timer runs for the oldest frame in flight */
+static KnxTimer_WheelType TpUart2_TimerWheel;
+static KnxTimer_Type TpUart2_ConfirmTimer;
+
+#ifdef TPUART2_TX_STATISTICS
+/* Per priority queue depth and waiting time are logged this often */
+#define TPUART2_TX_STATISTICS_PERIOD_MS (10000U)
+
+static KnxTimer_Type TpUart2_TxStatisticsTimer;
+
+static void TpUart2_TxStatisticsReport(void * context);
+#endif /* TPUART2_TX_STATISTICS */
+
+/* Receive parser gives up on a partial frame after this much silence. */
+/* Inside a frame the TP-UART forwards a byte every ~1.4 ms.            */
+#define TPUART2_RX_IDLE_TIMEOUT_MS (50U)
+
+/* A character on the bus, 13 bit times at 9600 bit/s */
+#define TPUART2_RX_BYTE_TIME_US    (1354U)
+
+typedef enum {
+    TPUART2_RX_STATE_IDLE,   /* Expecting a service byte or frame start */
+    TPUART2_RX_STATE_FRAME   /* Collecting frame bytes */
+} TpUart2_RxStateType;
+
+typedef struct {
+    TpUart2_RxStateType State;
+    KnxFrameBuffer_HandleType Frame; /* Taken at a frame start, kept for the next one when the frame is dropped */
+    uint8_t * FramePtr;      /* NULL while the pool is empty, the frame is then followed but not stored */
+    uint16_t Index;          /* Bytes of the current frame received so far */
+    uint16_t Length;         /* Expected frame length, 0 until the length field is in */
+    uint8_t LengthOffset;    /* Position of the length field in the current frame */
+    uint8_t Overhead;        /* Frame length minus LG */
+    uint8_t Fcs;             /* Running XOR, 0xFF at the end of a valid frame */
+    int64_t LastByteMs;
+#ifdef TPUART2_RX_LATENCY
+    int64_t ChunkTimestampUs; /* Arrival of the UART read holding the frame end */
+#endif
+} TpUart2_RxParserType;
+
+static TpUart2_RxParserType TpUart2_RxParser;
+static TpUart2_RxStatisticsType TpUart2_RxStatistics;
+
+#ifdef TPUART2_RX_STATISTICS
+/* Receive counters are logged this often from TpUart2_MainFunction */
+#define TPUART2_RX_STATISTICS_PERIOD_MS (10000U)
+
+static int64_t TpUart2_RxStatisticsTimestampMs;
+#endif /* TPUART2_RX_STATISTICS */
+
+#ifdef TPUART2_RX_LATENCY
+/* TP receive to IP send latency histograms, recorded by the network task */
+/* sending the frame, percentiles are logged every ..._FRAMES frames       */
+#define TPUART2_RX_LATENCY_FRAMES    (500U)
+#define TPUART2_RX_LATENCY_BUCKET_US (250U)
+#define TPUART2_RX_LATENCY_BUCKETS   (200U) /* Last bucket collects everything above 50 ms */
+
+typedef struct {
+    uint16_t Bucket[TPUART2_RX_LATENCY_BUCKETS];
+    uint32_t Frames;
+    int64_t MaxUs;
+} TpUart2_RxLatencyType;
+
+static TpUart2_RxLatencyType TpUart2_RxLatency[TPUART2_RX_LATENCY_SINK_NUM];
+
+static uint32_t TpUart2_RxLatencyPercentile(const TpUart2_RxLatencyType * latency, uint8_t percent);
+#endif /* TPUART2_RX_LATENCY */
+
+#ifdef TPUART2_TX_BENCHMARK
+/* Averages are logged every TPUART2_TX_BENCHMARK_FRAMES confirmed frames */
+#define TPUART2_TX_BENCHMARK_FRAMES (100U)
+
+typedef struct {
+    uint32_t Frames;
+    int64_t CpuTimeUs;     /* Time spent writing frames to the TP-UART */
+    int64_t LatencyUs;     /* TpUart2_L_Data_Req to L_Data.con */
+} TpUart2_TxBenchmarkType;
+
+static TpUart2_TxBenchmarkType TpUart2_TxBenchmark;
+#endif /* TPUART2_TX_BENCHMARK */
+
+void TpUart2_Init(void);
+void TpUart2_MainFunction(void);
+uint32_t TpUart2_GetNextTimeoutMs(void);
+StatusType TpUart2_L_Data_Req(uint8_t channelId, bool repeatFlag, uint16_t destAddr, AddressType addrType, PriorityType priority, KnxFrameBuffer_HandleType frame, int64_t reqTimestampMs);
+bool TpUart2_TxQueueFull(void);
+uint8_t TpUart2_TxQueueCount(void);
+void TpUart2_L_Data_Con(bool success);
+void TpUart2_L_Data_Ind(KnxFrameBuffer_HandleType frame);
+void TpUart2_RxIndication(const uint8_t * dataPtr, uint16_t length);
+const TpUart2_RxStatisticsType * TpUart2_GetRxStatistics(void);
+
+static void TpUart2_RxByte(uint8_t data);
+static void TpUart2_RxService(uint8_t data);
+static void TpUart2_RxFrameComplete(void);
+static void TpUart2_StateIndication(uint8_t state);
+static void TpUart2_TransmitFrame(TpUart2_TxEntryType * entry);
+static void TpUart2_TxPump(void);
+static uint8_t TpUart2_TxSelect(int64_t nowMs);
+static void TpUart2_TxComplete(bool success);
+static void TpUart2_ConfirmTimerStart(void);
+static void TpUart2_ConfirmTimeout(void * context);
+
+void TpUart2_Init(void)
+{
+    memset(&TpUart2_TxQueue, 0, sizeof(TpUart2_TxQueue));
+
+    KnxTimer_WheelInit(&TpUart2_TimerWheel, KnxTpUart2_GetTimeMs());
+    KnxTimer_Init(&TpUart2_ConfirmTimer, TpUart2_ConfirmTimeout, NULL);
+    memset(&TpUart2_TxStatistics, 0, sizeof(TpUart2_TxStatistics));
+
+#ifdef TPUART2_TX_STATISTICS
+    KnxTimer_Init(&TpUart2_TxStatisticsTimer, TpUart2_TxStatisticsReport, NULL);
+    KnxTimer_Arm(&TpUart2_TimerWheel, &TpUart2_TxStatisticsTimer, KnxTpUart2_GetTimeMs(), TPUART2_TX_STATISTICS_PERIOD_MS);
+#endif /* TPUART2_TX_STATISTICS */
+
+    memset(&TpUart2_RxParser, 0, sizeof(TpUart2_RxParser));
+    TpUart2_RxParser.Frame = KNX_FRAME_BUFFER_INVALID;
+    memset(&TpUart2_RxStatistics, 0, sizeof(TpUart2_RxStatistics));
+}
+
+void TpUart2_MainFunction(void)
 {
-    if (NULL == pduInfoPtr)
+    /* Expires the L_Data.con timeout of the frame in flight and the statistics period */
+    (void)KnxTimer_Advance(&TpUart2_TimerWheel, KnxTpUart2_GetTimeMs());
+
+#ifdef TPUART2_RX_STATISTICS
+    if ((KnxTpUart2_GetTimeMs() - TpUart2_RxStatisticsTimestampMs) > TPUART2_RX_STATISTICS_PERIOD_MS)
+    {
+        TpUart2_RxStatisticsTimestampMs = KnxTpUart2_GetTimeMs();
+
+        ESP_LOGI("TpUart2 Rx", "frames %lu, con %lu, state %lu, reset %lu, fcs err %lu, oversize %lu, no buffer %lu, timeout %lu, discarded %lu",
+                 (unsigned long)TpUart2_RxStatistics.Frames,
+                 (unsigned long)TpUart2_RxStatistics.Confirms,
+                 (unsigned long)TpUart2_RxStatistics.StateIndications,
+                 (unsigned long)TpUart2_RxStatistics.ResetIndications,
+                 (unsigned long)TpUart2_RxStatistics.ChecksumErrors,
+                 (unsigned long)TpUart2_RxStatistics.OversizeFrames,
+                 (unsigned long)TpUart2_RxStatistics.NoBuffer,
+                 (unsigned long)TpUart2_RxStatistics.Timeouts,
+                 (unsigned long)TpUart2_RxStatistics.DiscardedBytes);
+    }
+#endif /* TPUART2_RX_STATISTICS */
+}
+
+uint32_t TpUart2_GetNextTimeoutMs(void)
+{
+    uint32_t timeoutMs = TPUART2_NO_TIMEOUT;
+    uint32_t timerTimeoutMs = KnxTimer_NextTimeoutMs(&TpUart2_TimerWheel, KnxTpUart2_GetTimeMs());
+
+    if (KNX_TIMER_NO_TIMEOUT != timerTimeoutMs)
+    {
+        timeoutMs = timerTimeoutMs;
+    }
+
+#ifdef TPUART2_RX_STATISTICS
+    if (TPUART2_RX_STATISTICS_PERIOD_MS < timeoutMs)
+    {
+        timeoutMs = TPUART2_RX_STATISTICS_PERIOD_MS;
+    }
+#endif /* TPUART2_RX_STATISTICS */
+
+    return timeoutMs;
+}
+
+StatusType TpUart2_L_Data_Req(uint8_t channelId, bool repeatFlag, uint16_t destAddr, AddressType addrType, PriorityType priority, KnxFrameBuffer_HandleType frame, int64_t reqTimestampMs)
+{
+    StatusType status = E_NOT_OK;
+
+    /* The queue takes the frame on E_OK, the caller keeps it otherwise */
+    if (KNX_FRAME_BUFFER_INVALID == frame)
     {
         ESP_LOGI("TpUart2","TpUart2_L_Data_Req: ERR_NULL_PTR");
     }
+    else if (TPUART2_FRAME_MAX_LENGTH < KnxFrameBuffer_Get(frame)->Length)
+    {
+        ESP_LOGI("TpUart2","TpUart2_L_Data_Req: ERR_FRAME_LENGTH");
+    }
     else
     {
-        /* Copy frame into Tx buffer */
-        memcpy(&TpUart2_TxBuffer[0], pduInfoPtr->SduDataPtr, (uint16_t)(pduInfoPtr->SduLength));
+        if (TPUART2_TX_QUEUE_LENGTH > TpUart2_TxQueue.Count)
+        {
+            uint8_t level = TpUart2_TxLevel[(uint8_t)priority % TPUART2_TX_LEVEL_NUM];
+            TpUart2_TxFifoType * fifo = &TpUart2_TxQueue.Waiting[level];
+            TpUart2_TxEntryType * entry = &fifo->Entry[(fifo->Head + fifo->Count) % TPUART2_TX_QUEUE_LENGTH];
+
+            entry->Frame = frame;
+            entry->ChannelId = channelId;
+            entry->Sequence = TpUart2_TxQueue.Sequence++;
+            entry->Level = level;
+            entry->ReqTimestampMs = reqTimestampMs;
+            entry->QueueTimestampMs = KnxTpUart2_GetTimeMs();
+#ifdef TPUART2_TX_BENCHMARK
+            entry->ReqTimestampUs = KnxTpUart2_GetTimeUs();
+#endif
+            fifo->Count++;
+            TpUart2_TxQueue.Count++;
+
+            TpUart2_TxStatistics[level].HighWater = MAX(TpUart2_TxStatistics[level].HighWater, fifo->Count);
 
-        for (uint8_t i = 0; i < pduInfoPtr->SduLength; i++)
+            /* Stream into the TP-UART right away if the pipeline has room */
+            TpUart2_TxPump();
+
+            status = E_OK;
+        }
+        else
         {
-            if (0U == i)
-            {
-                KnxTpUart2_U_L_DataStart(TpUart2_TxBuffer[i]);
-            }
-            else if ((pduInfoPtr->SduLength) - 1 == i)
-            {
-                KnxTpUart2_U_L_DataEnd((pduInfoPtr->SduLength) - 1, TpUart2_TxBuffer[i]);
-            }
-            else
-            {
-                KnxTpUart2_U_L_DataContinue(i, TpUart2_TxBuffer[i]);
-            }
+            /* Tx queue full, the caller keeps the frame until the next L_Data.con */
         }
     }
     (void)repeatFlag;
     (void)destAddr;
     (void)addrType;
-    (void)priority;
+
+    return status;
+}
+
+bool TpUart2_TxQueueFull(void)
+{
+    return (TPUART2_TX_QUEUE_LENGTH <= TpUart2_TxQueue.Count);
 }
 
-void TpUart2_L_Data_Con()
+uint8_t TpUart2_TxQueueCount(void)
 {
+    return TpUart2_TxQueue.Count;
+}
 
+void TpUart2_L_Data_Con(bool success)
+{
+    TpUart2_TxComplete(success);
 }
 
-void TpUart2_L_Data_Ind(PduInfoType * pduInfoPtr)
+void TpUart2_L_Data_Ind(KnxFrameBuffer_HandleType frame)
 {
-    if (NULL == pduInfoPtr)
+    bool forwarded = false;
+
+    if (KNX_FRAME_BUFFER_INVALID == frame)
     {
         ESP_LOGI("TpUart2_DataLinkLayer","TpUart2_L_Data_Ind: ERR_NULL_PTR");
     }
-    else if (0U == (uint8_t)(pduInfoPtr->SduLength))
+    else if (0U == KnxFrameBuffer_Get(frame)->Length)
     {
         ESP_LOGI("TpUart2_DataLinkLayer","TpUart2_L_Data_Ind: ERR_ZERO_LENGTH_LPDU");
     }
     else
     {
         /* UART Controlfield */
-        uint8_t layer2Service = pduInfoPtr->SduDataPtr[0];
+        uint8_t layer2Service = KnxFrameBuffer_Frame(frame)[0];
 
         if (TPUART2_LAYER2_L_POLLDATA_REQ == layer2Service)
         {
-            KnxTpUart2_U_PollingState(0, 0x11FAU, 0);
+            KnxTpUart2_U_PollingState(0, KNX_INDIVIDUAL_ADDR, 0);
         }
         else
         {
@@ -84,13 +343,13 @@ void TpUart2_L_Data_Ind(PduInfoType * pduInfoPtr)
             {
                 case TPUART2_LAYER2_L_DATA_REQ:
                 case TPUART2_LAYER2_L_EXT_DATA_REQ:
-                    if (true == KNXnetIP_Connected)
-                    {
-                        ESP_LOGI("TpUart2_DataLinkLayer","TpUart2_L_Data_Ind: TUNNEL TO IP");
-                        /* Tunnel to IP */
-                        TP_GW_L_Data_Ind(pduInfoPtr);
-                        vTaskDelay(50/portTICK_PERIOD_MS);
-                    }
+#ifdef KNXNETIP_DEBUG_LOGGING
+                    ESP_LOGI("TpUart2_DataLinkLayer","TpUart2_L_Data_Ind: TUNNEL TO IP");
+#endif /* KNXNETIP_DEBUG_LOGGING */
+                    /* Routing is always on, the gateway takes the frame */
+                    /* even while no tunnel is open                       */
+                    TP_GW_L_Data_Ind(frame);
+                    forwarded = true;
                     break;
                 
                 default:
@@ -98,25 +357,494 @@ void TpUart2_L_Data_Ind(PduInfoType * pduInfoPtr)
             }
         }
     }
+
+    if (false == forwarded)
+    {
+        KnxFrameBuffer_Release(frame);
+    }
+}
+
+void TpUart2_RxIndication(const uint8_t * dataPtr, uint16_t length)
+{
+    int64_t nowMs = KnxTpUart2_GetTimeMs();
+    /* The chunk is read after its last byte, a long one started well before */
+    /* at bus pace, the silence ends with its first byte                      */
+    int64_t chunkMs = ((int64_t)MAX(length, 1U) - 1) * TPUART2_RX_BYTE_TIME_US / 1000;
+
+#ifdef TPUART2_RX_LATENCY
+    TpUart2_RxParser.ChunkTimestampUs = KnxTpUart2_GetTimeUs();
+#endif
+
+    if ((TPUART2_RX_STATE_FRAME == TpUart2_RxParser.State) &&
+        ((nowMs - chunkMs - TpUart2_RxParser.LastByteMs) > TPUART2_RX_IDLE_TIMEOUT_MS))
+    {
+        /* Bus went idle in the middle of a frame, resynchronise */
+        TpUart2_RxStatistics.Timeouts++;
+        TpUart2_RxParser.State = TPUART2_RX_STATE_IDLE;
+    }
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        TpUart2_RxByte(dataPtr[i]);
+    }
+
+    TpUart2_RxParser.LastByteMs = nowMs;
+}
+
+const TpUart2_RxStatisticsType * TpUart2_GetRxStatistics(void)
+{
+    return &TpUart2_RxStatistics;
+}
+
+static void TpUart2_TransmitFrame(TpUart2_TxEntryType * entry)
+{
+#ifdef TPUART2_TX_BENCHMARK
+    int64_t startUs = KnxTpUart2_GetTimeUs();
+#endif
+
+    uint8_t * framePtr = KnxFrameBuffer_Frame(entry->Frame);
+    uint8_t length = (uint8_t)KnxFrameBuffer_Get(entry->Frame)->Length;
+
+#ifdef TPUART2_TX_PER_BYTE
+    for (uint8_t i = 0; i < length; i++)
+    {
+        if (0U == i)
+        {
+            KnxTpUart2_U_L_DataStart(framePtr[i]);
+        }
+        else if (length - 1 == i)
+        {
+            KnxTpUart2_U_L_DataEnd(length - 1, framePtr[i]);
+        }
+        else
+        {
+            KnxTpUart2_U_L_DataContinue(i, framePtr[i]);
+        }
+    }
+#else
+    /* Single non-blocking write, TpUart2_L_Data_Con signals completion */
+    KnxTpUart2_U_L_DataFrame(framePtr, length);
+#endif /* TPUART2_TX_PER_BYTE */
+
+    entry->TxTimestampMs = KnxTpUart2_GetTimeMs();
+
+#ifdef TPUART2_TX_BENCHMARK
+    TpUart2_TxBenchmark.CpuTimeUs += KnxTpUart2_GetTimeUs() - startUs;
+#endif
+}
+
+static void TpUart2_TxPump(void)
+{
+    while ((TPUART2_TX_PIPELINE_DEPTH > TpUart2_TxQueue.InFlightCount) &&
+           (TpUart2_TxQueue.Count > TpUart2_TxQueue.InFlightCount))
+    {
+        int64_t nowMs = KnxTpUart2_GetTimeMs();
+        TpUart2_TxFifoType * fifo = &TpUart2_TxQueue.Waiting[TpUart2_TxSelect(nowMs)];
+        TpUart2_TxEntryType * entry = &TpUart2_TxQueue.InFlight[(TpUart2_TxQueue.InFlightHead + TpUart2_TxQueue.InFlightCount) % TPUART2_TX_PIPELINE_DEPTH];
+        TpUart2_TxLevelStatisticsType * statistics;
+
+        /* Moved to the in-flight entries, confirmed in the order they are written */
+        *entry = fifo->Entry[fifo->Head];
+        fifo->Head = (fifo->Head + 1U) % TPUART2_TX_QUEUE_LENGTH;
+        fifo->Count--;
+
+        statistics = &TpUart2_TxStatistics[entry->Level];
+        statistics->Frames++;
+        statistics->WaitSumMs += nowMs - entry->ReqTimestampMs;
+        statistics->WaitMaxMs = MAX(statistics->WaitMaxMs, nowMs - entry->ReqTimestampMs);
+
+        TpUart2_TransmitFrame(entry);
+        TpUart2_TxQueue.InFlightCount++;
+
+        if (1U == TpUart2_TxQueue.InFlightCount)
+        {
+            TpUart2_ConfirmTimerStart();
+        }
+    }
+}
+
+static uint8_t TpUart2_TxSelect(int64_t nowMs)
+{
+    uint8_t selected = TPUART2_TX_LEVEL_NONE;
+    uint8_t aged = TPUART2_TX_LEVEL_NONE;
+
+    /* Highest priority first, unless a lower one has waited past TPUART2_TX_AGING_MS, */
+    /* then the longest waiting of those goes first                                  */
+    for (uint8_t level = 0; level < TPUART2_TX_LEVEL_NUM; level++)
+    {
+        const TpUart2_TxFifoType * fifo = &TpUart2_TxQueue.Waiting[level];
+
+        if (0U == fifo->Count)
+        {
+            /* Nothing at this priority */
+        }
+        else if (TPUART2_TX_LEVEL_NONE == selected)
+        {
+            selected = level;
+        }
+        else if (((nowMs - fifo->Entry[fifo->Head].QueueTimestampMs) >= TPUART2_TX_AGING_MS) &&
+                 ((TPUART2_TX_LEVEL_NONE == aged) ||
+                  (fifo->Entry[fifo->Head].QueueTimestampMs < TpUart2_TxQueue.Waiting[aged].Entry[TpUart2_TxQueue.Waiting[aged].Head].QueueTimestampMs)))
+        {
+            aged = level;
+        }
+        else
+        {
+            /* Waits behind a higher priority */
+        }
+    }
+
+    if ((TPUART2_TX_LEVEL_NONE != aged) &&
+        (TpUart2_TxQueue.Waiting[aged].Entry[TpUart2_TxQueue.Waiting[aged].Head].QueueTimestampMs <
+         TpUart2_TxQueue.Waiting[selected].Entry[TpUart2_TxQueue.Waiting[selected].Head].QueueTimestampMs))
+    {
+        TpUart2_TxStatistics[aged].Aged++;
+        selected = aged;
+    }
+
+    return selected;
+}
+
+static void TpUart2_TxComplete(bool success)
+{
+    TpUart2_TxEntryType entry;
+    bool confirmed = false;
+
+    /* The TP-UART confirms frames in the order they were written */
+    if (0U < TpUart2_TxQueue.InFlightCount)
+    {
+        entry = TpUart2_TxQueue.InFlight[TpUart2_TxQueue.InFlightHead];
+
+        TpUart2_TxQueue.InFlightHead = (TpUart2_TxQueue.InFlightHead + 1U) % TPUART2_TX_PIPELINE_DEPTH;
+        TpUart2_TxQueue.InFlightCount--;
+        TpUart2_TxQueue.Count--;
+        confirmed = true;
+
+        /* The next frame in flight was written meanwhile, its timeout runs from then */
+        KnxTimer_Cancel(&TpUart2_ConfirmTimer);
+        if (0U < TpUart2_TxQueue.InFlightCount)
+        {
+            TpUart2_ConfirmTimerStart();
+        }
+
+        TpUart2_TxPump();
+    }
+
+    if (false == confirmed)
+    {
+        ESP_LOGW("TpUart2_DataLinkLayer","TpUart2_L_Data_Con: no frame in flight");
+    }
+    else
+    {
+        if (false == success)
+        {
+            ESP_LOGW("TpUart2_DataLinkLayer","TpUart2_L_Data_Con: frame %d not acknowledged", entry.Sequence);
+        }
+
+#ifdef TPUART2_TX_BENCHMARK
+        TpUart2_TxBenchmark.LatencyUs += KnxTpUart2_GetTimeUs() - entry.ReqTimestampUs;
+        TpUart2_TxBenchmark.Frames++;
+
+        if (TPUART2_TX_BENCHMARK_FRAMES <= TpUart2_TxBenchmark.Frames)
+        {
+            ESP_LOGI("TpUart2 Benchmark", "%lu frames, cpu %lld us/frame, IP->TP latency %lld us/frame",
+                     (unsigned long)TpUart2_TxBenchmark.Frames,
+                     TpUart2_TxBenchmark.CpuTimeUs / TpUart2_TxBenchmark.Frames,
+                     TpUart2_TxBenchmark.LatencyUs / TpUart2_TxBenchmark.Frames);
+
+            TpUart2_TxBenchmark.Frames = 0U;
+            TpUart2_TxBenchmark.CpuTimeUs = 0;
+            TpUart2_TxBenchmark.LatencyUs = 0;
+        }
+#endif /* TPUART2_TX_BENCHMARK */
+
+        /* Report the outcome to the originating tunnel, the frame goes with it */
+        TP_GW_L_Data_Con(entry.ChannelId, entry.Frame, success);
+    }
+}
+
+static void TpUart2_ConfirmTimerStart(void)
+{
+    int64_t nowMs = KnxTpUart2_GetTimeMs();
+    int64_t elapsedMs = nowMs - TpUart2_TxQueue.InFlight[TpUart2_TxQueue.InFlightHead].TxTimestampMs;
+    uint32_t delayMs = 0U;
+
+    if (TPUART2_CONFIRM_TIMEOUT_MS > elapsedMs)
+    {
+        delayMs = (uint32_t)(TPUART2_CONFIRM_TIMEOUT_MS - elapsedMs);
+    }
+
+    KnxTimer_Arm(&TpUart2_TimerWheel, &TpUart2_ConfirmTimer, nowMs, delayMs);
+}
+
+static void TpUart2_ConfirmTimeout(void * context)
+{
+    (void)context;
+
+    /* L_Data.con lost, give the frame a negative confirmation */
+    ESP_LOGW("TpUart2_DataLinkLayer","TpUart2_MainFunction: L_Data.con timeout");
+    TpUart2_TxComplete(false);
+}
+
+#ifdef TPUART2_TX_STATISTICS
+static void TpUart2_TxStatisticsReport(void * context)
+{
+    static const char * const levelName[TPUART2_TX_LEVEL_NUM] = { "system", "alarm", "high", "normal" };
+
+    (void)context;
+
+    for (uint8_t level = 0; level < TPUART2_TX_LEVEL_NUM; level++)
+    {
+        TpUart2_TxLevelStatisticsType * statistics = &TpUart2_TxStatistics[level];
+
+        ESP_LOGI("TpUart2 Tx", "%s: frames %lu, depth %u, high water %u, wait avg %lld ms, max %lld ms, aged %lu",
+                 levelName[level],
+                 (unsigned long)statistics->Frames,
+                 TpUart2_TxQueue.Waiting[level].Count,
+                 statistics->HighWater,
+                 (0U < statistics->Frames) ? (statistics->WaitSumMs / statistics->Frames) : 0LL,
+                 statistics->WaitMaxMs,
+                 (unsigned long)statistics->Aged);
+
+        memset(statistics, 0, sizeof(TpUart2_TxLevelStatisticsType));
+        statistics->HighWater = TpUart2_TxQueue.Waiting[level].Count;
+    }
+
+    KnxTimer_Arm(&TpUart2_TimerWheel, &TpUart2_TxStatisticsTimer, KnxTpUart2_GetTimeMs(), TPUART2_TX_STATISTICS_PERIOD_MS);
+}
+#endif /* TPUART2_TX_STATISTICS */
+
+static void TpUart2_RxByte(uint8_t data)
+{
+    if (TPUART2_RX_STATE_IDLE == TpUart2_RxParser.State)
+    {
+        TpUart2_RxService(data);
+    }
+    else
+    {
+        /* Longer frames are followed to their end but not stored */
+        if ((NULL != TpUart2_RxParser.FramePtr) && (TPUART2_FRAME_MAX_LENGTH > TpUart2_RxParser.Index))
+        {
+            TpUart2_RxParser.FramePtr[TpUart2_RxParser.Index] = data;
+        }
+
+        TpUart2_RxParser.Fcs ^= data;
+
+        if (TpUart2_RxParser.LengthOffset == TpUart2_RxParser.Index)
+        {
+            uint8_t lg = data;
+
+            if (TPUART2_STANDARD_LENGTH_OFFSET == TpUart2_RxParser.LengthOffset)
+            {
+                lg &= LENGTH_FIELD_LG_MASK;
+            }
+
+            TpUart2_RxParser.Length = lg + TpUart2_RxParser.Overhead;
+        }
+
+        TpUart2_RxParser.Index++;
+
+        if (TpUart2_RxParser.Length == TpUart2_RxParser.Index)
+        {
+            TpUart2_RxFrameComplete();
+            TpUart2_RxParser.State = TPUART2_RX_STATE_IDLE;
+        }
+    }
+}
+
+static void TpUart2_RxService(uint8_t data)
+{
+    if ((TPUART2_DATACONFIRMSUCCESS == data) || (TPUART2_DATACONFIRMFAIL == data))
+    {
+        /* L_Data.con of a frame sent with TpUart2_L_Data_Req */
+        TpUart2_RxStatistics.Confirms++;
+        TpUart2_L_Data_Con(TPUART2_DATACONFIRMSUCCESS == data);
+    }
+    else if (TPUART2_RESETINDICATION == data)
+    {
+        TpUart2_RxStatistics.ResetIndications++;
+        ESP_LOGW("TP-UART2+", "Reset indication");
+    }
+    else if (TPUART2_STATEINDICATION == (data & TPUART2_STATE_INDICATION_MASK))
+    {
+        TpUart2_RxStatistics.StateIndications++;
+        TpUart2_StateIndication(data);
+    }
+    else if (TPUART2_LAYER2_L_POLLDATA_REQ == data)
+    {
+        /* Poll frames carry no length field */
+        TpUart2_RxParser.State = TPUART2_RX_STATE_FRAME;
+        TpUart2_RxParser.Length = TPUART2_POLLDATA_FRAME_LENGTH;
+        TpUart2_RxParser.LengthOffset = 0xFFU;
+    }
+    else if (TPUART2_FRAME_START_STANDARD == (data & TPUART2_FRAME_START_MASK))
+    {
+        TpUart2_RxParser.State = TPUART2_RX_STATE_FRAME;
+        TpUart2_RxParser.Length = 0U;
+        TpUart2_RxParser.LengthOffset = TPUART2_STANDARD_LENGTH_OFFSET;
+        TpUart2_RxParser.Overhead = TPUART2_STANDARD_FRAME_OVERHEAD;
+    }
+    else if (TPUART2_FRAME_START_EXTENDED == (data & TPUART2_FRAME_START_MASK))
+    {
+        TpUart2_RxParser.State = TPUART2_RX_STATE_FRAME;
+        TpUart2_RxParser.Length = 0U;
+        TpUart2_RxParser.LengthOffset = TPUART2_EXTENDED_LENGTH_OFFSET;
+        TpUart2_RxParser.Overhead = TPUART2_EXTENDED_FRAME_OVERHEAD;
+    }
+    else if ((TPUART2_ACKNOWLEDGEFRAME == data) || (TPUART2_NOTACKNOWLEDGEFRAME == data) || (TPUART2_BUSYFRAME == data))
+    {
+        /* Acknowledge frames of other devices, nothing to do */
+    }
+    else
+    {
+        TpUart2_RxStatistics.DiscardedBytes++;
+    }
+
+    if (TPUART2_RX_STATE_FRAME == TpUart2_RxParser.State)
+    {
+        if (KNX_FRAME_BUFFER_INVALID == TpUart2_RxParser.Frame)
+        {
+            /* Received straight into a pool buffer, it travels to IP without a copy */
+            TpUart2_RxParser.Frame = KnxFrameBuffer_Alloc();
+        }
+
+        TpUart2_RxParser.FramePtr = (KNX_FRAME_BUFFER_INVALID == TpUart2_RxParser.Frame) ? NULL : KnxFrameBuffer_Frame(TpUart2_RxParser.Frame);
+
+        /* The start byte is the first frame byte */
+        if (NULL != TpUart2_RxParser.FramePtr)
+        {
+            TpUart2_RxParser.FramePtr[0] = data;
+        }
+
+        TpUart2_RxParser.Fcs = 0xFFU ^ data;
+        TpUart2_RxParser.Index = 1U;
+    }
 }
 
-bool TpUart2_DetectEOP(uint8_t * dataPtr, uint8_t rxLength, uint8_t * validDataLength)
+static void TpUart2_RxFrameComplete(void)
 {
-    uint8_t fcs = 0xFFU; /* Start with 0xFF */
-    bool validPacketFound = false;
- 
-    for (uint8_t index = 0; index < rxLength; index++)
+    if (TPUART2_FRAME_MAX_LENGTH < TpUart2_RxParser.Length)
+    {
+        TpUart2_RxStatistics.OversizeFrames++;
+        ESP_LOGW("TpUart2_DataLinkLayer","Frame of %d bytes dropped", TpUart2_RxParser.Length);
+    }
+    else if (0U != TpUart2_RxParser.Fcs)
+    {
+        /* XOR over frame and FCS must cancel the 0xFF seed */
+        TpUart2_RxStatistics.ChecksumErrors++;
+        ESP_LOGW("TpUart2_DataLinkLayer","Frame checksum error");
+    }
+    else if (NULL == TpUart2_RxParser.FramePtr)
     {
-        fcs ^= dataPtr[index];
-        
-        if ((rxLength >= index + 1) && (dataPtr[index + 1] == fcs))
+        TpUart2_RxStatistics.NoBuffer++;
+    }
+    else
+    {
+        KnxFrameBuffer_HandleType frame = TpUart2_RxParser.Frame;
+
+        TpUart2_RxStatistics.Frames++;
+
+        KnxFrameBuffer_Get(frame)->Length = TpUart2_RxParser.Length;
+
+        /* The next frame needs a buffer of its own */
+        TpUart2_RxParser.Frame = KNX_FRAME_BUFFER_INVALID;
+        TpUart2_RxParser.FramePtr = NULL;
+
+#ifdef KNXNETIP_DEBUG_LOGGING
+        ESP_LOG_BUFFER_HEXDUMP("TpUart2 Rx", KnxFrameBuffer_Frame(frame), TpUart2_RxParser.Length, ESP_LOG_INFO);
+#endif /* KNXNETIP_DEBUG_LOGGING */
+
+#ifdef TPUART2_RX_LATENCY
+        /* Read by the network tasks, set before the frame is passed on */
+        KnxFrameBuffer_Get(frame)->RxTimestampUs = TpUart2_RxParser.ChunkTimestampUs;
+#endif
+
+        /* Call L_Data_Ind to inform TP DataLinkLayer */
+        TpUart2_L_Data_Ind(frame);
+    }
+}
+
+static void TpUart2_StateIndication(uint8_t state)
+{
+#ifdef TPUART2_STATEINDICATION_ENABLED
+    if (TPUART2_STATE_SLAVE_COLLISION == (TPUART2_STATE_SLAVE_COLLISION & state))
+    {
+        ESP_LOGW("TP-UART2+", "SC:Slave Collision");
+    }
+    if (TPUART2_STATE_RECEIVE_ERROR == (TPUART2_STATE_RECEIVE_ERROR & state))
+    {
+        ESP_LOGW("TP-UART2+", "RE:Receive Error");
+    }
+    if (TPUART2_STATE_TRANSMIT_ERROR == (TPUART2_STATE_TRANSMIT_ERROR & state))
+    {
+        ESP_LOGW("TP-UART2+", "TE:Transmit Error");
+    }
+    if (TPUART2_STATE_PROTOCOL_ERROR == (TPUART2_STATE_PROTOCOL_ERROR & state))
+    {
+        ESP_LOGW("TP-UART2+", "PE:Protocol Error");
+    }
+    if (TPUART2_STATE_TEMP_WARNING == (TPUART2_STATE_TEMP_WARNING & state))
+    {
+        ESP_LOGW("TP-UART2+", "TW: Temperature Warning");
+    }
+#else
+    (void)state;
+#endif /* TPUART2_STATEINDICATION_ENABLED */
+}
+
+#ifdef TPUART2_RX_LATENCY
+void TpUart2_RxLatencyRecord(uint8_t sink, KnxFrameBuffer_HandleType frame)
+{
+    /* Runs in the network task of the sink, frames not from the bus are skipped */
+    int64_t rxTimestampUs = KnxFrameBuffer_Get(frame)->RxTimestampUs;
+
+    if ((TPUART2_RX_LATENCY_SINK_NUM > sink) && (0 != rxTimestampUs))
+    {
+        TpUart2_RxLatencyType * latency = &TpUart2_RxLatency[sink];
+        int64_t latencyUs = KnxTpUart2_GetTimeUs() - rxTimestampUs;
+        uint32_t bucket = (uint32_t)(latencyUs / TPUART2_RX_LATENCY_BUCKET_US);
+
+        if (TPUART2_RX_LATENCY_BUCKETS <= bucket)
         {
-            *validDataLength = index + 1;
-            validPacketFound = true;
-            ESP_LOGI("TpUart2 EOP","Length: %d, Checksum: 0x%X\n",index+1, fcs);
-            break;
+            bucket = TPUART2_RX_LATENCY_BUCKETS - 1U;
         }
+
+        latency->Bucket[bucket]++;
+        latency->Frames++;
+
+        if (latency->MaxUs < latencyUs)
+        {
+            latency->MaxUs = latencyUs;
+        }
+
+        if (TPUART2_RX_LATENCY_FRAMES <= latency->Frames)
+        {
+            ESP_LOGI("TpUart2 Latency", "TP->IP task %u, %lu frames, p50 %lu us, p90 %lu us, p99 %lu us, max %lld us",
+                     sink,
+                     (unsigned long)latency->Frames,
+                     (unsigned long)TpUart2_RxLatencyPercentile(latency, 50U),
+                     (unsigned long)TpUart2_RxLatencyPercentile(latency, 90U),
+                     (unsigned long)TpUart2_RxLatencyPercentile(latency, 99U),
+                     latency->MaxUs);
+
+            memset(latency, 0, sizeof(TpUart2_RxLatencyType));
+        }
+    }
+}
+
+static uint32_t TpUart2_RxLatencyPercentile(const TpUart2_RxLatencyType * latency, uint8_t percent)
+{
+    uint32_t rank = (latency->Frames * percent) / 100U;
+    uint32_t count = 0U;
+    uint32_t bucket = 0U;
+
+    /* Upper edge of the bucket holding the requested rank */
+    while ((TPUART2_RX_LATENCY_BUCKETS - 1U > bucket) && (count + latency->Bucket[bucket] <= rank))
+    {
+        count += latency->Bucket[bucket];
+        bucket++;
     }
 
-    return validPacketFound;
+    return (bucket + 1U) * TPUART2_RX_LATENCY_BUCKET_US;
 }
+#endif /* TPUART2_RX_LATENCY */
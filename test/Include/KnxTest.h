@@ -0,0 +1,57 @@
+/**
+ * \file KnxTest.h
+ *
+ * \brief Knx Host Test Helpers
+ *
+ * This file contains the assertions and the pseudo random numbers shared by
+ * the host tests
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+#ifndef KNXTEST_H
+#define KNXTEST_H
+
+/*==================[inclusions]============================================*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/*==================[macros]================================================*/
+/* Failures are counted and reported, the test goes on with the next check */
+#define KNX_TEST_ASSERT(condition) KnxTest_Assert((condition), #condition, __FILE__, __LINE__)
+
+/*==================[type definitions]======================================*/
+
+/*==================[external function declarations]========================*/
+extern void KnxTest_Assert(bool condition, const char * expression, const char * file, int line);
+extern int KnxTest_Result(const char * name);
+
+/* Same sequence on every run, a failure is reproduced by running the test again */
+extern void KnxTest_RandomSeed(uint32_t seed);
+extern uint32_t KnxTest_Random(uint32_t range);
+
+/*==================[internal function declarations]========================*/
+
+/*==================[external constants]====================================*/
+
+/*------------------[version constants definition]--------------------------*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+
+/*==================[external function definitions]=========================*/
+
+/*==================[internal function definitions]=========================*/
+
+/*==================[end of file]===========================================*/
+
+#endif /* ifndef KNXTEST_H */
@@ -0,0 +1,88 @@
+/**
+ * \file KnxTest.c
+ *
+ * \brief Knx Host Test Helpers
+ *
+ * This file contains the implementation of the assertions and the pseudo
+ * random numbers shared by the host tests
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include <stdio.h>
+
+#include "KnxTest.h"
+
+/*==================[macros]================================================*/
+/* Failed checks printed in full, the rest only counted */
+#define KNX_TEST_REPORTED_FAILURES (20U)
+
+/*==================[type definitions]======================================*/
+
+/*==================[external function declarations]========================*/
+void KnxTest_Assert(bool condition, const char * expression, const char * file, int line);
+int KnxTest_Result(const char * name);
+void KnxTest_RandomSeed(uint32_t seed);
+uint32_t KnxTest_Random(uint32_t range);
+
+/*==================[internal function declarations]========================*/
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+static uint32_t KnxTest_Checks;
+static uint32_t KnxTest_Failures;
+static uint32_t KnxTest_RandomState = 1U;
+
+/*==================[external function definitions]=========================*/
+void KnxTest_Assert(bool condition, const char * expression, const char * file, int line)
+{
+    KnxTest_Checks++;
+
+    if (false == condition)
+    {
+        KnxTest_Failures++;
+
+        if (KNX_TEST_REPORTED_FAILURES >= KnxTest_Failures)
+        {
+            printf("%s:%d: check failed: %s\n", file, line, expression);
+        }
+    }
+}
+
+int KnxTest_Result(const char * name)
+{
+    printf("%s: %lu checks, %lu failed\n", name, (unsigned long)KnxTest_Checks, (unsigned long)KnxTest_Failures);
+
+    return (0U == KnxTest_Failures) ? 0 : 1;
+}
+
+void KnxTest_RandomSeed(uint32_t seed)
+{
+    KnxTest_RandomState = (0U == seed) ? 1U : seed;
+}
+
+uint32_t KnxTest_Random(uint32_t range)
+{
+    /* xorshift32 */
+    KnxTest_RandomState ^= KnxTest_RandomState << 13;
+    KnxTest_RandomState ^= KnxTest_RandomState >> 17;
+    KnxTest_RandomState ^= KnxTest_RandomState << 5;
+
+    return (0U == range) ? KnxTest_RandomState : (KnxTest_RandomState % range);
+}
+
+/*==================[internal function definitions]=========================*/
+
+/*==================[end of file]===========================================*/
@@ -0,0 +1,659 @@
+/**
+ * \file Test_IpDispatch.c
+ *
+ * \brief KNXnet/IP Service Dispatch Host Test
+ *
+ * This file contains the host test of the table driven KNXnet/IP service
+ * dispatch. Every accepted service has to reach its handler at its minimum
+ * length and be answered on the right path, frames one byte short, unknown
+ * services, foreign protocol versions and host protocols are dropped before
+ * any handler runs, and the frame buffer always goes back to the pool
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include <stdio.h>
+#include <string.h>
+
+#include "KNXnetIP.h"
+#include "KNXnetIP_Core.h"
+#include "KNXnetIP_Tunnelling.h"
+#include "KNXnetIP_Routing.h"
+#include "KNXnetIP_Discovery.h"
+#include "KNXnetIP_UdpServer.h"
+#include "IP_DataLinkLayer.h"
+#include "TP_DataLinkLayer.h"
+#include "KnxFrameBuffer.h"
+#include "KnxTest.h"
+
+/*==================[macros]================================================*/
+#define TEST_IP_ADDR        (0xC0A80164UL)  /* 192.168.1.100 */
+#define TEST_IP_PORT        (3671U)
+#define TEST_TCP_SOCK       (7)
+#define TEST_CHANNEL        (CHANNEL_1)
+
+/* Response body the core service fakes write */
+#define TEST_BODY_LENGTH    (4U)
+
+/*==================[type definitions]======================================*/
+typedef enum {
+    TEST_ROUTE_NONE,
+    TEST_ROUTE_UDP,         /* Control endpoint */
+    TEST_ROUTE_DATA,        /* Data endpoint of the tunnel */
+    TEST_ROUTE_DEFER,       /* Search response sent after its delay */
+    TEST_ROUTE_TCP
+} Test_RouteType;
+
+typedef struct {
+    uint16_t ServiceType;
+    uint16_t Length;        /* Shortest frame the service takes */
+    const char * Handled;   /* Last service fake the frame reaches, NULL for none */
+    uint16_t ResponseType;
+    Test_RouteType Route;
+} Test_DispatchCaseType;
+
+/*==================[external function declarations]========================*/
+int main(void);
+
+/*==================[internal function declarations]========================*/
+static void Test_Reset(KNXnetIP_HostProtocolCodeTpe protocol);
+static uint16_t Test_Build(uint8_t * dataPtr, uint16_t serviceType, uint16_t length);
+static void Test_Dispatch(uint16_t serviceType, uint16_t length, KNXnetIP_HostProtocolCodeTpe protocol, const uint8_t * patchPtr);
+static void Test_Response(uint8_t * txBuffer, uint16_t * txLength);
+static void Test_Services(void);
+static void Test_Rejected(void);
+static void Test_Tcp(void);
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+static const Test_DispatchCaseType Test_Case[] = {
+    {SEARCH_REQUEST,          14U, "KNXnetIP_SearchResponse",         SEARCH_RESPONSE,             TEST_ROUTE_DEFER},
+    {DESCRIPTION_REQUEST,     14U, "KNXnetIP_DescriptionResponse",    DESCRIPTION_RESPONSE,        TEST_ROUTE_UDP},
+    {CONNECT_REQUEST,         26U, "KNXnetIP_ConnectResponse",        CONNECT_RESPONSE,            TEST_ROUTE_UDP},
+    {CONNECTIONSTATE_REQUEST, 16U, "KNXnetIP_ConnectionStateResponse", CONNECTIONSTATE_RESPONSE,   TEST_ROUTE_UDP},
+    {DISCONNECT_REQUEST,      16U, "KNXnetIP_DisconnectResponse",     DISCONNECT_RESPONSE,         TEST_ROUTE_UDP},
+    {DISCONNECT_RESPONSE,      8U, NULL,                              0U,                          TEST_ROUTE_NONE},
+    {SEARCH_REQUEST_EXTENDED, 14U, "KNXnetIP_SearchResponseExtended", SEARCH_RESPONSE_EXTENDED,    TEST_ROUTE_DEFER},
+    {TUNNELLING_REQUEST,      20U, "KNXnetIP_TunnellingAck",          TUNNELLING_ACK,              TEST_ROUTE_DATA},
+    {TUNNELLING_ACK,          10U, "KNXnetIP_TunnellingAckReceived",  0U,                          TEST_ROUTE_NONE},
+    {TUNNELLING_FEATURE_GET,  12U, "KNXnetIP_TunnellingFeatureGet",   TUNNELLING_FEATURE_RESPONSE, TEST_ROUTE_DATA},
+    {TUNNELLING_FEATURE_SET,  13U, "KNXnetIP_TunnellingFeatureSet",   TUNNELLING_FEATURE_RESPONSE, TEST_ROUTE_DATA},
+    {ROUTING_INDICATION,      16U, "KNXnetIP_RoutingIP2TP",           0U,                          TEST_ROUTE_NONE},
+    {ROUTING_LOST_MESSAGE,    10U, "KNXnetIP_RoutingLostMessage",     0U,                          TEST_ROUTE_NONE},
+    {ROUTING_BUSY,            12U, "KNXnetIP_RoutingBusy",            0U,                          TEST_ROUTE_NONE},
+};
+
+/* Services of no family or no handler in this device */
+static const uint16_t Test_Unknown[] = {
+    SEARCH_RESPONSE, DESCRIPTION_RESPONSE, CONNECT_RESPONSE, SEARCH_RESPONSE_EXTENDED,
+    0x0200U, 0x020DU, 0x020FU, DEVICE_CONFIGURATION_REQUEST, TUNNELLING_FEATURE_INFO, 0x0426U,
+    0x0533U, SECURE_WRAPPER, 0x0000U, 0x01FFU, 0xFFFFU,
+};
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+static KNXnetIP_ChannelType Test_Channel;
+static bool Test_ChannelOpen;
+static bool Test_Admit;
+static int Test_Sock;                           /* Connection a TCP frame comes in on */
+static KNXnetIP_ErrorCodeType Test_ErrorCode;   /* Expected in a connection state or disconnect response */
+
+static const char * Test_Handled;
+static uint16_t Test_ResponseType;
+static Test_RouteType Test_Route;
+static uint8_t Test_ChannelFrees;
+static uint8_t Test_TunnellingResets;
+
+/*==================[external function definitions]=========================*/
+int main(void)
+{
+    KnxFrameBuffer_Init();
+
+    Test_Services();
+    Test_Rejected();
+    Test_Tcp();
+
+    return KnxTest_Result("Test_IpDispatch");
+}
+
+/* Services behind the dispatch, replaced for the test */
+KNXnetIP_ChannelType * KNXnetIP_ChannelAlloc(KNXnetIP_ConnectionType connectionType, KNXnetIP_HostProtocolCodeTpe protocol, int sock)
+{
+    KNXnetIP_ChannelType * channel = NULL;
+
+    if (false == Test_ChannelOpen)
+    {
+        Test_Channel.ChannelId = TEST_CHANNEL;
+        Test_Channel.ConnectionType = connectionType;
+        Test_Channel.Protocol = protocol;
+        Test_Channel.Socket = (IPV4_TCP == protocol) ? sock : -1;
+        Test_ChannelOpen = true;
+        channel = &Test_Channel;
+    }
+
+    return channel;
+}
+
+KNXnetIP_ChannelType * KNXnetIP_ChannelGet(uint8_t channelId)
+{
+    return ((TEST_CHANNEL == channelId) && (true == Test_ChannelOpen)) ? &Test_Channel : NULL;
+}
+
+void KNXnetIP_ChannelFree(uint8_t channelId)
+{
+    KNX_TEST_ASSERT(TEST_CHANNEL == channelId);
+
+    Test_ChannelOpen = false;
+    Test_ChannelFrees++;
+}
+
+void KNXnetIP_ChannelHeartbeat(KNXnetIP_ChannelType * channel)
+{
+    KNX_TEST_ASSERT(&Test_Channel == channel);
+}
+
+bool KNXnetIP_DiscoveryAdmit(uint32_t ipAddr, uint16_t port, uint16_t serviceType)
+{
+    (void)ipAddr;
+    (void)port;
+    (void)serviceType;
+
+    return Test_Admit;
+}
+
+void KNXnetIP_DiscoveryDefer(uint32_t ipAddr, uint16_t port, uint16_t serviceType, const KNXnetIP_TxFrameType * txFrame)
+{
+    (void)serviceType;
+
+    KNX_TEST_ASSERT((TEST_IP_ADDR == ipAddr) && (TEST_IP_PORT == port));
+    Test_Route = TEST_ROUTE_DEFER;
+    Test_ResponseType = ((uint16_t)txFrame->Header[2] << 8) | txFrame->Header[3];
+}
+
+bool KNXnetIP_UDPDataEndpointOpen(uint8_t channelId, KNXnetIP_HPAIType * hpai)
+{
+    (void)hpai;
+
+    return (TEST_CHANNEL == channelId);
+}
+
+void KNXnetIP_UDPSend(uint32_t ipAddr, uint16_t port, const KNXnetIP_TxFrameType * txFrame)
+{
+    KNX_TEST_ASSERT((TEST_IP_ADDR == ipAddr) && (TEST_IP_PORT == port));
+    Test_Route = TEST_ROUTE_UDP;
+    Test_ResponseType = ((uint16_t)txFrame->Header[2] << 8) | txFrame->Header[3];
+}
+
+void KNXnetIP_UDPDataSend(uint8_t channelId, uint32_t ipAddr, uint16_t port, const KNXnetIP_TxFrameType * txFrame)
+{
+    KNX_TEST_ASSERT(TEST_CHANNEL == channelId);
+    KNX_TEST_ASSERT((TEST_IP_ADDR == ipAddr) && (TEST_IP_PORT == port));
+    Test_Route = TEST_ROUTE_DATA;
+    Test_ResponseType = ((uint16_t)txFrame->Header[2] << 8) | txFrame->Header[3];
+}
+
+void KNXnetIP_TcpSend(const int sock, const KNXnetIP_TxFrameType * txFrame)
+{
+    KNX_TEST_ASSERT(Test_Sock == sock);
+    Test_Route = TEST_ROUTE_TCP;
+    Test_ResponseType = ((uint16_t)txFrame->Header[2] << 8) | txFrame->Header[3];
+}
+
+void KNXnetIP_TxFrameInit(KNXnetIP_TxFrameType * txFrame, uint16_t serviceType)
+{
+    memset(txFrame, 0, sizeof(KNXnetIP_TxFrameType));
+
+    txFrame->Header[0] = HEADER_SIZE_10;
+    txFrame->Header[1] = KNXNETIP_VERSION_10;
+    txFrame->Header[2] = (uint8_t)(serviceType >> 8);
+    txFrame->Header[3] = (uint8_t)(serviceType & 0xFFU);
+    txFrame->HeaderLength = HEADER_SIZE_10;
+    txFrame->Length = HEADER_SIZE_10;
+}
+
+void KNXnetIP_TxFrameAppend(KNXnetIP_TxFrameType * txFrame, const uint8_t * dataPtr, uint16_t length)
+{
+    KNX_TEST_ASSERT(TEST_BODY_LENGTH == length);
+
+    txFrame->Segment[txFrame->SegmentCount].DataPtr = dataPtr;
+    txFrame->Segment[txFrame->SegmentCount].Length = length;
+    txFrame->SegmentCount++;
+    txFrame->Length += length;
+}
+
+void KNXnetIP_SearchResponse(uint8_t * txBuffer, uint16_t * txLength)
+{
+    Test_Handled = __func__;
+    Test_Response(txBuffer, txLength);
+}
+
+void KNXnetIP_SearchResponseExtended(const uint8_t * srpPtr, uint16_t srpLength, uint8_t * txBuffer, uint16_t * txLength)
+{
+    (void)srpPtr;
+
+    /* Header and discovery endpoint ahead of the search parameters */
+    KNX_TEST_ASSERT(0U == srpLength);
+    Test_Handled = __func__;
+    Test_Response(txBuffer, txLength);
+}
+
+void KNXnetIP_DescriptionResponse(uint8_t * txBuffer, uint16_t * txLength)
+{
+    Test_Handled = __func__;
+    Test_Response(txBuffer, txLength);
+}
+
+void KNXnetIP_ConnectResponse(uint8_t channelId, KNXnetIP_ErrorCodeType errorCode, KNXnetIP_HPAIType * dataEndpointHpai, KNXnetIP_CRIType * cri, uint8_t * txBuffer, uint16_t * txLength)
+{
+    (void)dataEndpointHpai;
+    (void)cri;
+
+    KNX_TEST_ASSERT((TEST_CHANNEL == channelId) && (E_NO_ERROR == errorCode));
+    Test_Handled = __func__;
+    Test_Response(txBuffer, txLength);
+}
+
+void KNXnetIP_ConnectionStateResponse(uint8_t channelId, KNXnetIP_ErrorCodeType errorCode, uint8_t * txBuffer, uint16_t * txLength)
+{
+    KNX_TEST_ASSERT((TEST_CHANNEL == channelId) && (Test_ErrorCode == errorCode));
+    Test_Handled = __func__;
+    Test_Response(txBuffer, txLength);
+}
+
+void KNXnetIP_DisconnectResponse(uint8_t channelId, KNXnetIP_ErrorCodeType errorCode, uint8_t * txBuffer, uint16_t * txLength)
+{
+    KNX_TEST_ASSERT((TEST_CHANNEL == channelId) && (Test_ErrorCode == errorCode));
+    Test_Handled = __func__;
+    Test_Response(txBuffer, txLength);
+}
+
+void KNXnetIP_TunnellingAck(uint8_t channelId, uint8_t sequenceCounter, uint8_t * txBuffer, uint16_t * txLength)
+{
+    KNX_TEST_ASSERT((TEST_CHANNEL == channelId) && (0U == sequenceCounter));
+    Test_Handled = __func__;
+    Test_Response(txBuffer, txLength);
+}
+
+void KNXnetIP_TunnellingAckReceived(uint8_t channelId, uint8_t sequenceCounter, KNXnetIP_ErrorCodeType status)
+{
+    (void)sequenceCounter;
+
+    KNX_TEST_ASSERT((TEST_CHANNEL == channelId) && (E_NO_ERROR == status));
+    Test_Handled = __func__;
+}
+
+void KNXnetIP_TunnellingReset(uint8_t channelId)
+{
+    /* On a channel still allocated, never on one a new connection may have taken */
+    KNX_TEST_ASSERT((TEST_CHANNEL == channelId) && (true == Test_ChannelOpen));
+    Test_TunnellingResets++;
+}
+
+void KNXnetIP_TunnellingAckWithhold(uint8_t channelId, uint8_t sequenceCounter)
+{
+    (void)channelId;
+    (void)sequenceCounter;
+
+    /* No backlog in this test */
+    KNX_TEST_ASSERT(false);
+}
+
+bool KNXnetIP_TunnellingAckRelease(uint8_t channelId)
+{
+    (void)channelId;
+
+    return false;
+}
+
+void KNXnetIP_TunnellingFeatureGet(uint8_t channelId, KNXnetIP_FeatureIdentifierType featureIdentifier, uint8_t * txBuffer, uint16_t * txLength)
+{
+    (void)featureIdentifier;
+
+    KNX_TEST_ASSERT(TEST_CHANNEL == channelId);
+    Test_Handled = __func__;
+    Test_Response(txBuffer, txLength);
+}
+
+void KNXnetIP_TunnellingFeatureSet(uint8_t channelId, KNXnetIP_FeatureIdentifierType featureIdentifier, uint16_t value, uint8_t * txBuffer, uint16_t * txLength)
+{
+    (void)featureIdentifier;
+    (void)value;
+
+    KNX_TEST_ASSERT(TEST_CHANNEL == channelId);
+    Test_Handled = __func__;
+    Test_Response(txBuffer, txLength);
+}
+
+void KNXnetIP_TunnelIP2TP(uint8_t channelId, KnxFrameBuffer_HandleType frame)
+{
+    /* The cEMI frame alone, the headers are stripped */
+    KNX_TEST_ASSERT(TEST_CHANNEL == channelId);
+    KNX_TEST_ASSERT(L_DATA_REQ == KnxFrameBuffer_Frame(frame)[0]);
+    Test_Handled = __func__;
+
+    KnxFrameBuffer_Release(frame);
+}
+
+unsigned int TP_GW_ChannelBacklog(uint8_t channelId)
+{
+    (void)channelId;
+
+    return 0U;
+}
+
+void KNXnetIP_RoutingIP2TP(KnxFrameBuffer_HandleType frame, uint32_t ipAddr)
+{
+    KNX_TEST_ASSERT(TEST_IP_ADDR == ipAddr);
+    KNX_TEST_ASSERT(L_DATA_IND == KnxFrameBuffer_Frame(frame)[0]);
+    Test_Handled = __func__;
+
+    KnxFrameBuffer_Release(frame);
+}
+
+void KNXnetIP_RoutingLostMessage(const uint8_t * dataPtr, uint16_t length)
+{
+    (void)dataPtr;
+    (void)length;
+
+    Test_Handled = __func__;
+}
+
+void KNXnetIP_RoutingBusy(const uint8_t * dataPtr, uint16_t length)
+{
+    (void)dataPtr;
+    (void)length;
+
+    Test_Handled = __func__;
+}
+
+/*==================[internal function definitions]=========================*/
+static void Test_Reset(KNXnetIP_HostProtocolCodeTpe protocol)
+{
+    /* One tunnel open over the transport of the frame, nothing handled yet */
+    memset(&Test_Channel, 0, sizeof(Test_Channel));
+    Test_Channel.ChannelId = TEST_CHANNEL;
+    Test_Channel.ConnectionType = TUNNEL_CONNECTION;
+    Test_Channel.Protocol = protocol;
+    Test_Channel.Socket = (IPV4_TCP == protocol) ? TEST_TCP_SOCK : -1;
+    Test_Channel.ControlHpai.ipAddress = TEST_IP_ADDR;
+    Test_Channel.ControlHpai.portNumber = TEST_IP_PORT;
+    Test_ChannelOpen = true;
+    Test_Admit = true;
+    Test_Sock = TEST_TCP_SOCK;
+    Test_ErrorCode = E_NO_ERROR;
+
+    Test_Handled = NULL;
+    Test_ResponseType = 0U;
+    Test_Route = TEST_ROUTE_NONE;
+    Test_ChannelFrees = 0U;
+    Test_TunnellingResets = 0U;
+}
+
+static uint16_t Test_Build(uint8_t * dataPtr, uint16_t serviceType, uint16_t length)
+{
+    /* The shortest valid frame of the service, zero filled */
+    memset(dataPtr, 0, KNX_FRAME_BUFFER_SIZE - KNX_FRAME_BUFFER_HEADROOM);
+
+    dataPtr[0] = HEADER_SIZE_10;
+    dataPtr[1] = KNXNETIP_VERSION_10;
+    dataPtr[2] = (uint8_t)(serviceType >> 8);
+    dataPtr[3] = (uint8_t)(serviceType & 0xFFU);
+    dataPtr[4] = (uint8_t)(length >> 8);
+    dataPtr[5] = (uint8_t)(length & 0xFFU);
+
+    switch (serviceType)
+    {
+        case SEARCH_REQUEST:
+        case SEARCH_REQUEST_EXTENDED:
+        case DESCRIPTION_REQUEST:
+            dataPtr[HEADER_SIZE_10] = 8U;
+            dataPtr[HEADER_SIZE_10 + 1U] = IPV4_UDP;
+            break;
+
+        case CONNECT_REQUEST:
+            dataPtr[HEADER_SIZE_10] = 8U;
+            dataPtr[HEADER_SIZE_10 + 1U] = IPV4_UDP;
+            dataPtr[HEADER_SIZE_10 + 8U] = 8U;
+            dataPtr[HEADER_SIZE_10 + 9U] = IPV4_UDP;
+            dataPtr[HEADER_SIZE_10 + 16U] = 4U;
+            dataPtr[HEADER_SIZE_10 + 17U] = TUNNEL_CONNECTION;
+            dataPtr[HEADER_SIZE_10 + 18U] = 0x02U;
+            break;
+
+        case CONNECTIONSTATE_REQUEST:
+        case DISCONNECT_REQUEST:
+            dataPtr[HEADER_SIZE_10] = TEST_CHANNEL;
+            dataPtr[HEADER_SIZE_10 + 2U] = 8U;
+            dataPtr[HEADER_SIZE_10 + 3U] = IPV4_UDP;
+            break;
+
+        case DISCONNECT_RESPONSE:
+            dataPtr[HEADER_SIZE_10] = TEST_CHANNEL;
+            break;
+
+        case TUNNELLING_REQUEST:
+        case TUNNELLING_ACK:
+        case TUNNELLING_FEATURE_GET:
+        case TUNNELLING_FEATURE_SET:
+            dataPtr[HEADER_SIZE_10] = CONNECTION_HEADER_SIZE;
+            dataPtr[HEADER_SIZE_10 + 1U] = TEST_CHANNEL;
+            dataPtr[HEADER_SIZE_10 + CONNECTION_HEADER_SIZE] = L_DATA_REQ;
+            break;
+
+        case ROUTING_INDICATION:
+            dataPtr[HEADER_SIZE_10] = L_DATA_IND;
+            break;
+
+        default:
+            break;
+    }
+
+    return length;
+}
+
+static void Test_Dispatch(uint16_t serviceType, uint16_t length, KNXnetIP_HostProtocolCodeTpe protocol, const uint8_t * patchPtr)
+{
+    /* Over UDP the datagram is received into a pool buffer, over TCP into the stream buffer */
+    static uint8_t stream[KNX_FRAME_BUFFER_SIZE];
+    KnxFrameBuffer_HandleType frame = (IPV4_UDP == protocol) ? KnxFrameBuffer_Alloc() : KNX_FRAME_BUFFER_INVALID;
+    uint8_t * dataPtr = (KNX_FRAME_BUFFER_INVALID != frame) ? KnxFrameBuffer_Frame(frame) : &stream[0];
+    PduInfoType pduInfo;
+
+    pduInfo.SduDataPtr = dataPtr;
+    pduInfo.SduLength = Test_Build(dataPtr, serviceType, length);
+
+    if (KNX_FRAME_BUFFER_INVALID != frame)
+    {
+        KnxFrameBuffer_Get(frame)->Length = pduInfo.SduLength;
+    }
+
+    if (NULL != patchPtr)
+    {
+        /* Offset and value of one byte to spoil */
+        dataPtr[patchPtr[0]] = patchPtr[1];
+    }
+
+    IP_L_Data_Ind(&pduInfo, frame, TEST_IP_ADDR, TEST_IP_PORT, protocol, (IPV4_TCP == protocol) ? Test_Sock : -1);
+
+    /* Taken over or released, nothing is left behind */
+    KNX_TEST_ASSERT(0U == KnxFrameBuffer_Statistics()->InUse);
+}
+
+static void Test_Response(uint8_t * txBuffer, uint16_t * txLength)
+{
+    memset(txBuffer, 0xA5U, TEST_BODY_LENGTH);
+    *txLength = TEST_BODY_LENGTH;
+}
+
+static void Test_Services(void)
+{
+    /* Every accepted service at its minimum length */
+    for (uint8_t index = 0; index < (sizeof(Test_Case) / sizeof(Test_Case[0])); index++)
+    {
+        const Test_DispatchCaseType * testCase = &Test_Case[index];
+
+        Test_Reset(IPV4_UDP);
+
+        /* A tunnel is opened on a free channel */
+        Test_ChannelOpen = (CONNECT_REQUEST != testCase->ServiceType);
+
+        Test_Dispatch(testCase->ServiceType, testCase->Length, IPV4_UDP, NULL);
+
+        if ((NULL == testCase->Handled) ? (NULL != Test_Handled) : ((NULL == Test_Handled) || (0 != strcmp(testCase->Handled, Test_Handled))))
+        {
+            printf("Test_IpDispatch: service 0x%04X reached %s\n", testCase->ServiceType, (NULL != Test_Handled) ? Test_Handled : "nothing");
+            KNX_TEST_ASSERT(false);
+        }
+
+        KNX_TEST_ASSERT(testCase->Route == Test_Route);
+        KNX_TEST_ASSERT(testCase->ResponseType == Test_ResponseType);
+    }
+
+    /* The connection state is kept by the dispatch: a tunnel opened and closed */
+    Test_Reset(IPV4_UDP);
+    Test_ChannelOpen = false;
+    Test_Dispatch(CONNECT_REQUEST, 26U, IPV4_UDP, NULL);
+    KNX_TEST_ASSERT((true == Test_ChannelOpen) && (IPV4_UDP == Test_Channel.Protocol));
+    KNX_TEST_ASSERT(1U == Test_TunnellingResets);
+
+    /* Its unacked requests go back to the pool before the channel is freed */
+    Test_Dispatch(DISCONNECT_REQUEST, 16U, IPV4_UDP, NULL);
+    KNX_TEST_ASSERT((false == Test_ChannelOpen) && (1U == Test_ChannelFrees));
+    KNX_TEST_ASSERT(2U == Test_TunnellingResets);
+}
+
+static void Test_Rejected(void)
+{
+    /* Dropped before any handler runs, nothing is answered */
+    static const uint8_t badVersion[] = { 1U, 0x20U };
+    static const uint8_t badHeader[] = { 0U, 0x08U };
+    static const uint8_t badHpai[] = { HEADER_SIZE_10 + 1U, 0x03U };
+
+    for (uint8_t index = 0; index < (sizeof(Test_Case) / sizeof(Test_Case[0])); index++)
+    {
+        Test_Reset(IPV4_UDP);
+        Test_Dispatch(Test_Case[index].ServiceType, Test_Case[index].Length - 1U, IPV4_UDP, NULL);
+
+        KNX_TEST_ASSERT((NULL == Test_Handled) && (TEST_ROUTE_NONE == Test_Route));
+
+        Test_Reset(IPV4_UDP);
+        Test_Dispatch(Test_Case[index].ServiceType, Test_Case[index].Length, IPV4_UDP, badVersion);
+
+        KNX_TEST_ASSERT((NULL == Test_Handled) && (TEST_ROUTE_NONE == Test_Route));
+
+        Test_Reset(IPV4_UDP);
+        Test_Dispatch(Test_Case[index].ServiceType, Test_Case[index].Length, IPV4_UDP, badHeader);
+
+        KNX_TEST_ASSERT((NULL == Test_Handled) && (TEST_ROUTE_NONE == Test_Route));
+    }
+
+    for (uint8_t index = 0; index < (sizeof(Test_Unknown) / sizeof(Test_Unknown[0])); index++)
+    {
+        Test_Reset(IPV4_UDP);
+        Test_Dispatch(Test_Unknown[index], 64U, IPV4_UDP, NULL);
+
+        KNX_TEST_ASSERT((NULL == Test_Handled) && (TEST_ROUTE_NONE == Test_Route));
+    }
+
+    /* Neither UDP nor TCP in the HPAI */
+    Test_Reset(IPV4_UDP);
+    Test_Dispatch(DESCRIPTION_REQUEST, 14U, IPV4_UDP, badHpai);
+    KNX_TEST_ASSERT((NULL == Test_Handled) && (TEST_ROUTE_NONE == Test_Route));
+
+    /* Over the budget of its source */
+    Test_Reset(IPV4_UDP);
+    Test_Admit = false;
+    Test_Dispatch(DESCRIPTION_REQUEST, 14U, IPV4_UDP, NULL);
+    KNX_TEST_ASSERT((NULL == Test_Handled) && (TEST_ROUTE_NONE == Test_Route));
+
+    /* The heartbeat of an open tunnel from its control endpoint is not budgeted, */
+    /* from another endpoint it is                                                 */
+    Test_Reset(IPV4_UDP);
+    Test_Admit = false;
+    Test_Dispatch(CONNECTIONSTATE_REQUEST, 16U, IPV4_UDP, NULL);
+    KNX_TEST_ASSERT((TEST_ROUTE_UDP == Test_Route) && (CONNECTIONSTATE_RESPONSE == Test_ResponseType));
+
+    Test_Reset(IPV4_UDP);
+    Test_Admit = false;
+    Test_Dispatch(DISCONNECT_REQUEST, 16U, IPV4_UDP, NULL);
+    KNX_TEST_ASSERT((TEST_ROUTE_UDP == Test_Route) && (1U == Test_ChannelFrees));
+
+    Test_Reset(IPV4_UDP);
+    Test_Admit = false;
+    Test_Channel.ControlHpai.portNumber = TEST_IP_PORT + 1U;
+    Test_Dispatch(CONNECTIONSTATE_REQUEST, 16U, IPV4_UDP, NULL);
+    KNX_TEST_ASSERT((NULL == Test_Handled) && (TEST_ROUTE_NONE == Test_Route));
+
+    Test_Reset(IPV4_UDP);
+    Test_Admit = false;
+    Test_ChannelOpen = false;
+    Test_Dispatch(DISCONNECT_REQUEST, 16U, IPV4_UDP, NULL);
+    KNX_TEST_ASSERT((NULL == Test_Handled) && (TEST_ROUTE_NONE == Test_Route));
+
+    /* Shorter than a KNXnet/IP header */
+    Test_Reset(IPV4_UDP);
+    Test_Dispatch(DESCRIPTION_REQUEST, HEADER_SIZE_10 - 1U, IPV4_UDP, NULL);
+    KNX_TEST_ASSERT((NULL == Test_Handled) && (TEST_ROUTE_NONE == Test_Route));
+}
+
+static void Test_Tcp(void)
+{
+    /* Answered over the connection of the frame, not budgeted, no tunnelling acks */
+    Test_Reset(IPV4_TCP);
+    Test_Admit = false;
+    Test_Dispatch(DESCRIPTION_REQUEST, 14U, IPV4_TCP, NULL);
+    KNX_TEST_ASSERT((TEST_ROUTE_TCP == Test_Route) && (DESCRIPTION_RESPONSE == Test_ResponseType));
+
+    Test_Reset(IPV4_TCP);
+    Test_Dispatch(TUNNELLING_REQUEST, 20U, IPV4_TCP, NULL);
+    KNX_TEST_ASSERT((NULL != Test_Handled) && (0 == strcmp("KNXnetIP_TunnelIP2TP", Test_Handled)));
+    KNX_TEST_ASSERT(TEST_ROUTE_NONE == Test_Route);
+
+    /* TCP tunnels keep no requests waiting for an ack */
+    Test_Reset(IPV4_TCP);
+    Test_Dispatch(DISCONNECT_REQUEST, 16U, IPV4_TCP, NULL);
+    KNX_TEST_ASSERT((TEST_ROUTE_TCP == Test_Route) && (DISCONNECT_RESPONSE == Test_ResponseType));
+    KNX_TEST_ASSERT((1U == Test_ChannelFrees) && (0U == Test_TunnellingResets));
+
+    /* A tunnel opened over UDP is not served by the TCP task */
+    Test_Reset(IPV4_UDP);
+    Test_Dispatch(TUNNELLING_REQUEST, 20U, IPV4_TCP, NULL);
+    KNX_TEST_ASSERT((NULL == Test_Handled) && (TEST_ROUTE_NONE == Test_Route));
+
+    /* Nor by another TCP connection, which can neither tunnel on it, keep it alive nor close it */
+    Test_Reset(IPV4_TCP);
+    Test_Sock = TEST_TCP_SOCK + 1;
+    Test_Dispatch(TUNNELLING_REQUEST, 20U, IPV4_TCP, NULL);
+    KNX_TEST_ASSERT((NULL == Test_Handled) && (TEST_ROUTE_NONE == Test_Route));
+
+    Test_ErrorCode = E_CONNECTION_ID;
+    Test_Dispatch(CONNECTIONSTATE_REQUEST, 16U, IPV4_TCP, NULL);
+    KNX_TEST_ASSERT((TEST_ROUTE_TCP == Test_Route) && (CONNECTIONSTATE_RESPONSE == Test_ResponseType));
+
+    Test_Dispatch(DISCONNECT_REQUEST, 16U, IPV4_TCP, NULL);
+    KNX_TEST_ASSERT((TEST_ROUTE_TCP == Test_Route) && (DISCONNECT_RESPONSE == Test_ResponseType));
+    KNX_TEST_ASSERT((0U == Test_ChannelFrees) && (true == Test_ChannelOpen));
+
+    /* A tunnel opened over TCP belongs to the connection of the request */
+    Test_Reset(IPV4_TCP);
+    Test_ChannelOpen = false;
+    Test_Sock = TEST_TCP_SOCK + 2;
+    Test_Dispatch(CONNECT_REQUEST, 26U, IPV4_TCP, NULL);
+    KNX_TEST_ASSERT((true == Test_ChannelOpen) && ((TEST_TCP_SOCK + 2) == Test_Channel.Socket));
+
+    /* Routing is multicast, never over TCP */
+    Test_Reset(IPV4_TCP);
+    Test_Dispatch(ROUTING_INDICATION, 16U, IPV4_TCP, NULL);
+    KNX_TEST_ASSERT((NULL == Test_Handled) && (TEST_ROUTE_NONE == Test_Route));
+}
+
+/*==================[end of file]===========================================*/
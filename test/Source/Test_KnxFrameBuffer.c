@@ -0,0 +1,184 @@
+/**
+ * \file Test_KnxFrameBuffer.c
+ *
+ * \brief Knx Frame Buffer Host Test
+ *
+ * This file contains the host test of the pooled, reference counted frame
+ * buffers: allocation up to exhaustion, the last release returning the
+ * buffer, header room handling with Push and Pull, and the copies made by
+ * Clone and AllocCopy
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include <string.h>
+
+#include "KnxFrameBuffer.h"
+#include "KnxTest.h"
+
+/*==================[macros]================================================*/
+
+/*==================[type definitions]======================================*/
+
+/*==================[external function declarations]========================*/
+int main(void);
+
+/*==================[internal function declarations]========================*/
+static void Test_Exhaustion(void);
+static void Test_RefCount(void);
+static void Test_PushPull(void);
+static void Test_Copies(void);
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+
+/*==================[external function definitions]=========================*/
+int main(void)
+{
+    Test_Exhaustion();
+    Test_RefCount();
+    Test_PushPull();
+    Test_Copies();
+
+    return KnxTest_Result("Test_KnxFrameBuffer");
+}
+
+/*==================[internal function definitions]=========================*/
+static void Test_Exhaustion(void)
+{
+    /* Every buffer once, then the pool refuses and counts it */
+    KnxFrameBuffer_HandleType handle[KNX_FRAME_BUFFER_NUM];
+    bool unique = true;
+
+    KnxFrameBuffer_Init();
+
+    for (uint8_t index = 0; index < KNX_FRAME_BUFFER_NUM; index++)
+    {
+        handle[index] = KnxFrameBuffer_Alloc();
+
+        KNX_TEST_ASSERT(KNX_FRAME_BUFFER_NUM > handle[index]);
+        KNX_TEST_ASSERT(KNX_FRAME_BUFFER_HEADROOM == KnxFrameBuffer_Get(handle[index])->Offset);
+        KNX_TEST_ASSERT(0U == KnxFrameBuffer_Get(handle[index])->Length);
+
+        for (uint8_t other = 0; other < index; other++)
+        {
+            unique = unique && (handle[other] != handle[index]);
+        }
+    }
+
+    KNX_TEST_ASSERT(true == unique);
+    KNX_TEST_ASSERT(KNX_FRAME_BUFFER_INVALID == KnxFrameBuffer_Alloc());
+    KNX_TEST_ASSERT(1U == KnxFrameBuffer_Statistics()->Exhausted);
+    KNX_TEST_ASSERT(KNX_FRAME_BUFFER_NUM == KnxFrameBuffer_Statistics()->HighWater);
+
+    for (uint8_t index = 0; index < KNX_FRAME_BUFFER_NUM; index++)
+    {
+        KnxFrameBuffer_Release(handle[index]);
+    }
+
+    KNX_TEST_ASSERT(0U == KnxFrameBuffer_Statistics()->InUse);
+    KNX_TEST_ASSERT(KNX_FRAME_BUFFER_INVALID != KnxFrameBuffer_Alloc());
+}
+
+static void Test_RefCount(void)
+{
+    /* The buffer goes back with the release of its last holder only */
+    KnxFrameBuffer_HandleType frame;
+
+    KnxFrameBuffer_Init();
+    frame = KnxFrameBuffer_Alloc();
+
+    KnxFrameBuffer_Ref(frame);
+    KnxFrameBuffer_Ref(frame);
+    KNX_TEST_ASSERT(3U == atomic_load(&KnxFrameBuffer_Get(frame)->RefCount));
+
+    KnxFrameBuffer_Release(frame);
+    KnxFrameBuffer_Release(frame);
+    KNX_TEST_ASSERT(1U == KnxFrameBuffer_Statistics()->InUse);
+
+    KnxFrameBuffer_Release(frame);
+    KNX_TEST_ASSERT(0U == KnxFrameBuffer_Statistics()->InUse);
+    KNX_TEST_ASSERT(0U == atomic_load(&KnxFrameBuffer_Get(frame)->RefCount));
+
+    /* Releasing no frame is allowed and changes nothing */
+    KnxFrameBuffer_Release(KNX_FRAME_BUFFER_INVALID);
+    KNX_TEST_ASSERT(0U == KnxFrameBuffer_Statistics()->InUse);
+}
+
+static void Test_PushPull(void)
+{
+    /* A TP frame grows into a cEMI frame in place and back */
+    static const uint8_t body[] = { 0xBCU, 0x11U, 0x01U, 0x08U, 0x01U, 0xE1U, 0x00U, 0x81U };
+    KnxFrameBuffer_HandleType frame;
+    uint8_t * framePtr;
+
+    KnxFrameBuffer_Init();
+    frame = KnxFrameBuffer_AllocCopy(body, sizeof(body));
+
+    framePtr = KnxFrameBuffer_Push(frame, 3U);
+    KNX_TEST_ASSERT(framePtr == KnxFrameBuffer_Frame(frame));
+    KNX_TEST_ASSERT((KNX_FRAME_BUFFER_HEADROOM - 3U) == KnxFrameBuffer_Get(frame)->Offset);
+    KNX_TEST_ASSERT((sizeof(body) + 3U) == KnxFrameBuffer_Get(frame)->Length);
+    KNX_TEST_ASSERT(0 == memcmp(&framePtr[3], body, sizeof(body)));
+
+    /* No more headroom than allocated */
+    KNX_TEST_ASSERT(NULL == KnxFrameBuffer_Push(frame, KNX_FRAME_BUFFER_HEADROOM));
+
+    framePtr = KnxFrameBuffer_Pull(frame, 3U);
+    KNX_TEST_ASSERT(KNX_FRAME_BUFFER_HEADROOM == KnxFrameBuffer_Get(frame)->Offset);
+    KNX_TEST_ASSERT(sizeof(body) == KnxFrameBuffer_Get(frame)->Length);
+    KNX_TEST_ASSERT(0 == memcmp(framePtr, body, sizeof(body)));
+
+    /* Nor more than the frame holds */
+    KNX_TEST_ASSERT(NULL == KnxFrameBuffer_Pull(frame, sizeof(body) + 1U));
+    KNX_TEST_ASSERT(NULL != KnxFrameBuffer_Pull(frame, sizeof(body)));
+    KNX_TEST_ASSERT(0U == KnxFrameBuffer_Get(frame)->Length);
+
+    KnxFrameBuffer_Release(frame);
+}
+
+static void Test_Copies(void)
+{
+    /* A clone keeps the offset of its original and owns its own bytes */
+    static const uint8_t body[] = { 0x29U, 0x00U, 0xBCU, 0xE0U, 0x11U, 0x01U, 0x08U, 0x01U, 0x01U, 0x00U, 0x81U };
+    uint8_t oversize[KNX_FRAME_BUFFER_SIZE] = { 0U };
+    KnxFrameBuffer_HandleType frame;
+    KnxFrameBuffer_HandleType clone;
+
+    KnxFrameBuffer_Init();
+    frame = KnxFrameBuffer_AllocCopy(body, sizeof(body));
+    KnxFrameBuffer_Pull(frame, 2U);
+
+    clone = KnxFrameBuffer_Clone(frame);
+    KNX_TEST_ASSERT(KNX_FRAME_BUFFER_INVALID != clone);
+    KNX_TEST_ASSERT(clone != frame);
+    KNX_TEST_ASSERT(KnxFrameBuffer_Get(frame)->Offset == KnxFrameBuffer_Get(clone)->Offset);
+    KNX_TEST_ASSERT(KnxFrameBuffer_Get(frame)->Length == KnxFrameBuffer_Get(clone)->Length);
+    KNX_TEST_ASSERT(0 == memcmp(KnxFrameBuffer_Frame(clone), &body[2], sizeof(body) - 2U));
+
+    KnxFrameBuffer_Frame(clone)[0] = 0x00U;
+    KNX_TEST_ASSERT(body[2] == KnxFrameBuffer_Frame(frame)[0]);
+    KNX_TEST_ASSERT(2U == KnxFrameBuffer_Statistics()->Copies);
+
+    /* Larger than a buffer behind its headroom: refused, nothing taken */
+    KNX_TEST_ASSERT(KNX_FRAME_BUFFER_INVALID == KnxFrameBuffer_AllocCopy(oversize, sizeof(oversize)));
+    KNX_TEST_ASSERT(2U == KnxFrameBuffer_Statistics()->InUse);
+
+    KnxFrameBuffer_Release(clone);
+    KnxFrameBuffer_Release(frame);
+    KNX_TEST_ASSERT(0U == KnxFrameBuffer_Statistics()->InUse);
+}
+
+/*==================[end of file]===========================================*/
@@ -0,0 +1,274 @@
+/**
+ * \file Test_KnxFrameRing.c
+ *
+ * \brief Knx Frame Ring Host Test
+ *
+ * This file contains the host test of the single-producer/single-consumer
+ * frame rings. The ring is filled and drained across the wrap of its free
+ * running counters, then two rings are stressed at the same time by one
+ * producer and one consumer thread each, passing pool handles of
+ * sequence-stamped frames as the tpuart and network tasks do
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include <stdio.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "KnxFrameRing.h"
+#include "KnxFrameBuffer.h"
+#include "KnxTest.h"
+
+/*==================[macros]================================================*/
+/* Frames pushed through each ring of the stress test */
+#define TEST_RING_STRESS_FRAMES (1000000UL)
+
+/* TP -> IP and IP -> TP shaped rings, run at the same time */
+#define TEST_RING_STRESS_NUM    (2U)
+
+/*==================[type definitions]======================================*/
+typedef struct {
+    KnxFrameRingType Ring;
+    uint32_t Errors;        /* Consumer side, checked once the threads are joined */
+    uint32_t Received;
+} Test_RingStressType;
+
+/*==================[external function declarations]========================*/
+int main(void);
+
+/*==================[internal function declarations]========================*/
+static void Test_FillDrain(void);
+static void Test_CounterWrap(void);
+static void Test_Stress(void);
+static void * Test_StressProducer(void * context);
+static void * Test_StressConsumer(void * context);
+static uint16_t Test_StressLength(uint32_t sequence);
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+static Test_RingStressType Test_RingStress[TEST_RING_STRESS_NUM];
+
+/*==================[external function definitions]=========================*/
+int main(void)
+{
+    Test_FillDrain();
+    Test_CounterWrap();
+    Test_Stress();
+
+    return KnxTest_Result("Test_KnxFrameRing");
+}
+
+/*==================[internal function definitions]=========================*/
+static void Test_FillDrain(void)
+{
+    /* A full ring refuses the next frame and counts it, frames come out in order */
+    KnxFrameRingType ring;
+
+    KnxFrameRing_Init(&ring);
+    KNX_TEST_ASSERT(NULL == KnxFrameRing_Peek(&ring));
+
+    for (uint8_t index = 0; index < KNX_FRAME_RING_LENGTH; index++)
+    {
+        KnxFrameRing_SlotType * slot = KnxFrameRing_Reserve(&ring);
+
+        KNX_TEST_ASSERT(NULL != slot);
+        slot->Frame = index;
+        slot->ChannelId = index;
+        KnxFrameRing_Commit(&ring);
+    }
+
+    KNX_TEST_ASSERT(KNX_FRAME_RING_LENGTH == KnxFrameRing_Count(&ring));
+    KNX_TEST_ASSERT(NULL == KnxFrameRing_Reserve(&ring));
+    KNX_TEST_ASSERT(1U == ring.Dropped);
+
+    for (uint8_t index = 0; index < KNX_FRAME_RING_LENGTH; index++)
+    {
+        KnxFrameRing_SlotType * slot = KnxFrameRing_Peek(&ring);
+
+        KNX_TEST_ASSERT((NULL != slot) && (index == slot->Frame) && (index == slot->ChannelId));
+        KnxFrameRing_Release(&ring);
+    }
+
+    KNX_TEST_ASSERT(0U == KnxFrameRing_Count(&ring));
+    KNX_TEST_ASSERT(NULL == KnxFrameRing_Peek(&ring));
+}
+
+static void Test_CounterWrap(void)
+{
+    /* The free running counters wrap in between, full and empty still hold */
+    KnxFrameRingType ring;
+
+    KnxFrameRing_Init(&ring);
+    atomic_store(&ring.Head, UINT_MAX - 4U);
+    atomic_store(&ring.Tail, UINT_MAX - 4U);
+
+    for (uint32_t sequence = 0; sequence < (4U * KNX_FRAME_RING_LENGTH); sequence++)
+    {
+        KnxFrameRing_SlotType * slot = KnxFrameRing_Reserve(&ring);
+
+        KNX_TEST_ASSERT(NULL != slot);
+        slot->ChannelId = (uint8_t)sequence;
+        KnxFrameRing_Commit(&ring);
+
+        if ((KNX_FRAME_RING_LENGTH - 1U) == (sequence % KNX_FRAME_RING_LENGTH))
+        {
+            KNX_TEST_ASSERT(KNX_FRAME_RING_LENGTH == KnxFrameRing_Count(&ring));
+            KNX_TEST_ASSERT(NULL == KnxFrameRing_Reserve(&ring));
+
+            for (uint8_t index = 0; index < KNX_FRAME_RING_LENGTH; index++)
+            {
+                slot = KnxFrameRing_Peek(&ring);
+
+                KNX_TEST_ASSERT((NULL != slot) && ((uint8_t)(sequence + 1U - KNX_FRAME_RING_LENGTH + index) == slot->ChannelId));
+                KnxFrameRing_Release(&ring);
+            }
+        }
+    }
+
+    KNX_TEST_ASSERT(0U == KnxFrameRing_Count(&ring));
+    KNX_TEST_ASSERT(4U == ring.Dropped);
+}
+
+static void Test_Stress(void)
+{
+    pthread_t producer[TEST_RING_STRESS_NUM];
+    pthread_t consumer[TEST_RING_STRESS_NUM];
+
+    KnxFrameBuffer_Init();
+
+    for (uint8_t index = 0; index < TEST_RING_STRESS_NUM; index++)
+    {
+        KnxFrameRing_Init(&Test_RingStress[index].Ring);
+        Test_RingStress[index].Errors = 0U;
+        Test_RingStress[index].Received = 0U;
+
+        KNX_TEST_ASSERT(0 == pthread_create(&consumer[index], NULL, Test_StressConsumer, &Test_RingStress[index]));
+        KNX_TEST_ASSERT(0 == pthread_create(&producer[index], NULL, Test_StressProducer, &Test_RingStress[index]));
+    }
+
+    for (uint8_t index = 0; index < TEST_RING_STRESS_NUM; index++)
+    {
+        pthread_join(producer[index], NULL);
+        pthread_join(consumer[index], NULL);
+
+        printf("Test_KnxFrameRing: ring %u, %lu frames, %lu corrupted, %lu ring full\n",
+               index,
+               (unsigned long)Test_RingStress[index].Received,
+               (unsigned long)Test_RingStress[index].Errors,
+               (unsigned long)Test_RingStress[index].Ring.Dropped);
+
+        KNX_TEST_ASSERT(TEST_RING_STRESS_FRAMES == Test_RingStress[index].Received);
+        KNX_TEST_ASSERT(0U == Test_RingStress[index].Errors);
+    }
+
+    /* Every handle made it back to the pool */
+    KNX_TEST_ASSERT(0U == KnxFrameBuffer_Statistics()->InUse);
+    KNX_TEST_ASSERT(TEST_RING_STRESS_NUM * TEST_RING_STRESS_FRAMES == KnxFrameBuffer_Statistics()->Frames);
+}
+
+static void * Test_StressProducer(void * context)
+{
+    Test_RingStressType * stress = (Test_RingStressType *)context;
+    uint32_t sequence = 0U;
+
+    while (TEST_RING_STRESS_FRAMES > sequence)
+    {
+        KnxFrameRing_SlotType * slot = KnxFrameRing_Reserve(&stress->Ring);
+        KnxFrameBuffer_HandleType frame = (NULL == slot) ? KNX_FRAME_BUFFER_INVALID : KnxFrameBuffer_Alloc();
+
+        if (KNX_FRAME_BUFFER_INVALID == frame)
+        {
+            /* Ring full or pool empty, let the consumer catch up */
+            sched_yield();
+        }
+        else
+        {
+            uint8_t * data = KnxFrameBuffer_Frame(frame);
+
+            /* Length and payload derived from the sequence number */
+            KnxFrameBuffer_Get(frame)->Length = Test_StressLength(sequence);
+            slot->Frame = frame;
+            slot->ChannelId = (uint8_t)sequence;
+
+            for (uint16_t i = 0; i < KnxFrameBuffer_Get(frame)->Length; i++)
+            {
+                data[i] = (uint8_t)(sequence + i);
+            }
+
+            KnxFrameRing_Commit(&stress->Ring);
+            sequence++;
+        }
+    }
+
+    return NULL;
+}
+
+static void * Test_StressConsumer(void * context)
+{
+    Test_RingStressType * stress = (Test_RingStressType *)context;
+    uint32_t sequence = 0U;
+
+    while (TEST_RING_STRESS_FRAMES > sequence)
+    {
+        KnxFrameRing_SlotType * slot = KnxFrameRing_Peek(&stress->Ring);
+
+        if (NULL == slot)
+        {
+            sched_yield();
+        }
+        else
+        {
+            bool corrupted = false;
+            uint16_t length = KnxFrameBuffer_Get(slot->Frame)->Length;
+            const uint8_t * data = KnxFrameBuffer_Frame(slot->Frame);
+
+            if ((length != Test_StressLength(sequence)) || (slot->ChannelId != (uint8_t)sequence))
+            {
+                corrupted = true;
+            }
+            else
+            {
+                for (uint16_t i = 0; i < length; i++)
+                {
+                    if (data[i] != (uint8_t)(sequence + i))
+                    {
+                        corrupted = true;
+                    }
+                }
+            }
+
+            if (true == corrupted)
+            {
+                stress->Errors++;
+            }
+
+            KnxFrameBuffer_Release(slot->Frame);
+            KnxFrameRing_Release(&stress->Ring);
+            stress->Received++;
+            sequence++;
+        }
+    }
+
+    return NULL;
+}
+
+static uint16_t Test_StressLength(uint32_t sequence)
+{
+    return 1U + (sequence % (KNX_FRAME_BUFFER_CEMI_MAX - 1U));
+}
+
+/*==================[end of file]===========================================*/
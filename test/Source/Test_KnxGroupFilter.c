@@ -0,0 +1,250 @@
+/**
+ * \file Test_KnxGroupFilter.c
+ *
+ * \brief Knx Group Filter Host Test
+ *
+ * This file contains the host test of the group address filter tables as
+ * loaded from NVS: no configuration, a blocked direction, a short table,
+ * and entries that are missing, invalid or too long
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include <string.h>
+
+#include "nvs.h"
+
+#include "KnxGroupFilter.h"
+#include "KnxTest.h"
+
+/*==================[macros]================================================*/
+#define TEST_NVS_HANDLE     (0x4B4EU)
+
+/* Group addresses in 3-level notation */
+#define TEST_GA(main, middle, sub) ((uint16_t)(((main) << 11) | ((middle) << 8) | (sub)))
+
+/*==================[type definitions]======================================*/
+typedef struct {
+    bool Namespace;         /* knx_filter exists */
+    bool ModeSet[KNX_GROUP_FILTER_DIRECTION_NUM];
+    uint8_t Mode[KNX_GROUP_FILTER_DIRECTION_NUM];
+    uint8_t Table[KNX_GROUP_FILTER_DIRECTION_NUM][KNX_GROUP_FILTER_TABLE_SIZE + 1U];
+    size_t TableLength[KNX_GROUP_FILTER_DIRECTION_NUM];    /* 0 for no table */
+    bool Open;
+} Test_NvsType;
+
+/*==================[external function declarations]========================*/
+int main(void);
+
+/*==================[internal function declarations]========================*/
+static void Test_Reset(void);
+static int Test_Direction(const char * key);
+static void Test_Unconfigured(void);
+static void Test_BlockAll(void);
+static void Test_Table(void);
+static void Test_Invalid(void);
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+static Test_NvsType Test_Nvs;
+
+/*==================[external function definitions]=========================*/
+int main(void)
+{
+    Test_Unconfigured();
+    Test_BlockAll();
+    Test_Table();
+    Test_Invalid();
+
+    return KnxTest_Result("Test_KnxGroupFilter");
+}
+
+esp_err_t nvs_open(const char * name, nvs_open_mode_t open_mode, nvs_handle_t * out_handle)
+{
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+
+    KNX_TEST_ASSERT((0 == strcmp("knx_filter", name)) && (NVS_READONLY == open_mode));
+
+    if (true == Test_Nvs.Namespace)
+    {
+        *out_handle = TEST_NVS_HANDLE;
+        Test_Nvs.Open = true;
+        err = ESP_OK;
+    }
+
+    return err;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char * key, uint8_t * out_value)
+{
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    int direction = Test_Direction(key);
+
+    KNX_TEST_ASSERT((TEST_NVS_HANDLE == handle) && (true == Test_Nvs.Open));
+    KNX_TEST_ASSERT((0 <= direction) && (NULL != strstr(key, "_mode")));
+
+    if ((0 <= direction) && (true == Test_Nvs.ModeSet[direction]))
+    {
+        *out_value = Test_Nvs.Mode[direction];
+        err = ESP_OK;
+    }
+
+    return err;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char * key, void * out_value, size_t * length)
+{
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    int direction = Test_Direction(key);
+
+    KNX_TEST_ASSERT((TEST_NVS_HANDLE == handle) && (true == Test_Nvs.Open));
+    KNX_TEST_ASSERT((0 <= direction) && (NULL != strstr(key, "_table")));
+
+    if ((0 > direction) || (0U == Test_Nvs.TableLength[direction]))
+    {
+        /* Not stored */
+    }
+    else if (*length < Test_Nvs.TableLength[direction])
+    {
+        /* As NVS does, nothing is copied into a buffer too short */
+        *length = Test_Nvs.TableLength[direction];
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    else
+    {
+        memcpy(out_value, &Test_Nvs.Table[direction][0], Test_Nvs.TableLength[direction]);
+        *length = Test_Nvs.TableLength[direction];
+        err = ESP_OK;
+    }
+
+    return err;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    KNX_TEST_ASSERT((TEST_NVS_HANDLE == handle) && (true == Test_Nvs.Open));
+
+    Test_Nvs.Open = false;
+}
+
+/*==================[internal function definitions]=========================*/
+static void Test_Reset(void)
+{
+    memset(&Test_Nvs, 0, sizeof(Test_Nvs));
+}
+
+static int Test_Direction(const char * key)
+{
+    int direction = -1;
+
+    if (0 == strncmp("tp2ip_", key, 6U))
+    {
+        direction = KNX_GROUP_FILTER_TP_TO_IP;
+    }
+    else if (0 == strncmp("ip2tp_", key, 6U))
+    {
+        direction = KNX_GROUP_FILTER_IP_TO_TP;
+    }
+    else
+    {
+        /* Unknown key */
+    }
+
+    return direction;
+}
+
+static void Test_Unconfigured(void)
+{
+    /* No namespace, or a namespace without entries: everything passes */
+    Test_Reset();
+    KnxGroupFilter_Init();
+
+    KNX_TEST_ASSERT(true == KnxGroupFilter_Pass(KNX_GROUP_FILTER_TP_TO_IP, TEST_GA(1, 2, 3)));
+    KNX_TEST_ASSERT(true == KnxGroupFilter_Pass(KNX_GROUP_FILTER_IP_TO_TP, TEST_GA(31, 7, 255)));
+
+    Test_Reset();
+    Test_Nvs.Namespace = true;
+    KnxGroupFilter_Init();
+
+    KNX_TEST_ASSERT(false == Test_Nvs.Open);
+    KNX_TEST_ASSERT(true == KnxGroupFilter_Pass(KNX_GROUP_FILTER_TP_TO_IP, TEST_GA(1, 2, 3)));
+    KNX_TEST_ASSERT(true == KnxGroupFilter_Pass(KNX_GROUP_FILTER_IP_TO_TP, TEST_GA(1, 2, 3)));
+}
+
+static void Test_BlockAll(void)
+{
+    /* One direction blocked, the broadcast still passes */
+    Test_Reset();
+    Test_Nvs.Namespace = true;
+    Test_Nvs.ModeSet[KNX_GROUP_FILTER_IP_TO_TP] = true;
+    Test_Nvs.Mode[KNX_GROUP_FILTER_IP_TO_TP] = KNX_GROUP_FILTER_BLOCK_ALL;
+    KnxGroupFilter_Init();
+
+    KNX_TEST_ASSERT(false == KnxGroupFilter_Pass(KNX_GROUP_FILTER_IP_TO_TP, TEST_GA(1, 2, 3)));
+    KNX_TEST_ASSERT(true == KnxGroupFilter_Pass(KNX_GROUP_FILTER_IP_TO_TP, TEST_GA(0, 0, 0)));
+    KNX_TEST_ASSERT(true == KnxGroupFilter_Pass(KNX_GROUP_FILTER_TP_TO_IP, TEST_GA(1, 2, 3)));
+}
+
+static void Test_Table(void)
+{
+    /* Bits as stored, group addresses beyond a short table are blocked */
+    Test_Reset();
+    Test_Nvs.Namespace = true;
+    Test_Nvs.ModeSet[KNX_GROUP_FILTER_TP_TO_IP] = true;
+    Test_Nvs.Mode[KNX_GROUP_FILTER_TP_TO_IP] = KNX_GROUP_FILTER_TABLE;
+    Test_Nvs.TableLength[KNX_GROUP_FILTER_TP_TO_IP] = 512U;     /* Main groups 0 and 1 */
+    Test_Nvs.Table[KNX_GROUP_FILTER_TP_TO_IP][TEST_GA(1, 2, 3) >> 3] = (uint8_t)(1U << (TEST_GA(1, 2, 3) & 0x07U));
+    KnxGroupFilter_Init();
+
+    KNX_TEST_ASSERT(true == KnxGroupFilter_Pass(KNX_GROUP_FILTER_TP_TO_IP, TEST_GA(1, 2, 3)));
+    KNX_TEST_ASSERT(false == KnxGroupFilter_Pass(KNX_GROUP_FILTER_TP_TO_IP, TEST_GA(1, 2, 4)));
+    KNX_TEST_ASSERT(false == KnxGroupFilter_Pass(KNX_GROUP_FILTER_TP_TO_IP, TEST_GA(1, 2, 2)));
+    KNX_TEST_ASSERT(false == KnxGroupFilter_Pass(KNX_GROUP_FILTER_TP_TO_IP, TEST_GA(2, 0, 1)));
+    KNX_TEST_ASSERT(true == KnxGroupFilter_Pass(KNX_GROUP_FILTER_TP_TO_IP, TEST_GA(0, 0, 0)));
+    KNX_TEST_ASSERT(true == KnxGroupFilter_Pass(KNX_GROUP_FILTER_IP_TO_TP, TEST_GA(2, 0, 1)));
+    KNX_TEST_ASSERT(false == Test_Nvs.Open);
+
+    /* A full table, every group address as stored */
+    Test_Nvs.TableLength[KNX_GROUP_FILTER_TP_TO_IP] = KNX_GROUP_FILTER_TABLE_SIZE;
+    Test_Nvs.Table[KNX_GROUP_FILTER_TP_TO_IP][KNX_GROUP_FILTER_TABLE_SIZE - 1U] = 0x80U;
+    KnxGroupFilter_Init();
+
+    KNX_TEST_ASSERT(true == KnxGroupFilter_Pass(KNX_GROUP_FILTER_TP_TO_IP, TEST_GA(31, 7, 255)));
+    KNX_TEST_ASSERT(false == KnxGroupFilter_Pass(KNX_GROUP_FILTER_TP_TO_IP, TEST_GA(31, 7, 254)));
+}
+
+static void Test_Invalid(void)
+{
+    /* A filter that cannot be read passes everything rather than cut the line off */
+    Test_Reset();
+    Test_Nvs.Namespace = true;
+    Test_Nvs.ModeSet[KNX_GROUP_FILTER_TP_TO_IP] = true;
+    Test_Nvs.Mode[KNX_GROUP_FILTER_TP_TO_IP] = KNX_GROUP_FILTER_MODE_NUM;
+    Test_Nvs.ModeSet[KNX_GROUP_FILTER_IP_TO_TP] = true;
+    Test_Nvs.Mode[KNX_GROUP_FILTER_IP_TO_TP] = KNX_GROUP_FILTER_TABLE;
+    KnxGroupFilter_Init();
+
+    KNX_TEST_ASSERT(true == KnxGroupFilter_Pass(KNX_GROUP_FILTER_TP_TO_IP, TEST_GA(1, 2, 3)));
+    KNX_TEST_ASSERT(true == KnxGroupFilter_Pass(KNX_GROUP_FILTER_IP_TO_TP, TEST_GA(1, 2, 3)));
+
+    /* Table longer than the address space */
+    Test_Nvs.TableLength[KNX_GROUP_FILTER_IP_TO_TP] = KNX_GROUP_FILTER_TABLE_SIZE + 1U;
+    KnxGroupFilter_Init();
+
+    KNX_TEST_ASSERT(true == KnxGroupFilter_Pass(KNX_GROUP_FILTER_IP_TO_TP, TEST_GA(1, 2, 3)));
+    KNX_TEST_ASSERT(false == Test_Nvs.Open);
+}
+
+/*==================[end of file]===========================================*/
@@ -0,0 +1,218 @@
+/**
+ * \file Test_KnxNetIpDiscovery.c
+ *
+ * \brief KNXnet/IP Discovery Flow Control Host Test
+ *
+ * This file contains the host test of the control endpoint rate limiter and
+ * the delayed search responses, driven from a virtual clock: the budget of a
+ * host, port hopping, a scan from more hosts than the limiter has entries,
+ * and a search repeated while its response is held back
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "esp_system.h"
+
+#include "KNXnetIP_Discovery.h"
+#include "KnxTest.h"
+
+/*==================[macros]================================================*/
+#define TEST_IP_ADDR            (0xC0A80164UL)  /* 192.168.1.100 */
+#define TEST_IP_PORT            (3671U)
+
+/* Scan: distinct hosts cycled through, one request every millisecond */
+#define TEST_SCAN_HOSTS         (64U)
+#define TEST_SCAN_MS            (1000U)
+
+/*==================[type definitions]======================================*/
+
+/*==================[external function declarations]========================*/
+int main(void);
+
+/*==================[internal function declarations]========================*/
+static void Test_Reset(void);
+static void Test_Budget(void);
+static void Test_PortHopping(void);
+static void Test_Scan(void);
+static void Test_Defer(void);
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+static int64_t Test_NowMs;
+static uint32_t Test_Sent;
+
+/*==================[external function definitions]=========================*/
+int main(void)
+{
+    Test_Budget();
+    Test_PortHopping();
+    Test_Scan();
+    Test_Defer();
+
+    return KnxTest_Result("Test_KnxNetIpDiscovery");
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return Test_NowMs * 1000;
+}
+
+uint32_t esp_random(void)
+{
+    return KnxTest_Random(0xFFFFFFFFUL);
+}
+
+void KNXnetIP_UDPSend(uint32_t ipAddr, uint16_t port, const KNXnetIP_TxFrameType * txFrame)
+{
+    KNX_TEST_ASSERT((TEST_IP_ADDR == ipAddr) && (TEST_IP_PORT == port));
+    KNX_TEST_ASSERT((1U == txFrame->SegmentCount) && (0xA5U == txFrame->Segment[0].DataPtr[0]));
+
+    Test_Sent++;
+}
+
+void KNXnetIP_TxFrameAppend(KNXnetIP_TxFrameType * txFrame, const uint8_t * dataPtr, uint16_t length)
+{
+    txFrame->Segment[txFrame->SegmentCount].DataPtr = dataPtr;
+    txFrame->Segment[txFrame->SegmentCount].Length = length;
+    txFrame->SegmentCount++;
+    txFrame->Length += length;
+}
+
+uint16_t KNXnetIP_TxFrameGather(const KNXnetIP_TxFrameType * txFrame, uint16_t offset, uint8_t * destPtr)
+{
+    uint16_t length = 0U;
+
+    KNX_TEST_ASSERT(txFrame->HeaderLength == offset);
+
+    for (uint8_t index = 0; index < txFrame->SegmentCount; index++)
+    {
+        memcpy(&destPtr[length], txFrame->Segment[index].DataPtr, txFrame->Segment[index].Length);
+        length += txFrame->Segment[index].Length;
+    }
+
+    return length;
+}
+
+/*==================[internal function definitions]=========================*/
+static void Test_Reset(void)
+{
+    /* Well past zero, an unused entry counts as refilled long ago */
+    Test_NowMs = 100000;
+    Test_Sent = 0U;
+    KnxTest_RandomSeed(1U);
+    KNXnetIP_DiscoveryInit();
+}
+
+static void Test_Budget(void)
+{
+    /* A burst, then one request per interval */
+    uint32_t admitted = 0U;
+
+    Test_Reset();
+
+    for (uint8_t index = 0; index < (2U * KNXNETIP_DISCOVERY_BURST); index++)
+    {
+        admitted += (true == KNXnetIP_DiscoveryAdmit(TEST_IP_ADDR, TEST_IP_PORT, DESCRIPTION_REQUEST)) ? 1U : 0U;
+    }
+
+    KNX_TEST_ASSERT(KNXNETIP_DISCOVERY_BURST == admitted);
+    KNX_TEST_ASSERT(KNXNETIP_DISCOVERY_BURST == KNXnetIP_DiscoveryStatistics()->RateLimited);
+
+    Test_NowMs += KNXNETIP_DISCOVERY_INTERVAL_MS;
+    KNX_TEST_ASSERT(true == KNXnetIP_DiscoveryAdmit(TEST_IP_ADDR, TEST_IP_PORT, DESCRIPTION_REQUEST));
+    KNX_TEST_ASSERT(false == KNXnetIP_DiscoveryAdmit(TEST_IP_ADDR, TEST_IP_PORT, DESCRIPTION_REQUEST));
+
+    /* Other hosts keep their own budget */
+    KNX_TEST_ASSERT(true == KNXnetIP_DiscoveryAdmit(TEST_IP_ADDR + 1U, TEST_IP_PORT, DESCRIPTION_REQUEST));
+}
+
+static void Test_PortHopping(void)
+{
+    /* A new port is no new source */
+    uint32_t admitted = 0U;
+
+    Test_Reset();
+
+    for (uint16_t port = 0; port < (4U * KNXNETIP_DISCOVERY_BURST); port++)
+    {
+        admitted += (true == KNXnetIP_DiscoveryAdmit(TEST_IP_ADDR, 50000U + port, DESCRIPTION_REQUEST)) ? 1U : 0U;
+    }
+
+    KNX_TEST_ASSERT(KNXNETIP_DISCOVERY_BURST == admitted);
+}
+
+static void Test_Scan(void)
+{
+    /* More hosts than entries: evicting an entry hands on its bucket, no fresh burst */
+    const uint32_t bound = KNXNETIP_DISCOVERY_SOURCE_NUM * (KNXNETIP_DISCOVERY_BURST + (TEST_SCAN_MS / KNXNETIP_DISCOVERY_INTERVAL_MS) + 1U);
+    uint32_t admitted = 0U;
+
+    Test_Reset();
+
+    for (uint32_t request = 0; request < TEST_SCAN_MS; request++)
+    {
+        uint32_t ipAddr = 0x0A000001UL + (request % TEST_SCAN_HOSTS);
+
+        admitted += (true == KNXnetIP_DiscoveryAdmit(ipAddr, TEST_IP_PORT, DESCRIPTION_REQUEST)) ? 1U : 0U;
+        Test_NowMs++;
+    }
+
+    printf("Test_KnxNetIpDiscovery: scan of %u hosts, %lu of %u requests admitted, bound %lu\n",
+           TEST_SCAN_HOSTS, (unsigned long)admitted, TEST_SCAN_MS, (unsigned long)bound);
+
+    KNX_TEST_ASSERT(bound >= admitted);
+
+    /* A host turning up once the scan is over is served again */
+    Test_NowMs += KNXNETIP_DISCOVERY_BURST * KNXNETIP_DISCOVERY_INTERVAL_MS;
+    KNX_TEST_ASSERT(true == KNXnetIP_DiscoveryAdmit(TEST_IP_ADDR, TEST_IP_PORT, DESCRIPTION_REQUEST));
+}
+
+static void Test_Defer(void)
+{
+    /* Held back up to the maximum delay, a repeated search is answered once */
+    static const uint8_t body[] = { 0xA5U, 0x00U, 0x01U, 0x02U };
+    KNXnetIP_TxFrameType txFrame;
+    uint32_t timeoutMs;
+
+    Test_Reset();
+
+    memset(&txFrame, 0, sizeof(txFrame));
+    txFrame.HeaderLength = 6U;
+    txFrame.Length = 6U;
+    KNXnetIP_TxFrameAppend(&txFrame, body, sizeof(body));
+
+    KNX_TEST_ASSERT(true == KNXnetIP_DiscoveryAdmit(TEST_IP_ADDR, TEST_IP_PORT, SEARCH_REQUEST));
+    KNXnetIP_DiscoveryDefer(TEST_IP_ADDR, TEST_IP_PORT, SEARCH_REQUEST, &txFrame);
+
+    /* The frame of the handler is gone once deferred */
+    memset(&txFrame, 0, sizeof(txFrame));
+
+    KNX_TEST_ASSERT(false == KNXnetIP_DiscoveryAdmit(TEST_IP_ADDR, TEST_IP_PORT, SEARCH_REQUEST));
+    KNX_TEST_ASSERT(1U == KNXnetIP_DiscoveryStatistics()->Collapsed);
+
+    timeoutMs = KNXnetIP_DiscoveryMainFunction();
+    KNX_TEST_ASSERT((0U == Test_Sent) || (0U == timeoutMs));
+    KNX_TEST_ASSERT(KNXNETIP_DISCOVERY_DELAY_MAX_MS >= timeoutMs);
+
+    Test_NowMs += KNXNETIP_DISCOVERY_DELAY_MAX_MS;
+    KNX_TEST_ASSERT(KNXNETIP_DISCOVERY_NO_TIMEOUT == KNXnetIP_DiscoveryMainFunction());
+    KNX_TEST_ASSERT(1U == Test_Sent);
+}
+
+/*==================[end of file]===========================================*/
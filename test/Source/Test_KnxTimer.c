@@ -0,0 +1,421 @@
+/**
+ * \file Test_KnxTimer.c
+ *
+ * \brief Knx Protocol Timers Host Test
+ *
+ * This file contains the host test of the timer wheel, driven from a virtual
+ * clock: arm, cancel, cascade, idle skip and arming on a wheel that was not
+ * advanced for a while
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include <stdio.h>
+#include <string.h>
+
+#include "KnxTimer.h"
+#include "KnxTest.h"
+
+/*==================[macros]================================================*/
+/* Timers of the randomized run, armed up to beyond the wheel span */
+#define TEST_TIMER_RANDOM_NUM   (5000U)
+#define TEST_TIMER_SPAN_MS      (KNX_TIMER_MAX_TICKS * KNX_TIMER_TICK_MS)
+
+#define TEST_TIMER_NOT_DUE      (-1)
+
+/*==================[type definitions]======================================*/
+typedef struct {
+    KnxTimer_Type Timer;
+    int64_t DueMs;          /* TEST_TIMER_NOT_DUE while not armed */
+    int64_t ExpiredMs;      /* Virtual time of the last expiry */
+    uint32_t Expiries;
+    uint32_t RearmMs;       /* Armed again from the callback with this delay, 0 for none */
+} Test_TimerType;
+
+/*==================[external function declarations]========================*/
+int main(void);
+
+/*==================[internal function declarations]========================*/
+static void Test_TimerInit(Test_TimerType * timer);
+static void Test_TimerArm(Test_TimerType * timer, uint32_t delayMs);
+static void Test_TimerExpired(void * context);
+static void Test_RandomExpired(void * context);
+static void Test_ArmExpire(void);
+static void Test_Cancel(void);
+static void Test_Cascade(void);
+static void Test_IdleSkip(void);
+static void Test_StaleTick(void);
+static void Test_RearmLate(void);
+static void Test_Random(void);
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+static KnxTimer_WheelType Test_Wheel;
+static int64_t Test_NowMs;
+
+static Test_TimerType Test_RandomTimer[TEST_TIMER_RANDOM_NUM];
+static uint32_t Test_RandomEarly;
+static uint32_t Test_RandomLate;
+static uint32_t Test_RandomExpiries;
+
+/*==================[external function definitions]=========================*/
+int main(void)
+{
+    Test_ArmExpire();
+    Test_Cancel();
+    Test_Cascade();
+    Test_IdleSkip();
+    Test_StaleTick();
+    Test_RearmLate();
+    Test_Random();
+
+    return KnxTest_Result("Test_KnxTimer");
+}
+
+/*==================[internal function definitions]=========================*/
+static void Test_TimerInit(Test_TimerType * timer)
+{
+    memset(timer, 0, sizeof(Test_TimerType));
+
+    timer->DueMs = TEST_TIMER_NOT_DUE;
+    KnxTimer_Init(&timer->Timer, Test_TimerExpired, timer);
+}
+
+static void Test_TimerArm(Test_TimerType * timer, uint32_t delayMs)
+{
+    timer->DueMs = Test_NowMs + delayMs;
+    KnxTimer_Arm(&Test_Wheel, &timer->Timer, Test_NowMs, delayMs);
+}
+
+static void Test_TimerExpired(void * context)
+{
+    Test_TimerType * timer = (Test_TimerType *)context;
+
+    /* Never before its delay */
+    KNX_TEST_ASSERT(Test_NowMs >= timer->DueMs);
+
+    timer->ExpiredMs = Test_NowMs;
+    timer->Expiries++;
+    timer->DueMs = TEST_TIMER_NOT_DUE;
+
+    if (0U != timer->RearmMs)
+    {
+        Test_TimerArm(timer, timer->RearmMs);
+    }
+}
+
+static void Test_ArmExpire(void)
+{
+    Test_TimerType timer;
+
+    Test_NowMs = 1000;
+    KnxTimer_WheelInit(&Test_Wheel, Test_NowMs);
+    Test_TimerInit(&timer);
+
+    KNX_TEST_ASSERT(KNX_TIMER_NO_TIMEOUT == KnxTimer_NextTimeoutMs(&Test_Wheel, Test_NowMs));
+
+    Test_TimerArm(&timer, 100U);
+    KNX_TEST_ASSERT(true == KnxTimer_Armed(&timer.Timer));
+    KNX_TEST_ASSERT(100U == KnxTimer_NextTimeoutMs(&Test_Wheel, Test_NowMs));
+
+    Test_NowMs += 99;
+    KNX_TEST_ASSERT(1U == KnxTimer_Advance(&Test_Wheel, Test_NowMs));
+    KNX_TEST_ASSERT(0U == timer.Expiries);
+
+    Test_NowMs += 1;
+    KNX_TEST_ASSERT(KNX_TIMER_NO_TIMEOUT == KnxTimer_Advance(&Test_Wheel, Test_NowMs));
+    KNX_TEST_ASSERT(1U == timer.Expiries);
+    KNX_TEST_ASSERT(false == KnxTimer_Armed(&timer.Timer));
+
+    /* A delay off the tick grid is rounded up */
+    Test_NowMs += 3;
+    Test_TimerArm(&timer, 15U);
+    Test_NowMs += 14;
+    (void)KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+    KNX_TEST_ASSERT(1U == timer.Expiries);
+    Test_NowMs += KNX_TIMER_TICK_MS;
+    (void)KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+    KNX_TEST_ASSERT(2U == timer.Expiries);
+    KNX_TEST_ASSERT(0U == Test_Wheel.Armed);
+}
+
+static void Test_Cancel(void)
+{
+    Test_TimerType first;
+    Test_TimerType second;
+
+    Test_NowMs = 0;
+    KnxTimer_WheelInit(&Test_Wheel, Test_NowMs);
+    Test_TimerInit(&first);
+    Test_TimerInit(&second);
+
+    /* Same slot, the one cancelled goes, the other stays */
+    Test_TimerArm(&first, 200U);
+    Test_TimerArm(&second, 200U);
+    KNX_TEST_ASSERT(2U == Test_Wheel.Armed);
+
+    KnxTimer_Cancel(&first.Timer);
+    KNX_TEST_ASSERT(false == KnxTimer_Armed(&first.Timer));
+    KNX_TEST_ASSERT(1U == Test_Wheel.Armed);
+
+    /* Cancelling twice is harmless */
+    KnxTimer_Cancel(&first.Timer);
+    KNX_TEST_ASSERT(1U == Test_Wheel.Armed);
+
+    Test_NowMs = 1000;
+    KNX_TEST_ASSERT(KNX_TIMER_NO_TIMEOUT == KnxTimer_Advance(&Test_Wheel, Test_NowMs));
+    KNX_TEST_ASSERT(0U == first.Expiries);
+    KNX_TEST_ASSERT(1U == second.Expiries);
+
+    /* Arming an armed timer moves it */
+    Test_TimerArm(&first, 100U);
+    Test_TimerArm(&first, 500U);
+    KNX_TEST_ASSERT(1U == Test_Wheel.Armed);
+    Test_NowMs += 100;
+    (void)KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+    KNX_TEST_ASSERT(0U == first.Expiries);
+    Test_NowMs += 400;
+    (void)KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+    KNX_TEST_ASSERT(1U == first.Expiries);
+}
+
+static void Test_Cascade(void)
+{
+    /* One timer per level, each cascades down before it expires */
+    static const uint32_t delayMs[] = { 630U, 640U, 5000U, 40950U, 41000U, 600000U, TEST_TIMER_SPAN_MS };
+    Test_TimerType timer[sizeof(delayMs) / sizeof(delayMs[0])];
+    uint32_t timeoutMs;
+
+    Test_NowMs = 7;
+    KnxTimer_WheelInit(&Test_Wheel, Test_NowMs);
+
+    for (uint8_t index = 0; index < (sizeof(delayMs) / sizeof(delayMs[0])); index++)
+    {
+        Test_TimerInit(&timer[index]);
+        Test_TimerArm(&timer[index], delayMs[index]);
+    }
+
+    /* Woken exactly when the wheel asks, the way the tasks wait */
+    timeoutMs = KnxTimer_NextTimeoutMs(&Test_Wheel, Test_NowMs);
+    while (KNX_TIMER_NO_TIMEOUT != timeoutMs)
+    {
+        Test_NowMs += timeoutMs;
+        timeoutMs = KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+    }
+
+    for (uint8_t index = 0; index < (sizeof(delayMs) / sizeof(delayMs[0])); index++)
+    {
+        int64_t dueMs = 7 + delayMs[index];
+
+        KNX_TEST_ASSERT(1U == timer[index].Expiries);
+        KNX_TEST_ASSERT(timer[index].ExpiredMs >= dueMs);
+        KNX_TEST_ASSERT(timer[index].ExpiredMs < (dueMs + KNX_TIMER_TICK_MS));
+    }
+}
+
+static void Test_IdleSkip(void)
+{
+    Test_TimerType timer;
+    uint32_t wakeups = 0U;
+    uint32_t timeoutMs;
+
+    Test_NowMs = 0;
+    KnxTimer_WheelInit(&Test_Wheel, Test_NowMs);
+    Test_TimerInit(&timer);
+
+    /* 30 minutes away, the wait in between is a handful of cascades, not 180000 ticks */
+    Test_TimerArm(&timer, 1800000U);
+
+    timeoutMs = KnxTimer_NextTimeoutMs(&Test_Wheel, Test_NowMs);
+    while (KNX_TIMER_NO_TIMEOUT != timeoutMs)
+    {
+        Test_NowMs += timeoutMs;
+        timeoutMs = KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+        wakeups++;
+    }
+
+    KNX_TEST_ASSERT(1U == timer.Expiries);
+    KNX_TEST_ASSERT(1800000 == timer.ExpiredMs);
+    KNX_TEST_ASSERT(4U > wakeups);
+
+    /* Hours without a timer on the wheel cost one step */
+    Test_NowMs += 7200000;
+    KNX_TEST_ASSERT(KNX_TIMER_NO_TIMEOUT == KnxTimer_Advance(&Test_Wheel, Test_NowMs));
+    KNX_TEST_ASSERT(Test_NowMs == Test_Wheel.TickMs);
+}
+
+static void Test_StaleTick(void)
+{
+    Test_TimerType timer;
+
+    /* The task waited 5 s without a timeout, its wheel still sits at 0 */
+    Test_NowMs = 0;
+    KnxTimer_WheelInit(&Test_Wheel, Test_NowMs);
+    (void)KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+    Test_TimerInit(&timer);
+
+    Test_NowMs = 5000;
+    Test_TimerArm(&timer, 1000U);
+    KNX_TEST_ASSERT(1000U >= KnxTimer_NextTimeoutMs(&Test_Wheel, Test_NowMs));
+
+    Test_NowMs = 5001;
+    (void)KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+    KNX_TEST_ASSERT(0U == timer.Expiries);
+
+    Test_NowMs = 5999;
+    (void)KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+    KNX_TEST_ASSERT(0U == timer.Expiries);
+
+    Test_NowMs = 6000;
+    (void)KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+    KNX_TEST_ASSERT(1U == timer.Expiries);
+
+    /* Longer than the wheel spans, the delay is not cut short */
+    Test_NowMs += 3U * TEST_TIMER_SPAN_MS;
+    Test_TimerArm(&timer, 1000U);
+    Test_NowMs += 999;
+    (void)KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+    KNX_TEST_ASSERT(1U == timer.Expiries);
+    Test_NowMs += 1;
+    (void)KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+    KNX_TEST_ASSERT(2U == timer.Expiries);
+
+    /* Stale while another timer is armed: the wheel lags behind now by the late wakeup */
+    {
+        Test_TimerType other;
+
+        Test_TimerInit(&other);
+        Test_TimerArm(&other, 60000U);
+
+        Test_NowMs += 30000;
+        Test_TimerArm(&timer, 1000U);
+        Test_NowMs += 990;
+        (void)KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+        KNX_TEST_ASSERT(2U == timer.Expiries);
+        Test_NowMs += 10;
+        (void)KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+        KNX_TEST_ASSERT(3U == timer.Expiries);
+
+        KnxTimer_Cancel(&other.Timer);
+    }
+}
+
+static void Test_RearmLate(void)
+{
+    Test_TimerType timer;
+
+    /* Due on tick 1 but the task wakes 63 ticks late; the callback re-arms */
+    /* on the then empty wheel, which lands in the slot being expired      */
+    Test_NowMs = 0;
+    KnxTimer_WheelInit(&Test_Wheel, Test_NowMs);
+    Test_TimerInit(&timer);
+    timer.RearmMs = 1U;
+    Test_TimerArm(&timer, KNX_TIMER_TICK_MS);
+
+    Test_NowMs = KNX_TIMER_TICK_MS * KNX_TIMER_SLOT_NUM;
+    (void)KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+    KNX_TEST_ASSERT(1U == timer.Expiries);
+    KNX_TEST_ASSERT(true == KnxTimer_Armed(&timer.Timer));
+
+    timer.RearmMs = 0U;
+    Test_NowMs += KNX_TIMER_TICK_MS;
+    (void)KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+    KNX_TEST_ASSERT(2U == timer.Expiries);
+}
+
+static void Test_RandomExpired(void * context)
+{
+    Test_TimerType * timer = (Test_TimerType *)context;
+    Test_TimerType * other = &Test_RandomTimer[KnxTest_Random(TEST_TIMER_RANDOM_NUM)];
+
+    Test_RandomExpiries++;
+
+    if (Test_NowMs < timer->DueMs)
+    {
+        Test_RandomEarly++;
+    }
+
+    /* The loop wakes exactly when asked, so one tick covers the rounding */
+    if (Test_NowMs >= (timer->DueMs + KNX_TIMER_TICK_MS))
+    {
+        Test_RandomLate++;
+    }
+
+    timer->DueMs = TEST_TIMER_NOT_DUE;
+
+    /* Callbacks arm themselves again and cancel others, as the protocol timers do */
+    if (0U == KnxTest_Random(4U))
+    {
+        Test_TimerArm(timer, KnxTest_Random(200000U));
+    }
+
+    if ((0U == KnxTest_Random(3U)) && (true == KnxTimer_Armed(&other->Timer)))
+    {
+        KnxTimer_Cancel(&other->Timer);
+        other->DueMs = TEST_TIMER_NOT_DUE;
+    }
+}
+
+static void Test_Random(void)
+{
+    uint32_t timeoutMs;
+    uint32_t armed = 0U;
+
+    KnxTest_RandomSeed(0x4B4E5854U);
+
+    Test_NowMs = 123456789;
+    KnxTimer_WheelInit(&Test_Wheel, Test_NowMs);
+
+    for (uint32_t index = 0; index < TEST_TIMER_RANDOM_NUM; index++)
+    {
+        Test_TimerType * timer = &Test_RandomTimer[index];
+
+        memset(timer, 0, sizeof(Test_TimerType));
+        KnxTimer_Init(&timer->Timer, Test_RandomExpired, timer);
+        Test_TimerArm(timer, KnxTest_Random(TEST_TIMER_SPAN_MS));
+    }
+
+    /* Woken at the asked time or earlier, timers armed in between as well */
+    timeoutMs = KnxTimer_NextTimeoutMs(&Test_Wheel, Test_NowMs);
+    while (KNX_TIMER_NO_TIMEOUT != timeoutMs)
+    {
+        Test_NowMs += (0U == KnxTest_Random(2U)) ? timeoutMs : KnxTest_Random(timeoutMs + 1U);
+        timeoutMs = KnxTimer_Advance(&Test_Wheel, Test_NowMs);
+
+        if (0U == KnxTest_Random(50U))
+        {
+            Test_TimerArm(&Test_RandomTimer[KnxTest_Random(TEST_TIMER_RANDOM_NUM)], KnxTest_Random(TEST_TIMER_SPAN_MS));
+            timeoutMs = KnxTimer_NextTimeoutMs(&Test_Wheel, Test_NowMs);
+        }
+    }
+
+    for (uint32_t index = 0; index < TEST_TIMER_RANDOM_NUM; index++)
+    {
+        if (true == KnxTimer_Armed(&Test_RandomTimer[index].Timer))
+        {
+            armed++;
+        }
+    }
+
+    printf("Test_KnxTimer: %lu random expiries\n", (unsigned long)Test_RandomExpiries);
+
+    KNX_TEST_ASSERT(TEST_TIMER_RANDOM_NUM <= Test_RandomExpiries);
+    KNX_TEST_ASSERT(0U == Test_RandomEarly);
+    KNX_TEST_ASSERT(0U == Test_RandomLate);
+    KNX_TEST_ASSERT(0U == armed);
+    KNX_TEST_ASSERT(0U == Test_Wheel.Armed);
+}
+
+/*==================[end of file]===========================================*/
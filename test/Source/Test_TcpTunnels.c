@@ -0,0 +1,872 @@
+/**
+ * \file Test_TcpTunnels.c
+ *
+ * \brief KNXnet/IP TCP Tunnel Load Host Test
+ *
+ * This file contains the host test of the TCP server under a full set of
+ * tunnels. The socket calls of the server are played by virtual clients on a
+ * virtual clock: every client connects and opens a tunnel, one connection
+ * more is refused, and a busy line sends group writes and point-to-point
+ * frames. Every tunnel has to get each frame meant for it once and in order,
+ * within a bounded time of the frame leaving the bus, and a client that
+ * stops reading must not hold up the others
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include <stdio.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/param.h>
+
+#include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "KNXnetIP.h"
+#include "KNXnetIP_Core.h"
+#include "KNXnetIP_Tunnelling.h"
+#include "KNXnetIP_UdpServer.h"
+#include "KNXnetIP_Routing.h"
+#include "IP_DataLinkLayer.h"
+#include "TP_DataLinkLayer.h"
+#include "TpUart2_DataLinkLayer.h"
+#include "KnxGroupFilter.h"
+#include "KnxFrameBuffer.h"
+#include "KnxTest.h"
+
+/*==================[macros]================================================*/
+/* One client per channel, built with KNX_CHANNEL_NUM raised to 16 */
+#define TEST_CLIENT_NUM         (KNX_CHANNEL_NUM)
+
+/* Descriptors of the virtual network, well clear of those of the host */
+#define TEST_LISTEN_SOCK        (100)
+#define TEST_CLIENT_SOCK(index) (101 + (int)(index))
+
+#define TEST_CLIENT_IP_ADDR     (0xC0A8010AUL)  /* 192.168.1.10 onwards */
+#define TEST_CLIENT_PORT        (50000U)
+
+/* A short group write every 10 ms keeps a TP1 line about fully loaded, */
+/* every TEST_P2P_PERIOD-th frame is addressed to one tunnel instead    */
+#define TEST_BUS_FRAMES         (200U)
+#define TEST_BUS_PERIOD_US      (10000)
+#define TEST_P2P_PERIOD         (10U)
+
+/* Network task: select() returning after the doorbell, one writev() */
+#define TEST_WAKEUP_US          (200)
+#define TEST_WRITEV_US          (100)
+
+/* Every tunnel gets a bus frame within one wakeup of the server */
+#define TEST_LATENCY_BOUND_US   (TEST_WAKEUP_US + (TEST_CLIENT_NUM * TEST_WRITEV_US))
+
+/* The first client in the fan-out stops reading for a few bus frames, */
+/* fewer than the server queues for it                                 */
+#define TEST_SLOW_CLIENT        (0U)
+#define TEST_STALL_FIRST        (100U)
+#define TEST_STALL_FRAMES       (6U)
+
+#define TEST_GROUP_ADDR         (0x0801U)       /* 1/0/1 */
+#define TEST_INDV_ADDR(channelId) ((uint16_t)(0x1180U + (channelId)))
+
+#define TEST_CONNECT_REQUEST_LENGTH (26U)
+#define TEST_STREAM_SIZE        (1024U)
+
+/*==================[type definitions]======================================*/
+typedef struct {
+    int Sock;               /* -1 until accepted */
+    bool Closed;
+    bool Stalled;           /* Takes no more bytes */
+    uint8_t Request[TEST_CONNECT_REQUEST_LENGTH];
+    uint16_t RequestLength; /* Bytes not yet read by the server */
+    uint8_t Stream[TEST_STREAM_SIZE];
+    uint16_t StreamLength;  /* Bytes written by the server, not yet parsed */
+    uint8_t ChannelId;
+    uint8_t Sequence;       /* Of the next TUNNELLING_REQUEST */
+    int32_t LastFrame;      /* Number of the last bus frame received */
+    uint32_t Frames;
+    uint32_t Expected;
+    int64_t LatencySumUs;
+    int64_t LatencyMaxUs;
+} Test_ClientType;
+
+/*==================[external function declarations]========================*/
+int main(void);
+
+/* Services around the server and the tunnels, replaced for the test */
+KNXnetIP_ChannelType * KNXnetIP_ChannelGet(uint8_t channelId);
+KNXnetIP_ChannelType * KNXnetIP_ChannelGetByIndvAddr(uint16_t indvAddr);
+void KNXnetIP_ChannelFreeBySocket(int sock);
+void KNXnetIP_ChannelHeartbeat(KNXnetIP_ChannelType * channel);
+void KNXnetIP_ChannelDisconnect(KNXnetIP_ChannelType * channel);
+void KNXnetIP_TimerArm(uint8_t transport, KnxTimer_Type * timer, uint32_t delayMs);
+uint32_t KNXnetIP_TimerMainFunction(uint8_t transport);
+void KNXnetIP_TxFrameInit(KNXnetIP_TxFrameType * txFrame, uint16_t serviceType);
+void KNXnetIP_TxFrameConnectionHeader(KNXnetIP_TxFrameType * txFrame, uint8_t channelId, uint8_t sequenceCounter);
+void KNXnetIP_TxFrameAppend(KNXnetIP_TxFrameType * txFrame, const uint8_t * dataPtr, uint16_t length);
+uint16_t KNXnetIP_TxFrameGather(const KNXnetIP_TxFrameType * txFrame, uint16_t offset, uint8_t * destPtr);
+void KNXnetIP_UDPDataSend(uint8_t channelId, uint32_t ipAddr, uint16_t port, const KNXnetIP_TxFrameType * txFrame);
+void KNXnetIP_RoutingTP2IP(KnxFrameBuffer_HandleType frame);
+bool KnxGroupFilter_Pass(uint8_t direction, uint16_t groupAddr);
+StatusType TpUart2_L_Data_Req(uint8_t channelId, bool repeatFlag, uint16_t destAddr, AddressType addrType, PriorityType priority, KnxFrameBuffer_HandleType frame, int64_t reqTimestampMs);
+bool TpUart2_TxQueueFull(void);
+uint8_t TpUart2_TxQueueCount(void);
+int64_t KnxTpUart2_GetTimeMs();
+
+/*==================[internal function declarations]========================*/
+static void Test_Setup(void);
+static Test_ClientType * Test_Client(int sock);
+static void Test_ConnectRequest(Test_ClientType * client);
+static uint16_t Test_FrameLength(const Test_ClientType * client);
+static void Test_ClientReceive(Test_ClientType * client);
+static void Test_TunnellingRequest(Test_ClientType * client, const uint8_t * dataPtr);
+static void Test_TxFrameLength(KNXnetIP_TxFrameType * txFrame);
+static void Test_BusFrame(void);
+static void Test_Load(void);
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+static int64_t Test_NowUs;
+
+/* The clients that get a tunnel, then the one refused */
+static Test_ClientType Test_Clients[TEST_CLIENT_NUM + 1U];
+static uint8_t Test_Accepted;
+
+static KNXnetIP_ChannelType Test_Channel[KNX_CHANNEL_NUM];
+static bool Test_ChannelOpen[KNX_CHANNEL_NUM];
+
+/* Bus frames sent so far and when each left the bus */
+static uint32_t Test_BusFrames;
+static int64_t Test_BusTimeUs[TEST_BUS_FRAMES];
+
+static bool Test_ListenClosed;
+static bool Test_TaskDeleted;
+static int Test_Doorbell;
+
+/*==================[external function definitions]=========================*/
+int main(void)
+{
+    Test_Load();
+
+    return KnxTest_Result("Test_TcpTunnels");
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return Test_NowUs;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    KNX_TEST_ASSERT(NULL == task);
+
+    Test_TaskDeleted = true;
+}
+
+/* The network, as the server sees it through lwIP */
+int lwip_socket(int domain, int type, int protocol)
+{
+    KNX_TEST_ASSERT((AF_INET == domain) && (SOCK_STREAM == type) && (IPPROTO_IP == protocol));
+
+    return TEST_LISTEN_SOCK;
+}
+
+int lwip_bind(int s, const struct sockaddr * name, socklen_t namelen)
+{
+    (void)name;
+    (void)namelen;
+
+    KNX_TEST_ASSERT(TEST_LISTEN_SOCK == s);
+
+    return 0;
+}
+
+int lwip_listen(int s, int backlog)
+{
+    (void)backlog;
+
+    KNX_TEST_ASSERT(TEST_LISTEN_SOCK == s);
+
+    return 0;
+}
+
+int lwip_accept(int s, struct sockaddr * addr, socklen_t * addrlen)
+{
+    struct sockaddr_in * source = (struct sockaddr_in *)addr;
+    Test_ClientType * client = &Test_Clients[Test_Accepted];
+
+    KNX_TEST_ASSERT((TEST_LISTEN_SOCK == s) && (sizeof(struct sockaddr_in) <= *addrlen));
+    KNX_TEST_ASSERT(TEST_CLIENT_NUM >= Test_Accepted);
+
+    memset(source, 0, sizeof(struct sockaddr_in));
+    source->sin_family = AF_INET;
+    source->sin_addr.s_addr = htonl(TEST_CLIENT_IP_ADDR + Test_Accepted);
+    source->sin_port = htons(TEST_CLIENT_PORT + Test_Accepted);
+
+    client->Sock = TEST_CLIENT_SOCK(Test_Accepted);
+
+    if (TEST_CLIENT_NUM > Test_Accepted)
+    {
+        /* The client asks for a tunnel right away */
+        Test_ConnectRequest(client);
+    }
+
+    Test_Accepted++;
+
+    return client->Sock;
+}
+
+int lwip_setsockopt(int s, int level, int optname, const void * optval, socklen_t optlen)
+{
+    (void)level;
+    (void)optname;
+    (void)optval;
+    (void)optlen;
+
+    KNX_TEST_ASSERT((TEST_LISTEN_SOCK == s) || (NULL != Test_Client(s)));
+
+    return 0;
+}
+
+int lwip_fcntl(int s, int cmd, int val)
+{
+    (void)cmd;
+    (void)val;
+
+    KNX_TEST_ASSERT((TEST_LISTEN_SOCK == s) || (NULL != Test_Client(s)));
+
+    return 0;
+}
+
+int lwip_shutdown(int s, int how)
+{
+    (void)how;
+
+    KNX_TEST_ASSERT(NULL != Test_Client(s));
+
+    return 0;
+}
+
+int lwip_close(int s)
+{
+    Test_ClientType * client = Test_Client(s);
+
+    if (TEST_LISTEN_SOCK == s)
+    {
+        Test_ListenClosed = true;
+    }
+    else
+    {
+        KNX_TEST_ASSERT((NULL != client) && (false == client->Closed));
+        client->Closed = true;
+    }
+
+    return 0;
+}
+
+ssize_t lwip_recv(int s, void * mem, size_t len, int flags)
+{
+    Test_ClientType * client = Test_Client(s);
+    ssize_t received = -1;
+
+    (void)flags;
+
+    KNX_TEST_ASSERT(NULL != client);
+
+    if (0U == client->RequestLength)
+    {
+        errno = EAGAIN;
+    }
+    else
+    {
+        KNX_TEST_ASSERT(client->RequestLength <= len);
+
+        memcpy(mem, &client->Request[0], client->RequestLength);
+        received = client->RequestLength;
+        client->RequestLength = 0U;
+    }
+
+    return received;
+}
+
+ssize_t lwip_recvfrom(int s, void * mem, size_t len, int flags, struct sockaddr * from, socklen_t * fromlen)
+{
+    (void)s;
+    (void)mem;
+    (void)len;
+    (void)flags;
+    (void)from;
+    (void)fromlen;
+
+    /* No UDP in this test */
+    KNX_TEST_ASSERT(false);
+
+    return -1;
+}
+
+ssize_t lwip_sendmsg(int s, const struct msghdr * message, int flags)
+{
+    (void)s;
+    (void)message;
+    (void)flags;
+
+    KNX_TEST_ASSERT(false);
+
+    return -1;
+}
+
+ssize_t lwip_writev(int s, const struct iovec * iov, int iovcnt)
+{
+    Test_ClientType * client = Test_Client(s);
+    ssize_t written = -1;
+
+    KNX_TEST_ASSERT((NULL != client) && (false == client->Closed));
+
+    Test_NowUs += TEST_WRITEV_US;
+
+    if (true == client->Stalled)
+    {
+        /* Receive window closed */
+        errno = EAGAIN;
+    }
+    else
+    {
+        written = 0;
+
+        for (int index = 0; index < iovcnt; index++)
+        {
+            KNX_TEST_ASSERT(TEST_STREAM_SIZE >= (client->StreamLength + iov[index].iov_len));
+
+            memcpy(&client->Stream[client->StreamLength], iov[index].iov_base, iov[index].iov_len);
+            client->StreamLength += (uint16_t)iov[index].iov_len;
+            written += (ssize_t)iov[index].iov_len;
+        }
+
+        Test_ClientReceive(client);
+    }
+
+    return written;
+}
+
+int lwip_select(int maxfdp1, fd_set * readset, fd_set * writeset, fd_set * exceptset, struct timeval * timeout)
+{
+    struct pollfd doorbell = { .fd = KNXnetIP_TunnellingDoorbell(KNXNETIP_TRANSPORT_TCP), .events = POLLIN, .revents = 0 };
+    Test_ClientType * slow = &Test_Clients[TEST_SLOW_CLIENT];
+    fd_set readable;
+    fd_set writable;
+    int ready = 0;
+
+    (void)timeout;
+
+    KNX_TEST_ASSERT(NULL == exceptset);
+
+    FD_ZERO(&readable);
+    FD_ZERO(&writable);
+
+    slow->Stalled = (TEST_STALL_FIRST <= Test_BusFrames) && ((TEST_STALL_FIRST + TEST_STALL_FRAMES) > Test_BusFrames);
+
+    for (int fd = 0; fd < maxfdp1; fd++)
+    {
+        Test_ClientType * client = Test_Client(fd);
+
+        if (FD_ISSET(fd, readset) &&
+            (((TEST_LISTEN_SOCK == fd) && (TEST_CLIENT_NUM >= Test_Accepted)) ||
+             ((NULL != client) && (0U < client->RequestLength)) ||
+             ((doorbell.fd == fd) && (1 == poll(&doorbell, 1U, 0)))))
+        {
+            FD_SET(fd, &readable);
+            ready++;
+        }
+
+        if (FD_ISSET(fd, writeset) && (NULL != client) && (false == client->Stalled))
+        {
+            FD_SET(fd, &writable);
+            ready++;
+        }
+    }
+
+    if ((0 == ready) && (TEST_BUS_FRAMES > Test_BusFrames))
+    {
+        /* Everything served, the next frame comes off the bus */
+        Test_BusFrame();
+        Test_NowUs += TEST_WAKEUP_US;
+
+        KNX_TEST_ASSERT(FD_ISSET(doorbell.fd, readset) && (1 == poll(&doorbell, 1U, 0)));
+        FD_SET(doorbell.fd, &readable);
+        ready++;
+    }
+
+    *readset = readable;
+    *writeset = writable;
+
+    /* Nothing left to do ends the task */
+    return (0 < ready) ? ready : -1;
+}
+
+/* Tunnel bookkeeping of the core, one tunnel per connection */
+void IP_L_Data_Ind(PduInfoType * pduInfoPtr, KnxFrameBuffer_HandleType frame, uint32_t ipAddr, uint16_t port, KNXnetIP_HostProtocolCodeTpe protocol, int sock)
+{
+    Test_ClientType * client = Test_Client(sock);
+    uint16_t serviceType = ((uint16_t)pduInfoPtr->SduDataPtr[2] << 8) | pduInfoPtr->SduDataPtr[3];
+    uint8_t body[2] = { KNX_CHANNEL_INVALID, E_NO_MORE_CONNECTIONS };
+    KNXnetIP_TxFrameType txFrame;
+
+    KNX_TEST_ASSERT((KNX_FRAME_BUFFER_INVALID == frame) && (IPV4_TCP == protocol) && (NULL != client));
+    KNX_TEST_ASSERT((CONNECT_REQUEST == serviceType) && (TEST_CONNECT_REQUEST_LENGTH == pduInfoPtr->SduLength));
+    KNX_TEST_ASSERT((TEST_CLIENT_IP_ADDR + (uint32_t)(client - &Test_Clients[0])) == ipAddr);
+    KNX_TEST_ASSERT((TEST_CLIENT_PORT + (uint16_t)(client - &Test_Clients[0])) == port);
+
+    for (uint8_t index = 0; (index < KNX_CHANNEL_NUM) && (KNX_CHANNEL_INVALID == body[0]); index++)
+    {
+        if (false == Test_ChannelOpen[index])
+        {
+            KNXnetIP_ChannelType * channel = &Test_Channel[index];
+
+            memset(channel, 0, sizeof(KNXnetIP_ChannelType));
+            channel->ChannelId = CHANNEL_1 + index;
+            channel->ConnectionType = TUNNEL_CONNECTION;
+            channel->Protocol = IPV4_TCP;
+            channel->Socket = sock;
+            channel->IndvAddr = TEST_INDV_ADDR(channel->ChannelId);
+            Test_ChannelOpen[index] = true;
+
+            body[0] = channel->ChannelId;
+            body[1] = E_NO_ERROR;
+        }
+    }
+
+    KNXnetIP_TxFrameInit(&txFrame, CONNECT_RESPONSE);
+    KNXnetIP_TxFrameAppend(&txFrame, &body[0], sizeof(body));
+    KNXnetIP_TcpSend(sock, &txFrame);
+}
+
+KNXnetIP_ChannelType * KNXnetIP_ChannelGet(uint8_t channelId)
+{
+    KNXnetIP_ChannelType * channel = NULL;
+
+    if ((CHANNEL_1 <= channelId) && (KNX_CHANNEL_NUM >= channelId) && (true == Test_ChannelOpen[channelId - CHANNEL_1]))
+    {
+        channel = &Test_Channel[channelId - CHANNEL_1];
+    }
+
+    return channel;
+}
+
+KNXnetIP_ChannelType * KNXnetIP_ChannelGetByIndvAddr(uint16_t indvAddr)
+{
+    KNXnetIP_ChannelType * channel = NULL;
+
+    for (uint8_t index = 0; (index < KNX_CHANNEL_NUM) && (NULL == channel); index++)
+    {
+        if ((true == Test_ChannelOpen[index]) && (indvAddr == Test_Channel[index].IndvAddr))
+        {
+            channel = &Test_Channel[index];
+        }
+    }
+
+    return channel;
+}
+
+void KNXnetIP_ChannelFreeBySocket(int sock)
+{
+    for (uint8_t index = 0; index < KNX_CHANNEL_NUM; index++)
+    {
+        if ((true == Test_ChannelOpen[index]) && (sock == Test_Channel[index].Socket))
+        {
+            Test_ChannelOpen[index] = false;
+        }
+    }
+}
+
+void KNXnetIP_ChannelHeartbeat(KNXnetIP_ChannelType * channel)
+{
+    (void)channel;
+}
+
+void KNXnetIP_ChannelDisconnect(KNXnetIP_ChannelType * channel)
+{
+    /* Only UDP tunnels time out on a missing ack */
+    (void)channel;
+
+    KNX_TEST_ASSERT(false);
+}
+
+void KNXnetIP_TimerArm(uint8_t transport, KnxTimer_Type * timer, uint32_t delayMs)
+{
+    (void)transport;
+    (void)timer;
+    (void)delayMs;
+
+    KNX_TEST_ASSERT(false);
+}
+
+uint32_t KNXnetIP_TimerMainFunction(uint8_t transport)
+{
+    KNX_TEST_ASSERT(KNXNETIP_TRANSPORT_TCP == transport);
+
+    return KNX_TIMER_NO_TIMEOUT;
+}
+
+void KNXnetIP_TxFrameInit(KNXnetIP_TxFrameType * txFrame, uint16_t serviceType)
+{
+    memset(txFrame, 0, sizeof(KNXnetIP_TxFrameType));
+
+    txFrame->Header[0] = HEADER_SIZE_10;
+    txFrame->Header[1] = KNXNETIP_VERSION_10;
+    txFrame->Header[2] = (uint8_t)(serviceType >> 8);
+    txFrame->Header[3] = (uint8_t)(serviceType & 0xFFU);
+    txFrame->HeaderLength = HEADER_SIZE_10;
+    txFrame->Length = HEADER_SIZE_10;
+
+    Test_TxFrameLength(txFrame);
+}
+
+void KNXnetIP_TxFrameConnectionHeader(KNXnetIP_TxFrameType * txFrame, uint8_t channelId, uint8_t sequenceCounter)
+{
+    txFrame->Header[HEADER_SIZE_10] = CONNECTION_HEADER_SIZE;
+    txFrame->Header[HEADER_SIZE_10 + 1U] = channelId;
+    txFrame->Header[HEADER_SIZE_10 + 2U] = sequenceCounter;
+    txFrame->Header[HEADER_SIZE_10 + 3U] = 0x00U;
+    txFrame->HeaderLength = HEADER_SIZE_10 + CONNECTION_HEADER_SIZE;
+    txFrame->Length += CONNECTION_HEADER_SIZE;
+
+    Test_TxFrameLength(txFrame);
+}
+
+void KNXnetIP_TxFrameAppend(KNXnetIP_TxFrameType * txFrame, const uint8_t * dataPtr, uint16_t length)
+{
+    txFrame->Segment[txFrame->SegmentCount].DataPtr = dataPtr;
+    txFrame->Segment[txFrame->SegmentCount].Length = length;
+    txFrame->SegmentCount++;
+    txFrame->Length += length;
+
+    Test_TxFrameLength(txFrame);
+}
+
+uint16_t KNXnetIP_TxFrameGather(const KNXnetIP_TxFrameType * txFrame, uint16_t offset, uint8_t * destPtr)
+{
+    uint8_t frame[KNXNETIP_TX_HEADER_MAX + KNX_FRAME_BUFFER_SIZE];
+    uint16_t length = txFrame->HeaderLength;
+
+    /* The whole frame, then the bytes from offset on */
+    memcpy(&frame[0], &txFrame->Header[0], txFrame->HeaderLength);
+
+    for (uint8_t index = 0; index < txFrame->SegmentCount; index++)
+    {
+        memcpy(&frame[length], txFrame->Segment[index].DataPtr, txFrame->Segment[index].Length);
+        length += txFrame->Segment[index].Length;
+    }
+
+    memcpy(destPtr, &frame[offset], length - offset);
+
+    return length - offset;
+}
+
+void KNXnetIP_UDPDataSend(uint8_t channelId, uint32_t ipAddr, uint16_t port, const KNXnetIP_TxFrameType * txFrame)
+{
+    (void)channelId;
+    (void)ipAddr;
+    (void)port;
+    (void)txFrame;
+
+    KNX_TEST_ASSERT(false);
+}
+
+void KNXnetIP_RoutingTP2IP(KnxFrameBuffer_HandleType frame)
+{
+    KnxFrameBuffer_Release(frame);
+}
+
+bool KnxGroupFilter_Pass(uint8_t direction, uint16_t groupAddr)
+{
+    (void)direction;
+    (void)groupAddr;
+
+    return true;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return (SemaphoreHandle_t)&Test_Doorbell;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    (void)semaphore;
+
+    return pdTRUE;
+}
+
+StatusType TpUart2_L_Data_Req(uint8_t channelId, bool repeatFlag, uint16_t destAddr, AddressType addrType, PriorityType priority, KnxFrameBuffer_HandleType frame, int64_t reqTimestampMs)
+{
+    (void)channelId;
+    (void)repeatFlag;
+    (void)destAddr;
+    (void)addrType;
+    (void)priority;
+    (void)frame;
+    (void)reqTimestampMs;
+
+    /* Nothing goes towards the bus in this test */
+    KNX_TEST_ASSERT(false);
+
+    return E_NOT_OK;
+}
+
+bool TpUart2_TxQueueFull(void)
+{
+    return false;
+}
+
+uint8_t TpUart2_TxQueueCount(void)
+{
+    return 0U;
+}
+
+int64_t KnxTpUart2_GetTimeMs()
+{
+    return Test_NowUs / 1000;
+}
+
+/*==================[internal function definitions]=========================*/
+static void Test_Setup(void)
+{
+    memset(Test_Clients, 0, sizeof(Test_Clients));
+    memset(Test_Channel, 0, sizeof(Test_Channel));
+    memset(Test_ChannelOpen, 0, sizeof(Test_ChannelOpen));
+
+    for (uint8_t index = 0; index <= TEST_CLIENT_NUM; index++)
+    {
+        Test_Clients[index].Sock = -1;
+        Test_Clients[index].LastFrame = -1;
+    }
+
+    Test_NowUs = 0;
+    Test_Accepted = 0U;
+    Test_BusFrames = 0U;
+    Test_ListenClosed = false;
+    Test_TaskDeleted = false;
+
+    KnxFrameBuffer_Init();
+    KNXnetIP_TunnellingInit();
+    TP_GW_Init();
+}
+
+static Test_ClientType * Test_Client(int sock)
+{
+    Test_ClientType * client = NULL;
+
+    for (uint8_t index = 0; (index <= TEST_CLIENT_NUM) && (NULL == client); index++)
+    {
+        if ((0 <= sock) && (sock == Test_Clients[index].Sock))
+        {
+            client = &Test_Clients[index];
+        }
+    }
+
+    return client;
+}
+
+static void Test_ConnectRequest(Test_ClientType * client)
+{
+    /* Tunnel on the link layer, the endpoints of a TCP client are all zero */
+    uint8_t * dataPtr = &client->Request[0];
+
+    memset(dataPtr, 0, TEST_CONNECT_REQUEST_LENGTH);
+    dataPtr[0] = HEADER_SIZE_10;
+    dataPtr[1] = KNXNETIP_VERSION_10;
+    dataPtr[2] = (uint8_t)(CONNECT_REQUEST >> 8);
+    dataPtr[3] = (uint8_t)(CONNECT_REQUEST & 0xFFU);
+    dataPtr[5] = TEST_CONNECT_REQUEST_LENGTH;
+    dataPtr[6] = 8U;
+    dataPtr[7] = IPV4_TCP;
+    dataPtr[14] = 8U;
+    dataPtr[15] = IPV4_TCP;
+    dataPtr[22] = 4U;
+    dataPtr[23] = TUNNEL_CONNECTION;
+    dataPtr[24] = 0x02U;
+
+    client->RequestLength = TEST_CONNECT_REQUEST_LENGTH;
+}
+
+static uint16_t Test_FrameLength(const Test_ClientType * client)
+{
+    /* Length of the complete frame at the front of the stream, 0 if it is not all there */
+    uint16_t length = 0U;
+
+    if (HEADER_SIZE_10 <= client->StreamLength)
+    {
+        length = ((uint16_t)client->Stream[4] << 8) | client->Stream[5];
+        KNX_TEST_ASSERT((HEADER_SIZE_10 == client->Stream[0]) && (HEADER_SIZE_10 <= length));
+
+        if (client->StreamLength < length)
+        {
+            length = 0U;
+        }
+    }
+
+    return length;
+}
+
+static void Test_ClientReceive(Test_ClientType * client)
+{
+    uint16_t length = Test_FrameLength(client);
+
+    /* Every complete frame of the stream, in order */
+    while (0U < length)
+    {
+        uint16_t serviceType = ((uint16_t)client->Stream[2] << 8) | client->Stream[3];
+
+        if (CONNECT_RESPONSE == serviceType)
+        {
+            KNX_TEST_ASSERT(KNX_CHANNEL_INVALID == client->ChannelId);
+            KNX_TEST_ASSERT(E_NO_ERROR == client->Stream[HEADER_SIZE_10 + 1U]);
+
+            client->ChannelId = client->Stream[HEADER_SIZE_10];
+        }
+        else
+        {
+            KNX_TEST_ASSERT(TUNNELLING_REQUEST == serviceType);
+            Test_TunnellingRequest(client, &client->Stream[0]);
+        }
+
+        memmove(&client->Stream[0], &client->Stream[length], client->StreamLength - length);
+        client->StreamLength -= length;
+        length = Test_FrameLength(client);
+    }
+}
+
+static void Test_TunnellingRequest(Test_ClientType * client, const uint8_t * dataPtr)
+{
+    /* The bus frame number rides in the data of the group write */
+    const uint8_t * cemiPtr = &dataPtr[HEADER_SIZE_10 + CONNECTION_HEADER_SIZE];
+    uint16_t destAddr = ((uint16_t)cemiPtr[CEMI_FRAME_DA_HI_BYTE_OFFET] << 8) | cemiPtr[CEMI_FRAME_DA_LO_BYTE_OFFET];
+    uint16_t frameNumber = ((uint16_t)cemiPtr[CEMI_FRAME_TPDU_FIELD_OFFSET + 2U] << 8) | cemiPtr[CEMI_FRAME_TPDU_FIELD_OFFSET + 3U];
+    int64_t latencyUs;
+
+    KNX_TEST_ASSERT((client->ChannelId == dataPtr[HEADER_SIZE_10 + 1U]) && (client->Sequence == dataPtr[HEADER_SIZE_10 + 2U]));
+    KNX_TEST_ASSERT(L_DATA_IND == cemiPtr[0]);
+    KNX_TEST_ASSERT((int32_t)frameNumber > client->LastFrame);
+    KNX_TEST_ASSERT(TEST_BUS_FRAMES > frameNumber);
+
+    /* A group write, or addressed to this tunnel */
+    KNX_TEST_ASSERT((0U != (cemiPtr[CEMI_FRAME_CTRL2_FIELD_OFFSET] & CTRLE_FIELD_ADDRESS_TYPE_MASK)) ?
+                    (TEST_GROUP_ADDR == destAddr) : (TEST_INDV_ADDR(client->ChannelId) == destAddr));
+
+    latencyUs = Test_NowUs - Test_BusTimeUs[MIN(frameNumber, TEST_BUS_FRAMES - 1U)];
+
+    client->Sequence++;
+    client->LastFrame = frameNumber;
+    client->Frames++;
+    client->LatencySumUs += latencyUs;
+    client->LatencyMaxUs = MAX(client->LatencyMaxUs, latencyUs);
+}
+
+static void Test_TxFrameLength(KNXnetIP_TxFrameType * txFrame)
+{
+    txFrame->Header[4] = (uint8_t)(txFrame->Length >> 8);
+    txFrame->Header[5] = (uint8_t)(txFrame->Length & 0xFFU);
+}
+
+static void Test_BusFrame(void)
+{
+    /* A TP frame as the TP-UART receives it, a point-to-point one goes to the tunnels in turn */
+    KnxFrameBuffer_HandleType frame = KnxFrameBuffer_Alloc();
+    bool group = (0U != (Test_BusFrames % TEST_P2P_PERIOD));
+    uint8_t target = (uint8_t)((Test_BusFrames / TEST_P2P_PERIOD) % TEST_CLIENT_NUM);
+    uint16_t destAddr = (true == group) ? TEST_GROUP_ADDR : TEST_INDV_ADDR(Test_Clients[target].ChannelId);
+    uint8_t * tpPtr;
+
+    KNX_TEST_ASSERT(KNX_FRAME_BUFFER_INVALID != frame);
+    tpPtr = KnxFrameBuffer_Frame(frame);
+
+    tpPtr[0] = 0xBCU;
+    tpPtr[1] = 0x11U;
+    tpPtr[2] = 0x05U;
+    tpPtr[3] = (uint8_t)(destAddr >> 8);
+    tpPtr[4] = (uint8_t)(destAddr & 0xFFU);
+    tpPtr[5] = ((true == group) ? LENGHT_FIELD_ADDRESS_TYPE_MASK : 0x00U) | 0x60U | 3U;
+    tpPtr[6] = 0x00U;
+    tpPtr[7] = 0x80U;
+    tpPtr[8] = (uint8_t)(Test_BusFrames >> 8);
+    tpPtr[9] = (uint8_t)(Test_BusFrames & 0xFFU);
+    tpPtr[10] = 0x00U;   /* FCS, checked by the TP-UART */
+    KnxFrameBuffer_Get(frame)->Length = 11U;
+
+    for (uint8_t index = 0; index < TEST_CLIENT_NUM; index++)
+    {
+        Test_Clients[index].Expected += ((true == group) || (target == index)) ? 1U : 0U;
+    }
+
+    Test_NowUs += TEST_BUS_PERIOD_US;
+    Test_BusTimeUs[Test_BusFrames] = Test_NowUs;
+    Test_BusFrames++;
+
+    /* The tpuart task hands it on, the TCP task is woken by its doorbell */
+    TP_GW_L_Data_Ind(frame);
+}
+
+static void Test_Load(void)
+{
+    int64_t latencyMaxUs = 0;
+    int64_t latencyAvgMaxUs = 0;
+
+    Test_Setup();
+
+    /* Runs until the virtual network has nothing left, then closes every connection */
+    tcp_server_task((void *)AF_INET);
+
+    KNX_TEST_ASSERT((true == Test_ListenClosed) && (true == Test_TaskDeleted));
+    KNX_TEST_ASSERT(TEST_BUS_FRAMES == Test_BusFrames);
+
+    /* The connection beyond the channels is closed at once */
+    KNX_TEST_ASSERT((TEST_CLIENT_NUM + 1U) == Test_Accepted);
+    KNX_TEST_ASSERT((true == Test_Clients[TEST_CLIENT_NUM].Closed) && (KNX_CHANNEL_INVALID == Test_Clients[TEST_CLIENT_NUM].ChannelId));
+
+    for (uint8_t index = 0; index < TEST_CLIENT_NUM; index++)
+    {
+        Test_ClientType * client = &Test_Clients[index];
+
+        /* A tunnel each, every frame meant for it delivered once, closed with the task */
+        KNX_TEST_ASSERT((CHANNEL_1 + index) == client->ChannelId);
+        KNX_TEST_ASSERT(client->Expected == client->Frames);
+        KNX_TEST_ASSERT((true == client->Closed) && (0U == client->StreamLength));
+        KNX_TEST_ASSERT(false == Test_ChannelOpen[index]);
+
+        if (TEST_SLOW_CLIENT == index)
+        {
+            /* Queued by the server while it did not read, sent once it does */
+            KNX_TEST_ASSERT(((TEST_STALL_FRAMES * TEST_BUS_PERIOD_US) + TEST_LATENCY_BOUND_US) >= client->LatencyMaxUs);
+        }
+        else
+        {
+            /* Not held up by the slow client nor by the tunnels before it */
+            KNX_TEST_ASSERT(TEST_LATENCY_BOUND_US >= client->LatencyMaxUs);
+
+            latencyMaxUs = MAX(latencyMaxUs, client->LatencyMaxUs);
+            latencyAvgMaxUs = MAX(latencyAvgMaxUs, client->LatencySumUs / MAX(client->Frames, 1U));
+        }
+    }
+
+    printf("Test_TcpTunnels: %u tunnels, %u bus frames, latency max %lld us (bound %d us), worst tunnel avg %lld us, slow client max %lld us\n",
+           TEST_CLIENT_NUM, TEST_BUS_FRAMES, (long long)latencyMaxUs, TEST_LATENCY_BOUND_US,
+           (long long)latencyAvgMaxUs, (long long)Test_Clients[TEST_SLOW_CLIENT].LatencyMaxUs);
+
+    /* Every frame buffer back in the pool */
+    KNX_TEST_ASSERT(0U == KnxFrameBuffer_Statistics()->InUse);
+}
+
+/*==================[end of file]===========================================*/
@@ -0,0 +1,988 @@
+/**
+ * \file Test_TpGwFairness.c
+ *
+ * \brief Knx Gateway Bus Sharing Host Test
+ *
+ * This file contains the host test of how the gateway shares the bus between
+ * tunnels. A virtual bus counted in byte-times takes the frames the gateway
+ * hands to the TP-UART. A greedy client must not hold up an interactive one,
+ * and a UDP client running ahead of the bus has its TUNNELLING_ACK withheld
+ * and released again once its frames drain. Frames left queued by a closed
+ * connection must not reach the next one on the same channel. High priority
+ * frames overtake the Normal ones of greedy clients, which still go out once
+ * they have waited past the aging time. A frame the TP-UART refuses, or a
+ * confirmation without a buffer for its copy, still confirms to the client,
+ * and a frame the group filter blocks is answered with a negative confirm.
+ * Frames that are no whole standard frame are refused
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include <stdio.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/param.h>
+
+#include "KNXnetIP.h"
+#include "KNXnetIP_Core.h"
+#include "KNXnetIP_Tunnelling.h"
+#include "KNXnetIP_UdpServer.h"
+#include "KNXnetIP_Routing.h"
+#include "KnxGroupFilter.h"
+#include "KnxFrameBuffer.h"
+#include "TP_DataLinkLayer.h"
+#include "TpUart2_DataLinkLayer.h"
+#include "KnxTpUart2_Services.h"
+#include "KnxTest.h"
+
+/*==================[macros]================================================*/
+/* Virtual bus time simulated per scenario */
+#define TEST_GW_BYTE_TIMES          (100000U)
+
+/* Bus time around a frame and the round robin quantum, as the gateway counts them */
+#define TEST_GW_BUS_OVERHEAD        (6U)
+#define TEST_GW_QUANTUM             (15U + TPUART2_STANDARD_FRAME_OVERHEAD + TEST_GW_BUS_OVERHEAD)
+#define TEST_GW_FEED_DEPTH          (3U)
+
+/* A byte-time on the bus, 13 bit-times at 9600 bit/s */
+#define TEST_GW_BYTE_TIME_US        (1354U)
+
+/* Byte-times after which a Normal priority frame is aged, rounding of the clock included */
+#define TEST_GW_AGING_BYTE_TIMES    (((500U * 1000U) / TEST_GW_BYTE_TIME_US) + 2U)
+
+/* Frames the greedy client keeps waiting, a full flow */
+#define TEST_GW_GREEDY_BACKLOG      (16U)
+
+/* Frames each of several greedy clients keeps waiting, together */
+/* they fit the ring of their network task                       */
+#define TEST_GW_SHARED_BACKLOG      (5U)
+
+/* The interactive client sends a short frame this often */
+#define TEST_GW_INTERACTIVE_PERIOD  (150U)
+
+/* Frames the TP-UART queue takes, as many as the real one */
+#define TEST_GW_BUS_QUEUE_LENGTH    (16U)
+
+#define TEST_GW_CHANNEL_GREEDY      (CHANNEL_1)
+#define TEST_GW_CHANNEL_INTERACTIVE (CHANNEL_1 + 1U)
+#define TEST_GW_CHANNEL_AHEAD       (CHANNEL_1 + 2U)
+#define TEST_GW_CHANNEL_GREEDY_2    (CHANNEL_1 + 3U)
+
+/*==================[type definitions]======================================*/
+typedef struct {
+    KnxFrameBuffer_HandleType Frame;
+    uint8_t ChannelId;
+} Test_GwBusFrameType;
+
+/* The TP-UART queue and the frame on the bus */
+typedef struct {
+    Test_GwBusFrameType Frame[TEST_GW_BUS_QUEUE_LENGTH];
+    uint8_t Head;
+    uint8_t Count;
+    bool Busy;              /* Head frame on the bus */
+    bool Refuse;            /* TpUart2_L_Data_Req refuses every frame */
+    uint32_t BusyUntil;
+    uint32_t IdleTimes;     /* Byte-times the bus had nothing to send */
+    uint32_t Frames[KNX_CHANNEL_NUM + 1U];
+} Test_GwBusType;
+
+typedef struct {
+    bool Open;
+    bool Waiting;           /* TUNNELLING_REQUEST sent, its TUNNELLING_ACK not yet in */
+    uint8_t Sequence;       /* Of the next TUNNELLING_REQUEST sent */
+    bool AckDue;            /* A TUNNELLING_REQUEST of the gateway to acknowledge */
+    uint8_t AckSequence;
+    uint32_t Requests;
+    uint32_t Acks;          /* TUNNELLING_ACKs received */
+    uint32_t Withheld;      /* Requests whose ack did not come with the answer */
+    uint32_t Confirms;      /* L_Data.con received */
+    uint32_t NegativeConfirms;
+} Test_GwClientType;
+
+/*==================[external function declarations]========================*/
+int main(void);
+
+/* Services around the gateway, replaced for the test */
+KNXnetIP_ChannelType * KNXnetIP_ChannelGet(uint8_t channelId);
+KNXnetIP_ChannelType * KNXnetIP_ChannelGetByIndvAddr(uint16_t indvAddr);
+void KNXnetIP_ChannelHeartbeat(KNXnetIP_ChannelType * channel);
+void KNXnetIP_ChannelDisconnect(KNXnetIP_ChannelType * channel);
+void KNXnetIP_TimerArm(uint8_t transport, KnxTimer_Type * timer, uint32_t delayMs);
+void KNXnetIP_TxFrameInit(KNXnetIP_TxFrameType * txFrame, uint16_t serviceType);
+void KNXnetIP_TxFrameConnectionHeader(KNXnetIP_TxFrameType * txFrame, uint8_t channelId, uint8_t sequenceCounter);
+void KNXnetIP_TxFrameAppend(KNXnetIP_TxFrameType * txFrame, const uint8_t * dataPtr, uint16_t length);
+void KNXnetIP_UDPDataSend(uint8_t channelId, uint32_t ipAddr, uint16_t port, const KNXnetIP_TxFrameType * txFrame);
+void KNXnetIP_TcpSend(const int sock, const KNXnetIP_TxFrameType * txFrame);
+void KNXnetIP_RoutingTP2IP(KnxFrameBuffer_HandleType frame);
+bool KnxGroupFilter_Pass(uint8_t direction, uint16_t groupAddr);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+StatusType TpUart2_L_Data_Req(uint8_t channelId, bool repeatFlag, uint16_t destAddr, AddressType addrType, PriorityType priority, KnxFrameBuffer_HandleType frame, int64_t reqTimestampMs);
+bool TpUart2_TxQueueFull(void);
+uint8_t TpUart2_TxQueueCount(void);
+int64_t KnxTpUart2_GetTimeMs();
+
+/*==================[internal function declarations]========================*/
+static void Test_GwSetup(void);
+static void Test_GwOpen(uint8_t channelId, KNXnetIP_HostProtocolCodeTpe protocol);
+static void Test_GwReconnect(uint8_t channelId, KNXnetIP_HostProtocolCodeTpe protocol);
+static bool Test_GwRequest(uint8_t channelId, uint8_t lg, PriorityType priority);
+static void Test_GwClientReceive(uint8_t channelId, const KNXnetIP_TxFrameType * txFrame);
+static void Test_GwNetwork(void);
+static void Test_GwBusComplete(void);
+static void Test_GwBusStart(void);
+static void Test_GwStep(void);
+static void Test_Fairness(void);
+static void Test_AckWithhold(void);
+static void Test_Reconnect(void);
+static void Test_Priority(void);
+static void Test_Aging(void);
+static void Test_Refused(void);
+static void Test_Filtered(void);
+static void Test_Invalid(void);
+static StatusType Test_GwInvalidRequest(uint8_t lg, uint16_t length);
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+static uint32_t Test_Now;   /* Byte-times */
+
+static KNXnetIP_ChannelType Test_Channel[KNX_CHANNEL_NUM];
+static Test_GwClientType Test_Client[KNX_CHANNEL_NUM];
+static Test_GwBusType Test_Bus;
+static int Test_Doorbell;
+
+/* Arrival of the interactive frames not yet on the bus, they keep their order */
+static uint32_t Test_Arrival[TEST_GW_BUS_QUEUE_LENGTH * 2U];
+static uint8_t Test_ArrivalHead;
+static uint8_t Test_ArrivalCount;
+static uint32_t Test_WaitMax;
+static uint32_t Test_Disconnects;
+static uint32_t Test_Routed;
+
+/* Group address the filter blocks towards the bus, 0 for none */
+static uint16_t Test_BlockedGroupAddr;
+static uint32_t Test_FilterCalls;
+
+/* Longest time from TP_GW_L_Data_Req to the TP-UART queue, as given to it */
+static int64_t Test_QueueWaitMaxMs[KNX_CHANNEL_NUM + 1U];
+
+/* Withheld acks the network task has to release on its next run */
+static bool Test_ReleaseDue[KNX_CHANNEL_NUM];
+
+/*==================[external function definitions]=========================*/
+int main(void)
+{
+    Test_Fairness();
+    Test_AckWithhold();
+    Test_Reconnect();
+    Test_Priority();
+    Test_Aging();
+    Test_Refused();
+    Test_Filtered();
+    Test_Invalid();
+
+    return KnxTest_Result("Test_TpGwFairness");
+}
+
+KNXnetIP_ChannelType * KNXnetIP_ChannelGet(uint8_t channelId)
+{
+    KNXnetIP_ChannelType * channel = NULL;
+
+    if ((CHANNEL_1 <= channelId) && (KNX_CHANNEL_NUM >= channelId) && (true == Test_Client[channelId - CHANNEL_1].Open))
+    {
+        channel = &Test_Channel[channelId - CHANNEL_1];
+    }
+
+    return channel;
+}
+
+KNXnetIP_ChannelType * KNXnetIP_ChannelGetByIndvAddr(uint16_t indvAddr)
+{
+    (void)indvAddr;
+
+    return NULL;
+}
+
+void KNXnetIP_ChannelHeartbeat(KNXnetIP_ChannelType * channel)
+{
+    (void)channel;
+}
+
+void KNXnetIP_ChannelDisconnect(KNXnetIP_ChannelType * channel)
+{
+    /* Only after an ack timeout, which the virtual clients never give reason to */
+    (void)channel;
+
+    Test_Disconnects++;
+}
+
+void KNXnetIP_TimerArm(uint8_t transport, KnxTimer_Type * timer, uint32_t delayMs)
+{
+    (void)transport;
+    (void)timer;
+    (void)delayMs;
+}
+
+void KNXnetIP_TxFrameInit(KNXnetIP_TxFrameType * txFrame, uint16_t serviceType)
+{
+    memset(txFrame, 0, sizeof(KNXnetIP_TxFrameType));
+
+    txFrame->Header[2] = (uint8_t)(serviceType >> 8);
+    txFrame->Header[3] = (uint8_t)(serviceType & 0xFFU);
+    txFrame->HeaderLength = HEADER_SIZE_10;
+    txFrame->Length = HEADER_SIZE_10;
+}
+
+void KNXnetIP_TxFrameConnectionHeader(KNXnetIP_TxFrameType * txFrame, uint8_t channelId, uint8_t sequenceCounter)
+{
+    txFrame->Header[HEADER_SIZE_10] = CONNECTION_HEADER_SIZE;
+    txFrame->Header[HEADER_SIZE_10 + 1U] = channelId;
+    txFrame->Header[HEADER_SIZE_10 + 2U] = sequenceCounter;
+    txFrame->HeaderLength = HEADER_SIZE_10 + CONNECTION_HEADER_SIZE;
+    txFrame->Length += CONNECTION_HEADER_SIZE;
+}
+
+void KNXnetIP_TxFrameAppend(KNXnetIP_TxFrameType * txFrame, const uint8_t * dataPtr, uint16_t length)
+{
+    txFrame->Segment[txFrame->SegmentCount].DataPtr = dataPtr;
+    txFrame->Segment[txFrame->SegmentCount].Length = length;
+    txFrame->SegmentCount++;
+    txFrame->Length += length;
+}
+
+void KNXnetIP_UDPDataSend(uint8_t channelId, uint32_t ipAddr, uint16_t port, const KNXnetIP_TxFrameType * txFrame)
+{
+    (void)ipAddr;
+    (void)port;
+
+    Test_GwClientReceive(channelId, txFrame);
+}
+
+void KNXnetIP_TcpSend(const int sock, const KNXnetIP_TxFrameType * txFrame)
+{
+    Test_GwClientReceive((uint8_t)sock, txFrame);
+}
+
+void KNXnetIP_RoutingTP2IP(KnxFrameBuffer_HandleType frame)
+{
+    Test_Routed++;
+    KnxFrameBuffer_Release(frame);
+}
+
+bool KnxGroupFilter_Pass(uint8_t direction, uint16_t groupAddr)
+{
+    KNX_TEST_ASSERT(KNX_GROUP_FILTER_IP_TO_TP == direction);
+
+    Test_FilterCalls++;
+
+    return ((0U == Test_BlockedGroupAddr) || (Test_BlockedGroupAddr != groupAddr));
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return (SemaphoreHandle_t)&Test_Doorbell;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    (void)semaphore;
+
+    Test_Doorbell++;
+
+    return pdTRUE;
+}
+
+StatusType TpUart2_L_Data_Req(uint8_t channelId, bool repeatFlag, uint16_t destAddr, AddressType addrType, PriorityType priority, KnxFrameBuffer_HandleType frame, int64_t reqTimestampMs)
+{
+    StatusType status = E_NOT_OK;
+
+    (void)repeatFlag;
+    (void)destAddr;
+    (void)addrType;
+    (void)priority;
+
+    /* Requested at the gateway, not when handed on */
+    KNX_TEST_ASSERT(KnxTpUart2_GetTimeMs() >= reqTimestampMs);
+    Test_QueueWaitMaxMs[channelId] = MAX(Test_QueueWaitMaxMs[channelId], KnxTpUart2_GetTimeMs() - reqTimestampMs);
+
+    if ((false == Test_Bus.Refuse) && (TEST_GW_BUS_QUEUE_LENGTH > Test_Bus.Count))
+    {
+        Test_GwBusFrameType * entry = &Test_Bus.Frame[(Test_Bus.Head + Test_Bus.Count) % TEST_GW_BUS_QUEUE_LENGTH];
+
+        entry->Frame = frame;
+        entry->ChannelId = channelId;
+        Test_Bus.Count++;
+
+        status = E_OK;
+    }
+
+    return status;
+}
+
+bool TpUart2_TxQueueFull(void)
+{
+    return (TEST_GW_BUS_QUEUE_LENGTH <= Test_Bus.Count);
+}
+
+uint8_t TpUart2_TxQueueCount(void)
+{
+    return Test_Bus.Count;
+}
+
+int64_t KnxTpUart2_GetTimeMs()
+{
+    return ((int64_t)Test_Now * TEST_GW_BYTE_TIME_US) / 1000;
+}
+
+/*==================[internal function definitions]=========================*/
+static void Test_GwSetup(void)
+{
+    for (uint8_t transport = 0; transport < KNXNETIP_TRANSPORT_NUM; transport++)
+    {
+        if (0 <= KNXnetIP_TunnellingDoorbell(transport))
+        {
+            close(KNXnetIP_TunnellingDoorbell(transport));
+        }
+    }
+
+    memset(Test_Channel, 0, sizeof(Test_Channel));
+    memset(Test_Client, 0, sizeof(Test_Client));
+    memset(&Test_Bus, 0, sizeof(Test_Bus));
+    Test_Now = 0U;
+    Test_ArrivalHead = 0U;
+    Test_ArrivalCount = 0U;
+    Test_WaitMax = 0U;
+    Test_Disconnects = 0U;
+    Test_Routed = 0U;
+    Test_BlockedGroupAddr = 0U;
+    Test_FilterCalls = 0U;
+    memset(Test_ReleaseDue, 0, sizeof(Test_ReleaseDue));
+    memset(Test_QueueWaitMaxMs, 0, sizeof(Test_QueueWaitMaxMs));
+
+    KnxFrameBuffer_Init();
+    KNXnetIP_TunnellingInit();
+    TP_GW_Init();
+}
+
+static void Test_GwOpen(uint8_t channelId, KNXnetIP_HostProtocolCodeTpe protocol)
+{
+    KNXnetIP_ChannelType * channel = &Test_Channel[channelId - CHANNEL_1];
+
+    channel->ChannelId = channelId;
+    channel->ConnectionType = TUNNEL_CONNECTION;
+    channel->Protocol = protocol;
+    channel->Socket = (IPV4_TCP == protocol) ? channelId : -1;
+    channel->IndvAddr = 0x1100U + channelId;
+
+    Test_Client[channelId - CHANNEL_1].Open = true;
+}
+
+static void Test_GwReconnect(uint8_t channelId, KNXnetIP_HostProtocolCodeTpe protocol)
+{
+    /* The channel goes to the next client the moment it is free, */
+    /* KNXnetIP_ChannelAlloc counts the generation up              */
+    uint8_t generation = Test_Channel[channelId - CHANNEL_1].Generation;
+
+    memset(&Test_Channel[channelId - CHANNEL_1], 0, sizeof(KNXnetIP_ChannelType));
+    memset(&Test_Client[channelId - CHANNEL_1], 0, sizeof(Test_GwClientType));
+    Test_Bus.Frames[channelId] = 0U;
+
+    Test_GwOpen(channelId, protocol);
+    Test_Channel[channelId - CHANNEL_1].Generation = generation + 1U;
+}
+
+static bool Test_GwRequest(uint8_t channelId, uint8_t lg, PriorityType priority)
+{
+    /* The client sends a group write, the UDP task takes it in the way */
+    /* IP_DataLinkLayer does with a TUNNELLING_REQUEST                   */
+    Test_GwClientType * client = &Test_Client[channelId - CHANNEL_1];
+    KnxFrameBuffer_HandleType frame = KnxFrameBuffer_Alloc();
+    bool sent = false;
+
+    if (KNX_FRAME_BUFFER_INVALID != frame)
+    {
+        uint8_t * cemiPtr = KnxFrameBuffer_Frame(frame);
+
+        memset(cemiPtr, 0, KNX_FRAME_BUFFER_CEMI_MAX);
+        cemiPtr[0] = L_DATA_REQ;
+        cemiPtr[CEMI_FRAME_CTRL1_FIELD_OFFSET] = 0xB0U | (uint8_t)(priority << CTRL_FIELD_PRIORITY_OFFSET);
+        cemiPtr[CEMI_FRAME_CTRL2_FIELD_OFFSET] = CTRLE_FIELD_ADDRESS_TYPE_MASK;
+        cemiPtr[CEMI_FRAME_DA_HI_BYTE_OFFET] = 0x08U;
+        cemiPtr[CEMI_FRAME_DA_LO_BYTE_OFFET] = channelId;
+        cemiPtr[CEMI_FRAME_LENGTH_FIELD_OFFSET] = lg;
+        KnxFrameBuffer_Get(frame)->Length = CEMI_FRAME_TPDU_FIELD_OFFSET + lg + 1U;
+
+        client->Requests++;
+        KNXnetIP_TunnelIP2TP(channelId, frame);
+
+        if (IPV4_UDP != Test_Channel[channelId - CHANNEL_1].Protocol)
+        {
+            /* No acks over TCP */
+        }
+        else if (TP_GW_ACK_WITHHOLD_DEPTH <= TP_GW_ChannelBacklog(channelId))
+        {
+            /* The client waits until the backlog drains */
+            KNXnetIP_TunnellingAckWithhold(channelId, client->Sequence);
+            client->Withheld++;
+            client->Waiting = true;
+        }
+        else
+        {
+            client->Acks++;
+        }
+
+        client->Sequence++;
+        sent = true;
+    }
+
+    return sent;
+}
+
+static void Test_GwClientReceive(uint8_t channelId, const KNXnetIP_TxFrameType * txFrame)
+{
+    Test_GwClientType * client = &Test_Client[channelId - CHANNEL_1];
+    uint16_t serviceType = ((uint16_t)txFrame->Header[2] << 8) | txFrame->Header[3];
+    uint8_t sequenceCounter = txFrame->Header[HEADER_SIZE_10 + 2U];
+
+    if (TUNNELLING_ACK == serviceType)
+    {
+        /* The ack of the request the client waits for */
+        KNX_TEST_ASSERT(true == client->Waiting);
+        KNX_TEST_ASSERT((uint8_t)(client->Sequence - 1U) == sequenceCounter);
+
+        client->Acks++;
+        client->Waiting = false;
+    }
+    else if (TUNNELLING_REQUEST == serviceType)
+    {
+        const uint8_t * cemiPtr = txFrame->Segment[0].DataPtr;
+
+        if (L_DATA_CON == cemiPtr[0])
+        {
+            client->Confirms++;
+
+            if (0U != (cemiPtr[CEMI_FRAME_CTRL1_FIELD_OFFSET] & CEMI_FRAME_CTRL1_CONFIRM_ERROR))
+            {
+                client->NegativeConfirms++;
+            }
+        }
+
+        /* Acknowledged from the client's next turn */
+        client->AckDue = true;
+        client->AckSequence = sequenceCounter;
+    }
+    else
+    {
+        KNX_TEST_ASSERT(false);
+    }
+}
+
+static void Test_GwNetwork(void)
+{
+    /* The network tasks run once their doorbell rings */
+    for (uint8_t transport = 0; transport < KNXNETIP_TRANSPORT_NUM; transport++)
+    {
+        struct pollfd doorbell = { .fd = KNXnetIP_TunnellingDoorbell(transport), .events = POLLIN, .revents = 0 };
+
+        if (1 == poll(&doorbell, 1U, 0))
+        {
+            KNXnetIP_TunnellingMainFunction(transport);
+        }
+    }
+
+    for (uint8_t channelId = CHANNEL_1; channelId <= KNX_CHANNEL_NUM; channelId++)
+    {
+        Test_GwClientType * client = &Test_Client[channelId - CHANNEL_1];
+
+        if (true == client->AckDue)
+        {
+            client->AckDue = false;
+            KNXnetIP_TunnellingAckReceived(channelId, client->AckSequence, E_NO_ERROR);
+        }
+
+        /* A backlog drained by the frames of another tunnel rings no    */
+        /* doorbell but through KNXnetIP_TunnellingResume, the ack has to */
+        /* be out all the same                                            */
+        KNX_TEST_ASSERT((false == Test_ReleaseDue[channelId - CHANNEL_1]) || (false == client->Waiting));
+        Test_ReleaseDue[channelId - CHANNEL_1] = false;
+    }
+}
+
+static void Test_GwBusComplete(void)
+{
+    if ((true == Test_Bus.Busy) && (Test_Now >= Test_Bus.BusyUntil))
+    {
+        Test_GwBusFrameType entry = Test_Bus.Frame[Test_Bus.Head];
+
+        Test_Bus.Head = (Test_Bus.Head + 1U) % TEST_GW_BUS_QUEUE_LENGTH;
+        Test_Bus.Count--;
+        Test_Bus.Busy = false;
+        Test_Bus.Frames[entry.ChannelId]++;
+
+        TP_GW_L_Data_Con(entry.ChannelId, entry.Frame, true);
+    }
+}
+
+static void Test_GwBusStart(void)
+{
+    if ((false == Test_Bus.Busy) && (0U < Test_Bus.Count))
+    {
+        Test_GwBusFrameType * entry = &Test_Bus.Frame[Test_Bus.Head];
+        uint8_t lg = KnxFrameBuffer_Frame(entry->Frame)[TPUART2_STANDARD_LENGTH_OFFSET] & LENGTH_FIELD_LG_MASK;
+
+        Test_Bus.Busy = true;
+        Test_Bus.BusyUntil = Test_Now + lg + TPUART2_STANDARD_FRAME_OVERHEAD + TEST_GW_BUS_OVERHEAD;
+
+        if (TEST_GW_CHANNEL_INTERACTIVE == entry->ChannelId)
+        {
+            Test_WaitMax = MAX(Test_WaitMax, Test_Now - Test_Arrival[Test_ArrivalHead]);
+            Test_ArrivalHead = (Test_ArrivalHead + 1U) % (TEST_GW_BUS_QUEUE_LENGTH * 2U);
+            Test_ArrivalCount--;
+        }
+    }
+    else if (false == Test_Bus.Busy)
+    {
+        Test_Bus.IdleTimes++;
+    }
+    else
+    {
+        /* A frame on the bus */
+    }
+}
+
+static void Test_GwStep(void)
+{
+    /* One byte-time: network tasks, the tpuart task, then the bus */
+    Test_GwNetwork();
+    Test_GwBusComplete();
+    TP_GW_MainFunction();
+    Test_GwBusStart();
+
+    for (uint8_t channelId = CHANNEL_1; channelId <= KNX_CHANNEL_NUM; channelId++)
+    {
+        Test_ReleaseDue[channelId - CHANNEL_1] = (true == Test_Client[channelId - CHANNEL_1].Waiting) &&
+                                                 (TP_GW_ACK_WITHHOLD_DEPTH > TP_GW_ChannelBacklog(channelId));
+    }
+
+    Test_Now++;
+}
+
+static void Test_Fairness(void)
+{
+    /* Tunnel 1 is greedy: over TCP, it keeps its flow full of the longest  */
+    /* standard frames. Tunnel 2 is interactive: one short frame every      */
+    /* TEST_GW_INTERACTIVE_PERIOD. Its wait for the bus stays below the     */
+    /* frames the TP-UART already holds plus one quantum of the greedy flow */
+    const uint32_t bound = (TEST_GW_FEED_DEPTH + 1U) * TEST_GW_QUANTUM;
+    uint32_t nextInteractive = 0U;
+    uint32_t interactive = 0U;
+
+    Test_GwSetup();
+    Test_GwOpen(TEST_GW_CHANNEL_GREEDY, IPV4_TCP);
+    Test_GwOpen(TEST_GW_CHANNEL_INTERACTIVE, IPV4_UDP);
+
+    while (TEST_GW_BYTE_TIMES > Test_Now)
+    {
+        bool sent = true;
+
+        while ((true == sent) && (TEST_GW_GREEDY_BACKLOG > TP_GW_ChannelBacklog(TEST_GW_CHANNEL_GREEDY)))
+        {
+            sent = Test_GwRequest(TEST_GW_CHANNEL_GREEDY, 15U, LowPriority);
+        }
+
+        if (nextInteractive <= Test_Now)
+        {
+            Test_Arrival[(Test_ArrivalHead + Test_ArrivalCount) % (TEST_GW_BUS_QUEUE_LENGTH * 2U)] = Test_Now;
+            Test_ArrivalCount++;
+
+            KNX_TEST_ASSERT(true == Test_GwRequest(TEST_GW_CHANNEL_INTERACTIVE, 1U, LowPriority));
+            nextInteractive += TEST_GW_INTERACTIVE_PERIOD;
+            interactive++;
+        }
+
+        Test_GwStep();
+    }
+
+    printf("Test_TpGwFairness: greedy %lu frames, interactive %lu frames, wait max %lu byte-times, bound %lu\n",
+           (unsigned long)Test_Bus.Frames[TEST_GW_CHANNEL_GREEDY],
+           (unsigned long)Test_Bus.Frames[TEST_GW_CHANNEL_INTERACTIVE],
+           (unsigned long)Test_WaitMax,
+           (unsigned long)bound);
+
+    KNX_TEST_ASSERT(bound >= Test_WaitMax);
+    KNX_TEST_ASSERT(0U == Test_Client[TEST_GW_CHANNEL_INTERACTIVE - CHANNEL_1].NegativeConfirms);
+    KNX_TEST_ASSERT(interactive <= (Test_Bus.Frames[TEST_GW_CHANNEL_INTERACTIVE] + Test_ArrivalCount + 1U));
+
+    /* The greedy client has the rest of the bus, which is never idle */
+    KNX_TEST_ASSERT(TEST_GW_FEED_DEPTH >= Test_Bus.IdleTimes);
+
+    /* Waiting times count from the request, the greedy frames wait in their flow */
+    KNX_TEST_ASSERT(((int64_t)TEST_GW_GREEDY_BACKLOG * TEST_GW_QUANTUM * TEST_GW_BYTE_TIME_US / 2000) < Test_QueueWaitMaxMs[TEST_GW_CHANNEL_GREEDY]);
+    KNX_TEST_ASSERT((Test_Bus.Frames[TEST_GW_CHANNEL_GREEDY] * TEST_GW_QUANTUM) >
+                    (TEST_GW_BYTE_TIMES - (TEST_GW_BYTE_TIMES / TEST_GW_INTERACTIVE_PERIOD * (1U + TPUART2_STANDARD_FRAME_OVERHEAD + TEST_GW_BUS_OVERHEAD)) - TEST_GW_QUANTUM * TEST_GW_FEED_DEPTH));
+    KNX_TEST_ASSERT(0U == Test_Disconnects);
+}
+
+static void Test_AckWithhold(void)
+{
+    /* Tunnel 3 sends its next request as soon as it has the ack of the */
+    /* last one, far faster than the bus takes them. Its acks are held   */
+    /* back at TP_GW_ACK_WITHHOLD_DEPTH frames waiting, and released as  */
+    /* the bus drains them, so the bus keeps going and nothing is lost.  */
+    /* The greedy tunnel shares the bus, its frames make way for tunnel  */
+    /* 3 without an L_Data.con of tunnel 3 to wake the UDP task          */
+    Test_GwClientType * client = &Test_Client[TEST_GW_CHANNEL_AHEAD - CHANNEL_1];
+    unsigned int backlogMax = 0U;
+
+    Test_GwSetup();
+    Test_GwOpen(TEST_GW_CHANNEL_GREEDY, IPV4_TCP);
+    Test_GwOpen(TEST_GW_CHANNEL_AHEAD, IPV4_UDP);
+
+    while (TEST_GW_BYTE_TIMES > Test_Now)
+    {
+        bool sent = true;
+
+        while ((true == sent) && (TEST_GW_GREEDY_BACKLOG > TP_GW_ChannelBacklog(TEST_GW_CHANNEL_GREEDY)))
+        {
+            sent = Test_GwRequest(TEST_GW_CHANNEL_GREEDY, 15U, LowPriority);
+        }
+
+        if (false == client->Waiting)
+        {
+            KNX_TEST_ASSERT(true == Test_GwRequest(TEST_GW_CHANNEL_AHEAD, 15U, LowPriority));
+            backlogMax = MAX(backlogMax, TP_GW_ChannelBacklog(TEST_GW_CHANNEL_AHEAD));
+        }
+
+        Test_GwStep();
+    }
+
+    /* The last requests drain */
+    while ((0U < Test_Bus.Count) || (true == client->Waiting) || (true == client->AckDue))
+    {
+        Test_GwStep();
+    }
+    Test_GwNetwork();
+
+    printf("Test_TpGwFairness: %lu requests, %lu acks withheld, backlog max %u\n",
+           (unsigned long)client->Requests,
+           (unsigned long)client->Withheld,
+           backlogMax);
+
+    KNX_TEST_ASSERT(0U < client->Withheld);
+    KNX_TEST_ASSERT(client->Requests == client->Acks);
+    KNX_TEST_ASSERT(TP_GW_ACK_WITHHOLD_DEPTH >= backlogMax);
+    KNX_TEST_ASSERT(client->Requests == Test_Bus.Frames[TEST_GW_CHANNEL_AHEAD]);
+    KNX_TEST_ASSERT(client->Requests == client->Confirms);
+    KNX_TEST_ASSERT(0U == client->NegativeConfirms);
+    KNX_TEST_ASSERT(0U == TP_GW_ChannelBacklog(TEST_GW_CHANNEL_AHEAD));
+    KNX_TEST_ASSERT(0U == Test_Disconnects);
+
+    /* Released in time, the client kept up with its half of the bus */
+    KNX_TEST_ASSERT((client->Requests * 5U) > (Test_Bus.Frames[TEST_GW_CHANNEL_GREEDY] * 4U));
+}
+
+static void Test_Reconnect(void)
+{
+    /* Tunnel 1 fills its flow over TCP and drops the connection. A UDP */
+    /* client gets the channel at once and sends a single frame. None   */
+    /* of the old frames may go out with its address or confirm to it, */
+    /* only those the TP-UART already holds still reach the bus          */
+    Test_GwClientType * client = &Test_Client[TEST_GW_CHANNEL_GREEDY - CHANNEL_1];
+    bool sent = true;
+
+    Test_GwSetup();
+    Test_GwOpen(TEST_GW_CHANNEL_GREEDY, IPV4_TCP);
+
+    while ((true == sent) && (TEST_GW_GREEDY_BACKLOG > TP_GW_ChannelBacklog(TEST_GW_CHANNEL_GREEDY)))
+    {
+        sent = Test_GwRequest(TEST_GW_CHANNEL_GREEDY, 15U, LowPriority);
+    }
+
+    while (TEST_GW_QUANTUM > Test_Now)
+    {
+        Test_GwStep();
+    }
+
+    Test_GwReconnect(TEST_GW_CHANNEL_GREEDY, IPV4_UDP);
+    KNX_TEST_ASSERT(true == Test_GwRequest(TEST_GW_CHANNEL_GREEDY, 1U, LowPriority));
+
+    while ((0U < Test_Bus.Count) || (true == client->Waiting) || (true == client->AckDue))
+    {
+        Test_GwStep();
+    }
+    Test_GwNetwork();
+
+    KNX_TEST_ASSERT((1U + TEST_GW_FEED_DEPTH) >= Test_Bus.Frames[TEST_GW_CHANNEL_GREEDY]);
+    KNX_TEST_ASSERT(1U == client->Acks);
+    KNX_TEST_ASSERT(1U == client->Confirms);
+    KNX_TEST_ASSERT(0U == client->NegativeConfirms);
+    KNX_TEST_ASSERT(0U == TP_GW_ChannelBacklog(TEST_GW_CHANNEL_GREEDY));
+    KNX_TEST_ASSERT(0U == KnxFrameBuffer_Statistics()->InUse);
+}
+
+static void Test_Priority(void)
+{
+    /* Tunnels 1, 3 and 4 are greedy with Normal priority frames, tunnel 2  */
+    /* sends High priority ones. These overtake the round robin, they wait */
+    /* only for the frames the TP-UART already holds                       */
+    static const uint8_t greedy[] = { TEST_GW_CHANNEL_GREEDY, TEST_GW_CHANNEL_AHEAD, TEST_GW_CHANNEL_GREEDY_2 };
+    const uint32_t bound = TEST_GW_FEED_DEPTH * TEST_GW_QUANTUM;
+    uint32_t nextInteractive = 0U;
+
+    Test_GwSetup();
+    Test_GwOpen(TEST_GW_CHANNEL_INTERACTIVE, IPV4_UDP);
+
+    for (uint8_t index = 0; index < sizeof(greedy); index++)
+    {
+        Test_GwOpen(greedy[index], IPV4_TCP);
+    }
+
+    while (TEST_GW_BYTE_TIMES > Test_Now)
+    {
+        for (uint8_t index = 0; index < sizeof(greedy); index++)
+        {
+            bool sent = true;
+
+            while ((true == sent) && (TEST_GW_SHARED_BACKLOG > TP_GW_ChannelBacklog(greedy[index])))
+            {
+                sent = Test_GwRequest(greedy[index], 15U, LowPriority);
+            }
+        }
+
+        if (nextInteractive <= Test_Now)
+        {
+            Test_Arrival[(Test_ArrivalHead + Test_ArrivalCount) % (TEST_GW_BUS_QUEUE_LENGTH * 2U)] = Test_Now;
+            Test_ArrivalCount++;
+
+            KNX_TEST_ASSERT(true == Test_GwRequest(TEST_GW_CHANNEL_INTERACTIVE, 1U, NormalPriority));
+            nextInteractive += TEST_GW_INTERACTIVE_PERIOD;
+        }
+
+        Test_GwStep();
+    }
+
+    printf("Test_TpGwFairness: high priority %lu frames among %u greedy tunnels, wait max %lu byte-times, bound %lu\n",
+           (unsigned long)Test_Bus.Frames[TEST_GW_CHANNEL_INTERACTIVE],
+           (unsigned)sizeof(greedy),
+           (unsigned long)Test_WaitMax,
+           (unsigned long)bound);
+
+    KNX_TEST_ASSERT(bound >= Test_WaitMax);
+    KNX_TEST_ASSERT(0U == Test_Client[TEST_GW_CHANNEL_INTERACTIVE - CHANNEL_1].NegativeConfirms);
+
+    /* The greedy tunnels still share the rest of the bus */
+    for (uint8_t index = 1U; index < sizeof(greedy); index++)
+    {
+        KNX_TEST_ASSERT((Test_Bus.Frames[greedy[0]] * 5U) > (Test_Bus.Frames[greedy[index]] * 4U));
+        KNX_TEST_ASSERT((Test_Bus.Frames[greedy[index]] * 5U) > (Test_Bus.Frames[greedy[0]] * 4U));
+    }
+}
+
+static void Test_Aging(void)
+{
+    /* Tunnel 1 keeps its flow full of High priority frames, tunnel 2 sends */
+    /* a Normal priority frame now and then. It is not starved: once aged, */
+    /* it takes turns with the High priority flow                          */
+    const uint32_t bound = TEST_GW_AGING_BYTE_TIMES + ((TEST_GW_FEED_DEPTH + 1U) * TEST_GW_QUANTUM);
+    uint32_t nextInteractive = 0U;
+    uint32_t interactive = 0U;
+
+    Test_GwSetup();
+    Test_GwOpen(TEST_GW_CHANNEL_GREEDY, IPV4_TCP);
+    Test_GwOpen(TEST_GW_CHANNEL_INTERACTIVE, IPV4_UDP);
+
+    while (TEST_GW_BYTE_TIMES > Test_Now)
+    {
+        bool sent = true;
+
+        while ((true == sent) && (TEST_GW_GREEDY_BACKLOG > TP_GW_ChannelBacklog(TEST_GW_CHANNEL_GREEDY)))
+        {
+            sent = Test_GwRequest(TEST_GW_CHANNEL_GREEDY, 15U, NormalPriority);
+        }
+
+        if (nextInteractive <= Test_Now)
+        {
+            Test_Arrival[(Test_ArrivalHead + Test_ArrivalCount) % (TEST_GW_BUS_QUEUE_LENGTH * 2U)] = Test_Now;
+            Test_ArrivalCount++;
+
+            KNX_TEST_ASSERT(true == Test_GwRequest(TEST_GW_CHANNEL_INTERACTIVE, 1U, LowPriority));
+            nextInteractive += TEST_GW_INTERACTIVE_PERIOD;
+            interactive++;
+        }
+
+        Test_GwStep();
+    }
+
+    printf("Test_TpGwFairness: normal priority %lu of %lu frames behind a high priority stream, wait max %lu byte-times, bound %lu\n",
+           (unsigned long)Test_Bus.Frames[TEST_GW_CHANNEL_INTERACTIVE],
+           (unsigned long)interactive,
+           (unsigned long)Test_WaitMax,
+           (unsigned long)bound);
+
+    KNX_TEST_ASSERT(bound >= Test_WaitMax);
+    KNX_TEST_ASSERT(TEST_GW_AGING_BYTE_TIMES <= (Test_WaitMax + TEST_GW_QUANTUM));
+    KNX_TEST_ASSERT(interactive <= (Test_Bus.Frames[TEST_GW_CHANNEL_INTERACTIVE] + Test_ArrivalCount + 1U));
+    KNX_TEST_ASSERT(Test_ArrivalCount <= ((bound / TEST_GW_INTERACTIVE_PERIOD) + 1U));
+    KNX_TEST_ASSERT(0U == Test_Client[TEST_GW_CHANNEL_INTERACTIVE - CHANNEL_1].NegativeConfirms);
+}
+
+static void Test_Refused(void)
+{
+    /* A frame the TP-UART does not take is answered with a negative */
+    /* L_Data.con, its buffer goes back to the pool                  */
+    Test_GwClientType * client = &Test_Client[TEST_GW_CHANNEL_INTERACTIVE - CHANNEL_1];
+    KnxFrameBuffer_HandleType hoard[KNX_FRAME_BUFFER_NUM];
+    uint8_t hoarded = 0U;
+
+    Test_GwSetup();
+    Test_GwOpen(TEST_GW_CHANNEL_INTERACTIVE, IPV4_UDP);
+
+    Test_Bus.Refuse = true;
+    KNX_TEST_ASSERT(true == Test_GwRequest(TEST_GW_CHANNEL_INTERACTIVE, 1U, LowPriority));
+
+    while ((0U == client->Confirms) && (TEST_GW_QUANTUM > Test_Now))
+    {
+        Test_GwStep();
+    }
+    Test_GwStep();
+
+    KNX_TEST_ASSERT((1U == client->Confirms) && (1U == client->NegativeConfirms));
+    KNX_TEST_ASSERT(0U == Test_Bus.Frames[TEST_GW_CHANNEL_INTERACTIVE]);
+    KNX_TEST_ASSERT(0U == TP_GW_ChannelBacklog(TEST_GW_CHANNEL_INTERACTIVE));
+    KNX_TEST_ASSERT(0U == KnxFrameBuffer_Statistics()->InUse);
+
+    /* The pool runs dry while the frame is on the bus: no copy for the */
+    /* routing indication, the confirmation goes out all the same        */
+    Test_Bus.Refuse = false;
+    KNX_TEST_ASSERT(true == Test_GwRequest(TEST_GW_CHANNEL_INTERACTIVE, 1U, LowPriority));
+
+    while (false == Test_Bus.Busy)
+    {
+        Test_GwStep();
+    }
+
+    for (KnxFrameBuffer_HandleType frame = KnxFrameBuffer_Alloc(); KNX_FRAME_BUFFER_INVALID != frame; frame = KnxFrameBuffer_Alloc())
+    {
+        hoard[hoarded++] = frame;
+    }
+
+    while (0U < Test_Bus.Count)
+    {
+        Test_GwStep();
+    }
+    Test_GwStep();
+
+    KNX_TEST_ASSERT((2U == client->Confirms) && (1U == client->NegativeConfirms));
+    KNX_TEST_ASSERT(0U == Test_Routed);
+
+    while (0U < hoarded)
+    {
+        KnxFrameBuffer_Release(hoard[--hoarded]);
+    }
+
+    KNX_TEST_ASSERT(0U == KnxFrameBuffer_Statistics()->InUse);
+}
+
+static void Test_Filtered(void)
+{
+    /* A group address blocked towards the bus is a negative L_Data.con */
+    Test_GwClientType * client = &Test_Client[TEST_GW_CHANNEL_INTERACTIVE - CHANNEL_1];
+    KnxFrameBuffer_HandleType frame;
+    uint8_t * cemiPtr;
+
+    Test_GwSetup();
+    Test_GwOpen(TEST_GW_CHANNEL_INTERACTIVE, IPV4_UDP);
+
+    Test_BlockedGroupAddr = 0x0800U | TEST_GW_CHANNEL_INTERACTIVE;
+    KNX_TEST_ASSERT(true == Test_GwRequest(TEST_GW_CHANNEL_INTERACTIVE, 1U, LowPriority));
+
+    while ((0U == client->Confirms) && (TEST_GW_QUANTUM > Test_Now))
+    {
+        Test_GwStep();
+    }
+    Test_GwStep();
+
+    KNX_TEST_ASSERT((1U == client->Confirms) && (1U == client->NegativeConfirms));
+    KNX_TEST_ASSERT((1U == Test_FilterCalls) && (0U == Test_Bus.Frames[TEST_GW_CHANNEL_INTERACTIVE]));
+    KNX_TEST_ASSERT(0U == KnxFrameBuffer_Statistics()->InUse);
+
+    /* A frame ending before its destination address is refused */
+    /* before the filter reads it                               */
+    frame = KnxFrameBuffer_Alloc();
+    cemiPtr = KnxFrameBuffer_Frame(frame);
+    memset(cemiPtr, 0, KNX_FRAME_BUFFER_CEMI_MAX);
+    cemiPtr[0] = L_DATA_REQ;
+    cemiPtr[CEMI_FRAME_CTRL2_FIELD_OFFSET] = CTRLE_FIELD_ADDRESS_TYPE_MASK;
+    KnxFrameBuffer_Get(frame)->Length = CEMI_FRAME_TPDU_FIELD_OFFSET;
+
+    KNX_TEST_ASSERT(E_NOT_OK == TP_GW_L_Data_Req(TEST_GW_CHANNEL_INTERACTIVE, frame));
+    KNX_TEST_ASSERT(1U == Test_FilterCalls);
+
+    KnxFrameBuffer_Release(frame);
+}
+
+static void Test_Invalid(void)
+{
+    /* Only whole standard frames are taken, LG up to 15 */
+    Test_GwClientType * client = &Test_Client[TEST_GW_CHANNEL_INTERACTIVE - CHANNEL_1];
+
+    Test_GwSetup();
+    Test_GwOpen(TEST_GW_CHANNEL_INTERACTIVE, IPV4_UDP);
+
+    KNX_TEST_ASSERT(E_NOT_OK == Test_GwInvalidRequest(16U, CEMI_FRAME_TPDU_FIELD_OFFSET + 16U + 1U));
+    KNX_TEST_ASSERT(E_NOT_OK == Test_GwInvalidRequest(5U, CEMI_FRAME_TPDU_FIELD_OFFSET + 5U));
+    KNX_TEST_ASSERT(E_NOT_OK == Test_GwInvalidRequest(1U, CEMI_FRAME_TPDU_FIELD_OFFSET));
+    KNX_TEST_ASSERT(0U == TP_GW_ChannelBacklog(TEST_GW_CHANNEL_INTERACTIVE));
+    KNX_TEST_ASSERT(0U == KnxFrameBuffer_Statistics()->InUse);
+
+    /* The longest standard frame goes out */
+    KNX_TEST_ASSERT(true == Test_GwRequest(TEST_GW_CHANNEL_INTERACTIVE, 15U, LowPriority));
+
+    while ((0U == client->Confirms) && ((4U * TEST_GW_QUANTUM) > Test_Now))
+    {
+        Test_GwStep();
+    }
+
+    KNX_TEST_ASSERT((1U == client->Confirms) && (0U == client->NegativeConfirms));
+    KNX_TEST_ASSERT(1U == Test_Bus.Frames[TEST_GW_CHANNEL_INTERACTIVE]);
+}
+
+static StatusType Test_GwInvalidRequest(uint8_t lg, uint16_t length)
+{
+    /* A group write with LG and a frame length that need not match */
+    KnxFrameBuffer_HandleType frame = KnxFrameBuffer_Alloc();
+    uint8_t * cemiPtr = KnxFrameBuffer_Frame(frame);
+    StatusType status;
+
+    memset(cemiPtr, 0, KNX_FRAME_BUFFER_CEMI_MAX);
+    cemiPtr[0] = L_DATA_REQ;
+    cemiPtr[CEMI_FRAME_CTRL1_FIELD_OFFSET] = 0xBCU;
+    cemiPtr[CEMI_FRAME_CTRL2_FIELD_OFFSET] = CTRLE_FIELD_ADDRESS_TYPE_MASK;
+    cemiPtr[CEMI_FRAME_DA_HI_BYTE_OFFET] = 0x08U;
+    cemiPtr[CEMI_FRAME_LENGTH_FIELD_OFFSET] = lg;
+    KnxFrameBuffer_Get(frame)->Length = length;
+
+    status = TP_GW_L_Data_Req(TEST_GW_CHANNEL_INTERACTIVE, frame);
+
+    if (E_OK != status)
+    {
+        KnxFrameBuffer_Release(frame);
+    }
+
+    return status;
+}
+
+/*==================[end of file]===========================================*/
@@ -0,0 +1,474 @@
+/**
+ * \file Test_TpUart2Rx.c
+ *
+ * \brief TP-UART2 Receive Parser Host Test
+ *
+ * This file contains the host test of the TP-UART2 receive parser. Streams of
+ * standard, extended and poll frames, L_Data.con, state and reset
+ * indications and acknowledge bytes are cut into UART reads at random points
+ * and every frame has to come out once, whole and unchanged
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "Knx_Types.h"
+#include "KNXnetIP.h"
+#include "KnxFrameBuffer.h"
+#include "KnxTpUart2_Services.h"
+#include "TpUart2_DataLinkLayer.h"
+#include "TP_DataLinkLayer.h"
+#include "KnxTest.h"
+
+/*==================[macros]================================================*/
+#define TEST_RX_STREAM_NUM      (200U)
+#define TEST_RX_EVENT_NUM       (300U)  /* Bus events per stream */
+#define TEST_RX_STREAM_SIZE     (TEST_RX_EVENT_NUM * 300U)
+
+/* A character on the bus, 13 bit times at 9600 bit/s */
+#define TEST_RX_BYTE_TIME_US    (1354)
+
+/* Longer than the parser waits inside a frame */
+#define TEST_RX_SILENCE_US      (100000)
+
+/* The UART driver reports what it holds once the line is quiet for 10 */
+/* symbols at 19200 baud, or once the receive FIFO fills up              */
+#define TEST_RX_UART_TIMEOUT_US (5729)
+#define TEST_RX_CHUNK_MAX       (120U)
+
+/*==================[type definitions]======================================*/
+typedef enum {
+    TEST_RX_ITEM_STANDARD,
+    TEST_RX_ITEM_EXTENDED,
+    TEST_RX_ITEM_POLL,
+    TEST_RX_ITEM_CONFIRM,
+    TEST_RX_ITEM_STATE,
+    TEST_RX_ITEM_RESET,
+    TEST_RX_ITEM_ACK,
+    TEST_RX_ITEM_CHECKSUM_ERROR,
+    TEST_RX_ITEM_OVERSIZE,
+    TEST_RX_ITEM_PARTIAL,
+    TEST_RX_ITEM_NUM
+} Test_RxItemType;
+
+typedef struct {
+    uint8_t Data[TPUART2_FRAME_MAX_LENGTH];
+    uint16_t Length;
+} Test_RxFrameType;
+
+/* What the parser has to report for a stream */
+typedef struct {
+    Test_RxFrameType Frame[TEST_RX_EVENT_NUM];
+    uint16_t FrameNum;
+    bool Confirm[TEST_RX_EVENT_NUM];
+    uint16_t ConfirmNum;
+    uint32_t Polls;
+    uint32_t StateIndications;
+    uint32_t ResetIndications;
+    uint32_t ChecksumErrors;
+    uint32_t OversizeFrames;
+    uint32_t Timeouts;
+} Test_RxExpectedType;
+
+/* Bytes as they come off the bus, each with its arrival time */
+typedef struct {
+    uint8_t Data[TEST_RX_STREAM_SIZE];
+    int64_t TimeUs[TEST_RX_STREAM_SIZE];
+    uint32_t Length;
+} Test_RxStreamType;
+
+/*==================[external function declarations]========================*/
+int main(void);
+
+/* Services of the TP-UART and the gateway, replaced for the test */
+int64_t KnxTpUart2_GetTimeMs();
+int64_t KnxTpUart2_GetTimeUs();
+UartReq_ReturnType KnxTpUart2_U_L_DataFrame(const uint8_t * frame, uint8_t length);
+UartReq_ReturnType KnxTpUart2_U_PollingState(uint8_t slotnumber, uint16_t pollAddr, uint8_t pollState);
+void TP_GW_L_Data_Ind(KnxFrameBuffer_HandleType frame);
+void TP_GW_L_Data_Con(uint8_t channelId, KnxFrameBuffer_HandleType frame, bool success);
+
+/*==================[internal function declarations]========================*/
+static void Test_RxStreamPut(uint8_t data, int64_t gapUs);
+static void Test_RxFramePut(const uint8_t * frame, uint16_t length, int64_t gapUs, bool expected);
+static void Test_RxDataFrame(bool extended, uint8_t lg, bool corrupt, int64_t gapUs);
+static void Test_RxPollFrame(int64_t gapUs);
+static void Test_RxItem(Test_RxItemType item);
+static void Test_RxGenerate(uint16_t items);
+static void Test_RxFeed(uint32_t chunkMax);
+static void Test_RxCheck(void);
+static void Test_RxRequest(void);
+static void Test_RxReset(void);
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+
+/*==================[external data]=========================================*/
+
+/*==================[internal data]=========================================*/
+static int64_t Test_NowUs;
+
+static Test_RxStreamType Test_RxStream;
+static Test_RxExpectedType Test_RxExpected;
+
+static uint16_t Test_RxFrames;         /* Frames indicated so far */
+static uint16_t Test_RxConfirms;       /* L_Data.con reported so far */
+static uint32_t Test_RxPolls;
+static uint32_t Test_RxMismatch;       /* Frames indicated out of order or changed */
+
+/*==================[external function definitions]=========================*/
+int main(void)
+{
+    KnxTest_RandomSeed(0x54505532U);
+    KnxFrameBuffer_Init();
+    TpUart2_Init();
+
+    /* The pipeline is kept full, every L_Data.con of a stream has its frame */
+    Test_RxRequest();
+    Test_RxRequest();
+
+    for (uint32_t stream = 0; stream < TEST_RX_STREAM_NUM; stream++)
+    {
+        Test_RxReset();
+        Test_RxGenerate(TEST_RX_EVENT_NUM);
+
+        /* Byte by byte first, then cut at random points up to a full FIFO */
+        Test_RxFeed((0U == stream) ? 1U : TEST_RX_CHUNK_MAX);
+
+        Test_RxCheck();
+    }
+
+    /* Every received frame went back to the pool, only the pipeline holds buffers */
+    KNX_TEST_ASSERT(TpUart2_TxQueueCount() == KnxFrameBuffer_Statistics()->InUse);
+    KNX_TEST_ASSERT(0U == KnxFrameBuffer_Statistics()->Exhausted);
+
+    return KnxTest_Result("Test_TpUart2Rx");
+}
+
+int64_t KnxTpUart2_GetTimeMs()
+{
+    return Test_NowUs / 1000;
+}
+
+int64_t KnxTpUart2_GetTimeUs()
+{
+    return Test_NowUs;
+}
+
+UartReq_ReturnType KnxTpUart2_U_L_DataFrame(const uint8_t * frame, uint8_t length)
+{
+    (void)frame;
+    (void)length;
+
+    return 0;
+}
+
+UartReq_ReturnType KnxTpUart2_U_PollingState(uint8_t slotnumber, uint16_t pollAddr, uint8_t pollState)
+{
+    (void)slotnumber;
+    (void)pollAddr;
+    (void)pollState;
+
+    Test_RxPolls++;
+
+    return 0;
+}
+
+void TP_GW_L_Data_Ind(KnxFrameBuffer_HandleType frame)
+{
+    const Test_RxFrameType * expected = &Test_RxExpected.Frame[Test_RxFrames];
+
+    if ((Test_RxExpected.FrameNum <= Test_RxFrames) ||
+        (expected->Length != KnxFrameBuffer_Get(frame)->Length) ||
+        (0 != memcmp(expected->Data, KnxFrameBuffer_Frame(frame), expected->Length)))
+    {
+        Test_RxMismatch++;
+    }
+
+    Test_RxFrames++;
+    KnxFrameBuffer_Release(frame);
+}
+
+void TP_GW_L_Data_Con(uint8_t channelId, KnxFrameBuffer_HandleType frame, bool success)
+{
+    (void)channelId;
+
+    if ((Test_RxExpected.ConfirmNum <= Test_RxConfirms) ||
+        (Test_RxExpected.Confirm[Test_RxConfirms] != success))
+    {
+        Test_RxMismatch++;
+    }
+
+    Test_RxConfirms++;
+    KnxFrameBuffer_Release(frame);
+
+    /* Keep a frame in flight for the next L_Data.con of the stream */
+    Test_RxRequest();
+}
+
+/*==================[internal function definitions]=========================*/
+static void Test_RxStreamPut(uint8_t data, int64_t gapUs)
+{
+    int64_t timeUs = (0U == Test_RxStream.Length) ? Test_NowUs : Test_RxStream.TimeUs[Test_RxStream.Length - 1U];
+
+    Test_RxStream.Data[Test_RxStream.Length] = data;
+    Test_RxStream.TimeUs[Test_RxStream.Length] = timeUs + TEST_RX_BYTE_TIME_US + gapUs;
+    Test_RxStream.Length++;
+}
+
+static void Test_RxFramePut(const uint8_t * frame, uint16_t length, int64_t gapUs, bool expected)
+{
+    for (uint16_t index = 0; index < length; index++)
+    {
+        Test_RxStreamPut(frame[index], (0U == index) ? gapUs : 0);
+    }
+
+    if (true == expected)
+    {
+        Test_RxFrameType * entry = &Test_RxExpected.Frame[Test_RxExpected.FrameNum++];
+
+        memcpy(entry->Data, frame, length);
+        entry->Length = length;
+    }
+}
+
+static void Test_RxDataFrame(bool extended, uint8_t lg, bool corrupt, int64_t gapUs)
+{
+    uint8_t frame[TPUART2_EXTENDED_FRAME_OVERHEAD + 255U];
+    uint16_t length;
+    uint8_t fcs = 0xFFU;
+    uint8_t control = (uint8_t)((KnxTest_Random(2U) << 5) | (KnxTest_Random(4U) << 2));
+
+    /* Source, destination and the payload are random, the parser must not care */
+    for (uint16_t index = 0; index < sizeof(frame); index++)
+    {
+        frame[index] = (uint8_t)KnxTest_Random(256U);
+    }
+
+    if (true == extended)
+    {
+        frame[0] = TPUART2_FRAME_START_EXTENDED | control;
+        frame[TPUART2_EXTENDED_LENGTH_OFFSET] = lg;
+        length = lg + TPUART2_EXTENDED_FRAME_OVERHEAD;
+    }
+    else
+    {
+        frame[0] = TPUART2_FRAME_START_STANDARD | control;
+        frame[TPUART2_STANDARD_LENGTH_OFFSET] = (frame[TPUART2_STANDARD_LENGTH_OFFSET] & (uint8_t)~LENGTH_FIELD_LG_MASK) | lg;
+        length = lg + TPUART2_STANDARD_FRAME_OVERHEAD;
+    }
+
+    for (uint16_t index = 0; index < (length - 1U); index++)
+    {
+        fcs ^= frame[index];
+    }
+
+    frame[length - 1U] = (true == corrupt) ? (uint8_t)(fcs ^ (1U + KnxTest_Random(255U))) : fcs;
+
+    Test_RxFramePut(frame, length, gapUs, ((false == corrupt) && (TPUART2_FRAME_MAX_LENGTH >= length)));
+}
+
+static void Test_RxPollFrame(int64_t gapUs)
+{
+    uint8_t frame[TPUART2_POLLDATA_FRAME_LENGTH];
+    uint8_t fcs = 0xFFU;
+
+    frame[0] = TPUART2_LAYER2_L_POLLDATA_REQ;
+    for (uint8_t index = 1U; index < (TPUART2_POLLDATA_FRAME_LENGTH - 1U); index++)
+    {
+        frame[index] = (uint8_t)KnxTest_Random(256U);
+    }
+
+    for (uint8_t index = 0; index < (TPUART2_POLLDATA_FRAME_LENGTH - 1U); index++)
+    {
+        fcs ^= frame[index];
+    }
+    frame[TPUART2_POLLDATA_FRAME_LENGTH - 1U] = fcs;
+
+    /* Poll frames are answered, not indicated */
+    Test_RxFramePut(frame, TPUART2_POLLDATA_FRAME_LENGTH, gapUs, false);
+    Test_RxExpected.Polls++;
+}
+
+static void Test_RxItem(Test_RxItemType item)
+{
+    static const uint8_t ackByte[] = { TPUART2_ACKNOWLEDGEFRAME, TPUART2_NOTACKNOWLEDGEFRAME, TPUART2_BUSYFRAME };
+    /* Bus idle before the item: from the acknowledge gap up to a quiet bus */
+    int64_t gapUs = (0U == KnxTest_Random(20U)) ? (int64_t)KnxTest_Random(200000U) : (int64_t)KnxTest_Random(10000U);
+
+    switch (item)
+    {
+        case TEST_RX_ITEM_STANDARD:
+            Test_RxDataFrame(false, (uint8_t)KnxTest_Random(16U), false, gapUs);
+            break;
+
+        case TEST_RX_ITEM_EXTENDED:
+            Test_RxDataFrame(true, (uint8_t)KnxTest_Random(TPUART2_FRAME_MAX_LENGTH - TPUART2_EXTENDED_FRAME_OVERHEAD + 1U), false, gapUs);
+            break;
+
+        case TEST_RX_ITEM_POLL:
+            Test_RxPollFrame(gapUs);
+            break;
+
+        case TEST_RX_ITEM_CONFIRM:
+            Test_RxExpected.Confirm[Test_RxExpected.ConfirmNum] = (0U != KnxTest_Random(4U));
+            Test_RxStreamPut((true == Test_RxExpected.Confirm[Test_RxExpected.ConfirmNum]) ? TPUART2_DATACONFIRMSUCCESS : TPUART2_DATACONFIRMFAIL, gapUs);
+            Test_RxExpected.ConfirmNum++;
+            break;
+
+        case TEST_RX_ITEM_STATE:
+            Test_RxStreamPut((uint8_t)(TPUART2_STATEINDICATION | (KnxTest_Random(32U) << 3)), gapUs);
+            Test_RxExpected.StateIndications++;
+            break;
+
+        case TEST_RX_ITEM_RESET:
+            Test_RxStreamPut(TPUART2_RESETINDICATION, gapUs);
+            Test_RxExpected.ResetIndications++;
+            break;
+
+        case TEST_RX_ITEM_ACK:
+            Test_RxStreamPut(ackByte[KnxTest_Random(sizeof(ackByte))], gapUs);
+            break;
+
+        case TEST_RX_ITEM_CHECKSUM_ERROR:
+            Test_RxDataFrame((0U != KnxTest_Random(2U)), (uint8_t)KnxTest_Random(16U), true, gapUs);
+            Test_RxExpected.ChecksumErrors++;
+            break;
+
+        case TEST_RX_ITEM_OVERSIZE:
+            Test_RxDataFrame(true, (uint8_t)(TPUART2_FRAME_MAX_LENGTH + KnxTest_Random(256U - TPUART2_FRAME_MAX_LENGTH)), false, gapUs);
+            Test_RxExpected.OversizeFrames++;
+            break;
+
+        case TEST_RX_ITEM_PARTIAL:
+        {
+            /* The start of a frame, then the bus falls silent */
+            uint32_t start = Test_RxStream.Length;
+            uint16_t frames = Test_RxExpected.FrameNum;
+
+            Test_RxDataFrame(false, (uint8_t)KnxTest_Random(16U), false, gapUs);
+            Test_RxStream.Length = start + 1U + KnxTest_Random(Test_RxStream.Length - start - 1U);
+            Test_RxExpected.FrameNum = frames;
+            Test_RxExpected.Timeouts++;
+
+            /* Whatever follows comes after the silence */
+            Test_RxDataFrame(false, (uint8_t)KnxTest_Random(16U), false, TEST_RX_SILENCE_US);
+        }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void Test_RxGenerate(uint16_t items)
+{
+    /* Mostly frames with the acknowledge of another device behind them */
+    static const uint8_t weight[TEST_RX_ITEM_NUM] = { 30U, 15U, 3U, 15U, 5U, 2U, 20U, 3U, 2U, 2U };
+    uint8_t weightSum = 0U;
+
+    for (uint8_t item = 0; item < TEST_RX_ITEM_NUM; item++)
+    {
+        weightSum += weight[item];
+    }
+
+    for (uint16_t index = 0; index < items; index++)
+    {
+        uint32_t pick = KnxTest_Random(weightSum);
+        uint8_t item = 0U;
+
+        while (pick >= weight[item])
+        {
+            pick -= weight[item];
+            item++;
+        }
+
+        Test_RxItem((Test_RxItemType)item);
+    }
+}
+
+static void Test_RxFeed(uint32_t chunkMax)
+{
+    uint32_t position = 0U;
+
+    while (position < Test_RxStream.Length)
+    {
+        uint32_t length = 1U + KnxTest_Random(chunkMax);
+        int64_t latencyUs = (int64_t)KnxTest_Random(3000U);
+
+        length = MIN(length, Test_RxStream.Length - position);
+
+        /* A read ends at the first pause of the line, wherever the task picks it up */
+        for (uint32_t index = length - 1U; index > 0U; index--)
+        {
+            if ((Test_RxStream.TimeUs[position + index] - Test_RxStream.TimeUs[position + index - 1U]) > (TEST_RX_BYTE_TIME_US + TEST_RX_UART_TIMEOUT_US))
+            {
+                length = index;
+            }
+        }
+
+        /* Read a little after the last byte came in */
+        Test_NowUs = MAX(Test_NowUs, Test_RxStream.TimeUs[position + length - 1U] + latencyUs);
+
+        TpUart2_RxIndication(&Test_RxStream.Data[position], (uint16_t)length);
+        position += length;
+    }
+}
+
+static void Test_RxCheck(void)
+{
+    static TpUart2_RxStatisticsType last;
+    const TpUart2_RxStatisticsType * statistics = TpUart2_GetRxStatistics();
+
+    /* No frame lost, none merged with another, all in order */
+    KNX_TEST_ASSERT(0U == Test_RxMismatch);
+    KNX_TEST_ASSERT(Test_RxExpected.FrameNum == Test_RxFrames);
+    KNX_TEST_ASSERT(Test_RxExpected.ConfirmNum == Test_RxConfirms);
+    KNX_TEST_ASSERT(Test_RxExpected.Polls == Test_RxPolls);
+
+    KNX_TEST_ASSERT(Test_RxExpected.FrameNum + Test_RxExpected.Polls == statistics->Frames - last.Frames);
+    KNX_TEST_ASSERT(Test_RxExpected.ConfirmNum == statistics->Confirms - last.Confirms);
+    KNX_TEST_ASSERT(Test_RxExpected.StateIndications == statistics->StateIndications - last.StateIndications);
+    KNX_TEST_ASSERT(Test_RxExpected.ResetIndications == statistics->ResetIndications - last.ResetIndications);
+    KNX_TEST_ASSERT(Test_RxExpected.ChecksumErrors == statistics->ChecksumErrors - last.ChecksumErrors);
+    KNX_TEST_ASSERT(Test_RxExpected.OversizeFrames == statistics->OversizeFrames - last.OversizeFrames);
+    KNX_TEST_ASSERT(Test_RxExpected.Timeouts == statistics->Timeouts - last.Timeouts);
+    KNX_TEST_ASSERT(statistics->NoBuffer == last.NoBuffer);
+    KNX_TEST_ASSERT(statistics->DiscardedBytes == last.DiscardedBytes);
+
+    last = *statistics;
+}
+
+static void Test_RxRequest(void)
+{
+    KnxFrameBuffer_HandleType frame = KnxFrameBuffer_Alloc();
+
+    KnxFrameBuffer_Get(frame)->Length = TPUART2_STANDARD_FRAME_OVERHEAD;
+    KNX_TEST_ASSERT(E_OK == TpUart2_L_Data_Req(KNX_CHANNEL_INVALID, false, 0U, GroupAddress, LowPriority, frame, KnxTpUart2_GetTimeMs()));
+}
+
+static void Test_RxReset(void)
+{
+    memset(&Test_RxStream, 0, sizeof(Test_RxStream));
+    memset(&Test_RxExpected, 0, sizeof(Test_RxExpected));
+    Test_RxFrames = 0U;
+    Test_RxConfirms = 0U;
+    Test_RxPolls = 0U;
+    Test_RxMismatch = 0U;
+
+    /* Each stream starts on a quiet bus */
+    Test_NowUs += TEST_RX_SILENCE_US;
+}
+
+/*==================[end of file]===========================================*/
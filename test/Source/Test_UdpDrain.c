@@ -0,0 +1,418 @@
+/**
+ * \file Test_UdpDrain.c
+ *
+ * \brief KNXnet/IP UDP Receive Batching Host Test
+ *
+ * This file contains the host test of the receive path of the UDP task. The
+ * task runs on a virtual control endpoint whose datagrams arrive alone, in
+ * small bursts and in search floods. Every datagram has to be handed on once
+ * and in order, and the datagrams per wakeup and the recvfrom() calls per
+ * datagram are reported for each kind of traffic. lwIP has no recvmmsg(),
+ * a batch is read with one recvfrom() per datagram
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+
+/*==================[inclusions]============================================*/
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "lwip/sockets.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+
+#include "KNXnetIP.h"
+#include "KNXnetIP_Routing.h"
+#include "KNXnetIP_Discovery.h"
+#include "IP_DataLinkLayer.h"
+#include "KnxWiFi.h"
+#include "KnxFrameBuffer.h"
+#include "KnxTest.h"
+
+/*==================[macros]================================================*/
+/* Descriptors of the virtual network, well clear of those of the host */
+#define TEST_MCAST_SOCK         (100)
+#define TEST_DOORBELL           (101)
+#define TEST_ROUTING_DOORBELL   (102)
+
+#define TEST_SOURCE_IP_ADDR     (0xC0A80164UL)  /* 192.168.1.100 */
+#define TEST_SOURCE_PORT        (50000U)
+
+/* A SEARCH_REQUEST, its sequence number in the HPAI address */
+#define TEST_DATAGRAM_LENGTH    (14U)
+#define TEST_SEQUENCE_OFFSET    (8U)
+
+/* Datagrams udp_drain reads before it processes any of them */
+#define TEST_RX_BATCH_SIZE      (8U)
+
+/* Each wakeup takes the virtual clock this far */
+#define TEST_WAKEUP_US          (200)
+
+#define TEST_PHASE_NUM          (sizeof(Test_Phase) / sizeof(Test_Phase[0]))
+
+/*==================[type definitions]======================================*/
+typedef struct {
+    const char * Name;
+    uint8_t Burst;          /* Datagrams queued on the socket together */
+    uint8_t Bursts;
+} Test_PhaseType;
+
+/*==================[external function declarations]========================*/
+int main(void);
+
+/* Services around the UDP task, replaced for the test */
+KNXnetIP_ChannelType * KNXnetIP_ChannelGet(uint8_t channelId);
+uint32_t KNXnetIP_TimerMainFunction(uint8_t transport);
+void KNXnetIP_TcpSend(const int sock, const KNXnetIP_TxFrameType * txFrame);
+
+/*==================[internal function declarations]========================*/
+static void * Test_Task(void * arg);
+static void Test_Arrive(void);
+static void Test_PhaseReport(const Test_PhaseType * phase);
+static void Test_Drain(void);
+
+/*==================[external constants]====================================*/
+
+/*==================[internal constants]====================================*/
+static const Test_PhaseType Test_Phase[] = {
+    { "single datagrams",       1U,  32U },
+    { "bursts of 3",            3U,  16U },
+    { "bursts of 8",            8U,  8U },
+    { "search floods of 64",    64U, 4U },
+};
+
+/*==================[external data]=========================================*/
+uint32_t KnxIPInterface_IpAddr = 0xC0A80102UL;
+
+/*==================[internal data]=========================================*/
+static int64_t Test_NowUs;
+
+static uint8_t Test_PhaseIndex;
+static uint8_t Test_BurstCount;     /* Bursts of the phase queued so far */
+
+/* Datagrams waiting on the socket, and numbered as they are read */
+static uint32_t Test_Queued;
+static uint32_t Test_Read;
+static uint32_t Test_Delivered;
+
+/* Counts of the current phase */
+static uint32_t Test_Wakeups;
+static uint32_t Test_Syscalls;
+static uint32_t Test_Datagrams;
+
+static uint8_t Test_Sockets;
+static bool Test_Closed;
+
+/*==================[external function definitions]=========================*/
+int main(void)
+{
+    Test_Drain();
+
+    return KnxTest_Result("Test_UdpDrain");
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return Test_NowUs;
+}
+
+esp_netif_t * wifi_get_netif(void)
+{
+    return NULL;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t * esp_netif, esp_netif_ip_info_t * ip_info)
+{
+    (void)esp_netif;
+
+    ip_info->ip.addr = htonl(0xC0A80102UL);
+
+    return ESP_OK;
+}
+
+/* The network, as the UDP task sees it through lwIP */
+int lwip_socket(int domain, int type, int protocol)
+{
+    KNX_TEST_ASSERT((PF_INET == domain) && (SOCK_DGRAM == type) && (IPPROTO_IP == protocol));
+
+    Test_Sockets++;
+
+    if (1U < Test_Sockets)
+    {
+        /* The task restarts after the end of the traffic, the test is over */
+        pthread_exit(NULL);
+    }
+
+    return TEST_MCAST_SOCK;
+}
+
+int lwip_bind(int s, const struct sockaddr * name, socklen_t namelen)
+{
+    (void)name;
+    (void)namelen;
+
+    KNX_TEST_ASSERT(TEST_MCAST_SOCK == s);
+
+    return 0;
+}
+
+int lwip_setsockopt(int s, int level, int optname, const void * optval, socklen_t optlen)
+{
+    (void)level;
+    (void)optname;
+    (void)optval;
+    (void)optlen;
+
+    KNX_TEST_ASSERT(TEST_MCAST_SOCK == s);
+
+    return 0;
+}
+
+int lwip_shutdown(int s, int how)
+{
+    (void)how;
+
+    KNX_TEST_ASSERT(TEST_MCAST_SOCK == s);
+
+    return 0;
+}
+
+int lwip_close(int s)
+{
+    KNX_TEST_ASSERT((TEST_MCAST_SOCK == s) && (false == Test_Closed));
+
+    Test_Closed = true;
+
+    return 0;
+}
+
+ssize_t lwip_recvfrom(int s, void * mem, size_t len, int flags, struct sockaddr * from, socklen_t * fromlen)
+{
+    struct sockaddr_in * source = (struct sockaddr_in *)from;
+    uint8_t * dataPtr = (uint8_t *)mem;
+    ssize_t received = -1;
+
+    KNX_TEST_ASSERT((TEST_MCAST_SOCK == s) && (MSG_DONTWAIT == flags));
+    KNX_TEST_ASSERT((TEST_DATAGRAM_LENGTH <= len) && (sizeof(struct sockaddr_in) <= *fromlen));
+
+    Test_Syscalls++;
+
+    if (0U == Test_Queued)
+    {
+        errno = EAGAIN;
+    }
+    else
+    {
+        memset(dataPtr, 0, TEST_DATAGRAM_LENGTH);
+        dataPtr[0] = HEADER_SIZE_10;
+        dataPtr[1] = KNXNETIP_VERSION_10;
+        dataPtr[2] = (uint8_t)(SEARCH_REQUEST >> 8);
+        dataPtr[3] = (uint8_t)SEARCH_REQUEST;
+        dataPtr[5] = TEST_DATAGRAM_LENGTH;
+        memcpy(&dataPtr[TEST_SEQUENCE_OFFSET], &Test_Read, sizeof(Test_Read));
+
+        memset(source, 0, sizeof(struct sockaddr_in));
+        source->sin_family = AF_INET;
+        source->sin_addr.s_addr = htonl(TEST_SOURCE_IP_ADDR);
+        source->sin_port = htons(TEST_SOURCE_PORT);
+        *fromlen = sizeof(struct sockaddr_in);
+
+        Test_Queued--;
+        Test_Read++;
+        received = TEST_DATAGRAM_LENGTH;
+    }
+
+    return received;
+}
+
+ssize_t lwip_sendmsg(int s, const struct msghdr * message, int flags)
+{
+    (void)s;
+    (void)message;
+    (void)flags;
+
+    /* Nothing is answered, the services that would are replaced */
+    KNX_TEST_ASSERT(false);
+
+    return -1;
+}
+
+int lwip_select(int maxfdp1, fd_set * readset, fd_set * writeset, fd_set * exceptset, struct timeval * timeout)
+{
+    int ready = -1;
+
+    (void)writeset;
+    (void)exceptset;
+    (void)timeout;
+
+    KNX_TEST_ASSERT((TEST_MCAST_SOCK < maxfdp1) && FD_ISSET(TEST_MCAST_SOCK, readset));
+    KNX_TEST_ASSERT(FD_ISSET(TEST_DOORBELL, readset) && FD_ISSET(TEST_ROUTING_DOORBELL, readset));
+
+    Test_NowUs += TEST_WAKEUP_US;
+
+    if (0U == Test_Queued)
+    {
+        /* The socket is drained, the next burst arrives */
+        Test_Arrive();
+    }
+
+    if (TEST_PHASE_NUM > Test_PhaseIndex)
+    {
+        FD_ZERO(readset);
+        FD_SET(TEST_MCAST_SOCK, readset);
+        Test_Wakeups++;
+        ready = 1;
+    }
+    else
+    {
+        /* End of the traffic, the task drops its socket */
+        errno = EBADF;
+    }
+
+    return ready;
+}
+
+int KNXnetIP_TunnellingDoorbell(uint8_t transport)
+{
+    KNX_TEST_ASSERT(KNXNETIP_TRANSPORT_UDP == transport);
+
+    return TEST_DOORBELL;
+}
+
+void KNXnetIP_TunnellingMainFunction(uint8_t transport)
+{
+    (void)transport;
+
+    /* The doorbell never rings */
+    KNX_TEST_ASSERT(false);
+}
+
+int KNXnetIP_RoutingDoorbell(void)
+{
+    return TEST_ROUTING_DOORBELL;
+}
+
+uint32_t KNXnetIP_RoutingMainFunction(bool doorbell)
+{
+    KNX_TEST_ASSERT(false == doorbell);
+
+    return KNXNETIP_ROUTING_NO_TIMEOUT;
+}
+
+uint32_t KNXnetIP_DiscoveryMainFunction(void)
+{
+    return KNXNETIP_DISCOVERY_NO_TIMEOUT;
+}
+
+uint32_t KNXnetIP_TimerMainFunction(uint8_t transport)
+{
+    KNX_TEST_ASSERT(KNXNETIP_TRANSPORT_UDP == transport);
+
+    return KNX_TIMER_NO_TIMEOUT;
+}
+
+KNXnetIP_ChannelType * KNXnetIP_ChannelGet(uint8_t channelId)
+{
+    (void)channelId;
+
+    return NULL;
+}
+
+void KNXnetIP_TcpSend(const int sock, const KNXnetIP_TxFrameType * txFrame)
+{
+    (void)sock;
+    (void)txFrame;
+
+    KNX_TEST_ASSERT(false);
+}
+
+void IP_L_Data_Ind(PduInfoType * pduInfoPtr, KnxFrameBuffer_HandleType frame, uint32_t ipAddr, uint16_t port,  KNXnetIP_HostProtocolCodeTpe protocol, int sock)
+{
+    uint32_t sequence;
+
+    KNX_TEST_ASSERT((KNX_FRAME_BUFFER_INVALID != frame) && (KnxFrameBuffer_Frame(frame) == pduInfoPtr->SduDataPtr));
+    KNX_TEST_ASSERT(TEST_DATAGRAM_LENGTH == pduInfoPtr->SduLength);
+    KNX_TEST_ASSERT((TEST_SOURCE_IP_ADDR == ipAddr) && (TEST_SOURCE_PORT == port));
+    KNX_TEST_ASSERT((IPV4_UDP == protocol) && (-1 == sock));
+
+    /* Once and in order */
+    memcpy(&sequence, &pduInfoPtr->SduDataPtr[TEST_SEQUENCE_OFFSET], sizeof(sequence));
+    KNX_TEST_ASSERT(Test_Delivered == sequence);
+
+    Test_Delivered++;
+    Test_Datagrams++;
+
+    KnxFrameBuffer_Release(frame);
+}
+
+/*==================[internal function definitions]=========================*/
+static void * Test_Task(void * arg)
+{
+    udp_mcast_task(arg);
+
+    return NULL;
+}
+
+static void Test_Arrive(void)
+{
+    if ((TEST_PHASE_NUM > Test_PhaseIndex) && (Test_Phase[Test_PhaseIndex].Bursts == Test_BurstCount))
+    {
+        Test_PhaseReport(&Test_Phase[Test_PhaseIndex]);
+
+        Test_PhaseIndex++;
+        Test_BurstCount = 0U;
+        Test_Wakeups = 0U;
+        Test_Syscalls = 0U;
+        Test_Datagrams = 0U;
+    }
+
+    if (TEST_PHASE_NUM > Test_PhaseIndex)
+    {
+        Test_Queued = Test_Phase[Test_PhaseIndex].Burst;
+        Test_BurstCount++;
+    }
+}
+
+static void Test_PhaseReport(const Test_PhaseType * phase)
+{
+    /* A batch stops at the empty queue or when full, the full one asks no further */
+    uint32_t batches = (phase->Burst + TEST_RX_BATCH_SIZE - 1U) / TEST_RX_BATCH_SIZE;
+    uint32_t syscalls = phase->Burst + ((0U != (phase->Burst % TEST_RX_BATCH_SIZE)) ? 1U : 0U);
+
+    printf("Test_UdpDrain: %s, %lu datagrams in %lu wakeups (%lu.%02lu per wakeup), %lu recvfrom calls (%lu.%02lu per datagram)\n",
+           phase->Name, (unsigned long)Test_Datagrams, (unsigned long)Test_Wakeups,
+           (unsigned long)(Test_Datagrams / Test_Wakeups),
+           (unsigned long)(((Test_Datagrams % Test_Wakeups) * 100U) / Test_Wakeups),
+           (unsigned long)Test_Syscalls,
+           (unsigned long)(Test_Syscalls / Test_Datagrams),
+           (unsigned long)(((Test_Syscalls % Test_Datagrams) * 100U) / Test_Datagrams));
+
+    KNX_TEST_ASSERT((uint32_t)phase->Burst * phase->Bursts == Test_Datagrams);
+    KNX_TEST_ASSERT(batches * phase->Bursts == Test_Wakeups);
+    KNX_TEST_ASSERT(syscalls * phase->Bursts == Test_Syscalls);
+}
+
+static void Test_Drain(void)
+{
+    pthread_t task;
+
+    KnxFrameBuffer_Init();
+
+    /* The task never returns, it is left when it restarts */
+    KNX_TEST_ASSERT(0 == pthread_create(&task, NULL, Test_Task, NULL));
+    KNX_TEST_ASSERT(0 == pthread_join(task, NULL));
+
+    KNX_TEST_ASSERT(TEST_PHASE_NUM == Test_PhaseIndex);
+    KNX_TEST_ASSERT((Test_Read == Test_Delivered) && (0U == Test_Queued));
+    KNX_TEST_ASSERT(true == Test_Closed);
+    KNX_TEST_ASSERT(0U == KnxFrameBuffer_Statistics()->InUse);
+}
+
+/*==================[end of file]===========================================*/
@@ -0,0 +1,28 @@
+/**
+ * \file esp_err.h
+ *
+ * \brief Host Stub of the ESP-IDF Error Codes
+ *
+ * Error type and checks of the ESP-IDF, a failed check aborts the test
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef ESP_ERR_H
+#define ESP_ERR_H
+
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK   (0)
+#define ESP_FAIL (-1)
+
+#define ESP_ERROR_CHECK(x) do { if (ESP_OK != (x)) { abort(); } } while (0)
+
+#endif /* #ifndef ESP_ERR_H */
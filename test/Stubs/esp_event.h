@@ -0,0 +1,19 @@
+/**
+ * \file esp_event.h
+ *
+ * \brief Host Stub of the ESP-IDF Event Loop
+ *
+ * Nothing of it is used by the sources under test, they include it all the same
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef ESP_EVENT_H
+#define ESP_EVENT_H
+
+#endif /* #ifndef ESP_EVENT_H */
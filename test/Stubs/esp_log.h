@@ -0,0 +1,50 @@
+/**
+ * \file esp_log.h
+ *
+ * \brief Host Stub of the ESP-IDF Logging
+ *
+ * Log output is dropped, the arguments are still evaluated and checked
+ * against the format
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef ESP_LOG_H
+#define ESP_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define ESP_LOG_ERROR   (1)
+#define ESP_LOG_WARN    (2)
+#define ESP_LOG_INFO    (3)
+#define ESP_LOG_DEBUG   (4)
+
+#define ESP_LOGE(tag, ...) KnxTest_Log((tag), __VA_ARGS__)
+#define ESP_LOGW(tag, ...) KnxTest_Log((tag), __VA_ARGS__)
+#define ESP_LOGI(tag, ...) KnxTest_Log((tag), __VA_ARGS__)
+#define ESP_LOGD(tag, ...) KnxTest_Log((tag), __VA_ARGS__)
+
+#define ESP_LOG_BUFFER_HEXDUMP(tag, buffer, length, level) \
+    ((void)(tag), (void)(buffer), (void)(length), (void)(level))
+
+static inline void KnxTest_Log(const char * tag, const char * format, ...) __attribute__((format(printf, 2, 3)));
+
+static inline void KnxTest_Log(const char * tag, const char * format, ...)
+{
+    (void)tag;
+    (void)format;
+}
+
+static inline void esp_log_level_set(const char * tag, int level)
+{
+    (void)tag;
+    (void)level;
+}
+
+#endif /* #ifndef ESP_LOG_H */
@@ -0,0 +1,38 @@
+/**
+ * \file esp_netif.h
+ *
+ * \brief Host Stub of the ESP-IDF Network Interface
+ *
+ * The handle type the Wi-Fi header declares its accessor with, and the
+ * address query of the interface, which the test provides
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef ESP_NETIF_H
+#define ESP_NETIF_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct esp_netif_obj esp_netif_t;
+
+typedef struct {
+    uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+extern esp_err_t esp_netif_get_ip_info(esp_netif_t * esp_netif, esp_netif_ip_info_t * ip_info);
+
+#endif /* #ifndef ESP_NETIF_H */
@@ -0,0 +1,30 @@
+/**
+ * \file esp_system.h
+ *
+ * \brief Host Stub of the ESP-IDF System Header
+ *
+ * Standard headers the ESP-IDF system header brings along
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef ESP_SYSTEM_H
+#define ESP_SYSTEM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "esp_err.h"
+
+extern uint32_t esp_random(void);
+
+#endif /* #ifndef ESP_SYSTEM_H */
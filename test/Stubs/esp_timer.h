@@ -0,0 +1,23 @@
+/**
+ * \file esp_timer.h
+ *
+ * \brief Host Stub of the ESP-IDF High Resolution Timer
+ *
+ * The time is provided by the test, usually a virtual clock
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+#include <stdint.h>
+
+extern int64_t esp_timer_get_time(void);
+
+#endif /* #ifndef ESP_TIMER_H */
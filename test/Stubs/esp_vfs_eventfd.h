@@ -0,0 +1,33 @@
+/**
+ * \file esp_vfs_eventfd.h
+ *
+ * \brief Host Stub of the ESP-IDF eventfd
+ *
+ * The doorbells of the network tasks are eventfds of the host, a test waits
+ * on them with poll() the way the tasks do with select()
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef ESP_VFS_EVENTFD_H
+#define ESP_VFS_EVENTFD_H
+
+#include <stddef.h>
+#include <sys/eventfd.h>
+
+#include "esp_err.h"
+
+typedef struct {
+    size_t max_fds;
+} esp_vfs_eventfd_config_t;
+
+#define ESP_VFS_EVENTD_CONFIG_DEFAULT() { .max_fds = 5 }
+
+extern esp_err_t esp_vfs_eventfd_register(const esp_vfs_eventfd_config_t * config);
+
+#endif /* #ifndef ESP_VFS_EVENTFD_H */
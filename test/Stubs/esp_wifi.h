@@ -0,0 +1,22 @@
+/**
+ * \file esp_wifi.h
+ *
+ * \brief Host Stub of the ESP-IDF Wi-Fi Driver
+ *
+ * Nothing of it is used by the sources under test, only the network
+ * interface it brings in, as the driver header does
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef ESP_WIFI_H
+#define ESP_WIFI_H
+
+#include "esp_netif.h"
+
+#endif /* #ifndef ESP_WIFI_H */
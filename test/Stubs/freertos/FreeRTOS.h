@@ -0,0 +1,60 @@
+/**
+ * \file FreeRTOS.h
+ *
+ * \brief Host Stub of the FreeRTOS Kernel Header
+ *
+ * Types and port macros. Tests bring their own threads if any, critical
+ * sections are spinlocks as on the dual core target
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define portTICK_PERIOD_MS  (1U)
+#define portMAX_DELAY       ((TickType_t)0xFFFFFFFFUL)
+#define pdTRUE              (1)
+#define pdFALSE             (0)
+#define pdPASS              (1)
+#define pdMS_TO_TICKS(x)    ((TickType_t)(x))
+
+typedef struct {
+    atomic_flag Locked;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { ATOMIC_FLAG_INIT }
+#define taskENTER_CRITICAL(mux)         KnxTest_CriticalEnter(mux)
+#define taskEXIT_CRITICAL(mux)          KnxTest_CriticalExit(mux)
+#define portENTER_CRITICAL(mux)         KnxTest_CriticalEnter(mux)
+#define portEXIT_CRITICAL(mux)          KnxTest_CriticalExit(mux)
+
+static inline void KnxTest_CriticalEnter(portMUX_TYPE * mux)
+{
+    while (atomic_flag_test_and_set_explicit(&mux->Locked, memory_order_acquire))
+    {
+        /* More threads than cores on the host, give the holder a chance */
+        sched_yield();
+    }
+}
+
+static inline void KnxTest_CriticalExit(portMUX_TYPE * mux)
+{
+    atomic_flag_clear_explicit(&mux->Locked, memory_order_release);
+}
+
+#endif /* #ifndef FREERTOS_H */
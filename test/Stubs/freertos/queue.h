@@ -0,0 +1,27 @@
+/**
+ * \file queue.h
+ *
+ * \brief Host Stub of the FreeRTOS Queue API
+ *
+ * Declarations only, a test provides what it calls
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include "FreeRTOS.h"
+
+typedef void * QueueHandle_t;
+
+extern QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+extern BaseType_t xQueueSend(QueueHandle_t queue, const void * item, TickType_t ticks);
+extern BaseType_t xQueueReceive(QueueHandle_t queue, void * item, TickType_t ticks);
+
+#endif /* #ifndef QUEUE_H */
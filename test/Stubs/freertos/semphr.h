@@ -0,0 +1,28 @@
+/**
+ * \file semphr.h
+ *
+ * \brief Host Stub of the FreeRTOS Semaphore API
+ *
+ * Declarations only, a test provides what it calls
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef SEMPHR_H
+#define SEMPHR_H
+
+#include "queue.h"
+
+typedef void * SemaphoreHandle_t;
+
+extern SemaphoreHandle_t xSemaphoreCreateMutex(void);
+extern SemaphoreHandle_t xSemaphoreCreateBinary(void);
+extern BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+extern BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+#endif /* #ifndef SEMPHR_H */
@@ -0,0 +1,27 @@
+/**
+ * \file task.h
+ *
+ * \brief Host Stub of the FreeRTOS Task API
+ *
+ * Declarations only, a test provides what it calls
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef TASK_H
+#define TASK_H
+
+#include "FreeRTOS.h"
+
+typedef void * TaskHandle_t;
+
+extern TickType_t xTaskGetTickCount(void);
+extern void vTaskDelay(TickType_t ticks);
+extern void vTaskDelete(TaskHandle_t task);
+
+#endif /* #ifndef TASK_H */
@@ -0,0 +1,19 @@
+/**
+ * \file err.h
+ *
+ * \brief Host Stub of the lwIP Error Codes
+ *
+ * Nothing of it is used by the sources under test, they include it all the same
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef LWIP_ERR_H
+#define LWIP_ERR_H
+
+#endif /* #ifndef LWIP_ERR_H */
@@ -0,0 +1,19 @@
+/**
+ * \file netdb.h
+ *
+ * \brief Host Stub of the lwIP Name Resolution
+ *
+ * Nothing of it is used by the sources under test, they include it all the same
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef LWIP_NETDB_H
+#define LWIP_NETDB_H
+
+#endif /* #ifndef LWIP_NETDB_H */
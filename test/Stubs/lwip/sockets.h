@@ -0,0 +1,65 @@
+/**
+ * \file sockets.h
+ *
+ * \brief Host Stub of the lwIP Socket API
+ *
+ * Types and constants come from the host. As lwIP does with its compat
+ * socket names, the calls are mapped onto lwip_ functions, which the test
+ * provides to play the network. Descriptors of the host, the eventfd
+ * doorbells among them, are not touched by the mapping of close()
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef LWIP_SOCKETS_H
+#define LWIP_SOCKETS_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define socket(domain, type, protocol)                          lwip_socket(domain, type, protocol)
+#define bind(s, name, namelen)                                  lwip_bind(s, name, namelen)
+#define listen(s, backlog)                                      lwip_listen(s, backlog)
+#define accept(s, addr, addrlen)                                lwip_accept(s, addr, addrlen)
+#define setsockopt(s, level, optname, optval, optlen)           lwip_setsockopt(s, level, optname, optval, optlen)
+#define shutdown(s, how)                                        lwip_shutdown(s, how)
+#define recv(s, mem, len, flags)                                lwip_recv(s, mem, len, flags)
+#define recvfrom(s, mem, len, flags, from, fromlen)             lwip_recvfrom(s, mem, len, flags, from, fromlen)
+#define sendmsg(s, message, flags)                              lwip_sendmsg(s, message, flags)
+#define writev(s, iov, iovcnt)                                  lwip_writev(s, iov, iovcnt)
+#define select(maxfdp1, readset, writeset, exceptset, timeout)  lwip_select(maxfdp1, readset, writeset, exceptset, timeout)
+#define fcntl(s, cmd, val)                                      lwip_fcntl(s, cmd, val)
+#define close(s)                                                lwip_close(s)
+
+/* Address helpers as lwIP has them, inet_aton taking the address word as well */
+#define inet_aton(cp, addr)                                     (inet_aton)((cp), (struct in_addr *)(addr))
+#define inet_addr_from_ip4addr(target_inaddr, source_ipaddr)    ((target_inaddr)->s_addr = (source_ipaddr)->addr)
+#define IP_MULTICAST(addr)                                      IN_MULTICAST(addr)
+
+extern int lwip_socket(int domain, int type, int protocol);
+extern int lwip_bind(int s, const struct sockaddr * name, socklen_t namelen);
+extern int lwip_listen(int s, int backlog);
+extern int lwip_accept(int s, struct sockaddr * addr, socklen_t * addrlen);
+extern int lwip_setsockopt(int s, int level, int optname, const void * optval, socklen_t optlen);
+extern int lwip_shutdown(int s, int how);
+extern ssize_t lwip_recv(int s, void * mem, size_t len, int flags);
+extern ssize_t lwip_recvfrom(int s, void * mem, size_t len, int flags, struct sockaddr * from, socklen_t * fromlen);
+extern ssize_t lwip_sendmsg(int s, const struct msghdr * message, int flags);
+extern ssize_t lwip_writev(int s, const struct iovec * iov, int iovcnt);
+extern int lwip_select(int maxfdp1, fd_set * readset, fd_set * writeset, fd_set * exceptset, struct timeval * timeout);
+extern int lwip_fcntl(int s, int cmd, int val);
+extern int lwip_close(int s);
+
+#endif /* #ifndef LWIP_SOCKETS_H */
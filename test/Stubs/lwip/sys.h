@@ -0,0 +1,19 @@
+/**
+ * \file sys.h
+ *
+ * \brief Host Stub of the lwIP System Abstraction
+ *
+ * Nothing of it is used by the sources under test, they include it all the same
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef LWIP_SYS_H
+#define LWIP_SYS_H
+
+#endif /* #ifndef LWIP_SYS_H */
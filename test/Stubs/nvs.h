@@ -0,0 +1,39 @@
+/**
+ * \file nvs.h
+ *
+ * \brief Host Stub of the ESP-IDF Non-Volatile Storage
+ *
+ * The entries are provided by the test
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef NVS_H
+#define NVS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+#define ESP_ERR_NVS_NOT_FOUND       (0x1102)
+#define ESP_ERR_NVS_INVALID_LENGTH  (0x110C)
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE
+} nvs_open_mode_t;
+
+extern esp_err_t nvs_open(const char * name, nvs_open_mode_t open_mode, nvs_handle_t * out_handle);
+extern esp_err_t nvs_get_u8(nvs_handle_t handle, const char * key, uint8_t * out_value);
+extern esp_err_t nvs_get_blob(nvs_handle_t handle, const char * key, void * out_value, size_t * length);
+extern void nvs_close(nvs_handle_t handle);
+
+#endif /* #ifndef NVS_H */
@@ -0,0 +1,19 @@
+/**
+ * \file nvs_flash.h
+ *
+ * \brief Host Stub of the ESP-IDF NVS Flash Initialisation
+ *
+ * Nothing of it is used by the sources under test, they include it all the same
+ *
+ * \version 1.0.0
+ *
+ * \author Ibrahim Ozturk
+ *
+ * Copyright 2023 Ibrahim Ozturk
+ * All rights exclusively reserved for Ibrahim Ozturk,
+ * unless expressly agreed to otherwise.
+*/
+#ifndef NVS_FLASH_H
+#define NVS_FLASH_H
+
+#endif /* #ifndef NVS_FLASH_H */